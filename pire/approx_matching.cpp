@@ -91,4 +91,24 @@ namespace Pire {
 
 		return approxFsm;
 	}
+
+	Fsm CreateTaggedApproxFsm(const Fsm& regexp, size_t distance) {
+		if (distance >= sizeof(unsigned long) * 8)
+			throw Error("Distance is too large for a tagged approximate FSM");
+
+		Fsm approxFsm = CreateApproxFsm(regexp, distance);
+
+		// CreateApproxFsm() places a copy of the regexp per number of errors
+		// one after another, followed by middle states of transpositions,
+		// which are never final
+		for (size_t state = 0; state < approxFsm.Size(); ++state) {
+			if (approxFsm.IsFinal(state)) {
+				approxFsm.SetTag(state, 1ul << (state / regexp.Size()));
+			} else {
+				approxFsm.SetTag(state, 0);
+			}
+		}
+
+		return approxFsm;
+	}
 }
@@ -25,4 +25,10 @@
 
 namespace Pire {
 	Fsm CreateApproxFsm(const Fsm& regexp, size_t distance);
+
+	/// Same as CreateApproxFsm(), but also tags each final state with (1 << d),
+	/// where d is the number of errors spent to reach it, so that the lowest bit
+	/// of a tag of a determined FSM state is the minimal distance of a match.
+	/// Tags of @p regexp are dropped.
+	Fsm CreateTaggedApproxFsm(const Fsm& regexp, size_t distance);
 }
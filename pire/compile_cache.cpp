@@ -0,0 +1,270 @@
+/*
+ * compile_cache.cpp -- persistent on-disk cache of compiled scanners
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include "compile_cache.h"
+#include "scanners/common.h"
+#include "stub/lexical_cast.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#else
+#include <fstream>
+#include <direct.h>
+#include <process.h>
+#endif
+
+namespace Pire {
+
+namespace {
+	/**
+	 * Layout of a cache file: the header, the full key, padding
+	 * up to DataOffset, and then the serialized scanner itself.
+	 */
+	struct EntryHeader {
+		ui64 Magic;
+		ui64 KeySize;
+		ui64 DataOffset;
+		ui64 DataSize;
+		/// Hash of the serialized scanner, so that damaged ones are never mapped
+		ui64 DataHash;
+
+		static const ui64 MAGIC = 0x3248434143455249ull; // "IRECACH2" on little-endian
+	};
+
+	/// Scanners are mmap()-ed right from the file, so their data must be well aligned.
+	const size_t DataAlignment = 64;
+
+	std::atomic<unsigned> g_tempCounter(0);
+
+	ui64 Hash(const char* data, size_t size)
+	{
+		// 64-bit FNV-1a
+		ui64 hash = 0xcbf29ce484222325ull;
+		for (const char* end = data + size; data != end; ++data) {
+			hash ^= static_cast<unsigned char>(*data);
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	bool ValidEntry(const char* data, size_t size, const ystring& fullKey)
+	{
+		if (size < sizeof(EntryHeader))
+			return false;
+		EntryHeader hdr;
+		memcpy(&hdr, data, sizeof(hdr));
+		return hdr.Magic == EntryHeader::MAGIC
+			&& hdr.KeySize == fullKey.size()
+			&& hdr.DataOffset >= sizeof(hdr) + hdr.KeySize
+			&& hdr.DataOffset % DataAlignment == 0
+			&& hdr.DataOffset <= size && hdr.DataSize == size - hdr.DataOffset
+			&& !memcmp(data + sizeof(hdr), fullKey.data(), fullKey.size())
+			&& hdr.DataHash == Hash(data + hdr.DataOffset, hdr.DataSize);
+	}
+
+#ifndef _WIN32
+	class MappedEntry: public Impl::CacheEntry {
+	public:
+		MappedEntry(void* mapping, size_t mappingSize, size_t offset)
+			: m_mapping(mapping), m_mappingSize(mappingSize), m_offset(offset) {}
+		~MappedEntry() { munmap(m_mapping, m_mappingSize); }
+		const char* Data() const { return static_cast<const char*>(m_mapping) + m_offset; }
+		size_t Size() const { return m_mappingSize - m_offset; }
+	private:
+		void* m_mapping;
+		size_t m_mappingSize;
+		size_t m_offset;
+	};
+
+	std::shared_ptr<const Impl::CacheEntry> OpenEntry(const ystring& path, const ystring& fullKey)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+			return std::shared_ptr<const Impl::CacheEntry>();
+		struct stat st;
+		void* mapping = MAP_FAILED;
+		size_t size = 0;
+		if (!fstat(fd, &st) && st.st_size > 0) {
+			size = st.st_size;
+			mapping = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		if (mapping == MAP_FAILED)
+			return std::shared_ptr<const Impl::CacheEntry>();
+		if (!ValidEntry(static_cast<const char*>(mapping), size, fullKey)) {
+			munmap(mapping, size);
+			return std::shared_ptr<const Impl::CacheEntry>();
+		}
+		EntryHeader hdr;
+		memcpy(&hdr, mapping, sizeof(hdr));
+		return std::make_shared<MappedEntry>(mapping, size, hdr.DataOffset);
+	}
+
+	bool WriteAll(int fd, const char* data, size_t size)
+	{
+		while (size) {
+			ssize_t written = write(fd, data, size);
+			if (written < 0 && errno == EINTR)
+				continue;
+			if (written <= 0)
+				return false;
+			data += written;
+			size -= written;
+		}
+		return true;
+	}
+
+	bool WriteEntry(const ystring& path, const ystring& contents)
+	{
+		const ystring tmp = path + ".tmp." + ToString(getpid()) + "." + ToString(g_tempCounter.fetch_add(1));
+		int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd == -1)
+			return false;
+		bool ok = WriteAll(fd, contents.data(), contents.size()) && !fsync(fd);
+		ok = !close(fd) && ok;
+		// rename() atomically replaces whatever another writer might have put there
+		ok = ok && !rename(tmp.c_str(), path.c_str());
+		if (!ok)
+			unlink(tmp.c_str());
+		return ok;
+	}
+
+	void MakeDirectory(const ystring& directory)
+	{
+		if (mkdir(directory.c_str(), 0777) && errno != EEXIST)
+			throw Error("Cannot create compile cache directory " + directory + ": " + strerror(errno));
+	}
+#else
+	char* AlignData(char* ptr)
+	{
+		return reinterpret_cast<char*>((reinterpret_cast<size_t>(ptr) + DataAlignment - 1) / DataAlignment * DataAlignment);
+	}
+
+	/// No zero-copy on Windows: the entry is read into an aligned buffer
+	class BufferedEntry: public Impl::CacheEntry {
+	public:
+		BufferedEntry(TVector<char>&& buffer, size_t size, size_t offset)
+			: m_buffer(std::move(buffer)), m_size(size), m_offset(offset) {}
+		const char* Data() const { return AlignData(const_cast<char*>(m_buffer.data())) + m_offset; }
+		size_t Size() const { return m_size - m_offset; }
+	private:
+		TVector<char> m_buffer;
+		size_t m_size;
+		size_t m_offset;
+	};
+
+	std::shared_ptr<const Impl::CacheEntry> OpenEntry(const ystring& path, const ystring& fullKey)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+		if (!file)
+			return std::shared_ptr<const Impl::CacheEntry>();
+		size_t size = file.tellg();
+		TVector<char> buffer(size + DataAlignment);
+		char* data = AlignData(buffer.data());
+		if (!file.seekg(0).read(data, size) || !ValidEntry(data, size, fullKey))
+			return std::shared_ptr<const Impl::CacheEntry>();
+		EntryHeader hdr;
+		memcpy(&hdr, data, sizeof(hdr));
+		return std::make_shared<BufferedEntry>(std::move(buffer), size, hdr.DataOffset);
+	}
+
+	bool WriteEntry(const ystring& path, const ystring& contents)
+	{
+		const ystring tmp = path + ".tmp." + ToString(_getpid()) + "." + ToString(g_tempCounter.fetch_add(1));
+		{
+			std::ofstream file(tmp.c_str(), std::ios::binary | std::ios::trunc);
+			if (!file.write(contents.data(), contents.size()).flush())
+				return false;
+		}
+		remove(path.c_str());
+		if (rename(tmp.c_str(), path.c_str())) {
+			remove(tmp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void MakeDirectory(const ystring& directory)
+	{
+		_mkdir(directory.c_str());
+	}
+#endif
+}
+
+CompileCache::CompileCache(const ystring& directory)
+	: m_directory(directory)
+{
+	MakeDirectory(m_directory);
+}
+
+ystring CompileCache::FullKey(const ystring& key, const char* scannerType)
+{
+	ystring fullKey = key;
+	fullKey += '\0';
+	fullKey += scannerType;
+	fullKey += '\0';
+	fullKey += ToString(ui32(Header::RE_VERSION)) + "/" + ToString(sizeof(void*)) + "/" + ToString(sizeof(Impl::MaxSizeWord));
+#ifdef PIRE_COMPACT_TRANSITIONS
+	// Transitions of LoadedScanner-based scanners have another layout
+	fullKey += "/compact";
+#endif
+	return fullKey;
+}
+
+ystring CompileCache::EntryPath(const ystring& fullKey) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.pire", static_cast<unsigned long long>(Hash(fullKey.data(), fullKey.size())));
+	return m_directory + "/" + name;
+}
+
+std::shared_ptr<const Impl::CacheEntry> CompileCache::Find(const ystring& fullKey) const
+{
+	return OpenEntry(EntryPath(fullKey), fullKey);
+}
+
+bool CompileCache::Store(const ystring& fullKey, const char* data, size_t size) const
+{
+	EntryHeader hdr;
+	hdr.Magic = EntryHeader::MAGIC;
+	hdr.KeySize = fullKey.size();
+	hdr.DataOffset = (sizeof(hdr) + fullKey.size() + DataAlignment - 1) / DataAlignment * DataAlignment;
+	hdr.DataSize = size;
+	hdr.DataHash = Hash(data, size);
+
+	ystring contents(hdr.DataOffset, '\0');
+	memcpy(&contents[0], &hdr, sizeof(hdr));
+	memcpy(&contents[sizeof(hdr)], fullKey.data(), fullKey.size());
+	contents.append(data, size);
+	return WriteEntry(EntryPath(fullKey), contents);
+}
+
+}
@@ -0,0 +1,120 @@
+/*
+ * compile_cache.h -- persistent on-disk cache of compiled scanners
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_COMPILE_CACHE_H
+#define PIRE_COMPILE_CACHE_H
+
+
+#include <typeinfo>
+#include "stub/stl.h"
+#include "stub/memstreams.h"
+#include "stub/noncopyable.h"
+
+namespace Pire {
+
+namespace Impl {
+	/// A read-only view of a cache entry (memory-mapped where possible).
+	class CacheEntry: NonCopyable {
+	public:
+		virtual ~CacheEntry() {}
+		virtual const char* Data() const = 0;
+		virtual size_t Size() const = 0;
+	};
+
+	template<class Scanner>
+	struct CachedScanner {
+		std::shared_ptr<const CacheEntry> entry;
+		Scanner scanner;
+	};
+}
+
+/**
+ * A cache of compiled scanners, stored in a local directory.
+ *
+ * Each entry is addressed by a hash of a user-supplied key (which must
+ * describe everything the compilation depends on: pattern text, encoding,
+ * lexer features, etc.), the scanner type and the serialization format version.
+ * Cached scanners are mmap()-ed and used in place, without copying.
+ *
+ * Entries are written to a temporary file and atomically renamed,
+ * so concurrent writers (threads or processes) never see partial entries.
+ * Each entry carries a hash of the scanner, checked on every lookup.
+ * Unreadable, stale or corrupted entries are silently recompiled;
+ * failure to store an entry does not affect the compilation result.
+ *
+ *    Pire::CompileCache cache("/var/cache/myservice");
+ *    auto scanner = cache.Get<Pire::Scanner>("utf8:i:" + pattern, [&] {
+ *        return Pire::Lexer(pattern).SetEncoding(Pire::Encodings::Utf8())
+ *            .AddFeature(Pire::Features::CaseInsensitive()).Parse().Surround()
+ *            .Compile<Pire::Scanner>();
+ *    });
+ */
+class CompileCache: NonCopyable {
+public:
+	/// Creates the cache in the given directory, creating the directory if necessary.
+	explicit CompileCache(const ystring& directory);
+
+	/// Returns a scanner for the @p key, either mapped from the cache,
+	/// or produced by @p compile() (and then stored into the cache).
+	template<class Scanner, class Compiler>
+	std::shared_ptr<const Scanner> Get(const ystring& key, Compiler compile) const
+	{
+		const ystring fullKey = FullKey(key, typeid(Scanner).name());
+
+		if (std::shared_ptr<const Impl::CacheEntry> entry = Find(fullKey)) {
+			try {
+				std::shared_ptr<Impl::CachedScanner<Scanner>> cached = std::make_shared<Impl::CachedScanner<Scanner>>();
+				cached->scanner.Mmap(entry->Data(), entry->Size());
+				cached->entry = std::move(entry);
+				return std::shared_ptr<const Scanner>(cached, &cached->scanner);
+			}
+			catch (Error&) {
+				// Stale or corrupted entry; it will be replaced below
+			}
+		}
+
+		std::shared_ptr<const Scanner> scanner = std::make_shared<Scanner>(compile());
+		BufferOutput buf;
+		scanner->Save(&buf);
+		Store(fullKey, buf.Buffer().Data(), buf.Buffer().Size());
+		return scanner;
+	}
+
+	/// Returns the path of the file which stores an entry for the given key and scanner type.
+	template<class Scanner>
+	ystring Path(const ystring& key) const { return EntryPath(FullKey(key, typeid(Scanner).name())); }
+
+	const ystring& Directory() const { return m_directory; }
+
+private:
+	ystring m_directory;
+
+	static ystring FullKey(const ystring& key, const char* scannerType);
+	ystring EntryPath(const ystring& fullKey) const;
+	std::shared_ptr<const Impl::CacheEntry> Find(const ystring& fullKey) const;
+	bool Store(const ystring& fullKey, const char* data, size_t size) const;
+};
+
+}
+
+#endif
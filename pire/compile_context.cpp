@@ -0,0 +1,89 @@
+/*
+ * compile_context.cpp -- resource limits for regexp compilation
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include "compile_context.h"
+#include "stub/lexical_cast.h"
+
+namespace Pire {
+
+namespace {
+	thread_local const CompileContext* g_currentContext = 0;
+
+	/// Reading the clock on each check is too expensive, so it is only done once in a while.
+	const unsigned ClockCheckPeriod = 64;
+
+	ystring LimitMessage(const char* stage, CompileLimitError::LimitType limit, size_t memory)
+	{
+		ystring msg = ystring("Regexp compilation stopped at stage \"") + stage + "\": ";
+		if (limit == CompileLimitError::MemoryLimit)
+			return msg + "memory limit exceeded (about " + ToString(memory) + " bytes required)";
+		else if (limit == CompileLimitError::Deadline)
+			return msg + "deadline exceeded";
+		else
+			return msg + "cancelled";
+	}
+}
+
+CompileLimitError::CompileLimitError(const char* stage, LimitType limit, size_t memory)
+	: Error(LimitMessage(stage, limit, memory))
+	, m_stage(stage)
+	, m_limit(limit)
+	, m_memory(memory)
+{
+}
+
+CompileContext::CompileContext()
+	: m_memoryLimit(0)
+	, m_hasDeadline(false)
+	, m_cancelled(false)
+	, m_checks(0)
+{
+}
+
+void CompileContext::Check(const char* stage, size_t memory) const
+{
+	if (Cancelled())
+		throw CompileLimitError(stage, CompileLimitError::Cancelled);
+	if (m_memoryLimit && memory > m_memoryLimit)
+		throw CompileLimitError(stage, CompileLimitError::MemoryLimit, memory);
+	if (m_hasDeadline && m_checks.fetch_add(1, std::memory_order_relaxed) % ClockCheckPeriod == 0 && Clock::now() > m_deadline)
+		throw CompileLimitError(stage, CompileLimitError::Deadline);
+}
+
+CompileContext::Scope::Scope(const CompileContext& ctx)
+	: m_prev(g_currentContext)
+{
+	g_currentContext = &ctx;
+}
+
+CompileContext::Scope::~Scope()
+{
+	g_currentContext = m_prev;
+}
+
+const CompileContext* CompileContext::Current()
+{
+	return g_currentContext;
+}
+
+}
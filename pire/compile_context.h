@@ -0,0 +1,125 @@
+/*
+ * compile_context.h -- resource limits for regexp compilation
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_COMPILE_CONTEXT_H
+#define PIRE_COMPILE_CONTEXT_H
+
+
+#include <atomic>
+#include <chrono>
+#include "stub/stl.h"
+#include "stub/noncopyable.h"
+
+namespace Pire {
+
+/**
+ * Thrown when a compilation stage exceeds limits imposed by a CompileContext.
+ */
+class CompileLimitError: public Error {
+public:
+	enum LimitType {
+		MemoryLimit,
+		Deadline,
+		Cancelled
+	};
+
+	CompileLimitError(const char* stage, LimitType limit, size_t memory = 0);
+
+	/// The stage of compilation which has been interrupted ("parse", "determine", etc...)
+	const ystring& Stage() const { return m_stage; }
+	/// The limit which has been exceeded
+	LimitType Limit() const { return m_limit; }
+	/// Approximate amount of memory the stage required, for MemoryLimit errors
+	size_t Memory() const { return m_memory; }
+
+private:
+	ystring m_stage;
+	LimitType m_limit;
+	size_t m_memory;
+};
+
+/**
+ * Limits imposed on regexp compilation: an approximate memory budget
+ * for intermediate automata, a wall-clock deadline and a cancellation flag.
+ *
+ * A context can be passed to Lexer::Parse(), Fsm::Canonize(), Fsm::Compile()
+ * and Scanner::Glue(); any other sequence of compilation calls can be
+ * put under a context by means of CompileContext::Scope.
+ * Once a limit is exceeded, the compilation throws CompileLimitError.
+ *
+ * Cancel() may be called from any thread.
+ */
+class CompileContext: NonCopyable {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	CompileContext();
+
+	/// Limits memory used by each compilation stage (zero means no limit)
+	CompileContext& SetMemoryLimit(size_t bytes) { m_memoryLimit = bytes; return *this; }
+	CompileContext& SetDeadline(Clock::time_point deadline) { m_deadline = deadline; m_hasDeadline = true; return *this; }
+	CompileContext& SetTimeout(Clock::duration timeout) { return SetDeadline(Clock::now() + timeout); }
+
+	size_t MemoryLimit() const { return m_memoryLimit; }
+
+	/// Requests all compilations using this context to stop.
+	void Cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+	bool Cancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+	/// Throws CompileLimitError if the given @p stage, currently
+	/// holding about @p memory bytes, has exceeded any of the limits.
+	void Check(const char* stage, size_t memory = 0) const;
+
+	/// Puts all compilation performed by the current thread
+	/// during its lifetime under the given context.
+	class Scope: NonCopyable {
+	public:
+		explicit Scope(const CompileContext& ctx);
+		~Scope();
+	private:
+		const CompileContext* m_prev;
+	};
+
+	/// Returns the context installed for the current thread, if any.
+	static const CompileContext* Current();
+
+private:
+	size_t m_memoryLimit;
+	bool m_hasDeadline;
+	Clock::time_point m_deadline;
+	std::atomic<bool> m_cancelled;
+	mutable std::atomic<unsigned> m_checks;
+};
+
+namespace Impl {
+	/// Checks limits of the current compile context (if any).
+	inline void CheckCompileLimits(const char* stage, size_t memory = 0)
+	{
+		if (const CompileContext* ctx = CompileContext::Current())
+			ctx->Check(stage, memory);
+	}
+}
+
+}
+
+#endif
@@ -26,6 +26,7 @@
 
 #include "stub/stl.h"
 #include "partition.h"
+#include "compile_context.h"
 
 namespace Pire {
 	namespace Impl {
@@ -67,72 +68,129 @@ namespace Pire {
 			/// Called for each transition from one new state to another.
 			void Connect(size_t from, size_t to, Char letter);
 
+			/// Called instead of Connect() by DetermineRows() for all transitions
+			/// from a state at once; row[i] is the destination by the i-th letter class.
+			void AcceptRow(size_t from, const TVector<size_t>& row);
+
 			typedef bool Result;
 			Result Success() { return true; }
 			Result Failure() { return false; }
 		};
 
+		/// Approximate amount of memory occupied by a state of a determination task.
+		template<class State>
+		inline size_t ApproxMemory(const State&) { return sizeof(State); }
+
+		template<class T>
+		inline size_t ApproxMemory(const TVector<T>& state) { return sizeof(state) + sizeof(T) * state.capacity(); }
+
 		/**
-		 * A helper function for FSM determining and all determine-like algorithms
-		 * like scanners' agglutination.
+		 * Performs a breadth-first traversal of the automaton specified by the task,
+		 * finding and enumerating all effectively reachable states, and calling
+		 * onRow(from, row) as soon as all transitions from a required state are known
+		 * (row[i] being the index of the destination by the i-th letter class).
 		 *
-		 * Given an indirectly specified automaton (through Task::Initial() and Task::Next()
-		 * functions, see above), performs a breadth-first traversal, finding and enumerating
-		 * all effectively reachable states. Then passes all found states and transitions
-		 * between them back to the task.
-		 *
-		 * Initial state is always placed at zero position.
-		 *
-		 * Please note that the function does not take care of any payload (including final flags);
-		 * it is the task's responsibility to agglutinate them properly.
-		 *
-		 * Returns task.Succeed() if everything was done; task.Failure() if maximum limit of state count was reached.
+		 * Found states are appended to @p states (the initial one at zero position).
+		 * Returns false if maximum limit of state count was reached.
 		 */
-		template<class Task>
-		typename Task::Result Determine(Task& task, size_t maxSize)
+		template<class Task, class OnRow>
+		bool Explore(Task& task, size_t maxSize, const char* stage, TVector<typename Task::State>& states, OnRow onRow)
 		{
 			typedef typename Task::State State;
 			typedef typename Task::InvStates InvStates;
-			typedef TDeque< TVector<size_t> > TransitionTable;
 
-			TVector<State> states;
 			InvStates invstates;
-			TransitionTable transitions;
-			TVector<size_t> stateIndices;
+			TVector<size_t> row(task.Letters().Size());
 
 			states.push_back(task.Initial());
 			invstates.insert(typename InvStates::value_type(states[0], 0));
+			size_t memory = 2 * ApproxMemory(states[0]);
 
 			for (size_t stateIdx = 0; stateIdx < states.size(); ++stateIdx) {
 				if (!task.IsRequired(states[stateIdx]))
 					continue;
-				TransitionTable::value_type row(task.Letters().Size());
+				CheckCompileLimits(stage, memory);
 				for (auto&& letter : task.Letters()) {
 					State newState = task.Next(states[stateIdx], letter.first);
 					auto i = invstates.find(newState);
 					if (i == invstates.end()) {
 						if (!maxSize--)
-							return task.Failure();
+							return false;
 						i = invstates.insert(typename InvStates::value_type(newState, states.size())).first;
 						states.push_back(newState);
+						// The state is stored both in states and in invstates
+						memory += 2 * ApproxMemory(newState);
 					}
 					row[letter.second.first] = i->second;
 				}
-				transitions.push_back(row);
-				stateIndices.push_back(stateIdx);
+				onRow(stateIdx, row);
+				memory += sizeof(size_t) * (row.size() + 1);
 			}
+			return true;
+		}
 
-			TVector<Char> invletters(task.Letters().Size());
+		/**
+		 * A helper function for FSM determining and all determine-like algorithms
+		 * like scanners' agglutination.
+		 *
+		 * Given an indirectly specified automaton (through Task::Initial() and Task::Next()
+		 * functions, see above), performs a breadth-first traversal, finding and enumerating
+		 * all effectively reachable states. Then passes all found states and transitions
+		 * between them back to the task.
+		 *
+		 * Initial state is always placed at zero position.
+		 *
+		 * Please note that the function does not take care of any payload (including final flags);
+		 * it is the task's responsibility to agglutinate them properly.
+		 *
+		 * Returns task.Succeed() if everything was done; task.Failure() if maximum limit of state count was reached.
+		 * Throws CompileLimitError if limits of the current compile context are exceeded
+		 * (@p stage is reported in the error).
+		 */
+		template<class Task>
+		typename Task::Result Determine(Task& task, size_t maxSize, const char* stage = "determine")
+		{
+			// All rows are of the same length, so they are kept back to back
+			const size_t rowSize = task.Letters().Size();
+			TDeque<size_t> transitions;
+			TVector<size_t> stateIndices;
+			TVector<typename Task::State> states;
+
+			bool explored = Explore(task, maxSize, stage, states, [&](size_t from, const TVector<size_t>& row) {
+				transitions.insert(transitions.end(), row.begin(), row.end());
+				stateIndices.push_back(from);
+			});
+			if (!explored)
+				return task.Failure();
+
+			TVector<Char> invletters(rowSize);
 			for (auto&& letter : task.Letters())
 				invletters[letter.second.first] = letter.first;
 
 			task.AcceptStates(states);
-			size_t from = 0;
-			for (TransitionTable::iterator i = transitions.begin(), ie = transitions.end(); i != ie; ++i, ++from) {
-				TVector<Char>::iterator l = invletters.begin();
-				for (TransitionTable::value_type::iterator j = i->begin(), je = i->end(); j != je; ++j, ++l)
-					task.Connect(stateIndices[from], *j, *l);
-			}
+			auto j = transitions.begin();
+			for (auto&& from : stateIndices)
+				for (auto&& letter : invletters)
+					task.Connect(from, *j++, letter);
+			return task.Success();
+		}
+
+		/**
+		 * Same as Determine(), but instead of collecting all transitions and passing
+		 * them to Task::Connect(), hands each row to Task::AcceptRow(from, row) as soon
+		 * as it is discovered (in ascending order of @p from), before Task::AcceptStates().
+		 * This lets tasks keep the transitions in whatever compact form they want.
+		 */
+		template<class Task>
+		typename Task::Result DetermineRows(Task& task, size_t maxSize, const char* stage = "determine")
+		{
+			TVector<typename Task::State> states;
+			bool explored = Explore(task, maxSize, stage, states, [&](size_t from, const TVector<size_t>& row) {
+				task.AcceptRow(from, row);
+			});
+			if (!explored)
+				return task.Failure();
+			task.AcceptStates(states);
 			return task.Success();
 		}
 
@@ -0,0 +1,268 @@
+/*
+ * direct_code.cpp -- generation of direct-coded C++ matchers from scanners
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <sstream>
+#include "direct_code.h"
+#include "stub/lexical_cast.h"
+
+namespace Pire {
+
+namespace Impl {
+
+namespace {
+	/// Self-loops with at most this many exit bytes are skipped with SIMD
+	const size_t MaxSkipBytes = 4;
+
+	/// What happens to the matcher once it enters a state
+	enum StateKind {
+		Regular,
+		Reject,  // acceptance is unreachable
+		Accept   // all reachable states accept
+	};
+
+	class DirectCodePrinter {
+	public:
+		DirectCodePrinter(yostream& out, const DirectCodeDfa& dfa, const ystring& name)
+			: m_out(out)
+			, m_dfa(dfa)
+			, m_name(name)
+			, m_kinds(dfa.Next.size(), Regular)
+			, m_usesLetters(false)
+		{
+			ClassifyStates();
+			SplitLetters();
+		}
+
+		void Print()
+		{
+			m_out << "#ifndef PIRE_DIRECT_CODE_PREAMBLE\n"
+				<< "#define PIRE_DIRECT_CODE_PREAMBLE\n"
+				<< "#ifdef __SSE2__\n"
+				<< "#include <emmintrin.h>\n"
+				<< "#endif\n"
+				<< "#endif\n\n";
+
+			m_out << "// Generated by Pire from a scanner with " << m_dfa.Next.size() << " states; do not edit.\n"
+				<< "inline bool " << m_name << "(const char* begin, const char* end)\n"
+				<< "{\n";
+
+			if (m_kinds[m_dfa.Initial] != Regular) {
+				m_out << "\t(void) begin;\n\t(void) end;\n"
+					<< "\treturn " << (m_kinds[m_dfa.Initial] == Accept ? "true" : "false") << ";\n}\n\n";
+				return;
+			}
+
+			// Only print states which can be jumped to, in order of their discovery
+			TVector<bool> printed(m_dfa.Next.size(), false);
+			TDeque<size_t> queue(1, m_dfa.Initial);
+			printed[m_dfa.Initial] = true;
+			for (; !queue.empty(); queue.pop_front()) {
+				PrintState(queue.front());
+				for (auto&& next : m_dfa.Next[queue.front()])
+					if (m_kinds[next] == Regular && !printed[next]) {
+						printed[next] = true;
+						queue.push_back(next);
+					}
+			}
+
+			if (m_usesLetters) {
+				m_out << "\tstatic const unsigned char letters[" << DirectCodeDfa::Bytes << "] = {";
+				for (size_t ch = 0; ch != DirectCodeDfa::Bytes; ++ch)
+					m_out << (ch % 32 ? " " : "\n\t\t") << m_letters[ch] << ",";
+				m_out << "\n\t};\n";
+			}
+			m_out << "\tconst unsigned char* p = (const unsigned char*) begin;\n"
+				<< "\tconst unsigned char* e = (const unsigned char*) end;\n"
+				<< "\tgoto s" << m_dfa.Initial << ";\n"
+				<< m_body.str();
+			m_out << "}\n\n";
+		}
+
+	private:
+		yostream& m_out;
+		const DirectCodeDfa& m_dfa;
+		ystring m_name;
+		TVector<StateKind> m_kinds;
+		TVector<size_t> m_letters;        // byte -> letter class
+		TVector<unsigned char> m_representatives; // letter class -> byte
+		std::ostringstream m_body;
+		bool m_usesLetters;
+
+		void ClassifyStates()
+		{
+			const size_t size = m_dfa.Next.size();
+			TVector<TVector<size_t>> previous(size);
+			for (size_t state = 0; state != size; ++state)
+				for (auto&& next : m_dfa.Next[state])
+					previous[next].push_back(state);
+
+			// States which can lead to an accepting one
+			TVector<bool> useful(size, false);
+			TVector<size_t> queue;
+			for (size_t state = 0; state != size; ++state)
+				if (m_dfa.Accepts[state]) {
+					useful[state] = true;
+					queue.push_back(state);
+				}
+			while (!queue.empty()) {
+				size_t state = queue.back();
+				queue.pop_back();
+				for (auto&& prev : previous[state])
+					if (!useful[prev]) {
+						useful[prev] = true;
+						queue.push_back(prev);
+					}
+			}
+
+			// States which can lead to a non-accepting one
+			TVector<bool> doubtful(size, false);
+			for (size_t state = 0; state != size; ++state)
+				if (!m_dfa.Accepts[state]) {
+					doubtful[state] = true;
+					queue.push_back(state);
+				}
+			while (!queue.empty()) {
+				size_t state = queue.back();
+				queue.pop_back();
+				for (auto&& prev : previous[state])
+					if (!doubtful[prev]) {
+						doubtful[prev] = true;
+						queue.push_back(prev);
+					}
+			}
+
+			for (size_t state = 0; state != size; ++state)
+				if (!useful[state])
+					m_kinds[state] = Reject;
+				else if (!doubtful[state])
+					m_kinds[state] = Accept;
+		}
+
+		/// Bytes leading to the same places from all states form a letter class
+		void SplitLetters()
+		{
+			TMap<TVector<size_t>, size_t> classes;
+			m_letters.resize(DirectCodeDfa::Bytes);
+			for (size_t ch = 0; ch != DirectCodeDfa::Bytes; ++ch) {
+				TVector<size_t> column;
+				column.reserve(m_dfa.Next.size());
+				for (auto&& row : m_dfa.Next)
+					column.push_back(m_kinds[row[ch]] == Regular ? row[ch] : m_dfa.Next.size() + m_kinds[row[ch]]);
+				auto ins = classes.insert(ymake_pair(column, classes.size()));
+				if (ins.second)
+					m_representatives.push_back(ch);
+				m_letters[ch] = ins.first->second;
+			}
+		}
+
+		ystring Target(size_t state) const
+		{
+			if (m_kinds[state] == Reject)
+				return "return false;";
+			else if (m_kinds[state] == Accept)
+				return "return true;";
+			else
+				return "goto s" + ToString(state) + ";";
+		}
+
+		void PrintState(size_t state)
+		{
+			const TVector<size_t>& next = m_dfa.Next[state];
+			m_body << "s" << state << ":\n";
+
+			TVector<unsigned char> exits;
+			for (size_t ch = 0; ch != DirectCodeDfa::Bytes; ++ch)
+				if (next[ch] != state)
+					exits.push_back(ch);
+			if (exits.size() <= MaxSkipBytes)
+				PrintSkipLoop(exits);
+
+			m_body << "\tif (p == e)\n"
+				<< "\t\treturn " << (m_dfa.Accepts[state] ? "true" : "false") << ";\n";
+
+			// Group letter classes by destination, the most popular one going to default
+			TMap<ystring, TVector<size_t>> targets;
+			for (size_t letter = 0; letter != m_representatives.size(); ++letter)
+				targets[Target(next[m_representatives[letter]])].push_back(letter);
+			auto deflt = targets.begin();
+			for (auto it = targets.begin(), ie = targets.end(); it != ie; ++it)
+				if (it->second.size() > deflt->second.size())
+					deflt = it;
+
+			if (targets.size() == 1) {
+				m_body << "\t++p;\n\t" << deflt->first << "\n";
+				return;
+			}
+			m_usesLetters = true;
+			m_body << "\tswitch (letters[*p++]) {\n";
+			for (auto&& target : targets) {
+				if (&target == &*deflt)
+					continue;
+				m_body << "\t";
+				for (auto&& letter : target.second)
+					m_body << "case " << letter << ": ";
+				m_body << target.first << "\n";
+			}
+			m_body << "\tdefault: " << deflt->first << "\n"
+				<< "\t}\n";
+		}
+
+		/// Skips bytes until one of @p exits is found
+		void PrintSkipLoop(const TVector<unsigned char>& exits)
+		{
+			if (exits.empty()) {
+				m_body << "\tp = e;\n";
+				return;
+			}
+
+			m_body << "#ifdef __SSE2__\n"
+				<< "\tfor (; e - p >= 16; p += 16) {\n"
+				<< "\t\t__m128i chunk = _mm_loadu_si128((const __m128i*) p);\n"
+				<< "\t\tint mask = _mm_movemask_epi8(";
+			for (size_t i = 0; i != exits.size(); ++i) {
+				ystring cmp = "_mm_cmpeq_epi8(chunk, _mm_set1_epi8((char) " + ToString((unsigned) exits[i]) + "))";
+				m_body << (i + 1 < exits.size() ? "_mm_or_si128(" + cmp + ", " : cmp);
+			}
+			m_body << ystring(exits.size() - 1, ')') << ");\n"
+				<< "\t\tif (mask) {\n"
+				<< "\t\t\tp += __builtin_ctz(mask);\n"
+				<< "\t\t\tbreak;\n"
+				<< "\t\t}\n"
+				<< "\t}\n"
+				<< "#endif\n"
+				<< "\twhile (p != e";
+			for (auto&& ch : exits)
+				m_body << " && *p != " << (unsigned) ch;
+			m_body << ")\n\t\t++p;\n";
+		}
+	};
+}
+
+void PrintDirectCode(yostream& out, const DirectCodeDfa& dfa, const ystring& name)
+{
+	DirectCodePrinter(out, dfa, name).Print();
+}
+
+}
+
+}
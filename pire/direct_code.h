@@ -0,0 +1,105 @@
+/*
+ * direct_code.h -- generation of direct-coded C++ matchers from scanners
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_DIRECT_CODE_H
+#define PIRE_DIRECT_CODE_H
+
+
+#include "stub/stl.h"
+#include "defs.h"
+#include "run.h"
+
+namespace Pire {
+
+namespace Impl {
+	/// A determined automaton over bytes, as seen by the code generator.
+	struct DirectCodeDfa {
+		enum { Bytes = 256 };
+
+		/// Destinations by each byte, for each state
+		TVector<TVector<size_t>> Next;
+		/// Whether the input is accepted if it ends in the state (i.e. the state is final after EndMark)
+		TVector<bool> Accepts;
+		/// The state after BeginMark
+		size_t Initial;
+	};
+
+	void PrintDirectCode(yostream& out, const DirectCodeDfa& dfa, const ystring& name);
+}
+
+/**
+ * Prints C++ source of a function
+ *
+ *    inline bool name(const char* begin, const char* end);
+ *
+ * which returns the same as Matches(scanner, begin, end), i.e. whether
+ * the scanner is in a final state after reading BeginMark, the input and EndMark.
+ *
+ * Each state of the scanner becomes a labelled block with a switch over
+ * letter classes; states which cannot lead to acceptance (or cannot lead
+ * anywhere else) return immediately, and long self-loops are skipped
+ * with SSE2 where available. The code needs no Pire headers or libraries.
+ *
+ * Meant for small scanners: the code grows linearly with the number of
+ * states times the number of distinct transitions.
+ */
+template<class Scanner>
+void PrintDirectCode(yostream& out, const Scanner& scanner, const ystring& name)
+{
+	typedef typename Scanner::State State;
+	Impl::DirectCodeDfa dfa;
+	TMap<State, size_t> index;
+	TVector<State> states;
+	auto intern = [&](const State& state) {
+		auto it = index.find(state);
+		if (it != index.end())
+			return it->second;
+		index.insert(ymake_pair(state, states.size()));
+		states.push_back(state);
+		return states.size() - 1;
+	};
+
+	State state;
+	scanner.Initialize(state);
+	Step(scanner, state, BeginMark);
+	dfa.Initial = intern(state);
+
+	for (size_t i = 0; i != states.size(); ++i) {
+		TVector<size_t> row(Impl::DirectCodeDfa::Bytes);
+		for (Char ch = 0; ch != Impl::DirectCodeDfa::Bytes; ++ch) {
+			state = states[i];
+			Step(scanner, state, ch);
+			row[ch] = intern(state);
+		}
+		dfa.Next.push_back(row);
+		state = states[i];
+		Step(scanner, state, EndMark);
+		dfa.Accepts.push_back(scanner.Final(state));
+	}
+
+	Impl::PrintDirectCode(out, dfa, name);
+}
+
+}
+
+#endif
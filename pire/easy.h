@@ -53,6 +53,7 @@
 #include "vbitset.h"
 #include "stub/stl.h"
 #include <iterator>
+#include <memory>
 
 namespace Pire {
 	
@@ -134,31 +135,62 @@ extern const Option<const Encoding&> LATIN1;
 extern const Option<Feature::Ptr> I;
 extern const Option<Feature::Ptr> ANDNOT;
 
+namespace Impl {
+	/// A scanner of some type, which Regexp runs through the input
+	class RegexpEngine {
+	public:
+		virtual ~RegexpEngine() {}
+		virtual RegexpEngine* Clone() const = 0;
+		virtual bool Matches(const char* begin, const char* end) const = 0;
+	};
+
+	template<class Scanner>
+	class RegexpEngineImpl: public RegexpEngine {
+	public:
+		explicit RegexpEngineImpl(const Scanner& scanner): m_scanner(scanner) {}
+
+		RegexpEngine* Clone() const { return new RegexpEngineImpl(m_scanner); }
+
+		bool Matches(const char* begin, const char* end) const
+		{
+			return Runner(m_scanner).Begin().Run(begin, end).End();
+		}
+
+	private:
+		Scanner m_scanner;
+	};
+}
 
 class Regexp {
 public:
+	/// A non-zero @p distance makes the regexp match strings within
+	/// that many edit operations (see CreateApproxFsm())
 	template<class Pattern>
-	explicit Regexp(Pattern pattern, Options options = Options())
+	explicit Regexp(Pattern pattern, Options options = Options(), size_t distance = 0)
 	{
-		Init(PatternBounds(pattern), options);
+		Init(PatternBounds(pattern), options, distance);
 	}
 	
 	template<class Pattern, class Arg>
-	Regexp(Pattern pattern, Option<Arg> option)
+	Regexp(Pattern pattern, Option<Arg> option, size_t distance = 0)
 	{
-		Init(PatternBounds(pattern), Options() | option);
+		Init(PatternBounds(pattern), Options() | option, distance);
 	}
 	
-	explicit Regexp(Scanner sc): m_scanner(sc) {}
-	explicit Regexp(SlowScanner ssc): m_slow(ssc) {}
+	explicit Regexp(Scanner sc) { SetEngine(sc); }
+	explicit Regexp(SlowScanner ssc) { SetEngine(LazyScanner(ssc)); }
+	explicit Regexp(LazyScanner lsc) { SetEngine(lsc); }
+	explicit Regexp(BitParallelScanner64 bsc) { SetEngine(bsc); }
+	explicit Regexp(BitParallelScanner128 bsc) { SetEngine(bsc); }
+	explicit Regexp(BitParallelScanner512 bsc) { SetEngine(bsc); }
+	explicit Regexp(ApproxLiteralScanner asc) { SetEngine(asc); }
+
+	Regexp(const Regexp& re): m_engine(re.m_engine ? re.m_engine->Clone() : 0) {}
+	Regexp(Regexp&& re) = default;
+	Regexp& operator = (const Regexp& re) { m_engine.reset(re.m_engine ? re.m_engine->Clone() : 0); return *this; }
+	Regexp& operator = (Regexp&& re) = default;
 	
-	bool Matches(const char* begin, const char* end) const
-	{
-		if (!m_scanner.Empty())
-			return Runner(m_scanner).Begin().Run(begin, end).End();
-		else
-			return Runner(m_slow).Begin().Run(begin, end).End();
-	}
+	bool Matches(const char* begin, const char* end) const { return m_engine && m_engine->Matches(begin, end); }
 	
 	bool Matches(const char* str) const { return Matches(str, str + strlen(str)); }
 	
@@ -181,8 +213,12 @@ public:
 	MatchProxy operator ~() const { return MatchProxy(*this); }
 		
 private:
-	Scanner m_scanner;
-	SlowScanner m_slow;
+	/// Exactly one scanner, of the type suitable for the pattern
+	/// (none in a moved-from regexp, which matches nothing)
+	std::unique_ptr<Impl::RegexpEngine> m_engine;
+
+	template<class Scanner>
+	void SetEngine(const Scanner& scanner) { m_engine.reset(new Impl::RegexpEngineImpl<Scanner>(scanner)); }
 	
 	ypair<const char*, const char*> PatternBounds(const ystring& pattern)
 	{
@@ -195,7 +231,7 @@ private:
 		return ymake_pair(pattern, pattern + strlen(pattern));
 	}
 	
-	void Init(ypair<const char*, const char*> rawPattern, Options options)
+	void Init(ypair<const char*, const char*> rawPattern, Options options, size_t distance)
 	{
 		TVector<wchar32> pattern;
 		options.Encoding().FromLocal(rawPattern.first, rawPattern.second, std::back_inserter(pattern));
@@ -207,11 +243,26 @@ private:
 		if (!BeginsWithCircumflex(fsm))
 			fsm.PrependAnything();
 		fsm.AppendAnything();
+
+		// Literals are matched approximately without any blow-up
+		if (distance && ApproxLiteralScanner::Suitable(fsm, distance)) {
+			SetEngine(fsm.Compile<ApproxLiteralScanner>(distance));
+			return;
+		}
+		if (distance)
+			fsm = CreateApproxFsm(fsm, distance);
 		
+		Impl::PositionAutomaton positions;
 		if (fsm.Determine())
-			m_scanner = fsm.Compile<Scanner>();
+			SetEngine(fsm.Compile<Scanner>());
+		else if (!Impl::BuildPositionAutomaton(fsm, BitParallelScanner512::MaxSize, positions))
+			SetEngine(fsm.Compile<LazyScanner>());
+		else if (positions.Size() <= BitParallelScanner64::MaxSize)
+			SetEngine(BitParallelScanner64(positions));
+		else if (positions.Size() <= BitParallelScanner128::MaxSize)
+			SetEngine(BitParallelScanner128(positions));
 		else
-			m_slow = fsm.Compile<SlowScanner>();
+			SetEngine(BitParallelScanner512(positions));
 	}
 	
 	static bool BeginsWithCircumflex(const Fsm& fsm)
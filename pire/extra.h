@@ -26,8 +26,10 @@
 #define PIRE_EXTRA_H
 
 
+#include "extra/approx.h"
 #include "extra/capture.h"
 #include "extra/count.h"
+#include "extra/fuzzy_dictionary.h"
 #include "extra/glyphs.h"
 
 #endif
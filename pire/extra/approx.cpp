@@ -0,0 +1,53 @@
+/*
+ * approx.cpp -- building the ApproxScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include "approx.h"
+
+namespace Pire {
+
+ApproxScanner::ApproxScanner(Fsm& fsm, size_t distance)
+{
+	if (distance > MaxDistance)
+		throw Error("Distance is too large for ApproxScanner");
+
+	fsm = CreateTaggedApproxFsm(fsm, distance);
+	if (!fsm.Determine(0, true))
+		throw Error("regexp pattern too complicated");
+
+	// A determined state carries distances of all its final approximate states;
+	// only the minimal one is kept, so that minimization can merge more states
+	for (size_t state = 0; state < fsm.Size(); ++state) {
+		unsigned long distances = fsm.Tag(state);
+		size_t minimal = 0;
+		if (distances)
+			while (!(distances & (1ul << minimal)))
+				++minimal;
+		fsm.SetTag(state, fsm.IsFinal(state) ? (minimal << DistanceShift) : 0);
+	}
+	fsm.Minimize(true);
+
+	Init(fsm.Size(), fsm.Letters(), fsm.Initial());
+	BuildScanner(fsm, *this);
+}
+
+}
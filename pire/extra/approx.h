@@ -0,0 +1,137 @@
+/*
+ * approx.h -- definition of ApproxScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_EXTRA_APPROX_H
+#define PIRE_EXTRA_APPROX_H
+
+
+#include "../scanners/loaded.h"
+#include "../approx_matching.h"
+#include "../fsm.h"
+#include "../run.h"
+
+namespace Pire {
+
+/**
+* An approximate scanner, which reports the minimal edit distance
+* the input matches the regexp with.
+*
+* It is built from a single FSM made by CreateTaggedApproxFsm(), so that
+* each final state of the scanner carries the minimal number of errors
+* among the approximate FSM states it consists of. Thus one pass tells
+* the best distance up to the given one, instead of running a separate
+* scanner per distance.
+*/
+class ApproxScanner: public LoadedScanner {
+public:
+	enum {
+		FinalFlag = 1,
+		DeadFlag  = 2,
+
+		/// Tags hold the minimal distance above the flags
+		DistanceShift = 2
+	};
+
+	/// Maximum distance a scanner can be built for
+	static const size_t MaxDistance = 31;
+	/// Distance() of a state which is not final
+	static const size_t NoMatch = static_cast<size_t>(-1);
+
+	class State {
+	private:
+		size_t m_state;
+		friend class ApproxScanner;
+
+#ifdef PIRE_DEBUG
+		friend yostream& operator << (yostream& s, const State& state)
+		{
+			return s << state.m_state;
+		}
+#endif
+	};
+
+	void Initialize(State& state) const { state.m_state = m.initial; }
+
+	bool TakeAction(State&, Action) const { return false; }
+
+	Char Translate(Char ch) const
+	{
+		return m_letters[static_cast<size_t>(ch)];
+	}
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action NextTranslated(State& s, Char c) const
+	{
+		Follow(s.m_state, c);
+		return 0;
+	}
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action Next(State& s, Char c) const
+	{
+		return NextTranslated(s, Translate(c));
+	}
+
+	Action Next(const State& current, State& n, Char c) const
+	{
+		n = current;
+		return Next(n, c);
+	}
+
+	bool Final(const State& s) const { return Flags(s) & FinalFlag; }
+
+	bool Dead(const State& s) const { return Flags(s) & DeadFlag; }
+
+	bool CanStop(const State& s) const { return Final(s); }
+
+	/// Returns the minimal number of errors the input matches the regexp with,
+	/// or NoMatch if it does not match within the distance the scanner was built for
+	size_t Distance(const State& s) const
+	{
+		return Final(s) ? static_cast<size_t>(Flags(s) >> DistanceShift) : NoMatch;
+	}
+
+	ypair<const size_t*, const size_t*> AcceptedRegexps(const State& s) const
+	{
+		static const size_t v[1] = { 0 };
+		return ymake_pair(v, v + (Final(s) ? 1 : 0));
+	}
+
+	ApproxScanner() {}
+	ApproxScanner(const ApproxScanner& s): LoadedScanner(s) {}
+	explicit ApproxScanner(Fsm& fsm, size_t distance = 0);
+
+	void Swap(ApproxScanner& s) { LoadedScanner::Swap(s); }
+	ApproxScanner& operator = (const ApproxScanner& s) { ApproxScanner(s).Swap(*this); return *this; }
+
+	size_t StateIndex(const State& s) const { return StateIdx(s.m_state); }
+
+private:
+	Tag Flags(const State& s) const { return m_tags[StateIdx(s.m_state)]; }
+
+	friend void BuildScanner<ApproxScanner>(const Fsm&, ApproxScanner&);
+};
+
+}
+
+#endif
@@ -22,7 +22,11 @@
 
 
 #include <stdexcept>
+#include <algorithm>
+#include <limits>
 #include "capture.h"
+#include "../determine.h"
+#include "../glue.h"
 
 namespace Pire {
 	
@@ -126,9 +130,713 @@ namespace {
 		
 		void FinishBuild() {}
 	};
+
+	class CaptureGroupsImpl: public Feature {
+	public:
+		CaptureGroupsImpl(): m_groups(0), m_repetitions(0) {}
+
+		bool Accepts(wchar32 c) const { return c == '(' || c == '+' || c == '*' || c == '?' || c == '{'; }
+		Term Lex()
+		{
+			wchar32 c = GetChar();
+			if (!Accepts(c))
+				Error("How did we get here?!..");
+			if (c == '(') {
+				if (m_groups == TaggedCapturingScanner::MaxGroups)
+					Error("Too many groups for Pire::TaggedCapturingScanner");
+				m_open.push_back(m_groups++);
+				return Term(TokenTypes::Open);
+			}
+
+			// Each repetition is followed by a call to Parenthesized() as well
+			++m_repetitions;
+			if (c != '{' && PeekChar() == '?')
+				Error("Non-greedy repetitions are not supported by Pire::TaggedCapturingScanner");
+			if (c == '+')
+				return Term::Repetition(1, Inf);
+			else if (c == '*')
+				return Term::Repetition(0, Inf);
+			else if (c == '?')
+				return Term::Repetition(0, 1);
+			else {
+				UngetChar(c);
+				return Term(0);
+			}
+		}
+
+		void Parenthesized(Fsm& fsm)
+		{
+			if (m_repetitions) {
+				--m_repetitions;
+			} else if (!m_open.empty()) {
+				SetGroupMark(fsm, m_open.back());
+				m_open.pop_back();
+			}
+		}
+
+	private:
+		size_t m_groups;
+		size_t m_repetitions;
+		TVector<size_t> m_open;
+
+		void SetGroupMark(Fsm& fsm, size_t group)
+		{
+			fsm.Resize(fsm.Size() + 2);
+			fsm.Connect(fsm.Size() - 2, fsm.Initial());
+			fsm.ConnectFinal(fsm.Size() - 1);
+
+			fsm.SetOutput(fsm.Size() - 2, fsm.Initial(), TaggedCapturingScanner::OpenTag(group));
+			for (size_t state = 0; state < fsm.Size() - 2; ++state)
+				if (fsm.IsFinal(state))
+					fsm.SetOutput(state, fsm.Size() - 1, TaggedCapturingScanner::CloseTag(group));
+
+			fsm.SetInitial(fsm.Size() - 2);
+			fsm.ClearFinal();
+			fsm.SetFinal(fsm.Size() - 1, true);
+			fsm.SetIsDetermined(false);
+		}
+	};
+
+	/// A rank of a register of a tag which has not been met yet
+	const i32 Unset = -1;
+	/// A value of a tag met by the current step, which is above any register
+	const i32 Now = std::numeric_limits<i32>::max();
+
+	/// A state of the source FSM, along with ranks of registers holding
+	/// each of its tags (registers of a tag are ordered by their values)
+	struct TaggedItem {
+		size_t state;
+		TVector<i32> ranks;
+
+		bool operator < (const TaggedItem& rhs) const
+		{
+			return state < rhs.state || (state == rhs.state && ranks < rhs.ranks);
+		}
+	};
+
+	/// A state of the tagged DFA (items are ordered by FSM states)
+	typedef TVector<TaggedItem> TaggedSet;
+
+	/// Builds a tagged DFA from an FSM with tags in its outputs.
+	class TaggedDetermineTask {
+	public:
+		/// Register operations: each one is a tag, the rank of its register to set
+		/// and the rank to take the value from (or Now)
+		typedef TVector<i32> Operations;
+
+		TaggedDetermineTask(const Fsm& fsm, size_t tags, size_t maxSize)
+			: m_fsm(fsm)
+			, m_tags(tags)
+			, m_maxSize(maxSize)
+			, m_dead(fsm.DeadStates())
+			, m_closures(fsm.Size())
+			, m_ranks(1)
+		{
+			const unsigned long mask = (tags < sizeof(unsigned long) * 8) ? (1ul << tags) - 1 : ~0ul;
+			for (size_t state = 0; state != fsm.Size(); ++state)
+				BuildClosure(state, mask);
+		}
+
+		void Determine()
+		{
+			// The initial state is the closure of a single item with nothing met
+			TaggedItem origin = { m_fsm.Initial(), TVector<i32>(m_tags, Unset) };
+			TMap<size_t, Candidate> best;
+			for (auto&& to : m_closures[origin.state])
+				Offer(best, to.first, Candidate(&origin, to.second));
+			ypair<size_t, Operations> initial = Settle(best);
+			m_initial = initial.first;
+			m_initialOps = Intern(initial.second);
+
+			for (size_t state = 0; state != m_states.size(); ++state) {
+				// Candidates refer to the items, while new states are being added
+				const TaggedSet current = m_states[state];
+				m_jumps.push_back(TVector< ypair<size_t, size_t> >());
+				for (auto&& letter : m_fsm.Letters()) {
+					best.clear();
+					for (auto&& item : current)
+						for (auto&& next : m_fsm.Destinations(item.state, letter.first))
+							for (auto&& to : m_closures[next])
+								Offer(best, to.first, Candidate(&item, to.second));
+					ypair<size_t, Operations> jump = Settle(best);
+					m_jumps[state].push_back(ymake_pair(jump.first, Intern(jump.second)));
+				}
+			}
+		}
+
+		const Fsm& Source() const { return m_fsm; }
+		size_t Size() const { return m_states.size(); }
+		size_t InitialState() const { return m_initial; }
+		size_t InitialOps() const { return m_initialOps; }
+		/// Maximal number of registers of a tag
+		size_t Ranks() const { return m_ranks; }
+
+		/// Returns the state and operations of the transition from @p state
+		/// by the @p letter-th letter of the source FSM
+		ypair<size_t, size_t> Jump(size_t state, size_t letter) const { return m_jumps[state][letter]; }
+
+		const TVector<Operations>& AllOperations() const { return m_operations; }
+
+		bool Dead(size_t state) const { return m_states[state].empty(); }
+
+		/// Returns ranks of the registers holding tags of the best final item
+		/// of the @p state, or null if it is not final
+		const TVector<i32>* Final(size_t state) const
+		{
+			const TaggedItem* winner = 0;
+			for (auto&& item : m_states[state])
+				if (m_fsm.IsFinal(item.state) && (!winner || Better(Candidate(&item, 0), Candidate(winner, 0))))
+					winner = &item;
+			return winner ? &winner->ranks : 0;
+		}
+
+	private:
+		/// An item the path came from and the tags met by the step
+		struct Candidate {
+			const TaggedItem* item;
+			unsigned long met;
+
+			Candidate(const TaggedItem* i, unsigned long m): item(i), met(m) {}
+
+			i32 Value(size_t tag) const { return ((met >> tag) & 1) ? Now : item->ranks[tag]; }
+		};
+
+		const Fsm& m_fsm;
+		size_t m_tags;
+		size_t m_maxSize;
+		TSet<size_t> m_dead;
+		/// States reachable from each state by epsilons, along with the tags met
+		TVector< TVector< ypair<size_t, unsigned long> > > m_closures;
+
+		TVector<TaggedSet> m_states;
+		TMap<TaggedSet, size_t> m_index;
+		TVector< TVector< ypair<size_t, size_t> > > m_jumps;
+		size_t m_initial;
+		size_t m_initialOps;
+
+		TVector<Operations> m_operations;
+		TMap<Operations, size_t> m_operationsIndex;
+		size_t m_ranks;
+
+		void BuildClosure(size_t state, unsigned long mask)
+		{
+			TSet< ypair<size_t, unsigned long> > visited;
+			TVector< ypair<size_t, unsigned long> > queue(1, ymake_pair(state, 0ul));
+			visited.insert(queue.front());
+			while (!queue.empty()) {
+				ypair<size_t, unsigned long> cur = queue.back();
+				queue.pop_back();
+				if (m_dead.find(cur.first) == m_dead.end())
+					m_closures[state].push_back(cur);
+				for (auto&& to : m_fsm.Destinations(cur.first, Epsilon)) {
+					ypair<size_t, unsigned long> next(to, cur.second | (m_fsm.Output(cur.first, to) & mask));
+					if (visited.insert(next).second)
+						queue.push_back(next);
+				}
+			}
+		}
+
+		/// Groups come in the order of their opening tags; each group should start
+		/// as early as possible and then end as late as possible
+		bool Better(const Candidate& a, const Candidate& b) const
+		{
+			for (size_t tag = 0; tag != m_tags; ++tag) {
+				i32 lhs = a.Value(tag);
+				i32 rhs = b.Value(tag);
+				if (lhs == rhs)
+					continue;
+				else if (lhs == Unset)
+					return false;
+				else if (rhs == Unset)
+					return true;
+				else
+					return (tag % 2) ? (lhs > rhs) : (lhs < rhs);
+			}
+			return false;
+		}
+
+		void Offer(TMap<size_t, Candidate>& best, size_t state, const Candidate& candidate) const
+		{
+			auto ins = best.insert(ymake_pair(state, candidate));
+			if (!ins.second && Better(candidate, ins.first->second))
+				ins.first->second = candidate;
+		}
+
+		/// Makes a state of the best paths to each FSM state, with ranks
+		/// of registers renumbered from zero. Returns the state and the
+		/// operations on registers moving them to their new ranks.
+		ypair<size_t, Operations> Settle(const TMap<size_t, Candidate>& best)
+		{
+			TaggedSet set;
+			set.reserve(best.size());
+			for (auto&& i : best) {
+				TaggedItem item = { i.first, TVector<i32>(m_tags, Unset) };
+				set.push_back(item);
+			}
+
+			Operations ops;
+			TVector<i32> values;
+			for (size_t tag = 0; tag != m_tags; ++tag) {
+				values.clear();
+				for (auto&& i : best)
+					if (i.second.Value(tag) != Unset)
+						values.push_back(i.second.Value(tag));
+				std::sort(values.begin(), values.end());
+				values.erase(std::unique(values.begin(), values.end()), values.end());
+				m_ranks = std::max(m_ranks, values.size());
+
+				size_t idx = 0;
+				for (auto&& i : best) {
+					i32 value = i.second.Value(tag);
+					if (value != Unset)
+						set[idx].ranks[tag] = std::lower_bound(values.begin(), values.end(), value) - values.begin();
+					++idx;
+				}
+				// New ranks never exceed the old ones, so registers can be
+				// moved in place in the order of their new ranks
+				for (size_t rank = 0; rank != values.size(); ++rank)
+					if (values[rank] != static_cast<i32>(rank)) {
+						ops.push_back(static_cast<i32>(tag));
+						ops.push_back(static_cast<i32>(rank));
+						ops.push_back(values[rank]);
+					}
+			}
+
+			auto ins = m_index.insert(ymake_pair(set, m_states.size()));
+			if (ins.second) {
+				if (m_maxSize && m_states.size() >= m_maxSize)
+					throw Error("regexp pattern too complicated");
+				m_states.push_back(set);
+			}
+			return ymake_pair(ins.first->second, ops);
+		}
+
+		size_t Intern(const Operations& ops)
+		{
+			auto ins = m_operationsIndex.insert(ymake_pair(ops, m_operations.size()));
+			if (ins.second)
+				m_operations.push_back(ops);
+			return ins.first->second;
+		}
+	};
 }
-	
+
+TwoPhaseCapture::TwoPhaseCapture(const Fsm& fsm)
+	: m_anchoredBegin(false)
+	, m_anchoredEnd(false)
+{
+	for (size_t state = 0; state != fsm.Size(); ++state) {
+		m_anchoredBegin = m_anchoredBegin || !fsm.Destinations(state, BeginMark).empty();
+		m_anchoredEnd = m_anchoredEnd || !fsm.Destinations(state, EndMark).empty();
+	}
+
+	// SlowCapturingScanner takes the end of the text for granted as soon as
+	// it can step over EndMark, so $ is allowed anywhere for the prefilter
+	Fsm plain = fsm;
+	plain.ClearOutputs();
+	for (size_t state = 0; state != plain.Size(); ++state) {
+		Fsm::StatesSet dests = plain.Destinations(state, EndMark);
+		for (auto&& to : dests)
+			plain.Connect(state, to);
+	}
+	Fsm forward = plain;
+	forward.PrependAnything();
+	m_forward = forward.Compile<Scanner>();
+	Fsm backward = plain;
+	backward.AppendAnything();
+	backward.Reverse();
+	m_backward = backward.Compile<Scanner>();
+
+	Fsm capturing = fsm;
+	capturing.Surround();
+	m_capturing = capturing.Compile<SlowCapturingScanner>();
+}
+
+bool TwoPhaseCapture::Capture(const char* begin, const char* end, SlowCapturingScanner::SingleState& final) const
+{
+	const char* rbegin = LongestSuffix(m_backward, end - 1, begin - 1, true, true);
+	if (!rbegin)
+		return false;
+
+	// Threads of the slow scanner starting before the leftmost match or ending
+	// after the rightmost one never reach a final state, so they cannot
+	// affect the choice between the other ones
+	const char* from = m_anchoredBegin ? begin : rbegin + 1;
+	const char* to = end;
+	if (!m_anchoredEnd) {
+		to = LongestPrefix(m_forward, from, end, from == begin);
+		Y_ASSERT(to);
+	}
+
+	SlowCapturingScanner::State state;
+	m_capturing.Initialize(state);
+	Run(m_capturing, state, from, to);
+	SlowCapturingScanner::SingleState found;
+	if (!m_capturing.GetCapture(state, found))
+		return false;
+
+	const size_t offset = from - begin;
+	final = SlowCapturingScanner::SingleState(found.GetNum());
+	if (found.HasBegin())
+		final.SetBegin(found.GetBegin() + offset);
+	if (found.HasEnd())
+		final.SetEnd(found.GetEnd() + offset);
+	return true;
+}
+
+TaggedCapturingScanner::TaggedCapturingScanner(const TaggedCapturingScanner& s)
+	: LoadedScanner(s)
+{
+	if (s.m_actionsBuffer) {
+		m_actionsBuffer.reset(new ActionIndex[*s.m_actions]);
+		std::copy_n(s.m_actions, *s.m_actions, m_actionsBuffer.get());
+		m_actions = m_actionsBuffer.get();
+	} else
+		m_actions = s.m_actions;
+}
+
+TaggedCapturingScanner::TaggedCapturingScanner(Fsm& fsm, size_t maxSize /* = 0 */)
+{
+	static const size_t DefMaxSize = 250000;
+
+	// Tags are the bits of outputs, two per group
+	size_t tags = 0;
+	for (size_t from = 0; from != fsm.Size(); ++from)
+		for (auto&& to : fsm.Destinations(from, Epsilon))
+			for (unsigned long output = fsm.Output(from, to); output >> tags; )
+				++tags;
+	const size_t groups = (tags + 1) / 2;
+	tags = 2 * groups;
+
+	fsm.Unsparse();
+	fsm.Sparse();
+	TaggedDetermineTask task(fsm, tags, maxSize ? maxSize : DefMaxSize);
+	task.Determine();
+
+	Init(task.Size(), fsm.Letters(), task.InitialState());
+
+	// A register of a tag with a rank
+	const size_t ranks = task.Ranks();
+	auto reg = [ranks](size_t tag, i32 rank) { return static_cast<ActionIndex>(tag * ranks + rank); };
+
+	TVector<ActionIndex> actions(HeaderSize, 0);
+	actions[GroupsIdx] = groups;
+	actions[RegistersIdx] = tags * ranks;
+	TVector<ActionIndex> offsets;
+	for (auto&& ops : task.AllOperations()) {
+		if (ops.empty()) {
+			offsets.push_back(0);
+			continue;
+		}
+		offsets.push_back(actions.size());
+		actions.push_back(ops.size() / 3);
+		for (size_t i = 0; i != ops.size(); i += 3) {
+			actions.push_back(reg(ops[i], ops[i + 1]));
+			actions.push_back(ops[i + 2] == Now ? SetPosition : reg(ops[i], ops[i + 2]));
+		}
+	}
+	actions[InitialActionIdx] = offsets[task.InitialOps()];
+
+	actions[FinalsIdx] = actions.size();
+	for (size_t state = 0; state != task.Size(); ++state) {
+		const TVector<i32>* final = task.Final(state);
+		for (size_t tag = 0; tag != tags; ++tag)
+			actions.push_back((final && (*final)[tag] != Unset) ? reg(tag, (*final)[tag]) : NoRegister);
+		SetTag(state, (final ? FinalFlag : 0) | (task.Dead(state) ? DeadFlag : 0));
+
+		size_t letter = 0;
+		for (auto&& l : fsm.Letters()) {
+			ypair<size_t, size_t> jump = task.Jump(state, letter++);
+			SetJump(state, l.first, jump.first, offsets[jump.second]);
+		}
+	}
+
+	actions[SizeIdx] = actions.size();
+	m_actionsBuffer.reset(new ActionIndex[actions.size()]);
+	std::copy(actions.begin(), actions.end(), m_actionsBuffer.get());
+	m_actions = m_actionsBuffer.get();
+}
+
+void TaggedCapturingScanner::Save(yostream* s) const
+{
+	LoadedScanner::Save(s, ScannerIOTypes::TaggedCapturingScanner);
+	if (m_actions) {
+		Impl::AlignedSaveArray(s, m_actions, *m_actions);
+	} else {
+		const ActionIndex empty[HeaderSize] = { HeaderSize };
+		Impl::AlignedSaveArray(s, empty, HeaderSize);
+	}
+}
+
+void TaggedCapturingScanner::Load(yistream* s)
+{
+	TaggedCapturingScanner sc;
+	ui32 type;
+	sc.LoadedScanner::Load(s, &type);
+	if (type != ScannerIOTypes::TaggedCapturingScanner)
+		throw Error("Serialized regexp is not a Pire::TaggedCapturingScanner");
+	ActionIndex size;
+	LoadPodType(s, size);
+	if (size < HeaderSize)
+		throw Error("Serialized Pire::TaggedCapturingScanner is corrupted");
+	sc.m_actionsBuffer.reset(new ActionIndex[size]);
+	sc.m_actionsBuffer[0] = size;
+	LoadPodArray(s, &sc.m_actionsBuffer[1], size - 1);
+	Impl::AlignLoad(s, size * sizeof(ActionIndex));
+	sc.m_actions = sc.m_actionsBuffer.get();
+	Swap(sc);
+}
+
+const void* TaggedCapturingScanner::Mmap(const void* ptr, size_t size)
+{
+	TaggedCapturingScanner sc;
+	ui32 type;
+	const size_t* p = static_cast<const size_t*>(sc.LoadedScanner::Mmap(ptr, size, &type));
+	if (type != ScannerIOTypes::TaggedCapturingScanner)
+		throw Error("Serialized regexp is not a Pire::TaggedCapturingScanner");
+	size -= reinterpret_cast<const char*>(p) - static_cast<const char*>(ptr);
+	if (size < sizeof(ActionIndex))
+		throw Error("EOF reached while mapping Pire::TaggedCapturingScanner");
+	Impl::MapPtr(sc.m_actions, *reinterpret_cast<const ActionIndex*>(p), p, size);
+	Swap(sc);
+	return static_cast<const void*>(p);
+}
+
+MultiCapturingScanner::MultiCapturingScanner(Fsm& fsm, size_t distance)
+	: LoadedScanner(CapturingScanner(fsm, distance))
+{
+	const Action captureMask = CapturingScanner::BeginCapture | CapturingScanner::EndCapture;
+	const size_t initial = StateIdx(m.initial);
+	auto target = [this](size_t jump) { return JumpTarget(jump); };
+
+	// Once the regexp reaches a final state it cannot leave without
+	// taking any more actions, it is done with: the match is recorded
+	// in the scanner state instead, and the automaton starts over, so
+	// that glued automata need not remember which regexps have matched
+	// (which would make them grow exponentially).
+	TVector<bool> done(m.statesCount);
+	for (size_t state = 0; state != m.statesCount; ++state)
+		done[state] = m_tags[state] & FinalFlag;
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (size_t state = 0; state != m.statesCount; ++state) {
+			for (size_t jump = state * m.lettersCount, end = jump + m.lettersCount; done[state] && jump != end; ++jump) {
+				if ((JumpAction(jump) & captureMask) || !done[target(jump)]) {
+					done[state] = false;
+					changed = true;
+				}
+			}
+		}
+	}
+	if (done[initial])
+		done.assign(m.statesCount, false);
+
+	// Each action of a CapturingScanner becomes an operation on the only regexp,
+	// followed by the one recording the match if the regexp gets done with
+	TVector<ActionIndex> actions(HeaderSize);
+	ActionIndex remap[2][captureMask + 1] = {{ 0 }};
+	for (size_t finish = 0; finish != 2; ++finish) {
+		for (Action a = finish ? 0 : 1; a <= captureMask; ++a) {
+			remap[finish][a] = actions.size();
+			actions.push_back((a ? 1 : 0) + finish);
+			if (a)
+				actions.push_back(a);
+			if (finish)
+				actions.push_back(MatchAction);
+		}
+	}
+	for (size_t jump = 0, size = m.statesCount * m.lettersCount; jump != size; ++jump) {
+		const size_t state = jump / m.lettersCount;
+		const bool finish = !done[state] && done[target(jump)];
+		SetJump(jump, finish ? initial : target(jump), remap[finish][JumpAction(jump) & captureMask]);
+	}
+
+	actions[FinalsIdx] = actions.size();
+	ActionIndex list = actions.size() + m.statesCount + 1;
+	for (size_t state = 0; state != m.statesCount; ++state) {
+		actions.push_back(list);
+		if ((m_tags[state] & FinalFlag) && !done[state])
+			++list;
+		else
+			m_tags[state] = 0;
+	}
+	actions.push_back(list);
+	actions.resize(list, 0);
+	actions[SizeIdx] = actions.size();
+	AcceptActions(actions);
+}
+
+MultiCapturingScanner::MultiCapturingScanner(const MultiCapturingScanner& s)
+	: LoadedScanner(s)
+{
+	if (s.m_actionsBuffer) {
+		m_actionsBuffer.reset(new ActionIndex[*s.m_actions]);
+		std::copy_n(s.m_actions, *s.m_actions, m_actionsBuffer.get());
+		m_actions = m_actionsBuffer.get();
+	} else
+		m_actions = s.m_actions;
+}
+
+void MultiCapturingScanner::AcceptActions(const TVector<ActionIndex>& actions)
+{
+	Y_ASSERT(actions.size() >= HeaderSize && actions[SizeIdx] == actions.size());
+	m_actionsBuffer.reset(new ActionIndex[actions.size()]);
+	std::copy(actions.begin(), actions.end(), m_actionsBuffer.get());
+	m_actions = m_actionsBuffer.get();
+}
+
+namespace Impl {
+
+class CapturingGlueTask: public ScannerGlueCommon<MultiCapturingScanner> {
+public:
+	typedef MultiCapturingScanner::ActionIndex ActionIndex;
+	typedef GluedStateLookupTable<MultiCapturingScanner::InternalState> InvStates;
+
+	CapturingGlueTask(const MultiCapturingScanner& lhs, const MultiCapturingScanner& rhs)
+		: ScannerGlueCommon<MultiCapturingScanner>(lhs, rhs, LettersEquality<MultiCapturingScanner>(lhs.m_letters, rhs.m_letters))
+		, m_actions(MultiCapturingScanner::HeaderSize)
+	{
+	}
+
+	void AcceptStates(const TVector<State>& states)
+	{
+		m_states = states;
+		SetSc(std::unique_ptr<MultiCapturingScanner>(new MultiCapturingScanner));
+		Sc().Init(states.size(), Letters(), 0, Lhs().RegexpsCount() + Rhs().RegexpsCount());
+
+		for (size_t state = 0; state != states.size(); ++state) {
+			m_finalsIndex.push_back(m_finals.size());
+			Shift(Lhs().MatchedIn(Lhs().StateIdx(states[state].first)), 0, m_finals);
+			Shift(Rhs().MatchedIn(Rhs().StateIdx(states[state].second)), Lhs().RegexpsCount(), m_finals);
+			Sc().SetTag(state, (m_finalsIndex.back() != m_finals.size()) ? MultiCapturingScanner::FinalFlag : 0);
+		}
+		m_finalsIndex.push_back(m_finals.size());
+	}
+
+	void Connect(size_t from, size_t to, Char letter)
+	{
+		m_ops.clear();
+		Shift(Operations(Lhs(), m_states[from].first, letter), 0, m_ops);
+		Shift(Operations(Rhs(), m_states[from].second, letter), Lhs().RegexpsCount() << MultiCapturingScanner::ActionShift, m_ops);
+
+		ActionIndex action = 0;
+		if (!m_ops.empty()) {
+			auto ins = m_index.insert(ymake_pair(m_ops, static_cast<ActionIndex>(m_actions.size())));
+			if (ins.second) {
+				m_actions.push_back(m_ops.size());
+				m_actions.insert(m_actions.end(), m_ops.begin(), m_ops.end());
+			}
+			action = ins.first->second;
+		}
+		Sc().SetJump(from, letter, to, action);
+	}
+
+	const MultiCapturingScanner& Success()
+	{
+		m_actions[MultiCapturingScanner::FinalsIdx] = m_actions.size();
+		const size_t lists = m_actions.size() + m_finalsIndex.size();
+		for (auto&& i : m_finalsIndex)
+			m_actions.push_back(lists + i);
+		m_actions.insert(m_actions.end(), m_finals.begin(), m_finals.end());
+		if (m_actions.size() >= static_cast<ActionIndex>(-1))
+			throw Error("Too many actions for Pire::MultiCapturingScanner");
+		m_actions[MultiCapturingScanner::SizeIdx] = m_actions.size();
+		Sc().AcceptActions(m_actions);
+		return Sc();
+	}
+
+private:
+	TVector<State> m_states;
+	TVector<ActionIndex> m_actions;
+	/// Actions met so far, by their operations
+	TMap<TVector<ActionIndex>, ActionIndex> m_index;
+	TVector<ActionIndex> m_ops;
+	/// Regexps matched in each state of the result
+	TVector<size_t> m_finalsIndex;
+	TVector<ActionIndex> m_finals;
+
+	typedef ypair<const ActionIndex*, const ActionIndex*> Range;
+
+	static Range Operations(const MultiCapturingScanner& sc, MultiCapturingScanner::InternalState state, Char letter)
+	{
+		MultiCapturingScanner::Action action = sc.JumpAction(sc.TransitionIndex(sc.StateIdx(state), letter));
+		if (!action)
+			return Range();
+		const ActionIndex* ops = sc.m_actions + action;
+		return Range(ops + 1, ops + 1 + *ops);
+	}
+
+	static void Shift(Range range, ActionIndex shift, TVector<ActionIndex>& out)
+	{
+		for (; range.first != range.second; ++range.first)
+			out.push_back(*range.first + shift);
+	}
+};
+
+}
+
+MultiCapturingScanner MultiCapturingScanner::Glue(const MultiCapturingScanner& lhs, const MultiCapturingScanner& rhs, size_t maxSize /* = 0 */)
+{
+	if (lhs.Empty())
+		return rhs;
+	if (rhs.Empty())
+		return lhs;
+
+	static const size_t DefMaxSize = 80000;
+	Impl::CapturingGlueTask task(lhs, rhs);
+	return Impl::Determine(task, maxSize ? maxSize : DefMaxSize, "glue");
+}
+
+void MultiCapturingScanner::Save(yostream* s) const
+{
+	LoadedScanner::Save(s, ScannerIOTypes::MultiCapturingScanner);
+	if (m_actions) {
+		Impl::AlignedSaveArray(s, m_actions, *m_actions);
+	} else {
+		const ActionIndex empty[HeaderSize] = { HeaderSize };
+		Impl::AlignedSaveArray(s, empty, HeaderSize);
+	}
+}
+
+void MultiCapturingScanner::Load(yistream* s)
+{
+	MultiCapturingScanner sc;
+	ui32 type;
+	sc.LoadedScanner::Load(s, &type);
+	if (type != ScannerIOTypes::MultiCapturingScanner)
+		throw Error("Serialized regexp is not a Pire::MultiCapturingScanner");
+	ActionIndex size;
+	LoadPodType(s, size);
+	if (size < HeaderSize)
+		throw Error("Serialized Pire::MultiCapturingScanner is corrupted");
+	sc.m_actionsBuffer.reset(new ActionIndex[size]);
+	sc.m_actionsBuffer[0] = size;
+	LoadPodArray(s, &sc.m_actionsBuffer[1], size - 1);
+	Impl::AlignLoad(s, size * sizeof(ActionIndex));
+	// A saved empty scanner has no finals index
+	sc.m_actions = (size > HeaderSize) ? sc.m_actionsBuffer.get() : nullptr;
+	Swap(sc);
+}
+
+const void* MultiCapturingScanner::Mmap(const void* ptr, size_t size)
+{
+	MultiCapturingScanner sc;
+	ui32 type;
+	const size_t* p = static_cast<const size_t*>(sc.LoadedScanner::Mmap(ptr, size, &type));
+	if (type != ScannerIOTypes::MultiCapturingScanner)
+		throw Error("Serialized regexp is not a Pire::MultiCapturingScanner");
+	size -= reinterpret_cast<const char*>(p) - static_cast<const char*>(ptr);
+	if (size < sizeof(ActionIndex))
+		throw Error("EOF reached while mapping Pire::MultiCapturingScanner");
+	const ActionIndex* actions = 0;
+	Impl::MapPtr(actions, *reinterpret_cast<const ActionIndex*>(p), p, size);
+	sc.m_actions = (*actions > HeaderSize) ? actions : nullptr;
+	Swap(sc);
+	return static_cast<const void*>(p);
+}
+
 namespace Features {
 	Feature::Ptr Capture(size_t pos) { return Feature::Ptr(new CaptureImpl(pos)); }
+	Feature::Ptr CaptureGroups() { return Feature::Ptr(new CaptureGroupsImpl); }
 };
 }
@@ -33,7 +33,7 @@
 #include "../re_lexer.h"
 #include "../run.h"
 
-#include <array>
+#include <algorithm>
 
 namespace Pire {
 
@@ -108,11 +108,10 @@ public:
 
 	Action NextTranslated(State& s, unsigned char c) const
 	{
-		Transition x = reinterpret_cast<const Transition*>(s.m_state)[c];
-		s.m_state += SignExtend(x.shift);
+		Action action = Follow(s.m_state, c);
 		++s.m_counter;
 
-		return x.action;
+		return action;
 	}
 
 	Action Next(State& s, Char c) const
@@ -131,7 +130,7 @@ public:
 		return Final(s);
 	}
 
-	bool Final(const State& s) const { return m_tags[(reinterpret_cast<Transition*>(s.m_state) - m_jumps) / m.lettersCount] & FinalFlag; }
+	bool Final(const State& s) const { return m_tags[StateIdx(s.m_state)] & FinalFlag; }
 
 	bool Dead(const State&) const { return false; }
 
@@ -179,7 +178,7 @@ public:
 		FinalFlag = 1,
 	};
 
-	const ui32 ActionsCapture = BeginCapture | EndCapture;
+	static const ui32 ActionsCapture = BeginCapture | EndCapture;
 
 	class SingleState {
 	public:
@@ -249,11 +248,22 @@ public:
 		static const size_t m_npos = static_cast<size_t>(-1);
 	};
 
+private:
+	/// A thread in the pool of a State, linked to the following one of the same priority
+	struct PooledThread {
+		SingleState state;
+		size_t next;
+	};
+
+	static const size_t NoThread = static_cast<size_t>(-1);
+
+public:
 	class State {
 	public:
 		State()
 			: m_strpos(0)
-			, m_matched(false) {}
+			, m_matched(false)
+			, m_generation(0) {}
 
 		size_t GetPos() const
 		{
@@ -311,144 +321,21 @@ public:
 		size_t m_strpos;
 		bool m_matched;
 		SingleState m_match;
-	};
 
-	class Transition {
-	private:
-		unsigned long m_stateto;
-		Action m_action;
+		// Scratch space of the scanner, allocated once for all the steps
+		// (each of them reaches every NFA state at most once)
 
-	public:
-		unsigned long GetState() const
-		{
-			return m_stateto;
-		}
+		/// Threads of the next step
+		TVector<SingleState> m_next;
+		/// Threads reached by the step, linked into priority lists
+		TVector<PooledThread> m_pool;
+		/// NFA states have been reached by the step if marked with the current generation
+		TVector<ui32> m_marks;
+		ui32 m_generation;
 
-		Action GetAction() const
-		{
-			return m_action;
-		}
-
-		Transition(unsigned long state, Action act = 0)
-				: m_stateto(state)
-				, m_action(act)
-		{
-		}
+		friend class SlowCapturingScanner;
 	};
 
-	class PriorityStates {
-	private:
-		TVector<SingleState> m_nonGreedy;
-		TVector<SingleState> m_nothing;
-		TVector<SingleState> m_greedy;
-
-	public:
-		void Push(const SingleState& st, RepetitionTypes repetition)
-		{
-			Get(repetition).push_back(st);
-		}
-
-		TVector<SingleState>& Get(RepetitionTypes repetition)
-		{
-			switch (repetition) {
-				case NonGreedyRepetition:
-					return m_nonGreedy;
-				case NoRepetition:
-					return m_nothing;
-				case GreedyRepetition:
-					return m_greedy;
-			}
-		}
-
-		const TVector<SingleState>& Get(RepetitionTypes repetition) const
-		{
-			switch (repetition) {
-				case NonGreedyRepetition:
-					return m_nonGreedy;
-				case NoRepetition:
-					return m_nothing;
-				case GreedyRepetition:
-					return m_greedy;
-			}
-		}
-	};
-
-	SlowScanner::State GetNextStates(const SingleState& cur, Char letter) const
-	{
-		SlowScanner::State st(GetSize());
-		st.states.push_back(cur.GetNum());
-		SlowScanner::State nextState(GetSize());
-		SlowScanner::NextTranslated(st, nextState, letter);
-		return nextState;
-	}
-
-	size_t GetPosition(const SingleState& state, Char letter) const
-	{
-		return state.GetNum() * GetLettersCount() + letter;
-	}
-
-	void NextStates(const SingleState& state, Char letter, TVector<Transition>& nextStates) const
-	{
-		if (IsMmaped()) {
-			const size_t* pos = GetJumpPos() + GetPosition(state, letter);
-			size_t posBegin = pos[0];
-			size_t posEnd = pos[1];
-			for (size_t i = posBegin; i < posEnd; ++i)
-				nextStates.emplace_back(GetJump(i), GetAction(i));
-		} else {
-			size_t num = GetPosition(state, letter);
-			const auto& jumpVec = GetJumpsVec(num);
-			const auto& actionVec = GetActionsVec(num);
-			for (size_t i = 0; i < jumpVec.size(); ++i)
-				nextStates.emplace_back(jumpVec[i], actionVec[i]);
-		}
-	}
-
-	void InsertStates(const PriorityStates& states, TVector<SingleState>& nonGreedy, TVector<SingleState>& nothing, TVector<SingleState>& greedy) const
-	{
-		for (auto& greed : {ymake_pair(&nonGreedy, NonGreedyRepetition), ymake_pair(&nothing, NoRepetition), ymake_pair(&greedy, GreedyRepetition)}) {
-			auto& vec = greed.first;
-			auto& tag = greed.second;
-			vec->insert(vec->end(), states.Get(tag).begin(), states.Get(tag).end());
-		}
-	}
-
-	void NextAndGetToGroups(PriorityStates& states, const SingleState& cur,
-							Char letter, size_t pos, TVector<bool>& used) const
-	{
-		TVector<Transition> nextStates;
-		NextStates(cur, letter, nextStates);
-		for (const auto& trans : nextStates) {
-			size_t st = trans.GetState();
-			if (used[st])
-				continue;
-			used[st] = true;
-			SingleState state(st);
-			const auto& action = trans.GetAction();
-			state.SetBegin(cur.GetBegin());
-			state.SetEnd(cur.GetEnd());
-			if (action & BeginCapture && !cur.HasBegin()) {
-				state.SetBegin(pos);
-			}
-			if (action & EndCapture && !cur.HasEnd()) {
-				state.SetEnd(pos);
-			}
-			PriorityStates statesInside;
-			NextAndGetToGroups(statesInside, state, Translate(Epsilon), pos, used);
-			statesInside.Push(state, NoRepetition);
-			if (action & EndNonGreedyRepetition) {
-				auto& nongreedy = states.Get(NonGreedyRepetition);
-				InsertStates(statesInside, nongreedy, nongreedy, nongreedy);
-			}
-			else if (!(action & EndRepetition))
-				InsertStates(statesInside, states.Get(NonGreedyRepetition), states.Get(NoRepetition), states.Get(GreedyRepetition));
-			else {
-				auto& greedy = states.Get(GreedyRepetition);
-				InsertStates(statesInside, greedy, greedy, greedy);
-			}
-		}
-	}
-
 	bool Captured(const SingleState& st, bool& matched) const
 	{
 		matched = false;
@@ -457,27 +344,19 @@ public:
 			if (st.HasBegin())
 				return true;
 		}
-		TVector<Transition> nextStates;
-		NextStates(st, Translate(EndMark), nextStates);
-		for (const auto& trans : nextStates)
-		{
-			size_t state = trans.GetState();
-			if (IsFinal(state)) {
+		ypair<size_t, size_t> range = JumpRange(st.GetNum(), Translate(EndMark));
+		for (size_t i = range.first; i != range.second; ++i) {
+			size_t state = GetJump(i);
+			bool reachesFinal = IsFinal(state);
+			if (!reachesFinal) { // After EndMark there can be Epsilon-transitions to the Final State
+				ypair<size_t, size_t> epsilons = JumpRange(state, Translate(Epsilon));
+				for (size_t j = epsilons.first; j != epsilons.second && !reachesFinal; ++j)
+					reachesFinal = IsFinal(GetJump(j));
+			}
+			if (reachesFinal) {
 				matched = true;
-				if (st.HasBegin() || (trans.GetAction() & ActionsCapture))
+				if (st.HasBegin() || (GetAction(i) & ActionsCapture))
 					return true;
-			} else { // After EndMark there can be Epsilon-transitions to the Final State
-				TVector<Transition> epsilonTrans;
-				SingleState newSt(state);
-				NextStates(newSt, Translate(Epsilon), epsilonTrans);
-				for (auto new_trans : epsilonTrans) {
-					size_t fin = new_trans.GetState();
-					if (IsFinal(fin)) {
-						matched = true;
-						if (st.HasBegin() || (trans.GetAction() & ActionsCapture))
-							return true;
-					}
-				}
 			}
 		}
 		return false;
@@ -511,77 +390,536 @@ public:
 		}
 	}
 
-	bool PushState(State& nlist, const SingleState& state) const
+	void Initialize(State& st) const
 	{
-		nlist.PushState(state);
-		if (Matched(state)) {
-			nlist.AddMatch(state);
-			return true;
+		st.m_states.clear();
+		st.m_strpos = 0;
+		st.m_matched = false;
+		StartStep(st);
+		ThreadLists lists;
+		SingleState init(GetStart());
+		NextAndGetToGroups(st, lists, init, Translate(BeginMark), 0);
+		NextAndGetToGroups(st, lists, 0, Translate(BeginMark), 0);
+		UpdateNList(st, lists);
+		st.m_states.swap(st.m_next);
+	}
+
+	Action NextTranslated(State& st, Char letter) const
+	{
+		StartStep(st);
+		++st.m_strpos;
+		for (size_t pos = 0; pos != st.m_states.size(); ++pos) {
+			ThreadLists lists;
+			NextAndGetToGroups(st, lists, st.m_states[pos], letter, st.m_strpos);
+			UpdateNList(st, lists);
+		}
+		st.m_states.swap(st.m_next);
+		return 0;
+	}
+
+	void TakeAction(State&, Action) const {}
+
+	Action Next(State& st, Char letter) const
+	{
+		return NextTranslated(st, Translate(letter));
+	}
+
+private:
+	/// Heads and tails of the lists of threads of each priority (indexed by RepetitionTypes)
+	struct ThreadLists {
+		size_t first[3];
+		size_t last[3];
+
+		ThreadLists()
+		{
+			for (size_t i = 0; i != 3; ++i)
+				first[i] = last[i] = NoThread;
+		}
+
+		/// Moves the threads of the @p from list of @p lists to the end of the @p to one
+		void Append(TVector<PooledThread>& pool, RepetitionTypes to, const ThreadLists& lists, RepetitionTypes from)
+		{
+			if (lists.first[from] == NoThread)
+				return;
+			if (last[to] == NoThread)
+				first[to] = lists.first[from];
+			else
+				pool[last[to]].next = lists.first[from];
+			last[to] = lists.last[from];
+		}
+	};
+
+	/// Prepares the scratch space of @p st for a step
+	void StartStep(State& st) const
+	{
+		if (st.m_marks.size() != GetSize()) {
+			st.m_marks.assign(GetSize(), 0);
+			st.m_generation = 0;
+			st.m_next.reserve(GetSize());
+			st.m_pool.reserve(GetSize());
+			st.m_states.reserve(GetSize());
+		}
+		if (++st.m_generation == 0) {
+			std::fill(st.m_marks.begin(), st.m_marks.end(), 0);
+			st.m_generation = 1;
+		}
+		st.m_next.clear();
+		st.m_pool.clear();
+	}
+
+	void NextAndGetToGroups(State& st, ThreadLists& lists, const SingleState& cur, Char letter, size_t pos) const
+	{
+		ypair<size_t, size_t> range = JumpRange(cur.GetNum(), letter);
+		for (size_t i = range.first; i != range.second; ++i) {
+			size_t to = GetJump(i);
+			if (st.m_marks[to] == st.m_generation)
+				continue;
+			st.m_marks[to] = st.m_generation;
+			SingleState state(to);
+			Action action = GetAction(i);
+			state.SetBegin(cur.GetBegin());
+			state.SetEnd(cur.GetEnd());
+			if (action & BeginCapture && !cur.HasBegin()) {
+				state.SetBegin(pos);
+			}
+			if (action & EndCapture && !cur.HasEnd()) {
+				state.SetEnd(pos);
+			}
+
+			// The threads reached by epsilons come before the state itself
+			ThreadLists inside;
+			NextAndGetToGroups(st, inside, state, Translate(Epsilon), pos);
+			PooledThread thread = { state, NoThread };
+			st.m_pool.push_back(thread);
+			ThreadLists self;
+			self.first[NoRepetition] = self.last[NoRepetition] = st.m_pool.size() - 1;
+			inside.Append(st.m_pool, NoRepetition, self, NoRepetition);
+
+			static const RepetitionTypes priorities[] = {NonGreedyRepetition, NoRepetition, GreedyRepetition};
+			for (auto priority : priorities) {
+				if (action & EndNonGreedyRepetition)
+					lists.Append(st.m_pool, NonGreedyRepetition, inside, priority);
+				else if (!(action & EndRepetition))
+					lists.Append(st.m_pool, priority, inside, priority);
+				else
+					lists.Append(st.m_pool, GreedyRepetition, inside, priority);
+			}
 		}
-		return false;
 	}
 
-	void UpdateNList(State& nlist, const PriorityStates& states) const
+	void UpdateNList(State& st, const ThreadLists& lists) const
 	{
-		static constexpr std::array<RepetitionTypes, 3> m_type_by_priority{{NonGreedyRepetition, NoRepetition, GreedyRepetition}};
-		for (const auto type : m_type_by_priority) {
-			for (const auto& state : states.Get(type)) {
-				if (PushState(nlist, state)) // Because we have strict priorities, after matching some state, we can be sure, that not states after will be better
+		static const RepetitionTypes priorities[] = {NonGreedyRepetition, NoRepetition, GreedyRepetition};
+		for (auto priority : priorities) {
+			for (size_t thread = lists.first[priority]; thread != NoThread; thread = st.m_pool[thread].next) {
+				const SingleState& state = st.m_pool[thread].state;
+				st.m_next.push_back(state);
+				if (Matched(state)) { // Because we have strict priorities, after matching some state, we can be sure, that not states after will be better
+					st.AddMatch(state);
 					return;
+				}
 			}
 		}
 	}
 
-	void Initialize(State& nlist) const
+public:
+	SlowCapturingScanner()
+		: SlowScanner(true)
 	{
-		PriorityStates states;
-		SingleState init(GetStart());
-		TVector<bool> used(GetSize());
-		NextAndGetToGroups(states, init, Translate(BeginMark), 0, used);
-		NextAndGetToGroups(states, 0, Translate(BeginMark), 0, used);
-		UpdateNList(nlist, states);
 	}
 
-	Action NextTranslated(State& clist, Char letter) const
+	SlowCapturingScanner(Fsm& fsm, size_t distance = 0)
+		: SlowScanner(fsm, true, false, distance)
 	{
-		State nlist;
-		if (clist.IsMatched())
-			nlist.AddMatch(clist.GetMatched());
-		nlist.SetPos(clist.GetPos() + 1);
-		size_t strpos = nlist.GetPos();
-		TVector<bool> used(GetSize());
-		size_t pos = 0;
-		while (pos < clist.GetSize()) {
-			PriorityStates states;
-			NextAndGetToGroups(states, clist.GetState(pos), letter, strpos, used);
-			UpdateNList(nlist, states);
-			++pos;
+	}
+};
+
+/**
+* Captures a group of a regexp found anywhere in the text, giving the same
+* results as a SlowCapturingScanner for the surrounded regexp, run over
+* the whole text, but without paying its price for most texts that do not match.
+*
+* A reversed DFA is run first, telling whether the regexp matches at all
+* and where the leftmost match starts; then a forward DFA finds where
+* the rightmost match ends, and the slow scanner only runs between them.
+* Regexps containing ^ or $ keep the corresponding end of the text.
+*/
+class TwoPhaseCapture {
+public:
+	TwoPhaseCapture(): m_anchoredBegin(false), m_anchoredEnd(false) {}
+
+	/// Takes a regexp with the group marked by Features::Capture()
+	/// (not surrounded, as the capture is looked for anywhere)
+	explicit TwoPhaseCapture(const Fsm& fsm);
+
+	/// Looks for the capture in [begin, end), returning the same as
+	/// SlowCapturingScanner::GetCapture() would; positions are counted from @p begin
+	bool Capture(const char* begin, const char* end, SlowCapturingScanner::SingleState& final) const;
+
+	const SlowCapturingScanner& Capturing() const { return m_capturing; }
+
+private:
+	/// Matches texts ending with a match of the regexp
+	Scanner m_forward;
+	/// Matches reversed texts starting with a match of the regexp
+	Scanner m_backward;
+	SlowCapturingScanner m_capturing;
+	bool m_anchoredBegin;
+	bool m_anchoredEnd;
+};
+
+/**
+* A capturing scanner for any number of groups, matching input
+* against a single regexp in O(strlen(str)) time.
+*
+* This is a tagged DFA: each group marked by Features::CaptureGroups()
+* has an opening and a closing tag, and the scanner keeps registers
+* with positions the tags were met at along all the paths through the regexp
+* it might be following. Transitions carry actions, which copy registers
+* or set them to the current position; once the scanner stops in a final
+* state, the state tells which registers hold the best submatches.
+*
+* Since Pire regexps carry no priorities, submatches are chosen by groups,
+* in the order of their opening parentheses: each group starts as early
+* as possible and then ends as late as possible (a repeated group
+* reports its last iteration). Repetitions outside groups do not
+* take part, so /.*(\d+)/ captures all the trailing digits, and
+* non-greedy repetitions are not supported.
+*
+* Positions are counted as in CapturingScanner.
+*/
+class TaggedCapturingScanner: public LoadedScanner {
+public:
+	enum {
+		FinalFlag = 1,
+		DeadFlag  = 2
+	};
+
+	typedef ui32 ActionIndex;
+
+	/// Each group takes two bits of an FSM output
+	static const size_t MaxGroups = sizeof(unsigned long) * 4;
+	/// Begin() and End() of a group which has not been captured
+	static const size_t NoPosition = static_cast<size_t>(-1);
+
+	static unsigned long OpenTag(size_t group) { return 1ul << (2 * group); }
+	static unsigned long CloseTag(size_t group) { return 1ul << (2 * group + 1); }
+
+	class State {
+	private:
+		size_t m_state;
+		size_t m_counter;
+		TVector<size_t> m_registers;
+		friend class TaggedCapturingScanner;
+
+#ifdef PIRE_DEBUG
+		friend yostream& operator << (yostream& s, const State& state)
+		{
+			return s << state.m_state << " @" << state.m_counter;
 		}
-		DoSwap(clist, nlist);
-		return 0;
+#endif
+	};
+
+	void Initialize(State& state) const
+	{
+		state.m_state = m.initial;
+		state.m_counter = 0;
+		state.m_registers.assign(Scalar(RegistersIdx), 0);
+		TakeAction(state, Scalar(InitialActionIdx));
 	}
 
-	void TakeAction(State&, Action) const {}
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	void TakeAction(State& s, Action a) const
+	{
+		if (!a)
+			return;
+		const ActionIndex* op = m_actions + a;
+		for (ActionIndex count = *op++; count--; op += 2)
+			s.m_registers[op[0]] = (op[1] == SetPosition) ? s.m_counter : s.m_registers[op[1]];
+	}
 
-	Action Next(State& st, Char letter) const
+	Char Translate(Char ch) const
 	{
-		return NextTranslated(st, Translate(letter));
+		return m_letters[static_cast<size_t>(ch)];
 	}
 
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action NextTranslated(State& s, Char c) const
+	{
+		Action action = Follow(s.m_state, c);
+		++s.m_counter;
+		return action;
+	}
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action Next(State& s, Char c) const
+	{
+		return NextTranslated(s, Translate(c));
+	}
+
+	Action Next(const State& current, State& n, Char c) const
+	{
+		n = current;
+		return Next(n, c);
+	}
+
+	bool Final(const State& s) const { return m_tags[StateIdx(s.m_state)] & FinalFlag; }
+
+	bool Dead(const State& s) const { return m_tags[StateIdx(s.m_state)] & DeadFlag; }
+
+	bool CanStop(const State& s) const { return Final(s); }
+
+	size_t GroupsCount() const { return Scalar(GroupsIdx); }
+
+	/// Tells whether the @p group has been captured by the match
+	/// (the scanner should be in a final state)
+	bool Captured(const State& s, size_t group) const
+	{
+		return Begin(s, group) != NoPosition && End(s, group) != NoPosition;
+	}
+
+	size_t Begin(const State& s, size_t group) const { return Position(s, 2 * group); }
+	size_t End(const State& s, size_t group) const { return Position(s, 2 * group + 1); }
+
+	TaggedCapturingScanner() {}
+	TaggedCapturingScanner(const TaggedCapturingScanner& s);
+	explicit TaggedCapturingScanner(Fsm& fsm, size_t maxSize = 0);
+
+	void Swap(TaggedCapturingScanner& s)
+	{
+		LoadedScanner::Swap(s);
+		DoSwap(m_actionsBuffer, s.m_actionsBuffer);
+		DoSwap(m_actions, s.m_actions);
+	}
+	TaggedCapturingScanner& operator = (const TaggedCapturingScanner& s) { TaggedCapturingScanner(s).Swap(*this); return *this; }
+
+	size_t StateIndex(const State& s) const { return StateIdx(s.m_state); }
+
+	void Save(yostream* s) const;
+	void Load(yistream* s);
+	const void* Mmap(const void* ptr, size_t size);
+
+private:
+	/// Register operations of an action are pairs of the register to set
+	/// and the register to copy (or SetPosition to set it to the current position)
+	static const ActionIndex SetPosition = static_cast<ActionIndex>(-1);
+	static const ActionIndex NoRegister = static_cast<ActionIndex>(-1);
+
+	/// m_actions starts with its size and a few scalars, followed by the operations
+	/// (each action is an offset of their count) and registers holding each tag
+	/// in each final state
+	enum {
+		SizeIdx,
+		GroupsIdx,
+		RegistersIdx,
+		InitialActionIdx,
+		FinalsIdx,
+		HeaderSize
+	};
+
+	std::unique_ptr<ActionIndex[]> m_actionsBuffer;
+	const ActionIndex* m_actions = nullptr;
+
+	ActionIndex Scalar(size_t idx) const { return m_actions ? m_actions[idx] : 0; }
+
+	size_t Position(const State& s, size_t tag) const
+	{
+		if (!Final(s))
+			return NoPosition;
+		ActionIndex reg = m_actions[Scalar(FinalsIdx) + StateIdx(s.m_state) * 2 * GroupsCount() + tag];
+		return (reg == NoRegister) ? NoPosition : s.m_registers[reg];
+	}
+};
+
+namespace Impl {
+	class CapturingGlueTask;
+}
+
+/**
+* Several capturing scanners glued together.
+*
+* Each regexp keeps its own capture, taken exactly as a CapturingScanner
+* built from it would take it, so a single pass over the input tells
+* which regexps have matched and what each of them has captured.
+* Combined actions of the regexps, which would not fit into transitions,
+* are kept in a side table, so there is no limit on the number of regexps
+* but the size of the glued automaton. As matches of (surrounded) regexps
+* are recorded in the state rather than in the automaton, its size grows
+* about linearly with the number of regexps.
+*/
+class MultiCapturingScanner: public LoadedScanner {
 public:
-	SlowCapturingScanner()
-		: SlowScanner(true)
+	enum {
+		FinalFlag = 1
+	};
+
+	typedef ui32 ActionIndex;
+
+	/// Begin() and End() of a regexp which has not captured anything
+	static const size_t NoPosition = static_cast<size_t>(-1);
+
+	class State {
+	private:
+		size_t m_state;
+		size_t m_counter;
+		/// Begin and end of the capture of each regexp
+		TVector<size_t> m_positions;
+		/// Regexps which have matched, so the automaton is done with them
+		TVector<bool> m_matched;
+		friend class MultiCapturingScanner;
+
+#ifdef PIRE_DEBUG
+		friend yostream& operator << (yostream& s, const State& state)
+		{
+			return s << state.m_state << " @" << state.m_counter;
+		}
+#endif
+	};
+
+	void Initialize(State& state) const
 	{
+		state.m_state = m.initial;
+		state.m_counter = 0;
+		state.m_positions.assign(2 * RegexpsCount(), static_cast<size_t>(NoPosition));
+		state.m_matched.assign(RegexpsCount(), false);
 	}
 
-	SlowCapturingScanner(Fsm& fsm, size_t distance = 0)
-		: SlowScanner(fsm, true, false, distance)
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	void TakeAction(State& s, Action a) const
+	{
+		if (!a)
+			return;
+		const ActionIndex* op = m_actions + a;
+		for (ActionIndex count = *op++; count--; ++op) {
+			const size_t regexp = *op >> ActionShift;
+			size_t* positions = &s.m_positions[2 * regexp];
+			if ((*op & ((1 << ActionShift) - 1)) == MatchAction)
+				s.m_matched[regexp] = true;
+			else if (s.m_matched[regexp] || (positions[0] != NoPosition && positions[1] != NoPosition))
+				continue;
+			else if (*op & CapturingScanner::BeginCapture)
+				positions[0] = s.m_counter - 1;
+			else if (*op & CapturingScanner::EndCapture)
+				positions[1] = s.m_counter - 1;
+		}
+	}
+
+	Char Translate(Char ch) const
+	{
+		return m_letters[static_cast<size_t>(ch)];
+	}
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action NextTranslated(State& s, Char c) const
+	{
+		Action action = Follow(s.m_state, c);
+		++s.m_counter;
+		return action;
+	}
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action Next(State& s, Char c) const
+	{
+		return NextTranslated(s, Translate(c));
+	}
+
+	Action Next(const State& current, State& n, Char c) const
 	{
+		n = current;
+		return Next(n, c);
+	}
+
+	/// Tells whether the input read so far ends with a match of any regexp
+	/// (regexps which have matched earlier are reported by Matched())
+	bool Final(const State& s) const { return m_tags[StateIdx(s.m_state)] & FinalFlag; }
+
+	bool Dead(const State&) const { return false; }
+
+	/// Other regexps can still capture something after one of them has matched
+	bool CanStop(const State&) const { return false; }
+
+	/// Tells whether the @p regexp has matched the input read so far
+	bool Matched(const State& s, size_t regexp) const
+	{
+		if (s.m_matched[regexp])
+			return true;
+		ypair<const ActionIndex*, const ActionIndex*> finals = MatchedIn(StateIdx(s.m_state));
+		return std::binary_search(finals.first, finals.second, regexp);
+	}
+
+	/// Same as CapturingScanner::State::Captured(), Begin() and End() for each regexp
+	bool Captured(const State& s, size_t regexp) const { return Begin(s, regexp) != NoPosition && End(s, regexp) != NoPosition; }
+	size_t Begin(const State& s, size_t regexp) const { return s.m_positions[2 * regexp]; }
+	size_t End(const State& s, size_t regexp) const { return s.m_positions[2 * regexp + 1]; }
+
+	MultiCapturingScanner() {}
+	MultiCapturingScanner(const MultiCapturingScanner& s);
+	/// Builds a scanner of a single regexp, capturing what CapturingScanner(fsm, distance) does
+	explicit MultiCapturingScanner(Fsm& fsm, size_t distance = 0);
+
+	void Swap(MultiCapturingScanner& s)
+	{
+		LoadedScanner::Swap(s);
+		DoSwap(m_actionsBuffer, s.m_actionsBuffer);
+		DoSwap(m_actions, s.m_actions);
+	}
+	MultiCapturingScanner& operator = (const MultiCapturingScanner& s) { MultiCapturingScanner(s).Swap(*this); return *this; }
+
+	size_t StateIndex(const State& s) const { return StateIdx(s.m_state); }
+
+	/// Returns an empty scanner if the glued one would have more than @p maxSize states
+	static MultiCapturingScanner Glue(const MultiCapturingScanner& a, const MultiCapturingScanner& b, size_t maxSize = 0);
+
+	void Save(yostream* s) const;
+	void Load(yistream* s);
+	const void* Mmap(const void* ptr, size_t size);
+
+private:
+	/// An operation of an action is the index of a regexp, shifted by ActionShift,
+	/// combined with the CapturingScanner action taken on it, or with MatchAction
+	/// if the automaton is done with the regexp, as it has matched
+	enum {
+		ActionShift = 2,
+		MatchAction = 0
+	};
+
+	/// m_actions starts with its size and the offset of the finals index,
+	/// followed by the operations (each action is an offset of their count).
+	/// The finals index holds offsets of lists of regexps matched in each state
+	/// (the list of a state ends where the one of the next state begins).
+	enum {
+		SizeIdx,
+		FinalsIdx,
+		HeaderSize
+	};
+
+	std::unique_ptr<ActionIndex[]> m_actionsBuffer;
+	const ActionIndex* m_actions = nullptr;
+
+	void AcceptActions(const TVector<ActionIndex>& actions);
+
+	ypair<const ActionIndex*, const ActionIndex*> MatchedIn(size_t state) const
+	{
+		if (!m_actions)
+			return ymake_pair(m_actions, m_actions);
+		const ActionIndex* index = m_actions + m_actions[FinalsIdx] + state;
+		return ymake_pair(m_actions + index[0], m_actions + index[1]);
 	}
+
+	void Next(InternalState& s, Char c) const
+	{
+		Follow(s, Translate(c));
+	}
+
+	friend class Impl::ScannerGlueCommon<MultiCapturingScanner>;
+	friend class Impl::CapturingGlueTask;
 };
 
 namespace Features {
 	Feature::Ptr Capture(size_t pos);
+
+	/// Marks all the groups in the regexp for TaggedCapturingScanner
+	Feature::Ptr CaptureGroups();
 }
 
 }
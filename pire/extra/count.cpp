@@ -29,6 +29,7 @@
 #include "../stub/lexical_cast.h"
 #include "../stub/stl.h"
 #include <tuple>
+#include <limits>
 
 namespace Pire {
 
@@ -173,7 +174,7 @@ class CountingFsmMinimizeTask : public CountingFsmTask {
 public:
 	explicit CountingFsmMinimizeTask(const CountingFsm& fsm)
 		: mFsm(fsm)
-		, reversedTransitions(fsm.Determined().Size())
+		, representatives(fsm.Letters().Size())
 		, StateClass(fsm.Determined().Size())
 		, Classes(0)
 	{
@@ -183,20 +184,10 @@ public:
 				stateClassMap[state] = Classes++;
 			}
 			StateClass[state] = stateClassMap[state];
-			reversedTransitions[state].resize(mFsm.Letters().Size());
 		}
 
-		for (size_t state = 0; state < mFsm.Determined().Size(); ++state) {
-			TSet<ypair<Char, size_t>> usedTransitions;
-			for (const auto& letter : mFsm.Letters()) {
-				const auto destination = Next(state, letter.first);
-				const auto letterId = letter.second.first;
-				if (usedTransitions.find(ymake_pair(letterId, destination)) == usedTransitions.end()) {
-					usedTransitions.insert(ymake_pair(letterId, destination));
-					reversedTransitions[destination][letterId].push_back(state);
-				}
-			}
-		}
+		for (const auto& letter : mFsm.Letters())
+			representatives[letter.second.first] = letter.first;
 	}
 
 	TVector<size_t>& GetStateClass() { return StateClass; }
@@ -215,8 +206,8 @@ public:
 		return mFsm.Determined().Size();
 	}
 
-	const TVector<size_t>& Previous(size_t state, size_t letter) const {
-		return reversedTransitions[state][letter];
+	size_t Next(size_t state, size_t letter) const {
+		return Destination(state, representatives[letter]);
 	}
 
 	void AcceptStates() {
@@ -230,7 +221,7 @@ public:
 			const auto fromMinimized = StateClass[from];
 			for (auto&& letter : mFsm.Letters()) {
 				const auto representative = letter.first;
-				const auto next = Next(from, representative);
+				const auto next = Destination(from, representative);
 				const auto nextMinimized = StateClass[next];
 				Connect(fromMinimized, nextMinimized, representative);
 				const auto outputs = mFsm.Output(from, representative);
@@ -248,11 +239,11 @@ public:
 
 private:
 	const CountingFsm& mFsm;
-	TVector<TVector<TVector<size_t>>> reversedTransitions;
+	TVector<Char> representatives;
 	TVector<size_t> StateClass;
 	size_t Classes;
 
-	size_t Next(size_t state, Char letter) const {
+	size_t Destination(size_t state, Char letter) const {
 		const auto& tos = mFsm.Determined().Destinations(state, letter);
 		Y_ASSERT(tos.size() == 1);
 		return *tos.begin();
@@ -910,8 +901,7 @@ protected:
 	{
 		size_t state_index = sc.StateIdx(state);
 		size_t transition_index = sc.TransitionIndex(state_index, letter);
-		const auto& tr = sc.m_jumps[transition_index];
-		return tr.action;
+		return sc.JumpAction(transition_index);
 	}
 };
 
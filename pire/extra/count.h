@@ -26,6 +26,8 @@
 
 #include "../scanners/loaded.h"
 #include "../fsm.h"
+#include "../glue.h"
+#include "../determine.h"
 
 #include <algorithm>
 
@@ -45,6 +47,9 @@ namespace Impl {
 	AdvancedScanner MakeAdvancedCountingScanner(const Fsm& re, const Fsm& sep, bool* simple);
 };
 
+template<class Scanner>
+class CountingSummary;
+
 template<size_t I>
 class IncrementPerformer {
 public:
@@ -149,9 +154,7 @@ public:
 
 	Action NextTranslated(State& s, Char c) const
 	{
-		Transition x = reinterpret_cast<const Transition*>(s.m_state)[c];
-		s.m_state += SignExtend(x.shift);
-		return x.action;
+		return Follow(s.m_state, c);
 	}
 
 	Action Next(State& s, Char c) const
@@ -198,8 +201,7 @@ protected:
 
 	void Next(InternalState& s, Char c) const
 	{
-		Transition x = reinterpret_cast<const Transition*>(s)[Translate(c)];
-		s += SignExtend(x.shift);
+		Follow(s, Translate(c));
 	}
 };
 
@@ -217,6 +219,9 @@ private:
 	template <class DerivedScanner, class State>
 	friend class BaseCountingScanner;
 
+	template<class Scanner>
+	friend class CountingSummary;
+
 	template<size_t I>
 	friend class IncrementPerformer;
 
@@ -344,6 +349,9 @@ private:
 	template <class DerivedScanner, class State>
 	friend class BaseCountingScanner;
 
+	template<class Scanner>
+	friend class CountingSummary;
+
 #ifdef PIRE_DEBUG
 	yostream& operator << (yostream& s, const State& state)
 		{
@@ -499,6 +507,277 @@ private:
 	friend NoGlueLimitCountingScanner Impl::MakeAdvancedCountingScanner<NoGlueLimitCountingScanner>(const Fsm&, const Fsm&, bool*);
 };
 
+/**
+ * The effect of a part of the input on a counting scanner, for each state
+ * the scanner may enter the part in, so that a large input can be split
+ * into chunks summarized independently (e.g. in separate threads).
+ * Summaries of adjacent chunks can be appended to each other in any
+ * grouping, and applying them in order to a state gives exactly
+ * what running the scanner through the whole input does.
+ *
+ * A chunk is run from all the states at once; runs entering the same
+ * state at the same position are merged, so the work is close to a single
+ * run unless runs from different states stay apart for long.
+ *
+ * For each counter, the summary of a run tells whether it is reset
+ * along the run, the number of increments before the first reset (head)
+ * and after the last one (tail), and the longest run of increments in
+ * between (mid).
+ */
+template<class Scanner>
+class CountingSummary {
+public:
+	typedef typename Scanner::State State;
+
+	/// An empty summary, which changes nothing
+	CountingSummary(): m_statesCount(0), m_regexpsCount(0), m_first(0), m_stateSize(0) {}
+
+	/// Summarizes the run through [@p begin, @p end) (as Run() does it)
+	CountingSummary(const Scanner& scanner, const char* begin, const char* end);
+
+	/// Appends the summary of the part of the input following this one
+	void Append(const CountingSummary& next);
+
+	/// Runs @p state through the summarized part of the input
+	void Apply(State& state) const;
+
+private:
+	struct Counter {
+		ui32 head;
+		ui32 mid;
+		ui32 tail;
+		/// Whether the counter is reset along the run
+		ui32 reset: 1;
+		/// Whether the total depends on the counter the run starts with
+		ui32 grows: 1;
+	};
+
+	/// Number of states summarized (zero for an empty summary)
+	size_t m_statesCount;
+	size_t m_regexpsCount;
+	/// The first state of the scanner, and the distance between adjacent ones
+	LoadedScanner::InternalState m_first;
+	size_t m_stateSize;
+	/// Index of the state the run from each state ends in
+	TVector<size_t> m_ends;
+	/// Counters of the run from each state
+	TVector<Counter> m_counters;
+
+	/// Counters start at this value in the run telling the head from the tail
+	static const ui32 Base = static_cast<ui32>(1) << 31;
+
+	static Counter Compose(const Counter& first, const Counter& second)
+	{
+		Counter c;
+		c.reset = first.reset | second.reset;
+		c.tail = second.reset ? second.tail : first.tail + second.tail;
+		// Increments of the second run which are not preceded by a reset
+		// of the first one extend the counter the first run starts with
+		const bool extends = second.grows && !first.reset;
+		c.grows = first.grows | extends;
+		c.head = ymax(first.grows ? first.head : 0, extends ? first.tail + second.head : 0);
+		c.mid = ymax(ymax(first.mid, second.mid), (second.grows && first.reset) ? first.tail + second.head : 0);
+		return c;
+	}
+
+	/// Tells the counters of a run from the states of two runs along it,
+	/// one started with all counters at Base, and the other with zero counters
+	static Counter Summarize(ui32 baseCurrent, ui32 baseTotal, ui32 zeroTotal)
+	{
+		Counter c;
+		c.reset = baseCurrent < Base;
+		c.tail = c.reset ? baseCurrent : baseCurrent - Base;
+		c.grows = baseTotal >= Base;
+		c.head = c.grows ? baseTotal - Base : 0;
+		c.mid = zeroTotal;
+		return c;
+	}
+
+	static void Restart(const Scanner& scanner, State& state, LoadedScanner::InternalState at, ui32 current)
+	{
+		scanner.Initialize(state);
+		state.m_state = at;
+		std::fill(std::begin(state.m_current), std::end(state.m_current), current);
+		for (size_t i = 0, count = std::end(state.m_current) - std::begin(state.m_current); i != count; ++i)
+			MarkUpdated(state, i, current != 0);
+	}
+
+	/// CountingState only resets counters incremented since their last reset
+	template<size_t N>
+	static void MarkUpdated(CountingState<N>& state, size_t i, bool updated)
+	{
+		const size_t bit = static_cast<size_t>(1) << (LoadedScanner::MAX_RE_COUNT + i);
+		state.m_updatedMask = updated ? (state.m_updatedMask | bit) : (state.m_updatedMask & ~bit);
+	}
+	template<class OtherState>
+	static void MarkUpdated(OtherState&, size_t, bool) {}
+};
+
+template<class Scanner>
+CountingSummary<Scanner>::CountingSummary(const Scanner& scanner, const char* begin, const char* end)
+	: m_statesCount(scanner.Size())
+	, m_regexpsCount(scanner.RegexpsCount())
+	, m_stateSize(scanner.StateSize())
+{
+	static const size_t None = static_cast<size_t>(-1);
+
+	State initial;
+	scanner.Initialize(initial);
+	m_first = initial.m_state - scanner.StateIndex(initial) * m_stateSize;
+
+	// Runs are split into segments where they merge, each segment being
+	// run twice, with counters starting at Base and at zero
+	// (only the former keeps track of the scanner state)
+	struct Run {
+		size_t segment;
+		State base;
+		State zero;
+
+		void Step(const Scanner& scanner, char ch)
+		{
+			typename Scanner::Action action = scanner.Next(base, static_cast<unsigned char>(ch));
+			scanner.TakeAction(base, action);
+			scanner.TakeAction(zero, action);
+		}
+	};
+	TVector<Run> runs(m_statesCount);
+	for (size_t i = 0; i != m_statesCount; ++i) {
+		runs[i].segment = i;
+		Restart(scanner, runs[i].base, m_first + i * m_stateSize, Base);
+		Restart(scanner, runs[i].zero, m_first + i * m_stateSize, 0);
+	}
+	// Segment following each one (segments of the run from i-th state start with the i-th one)
+	TVector<size_t> next(m_statesCount, None);
+	TVector<Counter> counters(m_statesCount * m_regexpsCount);
+	auto close = [&](const Run& run) {
+		Counter* c = &counters[run.segment * m_regexpsCount];
+		for (size_t i = 0; i != m_regexpsCount; ++i)
+			c[i] = Summarize(run.base.m_current[i], run.base.m_total[i], run.zero.m_total[i]);
+	};
+
+	// The run which entered each state at the current position,
+	// and whether it has started a new segment there
+	TVector<size_t> owners(m_statesCount);
+	TVector<size_t> stamps(m_statesCount, 0);
+	TVector<size_t> restarted(m_statesCount, 0);
+	size_t stamp = 0;
+	for (; begin != end && runs.size() > 1; ++begin) {
+		++stamp;
+		size_t live = 0;
+		for (size_t i = 0; i != runs.size(); ++i) {
+			runs[i].Step(scanner, *begin);
+			const size_t state = scanner.StateIndex(runs[i].base);
+			if (stamps[state] != stamp) {
+				stamps[state] = stamp;
+				owners[state] = live;
+				if (i != live)
+					DoSwap(runs[live], runs[i]);
+				++live;
+				continue;
+			}
+
+			// Both runs go on as a new segment of the one met first
+			Run& survivor = runs[owners[state]];
+			if (restarted[owners[state]] != stamp) {
+				restarted[owners[state]] = stamp;
+				close(survivor);
+				next[survivor.segment] = next.size();
+				survivor.segment = next.size();
+				next.push_back(None);
+				counters.resize(counters.size() + m_regexpsCount);
+				Restart(scanner, survivor.base, survivor.base.m_state, Base);
+				Restart(scanner, survivor.zero, survivor.base.m_state, 0);
+			}
+			close(runs[i]);
+			next[runs[i].segment] = survivor.segment;
+		}
+		runs.erase(runs.begin() + live, runs.end());
+	}
+	for (auto&& run : runs)
+		for (; begin != end; ++begin)
+			run.Step(scanner, *begin);
+
+	// Each run ends where its last segment does
+	TVector<size_t> ends(next.size(), None);
+	for (auto&& run : runs) {
+		close(run);
+		ends[run.segment] = scanner.StateIndex(run.base);
+	}
+	for (size_t segment = next.size(); segment--;) {
+		if (next[segment] == None)
+			continue;
+		ends[segment] = ends[next[segment]];
+		Counter* c = &counters[segment * m_regexpsCount];
+		const Counter* following = &counters[next[segment] * m_regexpsCount];
+		for (size_t i = 0; i != m_regexpsCount; ++i)
+			c[i] = Compose(c[i], following[i]);
+	}
+	ends.resize(m_statesCount);
+	counters.resize(m_statesCount * m_regexpsCount);
+	m_ends.swap(ends);
+	m_counters.swap(counters);
+}
+
+template<class Scanner>
+void CountingSummary<Scanner>::Append(const CountingSummary& next)
+{
+	if (!next.m_statesCount)
+		return;
+	if (!m_statesCount) {
+		*this = next;
+		return;
+	}
+	Y_ASSERT(m_statesCount == next.m_statesCount && m_regexpsCount == next.m_regexpsCount);
+	for (size_t state = 0; state != m_statesCount; ++state) {
+		Counter* c = &m_counters[state * m_regexpsCount];
+		const Counter* following = &next.m_counters[m_ends[state] * m_regexpsCount];
+		for (size_t i = 0; i != m_regexpsCount; ++i)
+			c[i] = Compose(c[i], following[i]);
+		m_ends[state] = next.m_ends[m_ends[state]];
+	}
+}
+
+template<class Scanner>
+void CountingSummary<Scanner>::Apply(State& state) const
+{
+	if (!m_statesCount)
+		return;
+	const size_t from = (state.m_state - m_first) / m_stateSize;
+	Y_ASSERT(from < m_statesCount);
+	state.m_state = m_first + m_ends[from] * m_stateSize;
+	const Counter* c = &m_counters[from * m_regexpsCount];
+	for (size_t i = 0; i != m_regexpsCount; ++i) {
+		const ui32 current = state.m_current[i];
+		state.m_total[i] = ymax(ymax(state.m_total[i], c[i].mid), c[i].grows ? current + c[i].head : 0);
+		state.m_current[i] = (c[i].reset ? 0 : current) + c[i].tail;
+		MarkUpdated(state, i, state.m_current[i] != 0);
+	}
+}
+
+/**
+ * Runs @p state through [@p begin, @p end) split into @p chunks parts
+ * of about the same size, which are summarized independently (see
+ * CountingSummary) and then applied in order, so the result is exactly
+ * what Run() gives.
+ *
+ * Pire starts no threads itself: the chunks are summarized by calling
+ * @p executor(n, task), which must call task(i) once for each i in [0, n),
+ * in any order and from any threads, and return once all calls are done.
+ */
+template<class Scanner, class Executor>
+void RunInChunks(const Scanner& scanner, typename Scanner::State& state, const char* begin, const char* end, size_t chunks, Executor&& executor)
+{
+	const size_t size = end - begin;
+	chunks = ymax<size_t>(ymin<size_t>(chunks, size), 1);
+	TVector<CountingSummary<Scanner>> summaries(chunks);
+	const auto task = [&](size_t i) {
+		summaries[i] = CountingSummary<Scanner>(scanner, begin + size * i / chunks, begin + size * (i + 1) / chunks);
+	};
+	executor(chunks, task);
+	for (auto&& summary : summaries)
+		summary.Apply(state);
+}
+
 }
 
 #endif
@@ -0,0 +1,297 @@
+/*
+ * fuzzy_dictionary.cpp -- building and looking up the FuzzyDictionary
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <algorithm>
+#include "fuzzy_dictionary.h"
+
+namespace Pire {
+
+namespace Impl {
+
+UniversalLevenshteinAutomaton::UniversalLevenshteinAutomaton(size_t distance)
+	: m_distance(distance)
+{
+	if (distance > MaxDistance)
+		throw Error("Distance is too large for a universal Levenshtein automaton");
+
+	const size_t band = BandSize();
+	const size_t bits = VectorBits();
+	const ui8 inf = static_cast<ui8>(distance + 1);
+
+	// A state is the band of distances, followed by the band of distances
+	// the next step can reach by a transposition (if the character read
+	// comes next in the word), all capped at inf
+	typedef TVector<ui8> Cells;
+	TMap<Cells, ui32> index;
+	TVector<Cells> states;
+	auto intern = [&](const Cells& cells) {
+		auto ins = index.insert(ymake_pair(cells, static_cast<ui32>(states.size())));
+		if (ins.second)
+			states.push_back(cells);
+		return ins.first->second;
+	};
+
+	// Initially, the i-th prefix of the word is i insertions away
+	Cells initial(2 * band, inf);
+	for (size_t b = distance; b != band; ++b)
+		initial[b] = static_cast<ui8>(b - distance);
+	intern(initial);
+
+	Cells next(2 * band);
+	for (size_t state = 0; state != states.size(); ++state) {
+		const Cells cur = states[state];
+		m_next.resize((state + 1) << bits);
+		for (ui32 vector = 0; vector != (ui32(1) << bits); ++vector) {
+			for (size_t b = 0; b != band; ++b) {
+				// Substitution or match, deletion, insertion and transposition
+				ui8 d = cur[b] + ((vector & (1 << (b + 1))) ? 0 : 1);
+				if (b + 1 != band)
+					d = std::min<ui8>(d, cur[b + 1] + 1);
+				if (b)
+					d = std::min<ui8>(d, next[b - 1] + 1);
+				if (vector & (1 << b))
+					d = std::min(d, cur[band + b]);
+				next[b] = std::min(d, inf);
+				next[band + b] = (vector & (1 << (b + 2))) ? std::min<ui8>(cur[b] + 1, inf) : inf;
+			}
+			m_next[(state << bits) | vector] = intern(next);
+		}
+	}
+
+	m_distances.resize(states.size() * band);
+	m_minimums.resize(states.size() * band);
+	for (size_t state = 0; state != states.size(); ++state) {
+		ui8 minimum = inf;
+		for (size_t b = 0; b != band; ++b) {
+			m_distances[state * band + b] = states[state][b];
+			minimum = std::min(minimum, states[state][b]);
+			m_minimums[state * band + b] = minimum;
+		}
+	}
+}
+
+}
+
+void FuzzyDictionary::Init(const TVector<ystring>& words, size_t distance)
+{
+	m_automaton = Impl::UniversalLevenshteinAutomaton(distance);
+
+	TVector<ystring> sorted(words);
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+	m_edges.assign(1, 0);
+	m_labels.clear();
+	m_targets.clear();
+	m_counts.clear();
+	m_finals.clear();
+
+	// States of the path spelling the last word added, which may still change
+	struct PathState {
+		bool final;
+		TVector< ypair<char, ui32> > edges;
+	};
+	TVector<PathState> path(1);
+	path[0].final = false;
+
+	// Equivalent states (with the same finality and edges) are shared
+	TMap<TVector<ui32>, ui32> registry;
+	TVector<ui32> signature;
+	auto freeze = [&](const PathState& state) {
+		signature.assign(1, state.final);
+		for (auto&& edge : state.edges) {
+			signature.push_back(static_cast<unsigned char>(edge.first));
+			signature.push_back(edge.second);
+		}
+		auto ins = registry.insert(ymake_pair(signature, static_cast<ui32>(m_counts.size())));
+		if (ins.second) {
+			if (m_counts.size() >= static_cast<ui32>(-1))
+				throw Error("Too many states for Pire::FuzzyDictionary");
+			ui32 count = state.final;
+			for (auto&& edge : state.edges) {
+				m_labels.push_back(edge.first);
+				m_targets.push_back(edge.second);
+				count += m_counts[edge.second];
+			}
+			m_edges.push_back(m_labels.size());
+			m_counts.push_back(count);
+			m_finals.push_back(state.final);
+		}
+		return ins.first->second;
+	};
+	// Freezes states of the path deeper than @p depth
+	auto shorten = [&](size_t depth) {
+		while (path.size() > depth + 1) {
+			ui32 frozen = freeze(path.back());
+			path.pop_back();
+			path.back().edges.back().second = frozen;
+		}
+	};
+
+	const ystring* prev = 0;
+	for (auto&& word : sorted) {
+		size_t common = 0;
+		if (prev)
+			while (common != prev->size() && common != word.size() && (*prev)[common] == word[common])
+				++common;
+		shorten(common);
+		for (size_t i = common; i != word.size(); ++i) {
+			path.back().edges.push_back(ymake_pair(word[i], static_cast<ui32>(0)));
+			path.push_back(PathState());
+			path.back().final = false;
+		}
+		path.back().final = true;
+		prev = &word;
+	}
+	shorten(0);
+	m_root = freeze(path[0]);
+}
+
+class FuzzyDictionary::Walker {
+public:
+	Walker(const FuzzyDictionary& dict, const ystring& str, size_t limit)
+		: m_dict(dict)
+		, m_automaton(dict.m_automaton)
+		, m_length(str.size())
+		, m_limit(limit)
+		, m_matches(0)
+		, m_best(NoMatch)
+	{
+		// Characteristic vectors of each character for each step
+		const size_t distance = m_automaton.Distance();
+		m_vectors.assign((m_length + distance + 1) * CharsCount, 0);
+		for (size_t depth = 0; depth != m_length + distance + 1; ++depth)
+			for (size_t bit = 0; bit != m_automaton.VectorBits(); ++bit) {
+				size_t pos = depth + bit;
+				if (pos > distance && pos - distance - 1 < m_length)
+					m_vectors[depth * CharsCount + static_cast<unsigned char>(str[pos - distance - 1])] |= 1 << bit;
+			}
+	}
+
+	void Collect(TVector<Match>& matches) { m_matches = &matches; }
+
+	size_t Best() const { return m_best; }
+
+	void Walk(ui32 state, size_t depth, ui32 position, size_t id)
+	{
+		const size_t distance = m_automaton.Distance();
+		// Further characters only move the band away from the end of the string
+		if (depth > m_length + distance)
+			return;
+		const size_t end = m_length + distance - depth;
+		if (m_automaton.MinDistance(position, std::min(end, 2 * distance)) > m_limit)
+			return;
+
+		if (m_dict.m_finals[state] && end <= 2 * distance) {
+			size_t d = m_automaton.PrefixDistance(position, end);
+			if (d <= m_limit)
+				Report(id, d);
+		}
+		if (m_dict.m_finals[state])
+			++id;
+
+		const ui32* vectors = &m_vectors[depth * CharsCount];
+		for (size_t edge = m_dict.m_edges[state], last = m_dict.m_edges[state + 1]; edge != last; ++edge) {
+			if (m_best == 0 && !m_matches)
+				return;
+			char label = m_dict.m_labels[edge];
+			ui32 target = m_dict.m_targets[edge];
+			if (m_matches)
+				m_path.push_back(label);
+			Walk(target, depth + 1, m_automaton.Next(position, vectors[static_cast<unsigned char>(label)]), id);
+			if (m_matches)
+				m_path.resize(m_path.size() - 1);
+			id += m_dict.m_counts[target];
+		}
+	}
+
+private:
+	static const size_t CharsCount = 256;
+
+	const FuzzyDictionary& m_dict;
+	const Impl::UniversalLevenshteinAutomaton& m_automaton;
+	size_t m_length;
+	size_t m_limit;
+	TVector<ui32> m_vectors;
+	TVector<Match>* m_matches;
+	ystring m_path;
+	size_t m_best;
+
+	void Report(size_t id, size_t distance)
+	{
+		if (m_matches) {
+			Match match = { id, distance, m_path };
+			m_matches->push_back(match);
+		} else if (distance) {
+			// Only closer words are of interest now
+			m_limit = distance - 1;
+		}
+		m_best = std::min(m_best, distance);
+	}
+};
+
+TVector<FuzzyDictionary::Match> FuzzyDictionary::Find(const ystring& str) const
+{
+	TVector<Match> matches;
+	Walker walker(*this, str, Distance());
+	walker.Collect(matches);
+	walker.Walk(m_root, 0, m_automaton.Initial(), 0);
+	return matches;
+}
+
+size_t FuzzyDictionary::MinDistance(const ystring& str) const
+{
+	Walker walker(*this, str, Distance());
+	walker.Walk(m_root, 0, m_automaton.Initial(), 0);
+	return walker.Best();
+}
+
+Fsm FuzzyDictionary::ToFsm() const
+{
+	// Besides the dictionary states, there is a final state reached by EndMark
+	// after a word, and a dead state taking all the missing transitions,
+	// so that the FSM is complete
+	const size_t ended = Size();
+	const size_t dead = Size() + 1;
+	Fsm fsm = Fsm::MakeFalse();
+	fsm.Resize(Size() + 2);
+	for (size_t state = 0; state != Size(); ++state) {
+		for (size_t edge = m_edges[state]; edge != m_edges[state + 1]; ++edge)
+			fsm.Connect(state, m_targets[edge], static_cast<unsigned char>(m_labels[edge]));
+		if (m_finals[state])
+			fsm.Connect(state, ended, EndMark);
+		fsm.SetFinal(state, m_finals[state]);
+	}
+	fsm.Connect(m_root, m_root, BeginMark);
+	fsm.SetFinal(ended, true);
+	fsm.SetInitial(m_root);
+	fsm.Sparse();
+	for (size_t state = 0; state != fsm.Size(); ++state)
+		for (auto&& letter : fsm.Letters())
+			if (fsm.Destinations(state, letter.first).empty())
+				fsm.Connect(state, dead, letter.first);
+	fsm.SetIsDetermined(true);
+	return fsm;
+}
+
+}
@@ -0,0 +1,157 @@
+/*
+ * fuzzy_dictionary.h -- definition of FuzzyDictionary
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_EXTRA_FUZZY_DICTIONARY_H
+#define PIRE_EXTRA_FUZZY_DICTIONARY_H
+
+
+#include "../stub/stl.h"
+#include "../stub/defaults.h"
+#include "../fsm.h"
+
+namespace Pire {
+
+namespace Impl {
+
+	/**
+	 * A universal Levenshtein automaton of a given degree k.
+	 *
+	 * It does not depend on the word it matches against: its states describe
+	 * edit distances within a band of 2k+1 positions around the diagonal
+	 * of the dynamic programming table (each capped at k+1), and its input
+	 * is a characteristic vector telling which positions of the word around
+	 * the current one hold the character read. Thus it is built once per k
+	 * and can be walked along any string, or any path in a dictionary.
+	 *
+	 * Distances allow insertions, deletions, substitutions and
+	 * transpositions of adjacent characters, as CreateApproxFsm() does.
+	 */
+	class UniversalLevenshteinAutomaton {
+	public:
+		static const size_t MaxDistance = 3;
+
+		explicit UniversalLevenshteinAutomaton(size_t distance = 0);
+
+		size_t Distance() const { return m_distance; }
+		size_t Size() const { return m_minimums.size() / BandSize(); }
+
+		/// Number of positions in the band
+		size_t BandSize() const { return 2 * m_distance + 1; }
+		/// Number of bits in a characteristic vector
+		size_t VectorBits() const { return 2 * m_distance + 3; }
+
+		static ui32 Initial() { return 0; }
+
+		/// Bit i of a characteristic vector of a character for the step reading
+		/// the n-th character of a string is set if the (n - Distance() - 1 + i)-th
+		/// character of the word is the same
+		ui32 Next(ui32 state, ui32 vector) const { return m_next[(static_cast<size_t>(state) << VectorBits()) | vector]; }
+
+		/// After reading n characters, the band of a state covers prefixes of the word
+		/// of lengths from (n - Distance()) to (n + Distance()).
+		/// Returns the distance between the string read and the @p band-th one.
+		size_t PrefixDistance(ui32 state, size_t band) const { return m_distances[state * BandSize() + band]; }
+
+		/// Returns the minimal distance between the string read and the first
+		/// @p band + 1 prefixes of the band (the string read is too far from
+		/// the word and its continuations if it exceeds Distance())
+		size_t MinDistance(ui32 state, size_t band) const { return m_minimums[state * BandSize() + band]; }
+
+	private:
+		size_t m_distance;
+		/// Transitions for each state and each characteristic vector
+		TVector<ui32> m_next;
+		/// Distances in the band of each state, and their prefix minimums
+		TVector<ui8> m_distances;
+		TVector<ui8> m_minimums;
+	};
+}
+
+/**
+ * A dictionary of words (treated as sequences of bytes), which looks up
+ * all the words within a given edit distance of a string.
+ *
+ * The words are stored as a minimal acyclic automaton (a DAWG), which is
+ * about the size of the plain word list, and looked up by walking it along
+ * with a universal Levenshtein automaton, pruning paths as soon as they
+ * are too far from the string. Unlike gluing approximate FSMs built for
+ * each word, this scales to hundreds of thousands of words.
+ */
+class FuzzyDictionary {
+public:
+	static const size_t MaxDistance = Impl::UniversalLevenshteinAutomaton::MaxDistance;
+
+	struct Match {
+		/// Index of the word in the sorted list of distinct words
+		size_t id;
+		size_t distance;
+		ystring word;
+	};
+
+	FuzzyDictionary() { Init(TVector<ystring>(), 0); }
+
+	/// Builds a dictionary of @p words, to be looked up within @p distance
+	FuzzyDictionary(const TVector<ystring>& words, size_t distance) { Init(words, distance); }
+
+	size_t Distance() const { return m_automaton.Distance(); }
+
+	/// Number of distinct words
+	size_t WordsCount() const { return m_counts.empty() ? 0 : m_counts[m_root]; }
+
+	/// Number of states in the dictionary automaton
+	size_t Size() const { return m_counts.size(); }
+
+	/// Returns all the words within Distance() of @p str, ordered by their ids
+	TVector<Match> Find(const ystring& str) const;
+
+	/// Returns the minimal distance of a word to @p str,
+	/// or NoMatch if there are no words within Distance()
+	size_t MinDistance(const ystring& str) const;
+
+	static const size_t NoMatch = static_cast<size_t>(-1);
+
+	/// Returns the dictionary automaton as a complete deterministic FSM
+	/// matching exactly the words (optionally enclosed in BeginMark and EndMark)
+	Fsm ToFsm() const;
+
+private:
+	Impl::UniversalLevenshteinAutomaton m_automaton;
+
+	ui32 m_root;
+	/// Edges of the i-th state are m_labels[m_edges[i]..m_edges[i + 1]),
+	/// leading to the corresponding m_targets
+	TVector<ui32> m_edges;
+	TVector<char> m_labels;
+	TVector<ui32> m_targets;
+	/// Number of words accepted from each state
+	TVector<ui32> m_counts;
+	TVector<bool> m_finals;
+
+	class Walker;
+
+	void Init(const TVector<ystring>& words, size_t distance);
+};
+
+}
+
+#endif
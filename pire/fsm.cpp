@@ -784,6 +784,9 @@ void Fsm::ShortCutEpsilon(size_t from, size_t thru, TVector< TSet<size_t> >& inv
 // effects from 'to' state into 'from' state
 void Fsm::RemoveEpsilons()
 {
+	// A rough estimate of a std::set node size
+	static const size_t EpsilonShortcutSize = sizeof(size_t) + 4 * sizeof(void*);
+
 	Unsparse();
 
 	// Build inverse map of epsilon transitions
@@ -796,11 +799,17 @@ void Fsm::RemoveEpsilons()
 
 	// Make a transitive closure of all epsilon transitions (Floyd-Warshall algorithm)
 	// (if there exists an epsilon-path between two states, epsilon-connect them directly)
-	for (size_t thru = 0; thru != Size(); ++thru)
+	size_t memory = MemoryUsage();
+	for (size_t thru = 0; thru != Size(); ++thru) {
 		for (auto&& from : inveps[thru])
 			// inveps[thru] may alter during loop body, hence we cannot cache ivneps[thru].end()
-			if (from != thru)
+			if (from != thru) {
+				// Each shortcut adds at most that many transitions (and as many inverse ones)
+				memory += 2 * EpsilonShortcutSize * Destinations(thru, Epsilon).size();
 				ShortCutEpsilon(from, thru, inveps);
+			}
+		Impl::CheckCompileLimits("remove epsilons", memory);
+	}
 
 	PIRE_IFDEBUG(Cdbg << "=== After epsilons shortcut\n" << *this << Endl);
 
@@ -836,12 +845,28 @@ bool Fsm::LettersEquality::operator()(Char a, Char b) const
 	return true;
 }
 
+TVector<size_t> Fsm::LettersEquality::Signatures() const
+{
+	static const size_t Multiplier = static_cast<size_t>(0x100000001B3ull);
+	TVector<size_t> signatures(MaxChar, 0);
+	for (size_t state = 0, statesCount = m_tbl->size(); state != statesCount; ++state)
+		for (auto&& transition : (*m_tbl)[state]) {
+			size_t& signature = signatures[transition.first];
+			signature = (signature ^ (state + 1)) * Multiplier;
+			for (auto&& dest : transition.second)
+				signature = (signature ^ dest) * Multiplier;
+		}
+	return signatures;
+}
+
 void Fsm::Sparse(bool needEpsilons /* = false */)
 {
 	letters = LettersTbl(LettersEquality(m_transitions));
+	// Letters with different columns in the transition table are never compared
+	TVector<size_t> signatures = LettersEquality(m_transitions).Signatures();
 	for (unsigned letter = 0; letter < MaxChar; ++letter)
 		if (letter != Epsilon || needEpsilons)
-			letters.Append(letter);
+			letters.Append(letter, signatures[letter]);
 
 	m_sparsed = true;
 	PIRE_IFDEBUG(Cdbg << "Letter classes = " << letters << Endl);
@@ -880,10 +905,23 @@ public:
 	typedef Fsm::LettersTbl LettersTbl;
 	typedef TMap<State, size_t> InvStates;
 	
-	FsmDetermineTask(const Fsm& fsm)
+	FsmDetermineTask(const Fsm& fsm, bool keepTags = false)
 		: mFsm(fsm)
 		, mTerminals(fsm.TerminalStates())
 	{
+		// A set containing a terminal state is not expanded any further,
+		// which only keeps tags if no other state could add a tag to it later
+		if (keepTags) {
+			unsigned long allTags = 0;
+			for (auto&& tag : mFsm.tags)
+				allTags |= tag.second;
+			for (auto i = mTerminals.begin(); i != mTerminals.end();) {
+				if (allTags & ~mFsm.Tag(*i))
+					mTerminals.erase(i++);
+				else
+					++i;
+			}
+		}
 		PIRE_IFDEBUG(Cdbg << "Terminal states: [" << Join(mTerminals.begin(), mTerminals.end(), ", ") << "]" << Endl);
 	}
 	const LettersTbl& Letters() const { return mFsm.letters; }
@@ -1013,7 +1051,7 @@ private:
 };
 }
 
-bool Fsm::Determine(size_t maxsize /* = 0 */)
+bool Fsm::Determine(size_t maxsize /* = 0 */, bool keepTags /* = false */)
 {
 	static const unsigned MaxSize = 200000;
 	if (determined)
@@ -1024,7 +1062,7 @@ bool Fsm::Determine(size_t maxsize /* = 0 */)
 	RemoveEpsilons();
 	PIRE_IFDEBUG(Cdbg << "=== After all epsilons removed" << Endl << *this << Endl);
 	
-	Impl::FsmDetermineTask task(*this);
+	Impl::FsmDetermineTask task(*this, keepTags);
 	if (Pire::Impl::Determine(task, maxsize ? maxsize : MaxSize)) {
 		task.Output().Swap(*this);
 		PIRE_IFDEBUG(Cdbg << "=== Determined ===" << Endl << *this << Endl);
@@ -1036,36 +1074,28 @@ bool Fsm::Determine(size_t maxsize /* = 0 */)
 namespace Impl {
 class FsmMinimizeTask {
 public:
-	explicit FsmMinimizeTask(const Fsm& fsm)
+	explicit FsmMinimizeTask(const Fsm& fsm, bool keepTags = false)
 		: mFsm(fsm)
-		, reversedTransitions(fsm.Size())
+		, representatives(fsm.Letters().Size())
 		, StateClass(fsm.Size())
 		, Classes(0)
 	{
 		Y_ASSERT(mFsm.IsDetermined());
 
-		TMap<bool, size_t> FinalStateClassMap;
+		// With keepTags, states carrying different tags are never merged
+		typedef ypair<bool, unsigned long> StateKind;
+		TMap<StateKind, size_t> FinalStateClassMap;
 
 		for (size_t state = 0; state < mFsm.Size(); ++state) {
-			reversedTransitions[state].resize(mFsm.Letters().Size());
-			if (FinalStateClassMap.find(mFsm.IsFinal(state)) == FinalStateClassMap.end()) {
-				FinalStateClassMap[mFsm.IsFinal(state)] = Classes++;
+			StateKind kind(mFsm.IsFinal(state), keepTags ? mFsm.Tag(state) : 0);
+			if (FinalStateClassMap.find(kind) == FinalStateClassMap.end()) {
+				FinalStateClassMap[kind] = Classes++;
 			}
-			StateClass[state] = FinalStateClassMap[mFsm.IsFinal(state)];
+			StateClass[state] = FinalStateClassMap[kind];
 		}
 
-		for (size_t state = 0; state < mFsm.Size(); ++state) {
-			TSet<ypair<Char, size_t>> usedTransitions;
-			for (const auto& transition : mFsm.m_transitions[state]) {
-				Y_ASSERT(transition.second.size() == 1);
-				auto destination = *transition.second.begin();
-				auto letter = mFsm.Letters().Index(transition.first);
-				if (usedTransitions.find(ymake_pair(letter, destination)) == usedTransitions.end()) {
-					usedTransitions.insert(ymake_pair(letter, destination));
-					reversedTransitions[destination][letter].push_back(state);
-				}
-			}
-		}
+		for (auto&& letter : mFsm.Letters())
+			representatives[letter.second.first] = letter.first;
 	}
 
 	TVector<size_t>& GetStateClass() { return StateClass; }
@@ -1084,8 +1114,13 @@ public:
 		return mFsm.Size();
 	}
 
-	const TVector<size_t>& Previous(size_t state, size_t letter) const {
-		return reversedTransitions[state][letter];
+	size_t Next(size_t state, size_t letter) const {
+		const auto& row = mFsm.m_transitions[state];
+		auto it = row.find(representatives[letter]);
+		if (it == row.end() || it->second.empty())
+			return Size();
+		Y_ASSERT(it->second.size() == 1);
+		return *it->second.begin();
 	}
 
 	void AcceptStates() {
@@ -1141,18 +1176,18 @@ public:
 private:
 	const Fsm& mFsm;
 	Fsm mNewFsm;
-	TVector<TVector<TVector<size_t>>> reversedTransitions;
+	TVector<Char> representatives;
 	TVector<size_t> StateClass;
 	size_t Classes;
 };
 }
 
-void Fsm::Minimize()
+void Fsm::Minimize(bool keepTags /* = false */)
 {
 	// Minimization algorithm is only applicable to a determined FSM.
 	Y_ASSERT(determined);
 
-	Impl::FsmMinimizeTask task{*this};
+	Impl::FsmMinimizeTask task{*this, keepTags};
 	if (Pire::Impl::Minimize(task)) {
 		task.Output().Swap(*this);
 	}
@@ -1168,6 +1203,27 @@ Fsm& Fsm::Canonize(size_t maxSize /* = 0 */)
 	return *this;
 }
 
+Fsm& Fsm::Canonize(size_t maxSize, const CompileContext& ctx)
+{
+	CompileContext::Scope scope(ctx);
+	return Canonize(maxSize);
+}
+
+size_t Fsm::MemoryUsage() const
+{
+	// Rough estimates of std::map and std::set node sizes
+	static const size_t TransitionSize = sizeof(TransitionRow::value_type) + 4 * sizeof(void*);
+	static const size_t DestinationSize = sizeof(size_t) + 4 * sizeof(void*);
+
+	size_t usage = sizeof(TransitionRow) * m_transitions.size();
+	for (auto&& row : m_transitions) {
+		usage += TransitionSize * row.size();
+		for (auto&& transition : row)
+			usage += DestinationSize * transition.second.size();
+	}
+	return usage;
+}
+
 void Fsm::PrependAnything()
 {
 	size_t newstate = Size();
@@ -28,6 +28,7 @@
 #include "stub/stl.h"
 #include "partition.h"
 #include "defs.h"
+#include "compile_context.h"
 
 namespace Pire {
 
@@ -114,10 +115,23 @@ namespace Pire {
 
 		/// Determines and minimizes the FSM if neccessary. Returns *this.
 		Fsm& Canonize(size_t maxSize = 0);
+		/// The same as above, but within limits of the given compile context
+		/// (throws CompileLimitError if they are exceeded).
+		Fsm& Canonize(size_t maxSize, const CompileContext& ctx);
 		
 		template<class Scanner>
 		Scanner Compile(size_t distance = 0);
 
+		template<class Scanner>
+		Scanner Compile(const CompileContext& ctx, size_t distance = 0)
+		{
+			CompileContext::Scope scope(ctx);
+			return Compile<Scanner>(distance);
+		}
+
+		/// Returns an approximate amount of memory occupied by the transition table.
+		size_t MemoryUsage() const;
+
 		void DumpState(yostream& s, size_t state) const;
 		void DumpTo(yostream& s, const ystring& name = "") const;
 
@@ -128,6 +142,9 @@ namespace Pire {
 		struct LettersEquality {
 			LettersEquality(const Fsm::TransitionTable& tbl): m_tbl(&tbl) {}
 			bool operator()(Char a, Char b) const;
+			/// Returns a hash of each letter's column in the transition table
+			/// (indexed by letter); equal letters have equal signatures.
+			TVector<size_t> Signatures() const;
 		private:
 			const Fsm::TransitionTable* m_tbl;
 		};
@@ -189,14 +206,17 @@ namespace Pire {
 		/// Breaks FSM invariant of having a single final state, so high-level FSM building
 		/// functions (i.e. Append(), operator+(), etc...) no longer can be applied to the FSM
 		/// until the invariants have been manually restored.
+		/// If @p keepTags is set, a set of states is not collapsed at a terminal
+		/// state while other states could still add tags to it.
 		/// return value: successful?
-		bool Determine(size_t maxsize = 0);
+		bool Determine(size_t maxsize = 0, bool keepTags = false);
 		bool IsDetermined() const { return determined; }
 		void SetIsDetermined(bool det) { determined = det; }
 
 		/// Minimizes amount of states in the regexp.
 		/// Requires a determined FSM.
-		void Minimize();
+		/// If @p keepTags is set, states carrying different tags are never merged.
+		void Minimize(bool keepTags = false);
 
 
 		/// Builds letters equivalence classes
@@ -251,6 +271,8 @@ namespace Pire {
 	template<class Scanner>
 	inline void BuildScanner(const Fsm& fsm, Scanner& r)
 	{
+		Impl::CheckCompileLimits("compile", fsm.Size() * fsm.Letters().Size() * sizeof(size_t));
+
 		TSet<size_t> dead;
 		if (Scanner::DeadFlag)
 			dead = fsm.DeadStates();
@@ -30,6 +30,7 @@ namespace Pire {
 	class Scanner;
 	class MultiScanner;
 	class SlowScanner;
+	class LazyScanner;
 	class CapturingScanner;
 	class CountingScanner;
 
@@ -27,6 +27,7 @@
 
 
 #include "stub/stl.h"
+#include "stub/defaults.h"
 #include "partition.h"
 
 namespace Pire {
@@ -48,13 +49,14 @@ private:
 };	
 
 // This lookup table is used instead of std::map.
-// The key idea is to specify size which is a power of 2 in order to use >> and | instead of
-// divisions and remainders.
+// It is an open addressing hash table with robin hood probing: an element being
+// inserted takes the place of any element closer to its home cell, which keeps
+// probe sequences short even at high load factors. The table doubles
+// as soon as it is 7/8 full, so it starts small and never runs out of space.
 // NB: it mimics limited std::map<> behaviour, hence stl-like method names and typedefs.
-template <size_t N, class State>
+template <class State>
 class GluedStateLookupTable {
 public:
-	static const size_t MaxSize = N;
 	typedef ypair<State, State> key_type;
 	typedef size_t mapped_type;
 	typedef ypair<key_type, mapped_type> value_type;
@@ -62,48 +64,98 @@ public:
 	typedef const value_type* const_iterator;
 
 	GluedStateLookupTable()
-		: mMap(new value_type[N])
-		, mFilled(N, false)
-	{}
-	
-	const_iterator end() const {
-		return mMap.get() + MaxSize;
+		: mSize(0)
+	{
+		Rehash(InitialCapacity);
 	}
+
+	size_t size() const { return mSize; }
+
 	// Note that in fact mMap is sparsed and traditional [begin,end)
 	// traversal is unavailable; hence no begin() method here.
 	// end() is only valid for comparing with find() result.
+	const_iterator end() const { return nullptr; }
+
 	const_iterator find(const key_type& st) const {
-		size_t ind = Search(st);
-		return mFilled[ind] ? (mMap.get() + ind) : end();
+		for (size_t ind = Hash(st) & mMask, dist = 1; mDistances[ind] >= dist; ind = (ind + 1) & mMask, ++dist)
+			if (mMap[ind].first == st)
+				return &mMap[ind];
+		return end();
 	}
 
+	// Iterators are only valid until the next insertion.
 	ypair<iterator, bool> insert(const value_type& v) {
-		size_t ind = Search(v.first);
-		if (!mFilled[ind]) {
-			mMap[ind] = v;
-			mFilled[ind] = true;
-			return ymake_pair(mMap.get() + ind, true);
-		} else
-			return ymake_pair(mMap.get() + ind, false);
+		size_t ind = Hash(v.first) & mMask;
+		size_t dist = 1;
+		for (; mDistances[ind] >= dist; ind = (ind + 1) & mMask, ++dist)
+			if (mMap[ind].first == v.first)
+				return ymake_pair(&mMap[ind], false);
+
+		if ((mSize + 1) * 8 > mMap.size() * 7) {
+			Rehash(mMap.size() * 2);
+			return ymake_pair(Place(v), true);
+		}
+		return ymake_pair(Place(v, ind, dist), true);
 	}
 
 private:
-	size_t Search(const key_type& st) const {
-		size_t startInd = (Hash(st) % N);
-		for (size_t ind = startInd; ind != (startInd + N - 1) % N; ind = (ind + 1) % N) {
-			if (!mFilled[ind] || mMap[ind].first == st) {
-				return ind;
+	static const size_t InitialCapacity = 64;
+
+	TVector<value_type> mMap;
+	// Distance from the home cell plus one; zero marks an empty cell
+	TVector<ui32> mDistances;
+	size_t mMask;
+	size_t mSize;
+
+	iterator Place(const value_type& v) {
+		size_t ind = Hash(v.first) & mMask;
+		size_t dist = 1;
+		for (; mDistances[ind] >= dist; ind = (ind + 1) & mMask)
+			++dist;
+		return Place(v, ind, dist);
+	}
+
+	// Puts @p v into cell @p ind, shifting richer elements further
+	iterator Place(const value_type& v, size_t ind, size_t dist) {
+		iterator placed = &mMap[ind];
+		value_type carried = v;
+		ui32 carriedDist = static_cast<ui32>(dist);
+		for (; mDistances[ind]; ind = (ind + 1) & mMask, ++carriedDist) {
+			if (mDistances[ind] < carriedDist) {
+				DoSwap(carried, mMap[ind]);
+				DoSwap(carriedDist, mDistances[ind]);
 			}
 		}
-		return -1;
+		mMap[ind] = carried;
+		mDistances[ind] = carriedDist;
+		++mSize;
+		return placed;
 	}
 
-	static size_t Hash(const key_type& st) {
-		return size_t((st.first >> 2) ^ (st.second >> 4) ^ (st.second << 10));
+	void Rehash(size_t capacity) {
+		TVector<value_type> map(capacity);
+		TVector<ui32> distances(capacity, 0);
+		map.swap(mMap);
+		distances.swap(mDistances);
+		mMask = capacity - 1;
+		mSize = 0;
+		for (size_t ind = 0; ind != map.size(); ++ind)
+			if (distances[ind])
+				Place(map[ind]);
 	}
 
-	std::unique_ptr<value_type[]> mMap;
-	TVector<bool> mFilled;
+	// States are usually addresses of transition rows, and thus
+	// differ in their middle bits only; mix them thoroughly
+	static size_t Hash(const key_type& st) {
+		ui64 h = static_cast<ui64>(st.first) * 0x9E3779B97F4A7C15ull;
+		h ^= static_cast<ui64>(st.second) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return static_cast<size_t>(h);
+	}
 
 	// Noncopyable
 	GluedStateLookupTable(const GluedStateLookupTable&);
@@ -124,7 +176,7 @@ public:
 		// Form a new letters partition
 		for (unsigned ch = 0; ch < MaxChar; ++ch)
 			if (ch != Epsilon)
-				m_letters.Append(ch);
+				m_letters.Append(ch, LetterSignature(ch));
 	}
 
 	const LettersTbl& Letters() const { return m_letters; }
@@ -152,6 +204,12 @@ protected:
 	void SetSc(std::unique_ptr<Scanner>&& sc) { m_result = std::move(sc); }
 
 private:
+	/// Equal letters are those mapped to the same letters by both scanners
+	size_t LetterSignature(Char ch) const
+	{
+		return (static_cast<size_t>(m_lhs.m_letters[ch]) << 16) ^ static_cast<size_t>(m_rhs.m_letters[ch]);
+	}
+
 	const Scanner& m_lhs;
 	const Scanner& m_rhs;
 	LettersTbl m_letters;
@@ -1,8 +1,11 @@
 #ifndef PIRE_MINIMIZE_H
 #define PIRE_MINIMIZE_H
 
+#include <limits>
+#include "stub/defaults.h"
 #include "stub/stl.h"
 #include "partition.h"
+#include "compile_context.h"
 
 namespace Pire {
 	namespace Impl {
@@ -37,8 +40,9 @@ namespace Pire {
 			/// Should return number of states.
 			size_t Size() const;
 
-			/// Should calculate vector of previous states by, given the current state and incoming letter class index.
-			const TVector<size_t>& Previous(size_t state, size_t letter) const;
+			/// Should return the state reached from the given one by the letter class index,
+			/// or any value not less than Size() if there is no such transition.
+			size_t Next(size_t state, size_t letter) const;
 
 			/// Called when states equivalent classes are formed, and written in StateClass.
 			void AcceptStates();
@@ -55,8 +59,104 @@ namespace Pire {
 			size_t Classes;
 		};
 
-		// Minimizes Determined FSM using Hopcroft algorithm, works in O(Size * log(Size) * MaxChar) time,
-		// requires O(Size * MaxChar * sizof(size_t)) memory.
+		/**
+		 * A partition of integers [0, size) into sets, which supports marking
+		 * elements and splitting each set into its marked and unmarked parts
+		 * in time proportional to the number of marked elements
+		 * (see A. Valmari, "Fast brief practical DFA minimization", 2012).
+		 *
+		 * Elements of each set occupy a contiguous range of m_elements,
+		 * marked ones being at the beginning of the range.
+		 */
+		class RefinablePartition {
+		public:
+			typedef ui32 Index;
+
+			/// Creates a partition with the given initial classes (numbered from 0 to classesCount - 1).
+			RefinablePartition(const TVector<size_t>& classes, size_t classesCount)
+				: m_elements(classes.size())
+				, m_location(classes.size())
+				, m_set(classes.size())
+				, m_first(ymax(classes.size(), classesCount) + 1)
+				, m_past(m_first.size())
+				, m_marked(m_first.size())
+				, m_size(classesCount)
+			{
+				for (auto&& cls : classes)
+					++m_past[cls];
+				for (size_t i = 0, first = 0; i != classesCount; ++i) {
+					m_first[i] = first;
+					first += m_past[i];
+					m_past[i] = m_first[i];
+				}
+				for (size_t e = 0; e != classes.size(); ++e) {
+					m_set[e] = classes[e];
+					m_location[e] = m_past[classes[e]]++;
+					m_elements[m_location[e]] = e;
+				}
+			}
+
+			size_t Size() const { return m_size; }
+			size_t SetOf(size_t element) const { return m_set[element]; }
+			const Index* Begin(size_t set) const { return m_elements.data() + m_first[set]; }
+			const Index* End(size_t set) const { return m_elements.data() + m_past[set]; }
+			size_t SetSize(size_t set) const { return m_past[set] - m_first[set]; }
+
+			void Mark(size_t element)
+			{
+				Index set = m_set[element];
+				Index i = m_location[element];
+				Index j = m_first[set] + m_marked[set];
+				m_elements[i] = m_elements[j];
+				m_location[m_elements[i]] = i;
+				m_elements[j] = element;
+				m_location[element] = j;
+				if (!m_marked[set]++)
+					m_touched.push_back(set);
+			}
+
+			/// Splits all sets having marked elements, and unmarks everything.
+			/// The smaller part of each set gets a new index, which is passed to @p onSplit.
+			template<class OnSplit>
+			void Split(OnSplit onSplit)
+			{
+				while (!m_touched.empty()) {
+					Index set = m_touched.back();
+					m_touched.pop_back();
+					Index boundary = m_first[set] + m_marked[set];
+					m_marked[set] = 0;
+					if (boundary == m_past[set])
+						continue;
+
+					Index newSet = m_size++;
+					if (boundary - m_first[set] <= m_past[set] - boundary) {
+						m_first[newSet] = m_first[set];
+						m_past[newSet] = m_first[set] = boundary;
+					} else {
+						m_past[newSet] = m_past[set];
+						m_first[newSet] = m_past[set] = boundary;
+					}
+					for (Index i = m_first[newSet]; i != m_past[newSet]; ++i)
+						m_set[m_elements[i]] = newSet;
+					onSplit(newSet);
+				}
+			}
+
+		private:
+			TVector<Index> m_elements;
+			TVector<Index> m_location;
+			TVector<Index> m_set;
+			TVector<Index> m_first;
+			TVector<Index> m_past;
+			TVector<Index> m_marked;
+			TVector<Index> m_touched;
+			Index m_size;
+		};
+
+		// Minimizes Determined FSM using Hopcroft's algorithm on top of a refinable partition.
+		// All letters of a splitter block are processed at once, so only blocks are queued.
+		// Works in O(Size * LettersCount * log(Size)) time and requires
+		// about 2 * Size * LettersCount + 8 * Size 32-bit integers of memory.
 		template<class Task>
 		typename Task::Result Minimize(Task& task)
 		{
@@ -65,85 +165,74 @@ namespace Pire {
 				return task.Failure();
 			}
 
-			typedef ypair<size_t, size_t> ClassLetter;
-
-			TVector<ybitset<MaxChar>> queuedClasses(task.Size());
-
-			TDeque<ClassLetter> classesToProcess;
-
-			TVector<TVector<size_t>> classStates(task.Size());
-
-			TVector<size_t>& stateClass = task.GetStateClass();
-
-			for (size_t state = 0; state < task.Size(); ++state) {
-				classStates[stateClass[state]].push_back(state);
+			typedef RefinablePartition::Index Index;
+			const size_t size = task.Size();
+			const size_t letters = task.LettersCount();
+			const size_t rows = size * letters;
+			if (rows + 1 >= std::numeric_limits<Index>::max()) {
+				return task.Failure();
 			}
 
-			for (size_t classIndex = 0; classIndex < task.GetClassesNumber(); ++classIndex) {
-				for (size_t letter = 0; letter < task.LettersCount(); ++letter) {
-					classesToProcess.push_back(ymake_pair(classIndex, letter));
-					queuedClasses[classIndex][letter] = 1;
-				}
-			}
+			CheckCompileLimits("minimize", sizeof(Index) * (2 * rows + 8 * size));
 
-			TVector<size_t> classChange(task.Size());
-			TVector<TVector<size_t>> removedStates(task.Size());
-
-			while (classesToProcess.size()) {
-				const auto currentClass = classesToProcess.front().first;
-				const auto currentLetter = classesToProcess.front().second;
-				classesToProcess.pop_front();
-				queuedClasses[currentClass][currentLetter] = 0;
-				TVector<size_t> splittedClasses;
-
-				for (const auto& classState : classStates[currentClass]) {
-					for (const auto& state: task.Previous(classState, currentLetter)) {
-						if (classChange[stateClass[state]] != task.GetClassesNumber()) {
-							classChange[stateClass[state]] = task.GetClassesNumber();
-							splittedClasses.push_back(stateClass[state]);
-						}
-						removedStates[stateClass[state]].push_back(state);
-					}
+			// Sources of transitions to state s by letter l are
+			// inverse[offsets[s * letters + l] .. offsets[s * letters + l + 1])
+			TVector<Index> offsets(rows + 1, 0);
+			for (size_t state = 0; state != size; ++state)
+				for (size_t letter = 0; letter != letters; ++letter) {
+					size_t next = task.Next(state, letter);
+					if (next < size)
+						++offsets[next * letters + letter + 1];
 				}
-
-
-				for (const auto& splittedClass : splittedClasses) {
-					if (removedStates[splittedClass].size() == classStates[splittedClass].size()) {
-						classChange[splittedClass] = 0;
-						removedStates[splittedClass].clear();
-						continue;
-					}
-
-					const auto newClass = task.GetClassesNumber()++;
-					classChange[splittedClass] = newClass;
-					std::swap(classStates[newClass], removedStates[splittedClass]);
-					for (const auto& state : classStates[newClass]) {
-						stateClass[state] = newClass;
+			for (size_t i = 0; i != rows; ++i)
+				offsets[i + 1] += offsets[i];
+			TVector<Index> inverse(offsets[rows]);
+			{
+				TVector<Index> fill(offsets.begin(), offsets.end() - 1);
+				for (size_t state = 0; state != size; ++state)
+					for (size_t letter = 0; letter != letters; ++letter) {
+						size_t next = task.Next(state, letter);
+						if (next < size)
+							inverse[fill[next * letters + letter]++] = state;
 					}
+			}
 
-					auto iter = classStates[splittedClass].begin();
-					for (const auto state : classStates[splittedClass]) {
-						if (stateClass[state] == splittedClass) {
-							*iter = state;
-							++iter;
-						}
-					}
-					classStates[splittedClass].erase(iter, classStates[splittedClass].end());
-
-					for (size_t letter = 0; letter < task.LettersCount(); ++letter) {
-						if (queuedClasses[splittedClass][letter]
-							|| classStates[splittedClass].size() > classStates[newClass].size()) {
-
-							queuedClasses[newClass][letter] = 1;
-							classesToProcess.push_back(ymake_pair(newClass, letter));
-						} else {
-							queuedClasses[splittedClass][letter] = 1;
-							classesToProcess.push_back(ymake_pair(splittedClass, letter));
-						}
+			TVector<size_t>& stateClass = task.GetStateClass();
+			RefinablePartition blocks(stateClass, task.GetClassesNumber());
+
+			// Some transitions may be missing, so all the initial blocks are needed
+			// as splitters (skipping one is only correct for a complete FSM).
+			TVector<Index> blocksToProcess;
+			for (size_t block = 0; block != blocks.Size(); ++block)
+				blocksToProcess.push_back(block);
+
+			// Each time a block is split, its smaller part gets a new index. If the block has
+			// already been processed, it's enough to process the smaller part; otherwise
+			// the block remains queued under its old index. Either way, queueing the new index suffices.
+			auto queueBlock = [&blocksToProcess](Index block) { blocksToProcess.push_back(block); };
+
+			TVector<Index> splitter;
+			while (!blocksToProcess.empty()) {
+				CheckCompileLimits("minimize");
+				Index block = blocksToProcess.back();
+				blocksToProcess.pop_back();
+				// The block itself may be split while being processed
+				splitter.assign(blocks.Begin(block), blocks.End(block));
+
+				for (size_t letter = 0; letter != letters; ++letter) {
+					for (auto&& state : splitter) {
+						const size_t row = state * letters + letter;
+						for (Index i = offsets[row]; i != offsets[row + 1]; ++i)
+							blocks.Mark(inverse[i]);
 					}
+					blocks.Split(queueBlock);
 				}
 			}
 
+			for (size_t state = 0; state != size; ++state)
+				stateClass[state] = blocks.SetOf(state);
+			task.GetClassesNumber() = blocks.Size();
+
 			task.AcceptStates();
 			return task.Success();
 		}
@@ -51,6 +51,28 @@ public:
 		DoAppend(m_set, t);
 	}
 
+	/// Does the same as Append(t), but only compares @p t against those classes
+	/// whose items have the same @p signature. Equivalent items must have equal
+	/// signatures. The resulting partition is exactly the one that Append(t)
+	/// would build, provided that all items are appended with their signatures.
+	void Append(const T& t, size_t signature)
+	{
+		TVector<T>& candidates = m_signatures[signature];
+		for (auto&& representative : candidates)
+			if (m_eq(representative, t)) {
+				auto it = m_set.find(representative);
+				Y_ASSERT(it != m_set.end());
+				it->second.second.push_back(t);
+				m_inv[t] = representative;
+				return;
+			}
+
+		// Begin new set
+		candidates.push_back(t);
+		m_set.insert(ymake_pair(t, ymake_pair(m_maxidx++, TVector<T>(1, t))));
+		m_inv[t] = t;
+	}
+
 	typedef typename Set::const_iterator ConstIterator;
 
 	ConstIterator Begin() const {
@@ -120,9 +142,12 @@ public:
 	/// Requires given relation imply previous one (set either in ctor or
 	/// in preceeding calls to split()), but performs faster.
 	/// Replaces previous relation with given one.
+	/// Signatures stay valid, so items can still be appended with them.
 	void Split(const Eq& eq)
 	{
 		m_eq = eq;
+		// Representatives of the new classes, by those they were split from
+		TMap<T, TVector<T>> splitOff;
 
 		for (auto&& element : m_set)
 			if (element.second.second.size() > 1) {
@@ -136,8 +161,21 @@ public:
 					DoAppend(delta, *it);
 
 				v.erase(bound, v.end());
+				if (!m_signatures.empty())
+					for (auto&& klass : delta)
+						splitOff[element.first].push_back(klass.first);
 				m_set.insert(delta.begin(), delta.end());
 			}
+
+		// A new class has the signature of the one it was split from
+		for (auto&& signature : m_signatures) {
+			TVector<T>& representatives = signature.second;
+			for (size_t i = 0, size = representatives.size(); i != size; ++i) {
+				auto it = splitOff.find(representatives[i]);
+				if (it != splitOff.end())
+					representatives.insert(representatives.end(), it->second.begin(), it->second.end());
+			}
+		}
 	}
 
 private:
@@ -145,6 +183,8 @@ private:
 	Set m_set;
 	TMap<T, T> m_inv;
 	size_t m_maxidx;
+	/// Class representatives, grouped by signatures of their items
+	TMap<size_t, TVector<T>> m_signatures;
 
 	void DoAppend(Set& set, const T& t)
 	{
@@ -29,11 +29,18 @@
 #include "fsm.h"
 #include "encoding.h"
 #include "run.h"
+#include "compile_cache.h"
+#include "direct_code.h"
 
 #include "scanners/multi.h"
 #include "scanners/half_final.h"
 #include "scanners/simple.h"
 #include "scanners/slow.h"
+#include "scanners/lazy.h"
+#include "scanners/bitparallel.h"
+#include "scanners/approx_literal.h"
 #include "scanners/pair.h"
+#include "scanners/tuple.h"
+#include "scanners/set.h"
 
 #endif
@@ -221,6 +221,32 @@ inline Word Or(Word mask1, Word mask2) { return AvailInstructionSet::Or(mask1, m
 
 inline bool IsAnySet(Word mask) { return AvailInstructionSet::IsAnySet(mask); }
 
+/// Index of the lowest bit set in a nonzero @p word
+inline size_t LowestBit(ui64 word)
+{
+#ifdef __GNUC__
+	return static_cast<size_t>(__builtin_ctzll(word));
+#else
+	size_t bit = 0;
+	for (; !(word & 1); word >>= 1)
+		++bit;
+	return bit;
+#endif
+}
+
+/// Number of bits set in @p word
+inline size_t PopCount(ui64 word)
+{
+#ifdef __GNUC__
+	return static_cast<size_t>(__builtin_popcountll(word));
+#else
+	size_t count = 0;
+	for (; word; word &= word - 1)
+		++count;
+	return count;
+#endif
+}
+
 // MaxSizeWord type is largest integer type supported by the plaform including
 // all possible SSE extensions that are are known for this platform (even if these
 // extensions are not available at compile time)
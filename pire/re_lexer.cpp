@@ -378,7 +378,17 @@ void Lexer::InstallDefaultFeatures()
 
 Fsm Lexer::Parse()
 {
-	if (!Impl::yre_parse(*this))
+	Impl::CheckCompileLimits("parse");
+	m_actionError = nullptr;
+	int rc = 0;
+	try {
+		rc = Impl::yre_parse(*this);
+	} catch (Pire::Error&) {
+		if (m_actionError)
+			std::rethrow_exception(m_actionError);
+		throw;
+	}
+	if (!rc)
 		return m_retval.As<Fsm>();
 	else {
 		Error("Syntax error in regexp");
@@ -386,4 +396,10 @@ Fsm Lexer::Parse()
 	}
 }
 
+Fsm Lexer::Parse(const CompileContext& ctx)
+{
+	CompileContext::Scope scope(ctx);
+	return Parse();
+}
+
 }
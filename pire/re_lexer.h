@@ -27,6 +27,7 @@
 
 #include "encoding.h"
 #include "any.h"
+#include "compile_context.h"
 #include "stub/defaults.h"
 #include "stub/stl.h"
 #include <vector>
@@ -34,6 +35,7 @@
 #include <set>
 #include <utility>
 #include <stdexcept>
+#include <exception>
 #include <utility>
 #include <string.h>
 
@@ -151,10 +153,16 @@ public:
 	void SetErrMsg(const char* msg) { m_errmsg = msg; }
 	void SetErrMsg(ystring msg) { m_errmsg = msg; }
 	ystring& ErrMsg() { return m_errmsg; }
+	/// Records an error raised inside a parser action; Parse() rethrows it
+	/// once the parser has released the values on its stack.
+	void SetActionError(std::exception_ptr e) { m_actionError = e; }
 
 	Any& Retval() { return m_retval; }
 
 	Fsm Parse();
+	/// Parses the pattern within limits of the given compile context
+	/// (throws CompileLimitError if they are exceeded).
+	Fsm Parse(const CompileContext& ctx);
 
 	void Parenthesized(Fsm& fsm);
 
@@ -174,6 +182,7 @@ private:
 	TVector<std::unique_ptr<Feature>> m_features;
 	Any m_retval;
 	ystring m_errmsg;
+	std::exception_ptr m_actionError;
 
 	friend class Feature;
 
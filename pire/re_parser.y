@@ -35,6 +35,8 @@
 #endif
 
 #include <stdexcept>
+#include <exception>
+#include <memory>
 
 #include "fsm.h"
 #include "re_lexer.h"
@@ -57,6 +59,11 @@ void yyerror(Pire::Lexer&, const char*);
 Fsm& ConvertToFSM(const Encoding& encoding, Any* any);
 void AppendRange(const Encoding& encoding, Fsm& a, const Term::CharacterRange& cr);
 
+// Errors must not propagate through yyparse(), otherwise values on the parser
+// stack would leak. Actions catch them, release their own values, record
+// the error in the lexer and abort; Lexer::Parse() rethrows it afterwards.
+#define YRE_ABORT_ACTION(e) do { rlex.SetActionError(std::current_exception()); rlex.SetErrMsg((e).what()); YYABORT; } while (0)
+
 #ifdef YYBYACC
 #define YYPARSE_PARAM ,Pire::Lexer& rlex /* Yes, the leading comma is really needed here */
 #define YYLEX_PARAM rlex
@@ -82,7 +89,12 @@ void AppendRange(const Encoding& encoding, Fsm& a, const Term::CharacterRange& c
 regexp
 	: alternative
 		{
-			ConvertToFSM(rlex.Encoding(), $1);
+			try {
+				ConvertToFSM(rlex.Encoding(), $1);
+			} catch (Pire::Error& e) {
+				delete $1;
+				YRE_ABORT_ACTION(e);
+			}
 			DoSwap(rlex.Retval(), *$1);
 			delete $1;
 			$$ = nullptr;
@@ -91,30 +103,77 @@ regexp
 
 alternative
 	: conjunction
-	| alternative '|' conjunction { ConvertToFSM(rlex.Encoding(), ($$ = $1)) |= ConvertToFSM(rlex.Encoding(), $3); delete $2; delete $3; }
+	| alternative '|' conjunction
+		{
+			try {
+				ConvertToFSM(rlex.Encoding(), $1) |= ConvertToFSM(rlex.Encoding(), $3);
+			} catch (Pire::Error& e) {
+				delete $1;
+				delete $2;
+				delete $3;
+				YRE_ABORT_ACTION(e);
+			}
+			$$ = $1;
+			delete $2;
+			delete $3;
+		}
 	;
 
 conjunction
 	: negation
-	| conjunction YRE_AND negation { ConvertToFSM(rlex.Encoding(), ($$ = $1)) &= ConvertToFSM(rlex.Encoding(), $3); delete $2; delete $3; }
+	| conjunction YRE_AND negation
+		{
+			try {
+				Fsm& a = ConvertToFSM(rlex.Encoding(), $1);
+				a &= ConvertToFSM(rlex.Encoding(), $3);
+				Impl::CheckCompileLimits("parse", a.MemoryUsage());
+			} catch (Pire::Error& e) {
+				delete $1;
+				delete $2;
+				delete $3;
+				YRE_ABORT_ACTION(e);
+			}
+			$$ = $1;
+			delete $2;
+			delete $3;
+		}
 	;
 
 negation
 	: concatenation
-	| YRE_NOT concatenation { ConvertToFSM(rlex.Encoding(), ($$ = $2)).Complement(); delete $1; }
+	| YRE_NOT concatenation
+		{
+			try {
+				ConvertToFSM(rlex.Encoding(), $2).Complement();
+			} catch (Pire::Error& e) {
+				delete $1;
+				delete $2;
+				YRE_ABORT_ACTION(e);
+			}
+			$$ = $2;
+			delete $1;
+		}
 	;
 
 concatenation
 	: { $$ = new Any(Fsm()); }
 	| concatenation iteration
 		{
-			Fsm& a = ConvertToFSM(rlex.Encoding(), ($$ = $1));
-			if ($2->IsA<Term::CharacterRange>() && !$2->As<Term::CharacterRange>().second)
-				AppendRange(rlex.Encoding(), a, $2->As<Term::CharacterRange>());
-			else if ($2->IsA<Term::DotTag>())
-				rlex.Encoding().AppendDot(a);
-			else
-				a += ConvertToFSM(rlex.Encoding(), $2);
+			try {
+				Impl::CheckCompileLimits("parse");
+				Fsm& a = ConvertToFSM(rlex.Encoding(), $1);
+				if ($2->IsA<Term::CharacterRange>() && !$2->As<Term::CharacterRange>().second)
+					AppendRange(rlex.Encoding(), a, $2->As<Term::CharacterRange>());
+				else if ($2->IsA<Term::DotTag>())
+					rlex.Encoding().AppendDot(a);
+				else
+					a += ConvertToFSM(rlex.Encoding(), $2);
+			} catch (Pire::Error& e) {
+				delete $1;
+				delete $2;
+				YRE_ABORT_ACTION(e);
+			}
+			$$ = $1;
 			delete $2;
 		}
 	;
@@ -123,28 +182,38 @@ iteration
 	: term
 	| term YRE_COUNT
 		{
-			Fsm& orig = ConvertToFSM(rlex.Encoding(), $1);
-			$$ = new Any(orig);
-			Fsm& cur = $$->As<Fsm>();
-			const Term::RepetitionCount& repc = $2->As<Term::RepetitionCount>();
-
-
-			if (repc.first == 0 && repc.second == 1) {
-				Fsm empty;
-				cur |= empty;
-			} else if (repc.first == 0 && repc.second == Inf) {
-				cur.Iterate();
-			} else if (repc.first == 1 && repc.second == Inf) {
-				cur += *cur;
-			} else {
-				cur *= repc.first;
-				if (repc.second == Inf) {
-					cur += *orig;
-				} else if (repc.second != repc.first) {
-					cur += (orig | Fsm()) * (repc.second - repc.first);
+			try {
+				Fsm& orig = ConvertToFSM(rlex.Encoding(), $1);
+				const Term::RepetitionCount& repc = $2->As<Term::RepetitionCount>();
+				// Each repetition makes another copy of the FSM
+				size_t copies = static_cast<size_t>(repc.second == Inf ? repc.first + 1 : repc.second) + 1;
+				Impl::CheckCompileLimits("parse", orig.MemoryUsage() * copies);
+
+				std::unique_ptr<Any> ret(new Any(orig));
+				Fsm& cur = ret->As<Fsm>();
+
+				if (repc.first == 0 && repc.second == 1) {
+					Fsm empty;
+					cur |= empty;
+				} else if (repc.first == 0 && repc.second == Inf) {
+					cur.Iterate();
+				} else if (repc.first == 1 && repc.second == Inf) {
+					cur += *cur;
+				} else {
+					cur *= repc.first;
+					if (repc.second == Inf) {
+						cur += *orig;
+					} else if (repc.second != repc.first) {
+						cur += (orig | Fsm()) * (repc.second - repc.first);
+					}
 				}
+				rlex.Parenthesized(cur);
+				$$ = ret.release();
+			} catch (Pire::Error& e) {
+				delete $1;
+				delete $2;
+				YRE_ABORT_ACTION(e);
 			}
-			rlex.Parenthesized($$->As<Fsm>());
 			delete $1;
 			delete $2;
 		}
@@ -155,7 +224,20 @@ term
 	| YRE_DOT
 	| '^'
 	| '$'
-	| '(' alternative ')'      { $$ = $2; rlex.Parenthesized($$->As<Fsm>()); delete $1; delete $3; }
+	| '(' alternative ')'
+		{
+			try {
+				rlex.Parenthesized($2->As<Fsm>());
+			} catch (Pire::Error& e) {
+				delete $1;
+				delete $2;
+				delete $3;
+				YRE_ABORT_ACTION(e);
+			}
+			$$ = $2;
+			delete $1;
+			delete $3;
+		}
 	;
 
 %%
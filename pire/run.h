@@ -99,6 +99,23 @@ namespace Impl {
 		const char** m_pos;
 	};
 
+	template<class Scanner>
+	struct DecidedPred {
+		explicit DecidedPred(const char*& pos): m_pos(&pos) {}
+
+		PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+		Action operator()(const Scanner& sc, const typename Scanner::State& st, const char* pos) const
+		{
+			if (sc.Decided(st)) {
+				*m_pos = pos;
+				return Stop;
+			} else
+				return Continue;
+		}
+	private:
+		const char** m_pos;
+	};
+
 }
 
 #ifndef PIRE_DEBUG
@@ -274,6 +291,19 @@ void Run(const Scanner& sc, typename Scanner::State& st, const char* begin, cons
 	Impl::DoRun(sc, st, begin, end, Impl::RunPred<Scanner>());
 }
 
+/// The same as Run(), but stops as soon as the scanner reaches a state which
+/// decides the regexps accepted (see Scanner::Decided()), so that the rest
+/// of the input cannot change them. Returns the position it stopped at.
+template<class Scanner>
+const char* RunUntilDecided(const Scanner& sc, typename Scanner::State& st, const char* begin, const char* end)
+{
+	if (sc.Decided(st))
+		return begin;
+	const char* pos = end;
+	Impl::DoRun(sc, st, begin, end, Impl::DecidedPred<Scanner>(pos));
+	return pos;
+}
+
 template<class Scanner>
 const char* LongestPrefix(const Scanner& sc, const char* begin, const char* end, bool throughBeginMark = false, bool throughEndMark = false)
 {
@@ -76,95 +76,27 @@ void SlowScanner::Save(yostream* s) const
 	Impl::AlignSave(s, sizeof(m));
 	SavePodType(s, Empty());
 	Impl::AlignSave(s, sizeof(Empty()));
-	if (!Empty()) {
-		Y_ASSERT(!m_vec.empty());
-		Impl::AlignedSaveArray(s, m_letters, MaxChar);
-		Impl::AlignedSaveArray(s, m_finals, m.statesCount);
-
-		size_t c = 0;
-		SavePodType<size_t>(s, 0);
-		for (auto&& i : m_vec) {
-			size_t n = c + i.size();
-			SavePodType(s, n);
-			c = n;
-		}
-		Impl::AlignSave(s, (m_vec.size() + 1) * sizeof(size_t));
-
-		size_t size = 0;
-		for (auto&& i : m_vec)
-			if (!i.empty()) {
-				SavePodArray(s, &(i)[0], i.size());
-				size += sizeof(unsigned) * i.size();
-			}
-		Impl::AlignSave(s, size);
-		if (need_actions) {
-			size_t pos = 0;
-			for (TVector< TVector< Action > >::const_iterator i = m_actionsvec.begin(), ie = m_actionsvec.end(); i != ie; ++i)
-				if (!i->empty()) {
-					SavePodArray(s, &(*i)[0], i->size());
-					pos += sizeof(Action) * i->size();
-				}
-			Impl::AlignSave(s, pos);
-		}
-	}
+	if (!Empty())
+		// In-memory and mmap()-ed scanners share the layout, so the tables are saved as is
+		Impl::AlignedSaveArray(s, reinterpret_cast<const char*>(m_letters), BufSize());
 }
 
 void SlowScanner::Load(yistream* s)
 {
-	SlowScanner sc;
+	SlowScanner sc(need_actions);
 	Impl::ValidateHeader(s, ScannerIOTypes::SlowScanner, sizeof(sc.m));
 	LoadPodType(s, sc.m);
 	Impl::AlignLoad(s, sizeof(sc.m));
 	bool empty;
 	LoadPodType(s, empty);
 	Impl::AlignLoad(s, sizeof(empty));
-	sc.need_actions = need_actions;
 	if (empty) {
 		sc.Alias(Null());
 	} else {
-		sc.m_vec.resize(sc.m.lettersCount * sc.m.statesCount);
-		if (sc.need_actions)
-			sc.m_actionsvec.resize(sc.m.lettersCount * sc.m.statesCount);
-		sc.m_vecptr = &sc.m_vec;
-
-		sc.alloc(sc.m_letters, MaxChar);
-		Impl::AlignedLoadArray(s, sc.m_letters, MaxChar);
-
-		sc.alloc(sc.m_finals, sc.m.statesCount);
-		Impl::AlignedLoadArray(s, sc.m_finals, sc.m.statesCount);
-
-		size_t c;
-		LoadPodType(s, c);
-		auto act = sc.m_actionsvec.begin();
-		for (auto&& i : sc.m_vec) {
-			size_t n;
-			LoadPodType(s, n);
-			i.resize(n - c);
-			if (sc.need_actions) {
-				act->resize(n - c);
-				++act;
-			}
-			c = n;
-		}
-		Impl::AlignLoad(s, (m_vec.size() + 1) * sizeof(size_t));
-
-		size_t size = 0;
-		for (auto&& i : sc.m_vec)
-			if (!i.empty()) {
-				LoadPodArray(s, &(i)[0], i.size());
-				size += sizeof(unsigned) * i.size();
-			}
-		Impl::AlignLoad(s, size);
-		size_t actSize = 0;
-		if (sc.need_actions) {
-			for (auto&& i : sc.m_actionsvec) {
-				if (!i.empty()) {
-					LoadPodArray(s, &(i)[0], i.size());
-					actSize += sizeof(Action) * i.size();
-				}
-			}
-			Impl::AlignLoad(s, actSize);
-		}
+		sc.CheckActions();
+		sc.m_buffer = BufferType(new char[sc.BufSize()]);
+		Impl::AlignedLoadArray(s, sc.m_buffer.get(), sc.BufSize());
+		sc.Markup(sc.m_buffer.get());
 	}
 	Swap(sc);
 }
@@ -175,8 +107,11 @@ void LoadedScanner::Save(yostream* s) const {
 
 void LoadedScanner::Save(yostream* s, ui32 type) const
 {
-	Y_ASSERT(type == ScannerIOTypes::LoadedScanner || type == ScannerIOTypes::NoGlueLimitCountingScanner);
-	SavePodType(s, Header(type, sizeof(m)));
+	Y_ASSERT(type == ScannerIOTypes::LoadedScanner || type == ScannerIOTypes::NoGlueLimitCountingScanner || type == ScannerIOTypes::TaggedCapturingScanner || type == ScannerIOTypes::MultiCapturingScanner);
+	Header header(type, sizeof(m));
+	if (CompactTransitions())
+		header.Version |= Header::COMPACT_TRANSITIONS;
+	SavePodType(s, header);
 	Impl::AlignSave(s, sizeof(Header));
 	Locals mc = m;
 	mc.initial -= reinterpret_cast<size_t>(m_jumps);
@@ -186,6 +121,10 @@ void LoadedScanner::Save(yostream* s, ui32 type) const
 	Impl::AlignedSaveArray(s, m_letters, MaxChar);	
 	Impl::AlignedSaveArray(s, m_jumps, m.statesCount * m.lettersCount);	
 	Impl::AlignedSaveArray(s, m_tags, m.statesCount);
+#ifdef PIRE_COMPACT_TRANSITIONS
+	SavePodType(s, m_actionJumpsCount);
+	Impl::AlignedSaveArray(s, m_actionJumps, m_actionJumpsCount);
+#endif
 }
 
 void LoadedScanner::Load(yistream* s) {
@@ -204,12 +143,68 @@ void LoadedScanner::Load(yistream* s, ui32* type)
 	sc.m_buffer = BufferType(new char[sc.BufSize()]);
 	sc.Markup(sc.m_buffer.get());
 	Impl::AlignedLoadArray(s, sc.m_letters, MaxChar);
-	Impl::AlignedLoadArray(s, sc.m_jumps, sc.m.statesCount * sc.m.lettersCount);
-	if (header.Version == Header::RE_VERSION_WITH_MACTIONS) {
-		TVector<Action> actions(sc.m.statesCount * sc.m.lettersCount);
-		Impl::AlignedLoadArray(s, actions.data(), actions.size());
+
+	const size_t jumpsCount = sc.m.statesCount * sc.m.lettersCount;
+	if (header.CompactTransitions() == CompactTransitions()) {
+		Impl::AlignedLoadArray(s, sc.m_jumps, jumpsCount);
+		if (header.Version == Header::RE_VERSION_WITH_MACTIONS) {
+			TVector<Action> actions(jumpsCount);
+			Impl::AlignedLoadArray(s, actions.data(), actions.size());
+		}
+		Impl::AlignedLoadArray(s, sc.m_tags, sc.m.statesCount);
+#ifdef PIRE_COMPACT_TRANSITIONS
+		LoadPodType(s, sc.m_actionJumpsCount);
+		sc.m_actionJumpsBuffer.resize(sc.m_actionJumpsCount);
+		Impl::AlignedLoadArray(s, sc.m_actionJumpsBuffer.data(), sc.m_actionJumpsCount);
+		sc.m_actionJumps = sc.m_actionJumpsBuffer.data();
+#endif
+		sc.m.initial += reinterpret_cast<size_t>(sc.m_jumps);
+		Swap(sc);
+		return;
+	}
+
+	// The scanner was saved with another layout of transitions,
+	// so they are rebuilt one by one
+	TVector<ui32> shifts(jumpsCount);
+	TVector<Action> actions(jumpsCount, 0);
+	size_t cellSize;
+	if (header.CompactTransitions()) {
+		cellSize = sizeof(ui32);
+		Impl::AlignedLoadArray(s, shifts.data(), jumpsCount);
+		Impl::AlignedLoadArray(s, sc.m_tags, sc.m.statesCount);
+		size_t count;
+		LoadPodType(s, count);
+		TVector<Transition> actionJumps(count);
+		Impl::AlignedLoadArray(s, actionJumps.data(), count);
+		for (size_t i = 0; i != jumpsCount; ++i) {
+			if (shifts[i] & 1) {
+				if ((shifts[i] >> 1) >= count)
+					throw Error("Serialized regexp is corrupted");
+				actions[i] = actionJumps[shifts[i] >> 1].action;
+				shifts[i] = actionJumps[shifts[i] >> 1].shift;
+			}
+		}
+	} else {
+		cellSize = sizeof(Transition);
+		TVector<Transition> jumps(jumpsCount);
+		Impl::AlignedLoadArray(s, jumps.data(), jumpsCount);
+		if (header.Version == Header::RE_VERSION_WITH_MACTIONS) {
+			TVector<Action> ignored(jumpsCount);
+			Impl::AlignedLoadArray(s, ignored.data(), ignored.size());
+		}
+		Impl::AlignedLoadArray(s, sc.m_tags, sc.m.statesCount);
+		for (size_t i = 0; i != jumpsCount; ++i) {
+			shifts[i] = jumps[i].shift;
+			actions[i] = jumps[i].action;
+		}
 	}
-	Impl::AlignedLoadArray(s, sc.m_tags, sc.m.statesCount);
+
+	const i64 savedStateSize = sc.m.lettersCount * cellSize;
+	memset(sc.m_jumps, 0, jumpsCount * sizeof(*sc.m_jumps));
+	for (size_t i = 0; i != jumpsCount; ++i)
+		sc.SetJump(i, i / sc.m.lettersCount + SignExtend(shifts[i]) / savedStateSize, actions[i]);
+	if (savedStateSize)
+		sc.m.initial = sc.m.initial / savedStateSize * sc.StateSize();
 	sc.m.initial += reinterpret_cast<size_t>(sc.m_jumps);
 	Swap(sc);
 }
@@ -0,0 +1,102 @@
+/*
+ * approx_literal.cpp -- recognition of literal patterns for ApproxLiteralScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include "approx_literal.h"
+
+namespace Pire {
+
+namespace Impl {
+
+namespace {
+	/// Whether @p state loops by any input character (as Fsm::Surround() makes it),
+	/// leading nowhere else by them
+	bool LoopsByAnything(const Fsm& fsm, size_t state)
+	{
+		for (Char ch = 0; ch != MaxCharUnaligned; ++ch) {
+			if (ch >= 256 && ch != BeginMark && ch != EndMark)
+				continue;
+			const Fsm::StatesSet& dests = fsm.Destinations(state, ch);
+			if (dests.size() != 1 || *dests.begin() != state)
+				return false;
+		}
+		return true;
+	}
+}
+
+bool BuildLiteralChain(const Fsm& fsm, size_t maxLength, LiteralChain& chain)
+{
+	chain = LiteralChain();
+	size_t state = fsm.Initial();
+
+	// A surrounded pattern starts with a state looping by anything
+	// and having an epsilon transition to the rest of the pattern
+	if (LoopsByAnything(fsm, state)) {
+		if (fsm.IsFinal(state))
+			return false;
+		Fsm::StatesSet next = fsm.Destinations(state, Epsilon);
+		next.erase(state);
+		if (next.size() != 1)
+			return false;
+		chain.anyPrefix = true;
+		state = *next.begin();
+	}
+
+	// Each state of the chain has a single destination, which it leads to
+	// by any of its letters, and the last one is final
+	TSet<size_t> visited;
+	for (;;) {
+		if (!visited.insert(state).second || chain.classes.size() > maxLength)
+			return false;
+		TSet<Char> letters = fsm.OutgoingLetters(state);
+		if (letters.empty())
+			return fsm.IsFinal(state) && !chain.classes.empty();
+		if (fsm.IsFinal(state))
+			return false;
+
+		size_t next = 0;
+		for (auto&& letter : letters) {
+			const Fsm::StatesSet& dests = fsm.Destinations(state, letter);
+			if (dests.size() != 1 || (letter != *letters.begin() && *dests.begin() != next))
+				return false;
+			next = *dests.begin();
+		}
+
+		if (letters.count(Epsilon)) {
+			// The only epsilon transition allowed is the one to a final
+			// state looping by anything, as Fsm::Surround() makes it
+			chain.anySuffix = true;
+			Fsm::StatesSet further = fsm.Destinations(next, Epsilon);
+			further.erase(next);
+			return letters.size() == 1 && next != state && fsm.IsFinal(next)
+				&& LoopsByAnything(fsm, next) && further.empty() && !chain.classes.empty();
+		}
+		if (next == state)
+			return false;
+		chain.classes.push_back(TVector<Char>(letters.begin(), letters.end()));
+		state = next;
+	}
+}
+
+}
+
+}
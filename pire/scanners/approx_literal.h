@@ -0,0 +1,346 @@
+/*
+ * approx_literal.h -- definition of the ApproxLiteralScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_SCANNERS_APPROX_LITERAL_H
+#define PIRE_SCANNERS_APPROX_LITERAL_H
+
+#include "common.h"
+#include "../stub/stl.h"
+#include "../stub/defaults.h"
+#include "../fsm.h"
+#include "../run.h"
+#include "../platform.h"
+#include <algorithm>
+
+namespace Pire {
+
+namespace Impl {
+
+	/**
+	 * A pattern which is a chain of character classes, possibly
+	 * preceded and/or followed by anything (as Fsm::Surround() does).
+	 */
+	struct LiteralChain {
+		/// Characters (including BeginMark and EndMark) of each position
+		TVector< TVector<Char> > classes;
+		bool anyPrefix;
+		bool anySuffix;
+
+		LiteralChain(): anyPrefix(false), anySuffix(false) {}
+	};
+
+	/// Recognizes a literal chain in @p fsm (as produced by Lexer, with epsilons).
+	/// Returns false if the FSM has any other shape or is longer than @p maxLength.
+	bool BuildLiteralChain(const Fsm& fsm, size_t maxLength, LiteralChain& chain);
+}
+
+/**
+ * A scanner matching literal-like patterns within a given edit distance,
+ * with bit-parallel simulation of the approximate NFA (after Wu and Manber).
+ *
+ * For each number of errors d, the state keeps a bitmask of pattern
+ * positions reachable with at most d insertions, deletions, substitutions
+ * and transpositions of adjacent characters, so that a step takes
+ * a few word operations per allowed error, whatever the pattern is.
+ * It accepts exactly the same strings as other scanners built
+ * with CreateApproxFsm() for the same distance, but its size
+ * does not grow with the distance, and it also reports
+ * the minimal distance of a match.
+ *
+ * Only patterns which are chains of character classes (such as
+ * /^ab[cd]e$/ or surrounded /abc/) of up to MaxLength characters
+ * are supported; Suitable() tells whether a pattern is one.
+ */
+class ApproxLiteralScanner {
+public:
+	typedef ui16 Letter;
+	typedef ui32 Action;
+	typedef ui8  Tag;
+
+	enum {
+		FinalFlag = 1,
+		DeadFlag  = 2
+	};
+
+	/// Maximum number of characters in a pattern (counting BeginMark and EndMark)
+	static const size_t MaxLength = 63;
+	static const size_t MaxDistance = 7;
+	/// Distance() of a state which has not matched
+	static const size_t NoMatch = static_cast<size_t>(-1);
+
+	struct State {
+		/// Positions reachable with at most the given number of errors
+		ui64 reached[MaxDistance + 1];
+		/// Positions from which the letter of the next position has just been read,
+		/// so that the current one can follow (and swap with) it
+		ui64 swapped[MaxDistance + 1];
+		/// Minimal distance of a match which cannot be undone
+		/// (when the pattern is followed by anything)
+		size_t matched;
+	};
+
+	ApproxLiteralScanner()
+		: m_length(0)
+		, m_distance(0)
+		, m_anyPrefix(false)
+		, m_anySuffix(false)
+		, m_inner(0)
+		, m_letters(MaxChar, 0)
+		, m_masks(1, 0)
+	{}
+
+	explicit ApproxLiteralScanner(Fsm& fsm, size_t distance = 0)
+	{
+		Impl::LiteralChain chain;
+		if (distance > MaxDistance || !Impl::BuildLiteralChain(fsm, MaxLength, chain))
+			throw Error("Regexp is not suitable for ApproxLiteralScanner");
+		Init(chain, distance);
+	}
+
+	/// Tells whether @p fsm can be matched within @p distance by this scanner
+	static bool Suitable(const Fsm& fsm, size_t distance)
+	{
+		Impl::LiteralChain chain;
+		return distance <= MaxDistance && Impl::BuildLiteralChain(fsm, MaxLength, chain);
+	}
+
+	size_t Size() const { return m_length + 1; }
+	bool Empty() const { return !m_length; }
+
+	size_t Id() const { return (size_t) -1; }
+	size_t RegexpsCount() const { return Empty() ? 0 : 1; }
+
+	size_t LettersCount() const { return m_masks.size(); }
+
+	/// The edit distance the scanner was built for
+	size_t MaxErrors() const { return m_distance; }
+
+	void Initialize(State& state) const
+	{
+		for (size_t d = 0; d <= MaxDistance; ++d) {
+			state.reached[d] = 0;
+			state.swapped[d] = 0;
+		}
+		state.reached[0] = 1;
+		state.matched = NoMatch;
+		Close(state);
+	}
+
+	Char Translate(Char ch) const { return m_letters[static_cast<size_t>(ch)]; }
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action NextTranslated(State& state, Char letter) const
+	{
+		Advance(state.reached, state.swapped, m_distance, m_masks[letter]);
+		if (m_anySuffix)
+			state.matched = std::min(state.matched, MatchedDistance(state));
+		return 0;
+	}
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action Next(State& state, Char c) const
+	{
+		return NextTranslated(state, Translate(c));
+	}
+
+	bool TakeAction(State&, Action) const { return false; }
+
+	/// Returns the minimal number of errors the input matches the pattern with,
+	/// or NoMatch if it does not match within MaxErrors()
+	size_t Distance(const State& state) const
+	{
+		return std::min(state.matched, MatchedDistance(state));
+	}
+
+	bool Final(const State& state) const { return Distance(state) != NoMatch; }
+
+	bool Dead(const State& state) const
+	{
+		return !m_anyPrefix && state.matched == NoMatch
+			&& !state.reached[m_distance] && !(m_distance && state.swapped[m_distance - 1]);
+	}
+
+	ypair<const size_t*, const size_t*> AcceptedRegexps(const State& state) const
+	{
+		static const size_t v[1] = { 0 };
+		return ymake_pair(v, v + (Final(state) ? 1 : 0));
+	}
+
+	bool CanStop(const State& state) const { return Final(state); }
+
+	/// Only used for debug output
+	size_t StateIndex(const State& state) const { return static_cast<size_t>(state.reached[0]); }
+
+	/// Runs the scanner through the input with the distance known
+	/// at compile time, so that all the masks are kept in registers
+	template<size_t Distance>
+	void RunFixed(State& state, const char* begin, const char* end) const
+	{
+		ui64 reached[Distance + 1];
+		ui64 swapped[Distance + 1];
+		for (size_t d = 0; d <= Distance; ++d) {
+			reached[d] = state.reached[d];
+			swapped[d] = state.swapped[d];
+		}
+		const ui64 final = ui64(1) << m_length;
+		const Letter* letters = m_letters.data();
+		const ui64* masks = m_masks.data();
+		for (; begin != end; ++begin) {
+			Advance(reached, swapped, Distance, masks[letters[static_cast<unsigned char>(*begin)]]);
+			if (m_anySuffix && PIRE_UNLIKELY(reached[Distance] & final)) {
+				size_t d = 0;
+				while (!(reached[d] & final))
+					++d;
+				state.matched = std::min(state.matched, d);
+			}
+		}
+		for (size_t d = 0; d <= Distance; ++d) {
+			state.reached[d] = reached[d];
+			state.swapped[d] = swapped[d];
+		}
+	}
+
+	void Swap(ApproxLiteralScanner& s)
+	{
+		DoSwap(m_length, s.m_length);
+		DoSwap(m_distance, s.m_distance);
+		DoSwap(m_anyPrefix, s.m_anyPrefix);
+		DoSwap(m_anySuffix, s.m_anySuffix);
+		DoSwap(m_inner, s.m_inner);
+		m_letters.swap(s.m_letters);
+		m_masks.swap(s.m_masks);
+	}
+
+private:
+	/// Number of characters in the pattern; position i is the one
+	/// after i characters, so the final position is m_length
+	size_t m_length;
+	size_t m_distance;
+	bool m_anyPrefix;
+	bool m_anySuffix;
+	/// Positions but the final one
+	ui64 m_inner;
+	TVector<Letter> m_letters;
+	/// Positions entered by each letter class
+	TVector<ui64> m_masks;
+
+	/// Moves the masks of each number of errors up to @p distance by a letter
+	/// entering the @p entering positions
+	PIRE_FORCED_INLINE
+	void Advance(ui64* reached, ui64* swapped, size_t distance, ui64 entering) const
+	{
+		// Positions followed by the ones entered by the letter
+		const ui64 swapping = entering >> 2;
+		const ui64 inner = m_inner;
+
+		ui64 prevReached = 0;
+		ui64 prevNext = 0;
+		ui64 prevSwapped = 0;
+		for (size_t d = 0; d <= distance; ++d) {
+			const ui64 cur = reached[d];
+			ui64 next = (cur << 1) & entering;
+			if (d) {
+				next |= prevNext
+					// Substitutions and deletions
+					| ((prevReached | prevNext) & inner) << 1
+					// Insertions
+					| (prevReached & inner)
+					// Transpositions
+					| ((prevSwapped << 1) & entering) << 1;
+			} else if (m_anyPrefix) {
+				next |= 1;
+			}
+			prevReached = cur;
+			prevSwapped = swapped[d];
+			prevNext = next;
+			reached[d] = next;
+			swapped[d] = cur & swapping;
+		}
+	}
+
+	size_t MatchedDistance(const State& state) const
+	{
+		const ui64 final = ui64(1) << m_length;
+		if (!(state.reached[m_distance] & final))
+			return NoMatch;
+		size_t d = 0;
+		while (!(state.reached[d] & final))
+			++d;
+		return d;
+	}
+
+	/// Adds positions reachable by deleting characters of the pattern
+	void Close(State& state) const
+	{
+		for (size_t d = 1; d <= m_distance; ++d)
+			state.reached[d] |= state.reached[d - 1] | (state.reached[d - 1] & m_inner) << 1;
+		if (m_anySuffix)
+			state.matched = std::min(state.matched, MatchedDistance(state));
+	}
+
+	void Init(const Impl::LiteralChain& chain, size_t distance)
+	{
+		m_length = chain.classes.size();
+		m_distance = distance;
+		m_anyPrefix = chain.anyPrefix;
+		m_anySuffix = chain.anySuffix;
+		m_inner = (ui64(1) << m_length) - 1;
+
+		// Characters entering the same positions share a letter
+		TVector<ui64> masks(MaxChar, 0);
+		for (size_t pos = 0; pos != m_length; ++pos)
+			for (auto&& ch : chain.classes[pos])
+				masks[ch] |= ui64(2) << pos;
+		TMap<ui64, Letter> letters;
+		m_letters.assign(MaxChar, 0);
+		m_masks.clear();
+		for (size_t ch = 0; ch != MaxChar; ++ch) {
+			auto ins = letters.insert(ymake_pair(masks[ch], static_cast<Letter>(m_masks.size())));
+			if (ins.second)
+				m_masks.push_back(masks[ch]);
+			m_letters[ch] = ins.first->second;
+		}
+	}
+};
+
+#ifndef PIRE_DEBUG
+/// A specialization of Run(), which keeps the masks in registers
+template<>
+inline void Run<ApproxLiteralScanner>(const ApproxLiteralScanner& scanner, ApproxLiteralScanner::State& state, const char* begin, const char* end)
+{
+	switch (scanner.MaxErrors()) {
+	case 0: scanner.RunFixed<0>(state, begin, end); break;
+	case 1: scanner.RunFixed<1>(state, begin, end); break;
+	case 2: scanner.RunFixed<2>(state, begin, end); break;
+	case 3: scanner.RunFixed<3>(state, begin, end); break;
+	case 4: scanner.RunFixed<4>(state, begin, end); break;
+	case 5: scanner.RunFixed<5>(state, begin, end); break;
+	case 6: scanner.RunFixed<6>(state, begin, end); break;
+	default: scanner.RunFixed<ApproxLiteralScanner::MaxDistance>(state, begin, end); break;
+	}
+}
+#endif
+
+}
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * bitparallel.cpp -- construction of position automata for BitParallelScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include "bitparallel.h"
+
+namespace Pire {
+
+namespace Impl {
+
+bool BuildPositionAutomaton(const Fsm& source, size_t maxSize, PositionAutomaton& automaton)
+{
+	Fsm fsm = source;
+	fsm.RemoveEpsilons();
+	fsm.Sparse();
+
+	const size_t lettersCount = fsm.Letters().Size();
+	TVector<size_t> letters(MaxChar, 0);
+	TVector<Char> representatives(lettersCount);
+	for (auto&& letter : fsm.Letters()) {
+		representatives[letter.second.first] = letter.first;
+		for (auto&& character : letter.second.second)
+			letters[character] = letter.second.first;
+	}
+
+	// A position is a state along with the letters it is entered with
+	// (the initial position being entered with none)
+	typedef ypair< size_t, TVector<size_t> > Position;
+	TMap<Position, size_t> index;
+	TVector<Position> positions;
+	TVector< TVector<size_t> > follow;
+	auto intern = [&](const Position& position) {
+		auto it = index.find(position);
+		if (it != index.end())
+			return it->second;
+		index.insert(ymake_pair(position, positions.size()));
+		positions.push_back(position);
+		follow.emplace_back();
+		return positions.size() - 1;
+	};
+
+	intern(Position(fsm.Initial(), TVector<size_t>()));
+	for (size_t pos = 0; pos != positions.size(); ++pos) {
+		if (positions.size() > maxSize)
+			return false;
+		TMap< size_t, TVector<size_t> > incoming;
+		const size_t state = positions[pos].first;
+		for (size_t letter = 0; letter != lettersCount; ++letter)
+			for (auto&& to : fsm.Destinations(state, representatives[letter]))
+				incoming[to].push_back(letter);
+		for (auto&& in : incoming) {
+			size_t next = intern(Position(in.first, in.second));
+			follow[pos].push_back(next);
+		}
+	}
+	if (positions.size() > maxSize)
+		return false;
+
+	// Drop positions which cannot lead to a final one
+	TVector< TVector<size_t> > previous(positions.size());
+	for (size_t pos = 0; pos != positions.size(); ++pos)
+		for (auto&& next : follow[pos])
+			previous[next].push_back(pos);
+	TVector<bool> useful(positions.size(), false);
+	TVector<size_t> queue;
+	for (size_t pos = 0; pos != positions.size(); ++pos)
+		if (fsm.IsFinal(positions[pos].first)) {
+			useful[pos] = true;
+			queue.push_back(pos);
+		}
+	while (!queue.empty()) {
+		size_t pos = queue.back();
+		queue.pop_back();
+		for (auto&& prev : previous[pos])
+			if (!useful[prev]) {
+				useful[prev] = true;
+				queue.push_back(prev);
+			}
+	}
+	useful[0] = true;
+
+	// Number positions along chains, so that as many of them as possible
+	// are followed by the next one (which the scanner handles with a shift)
+	const size_t none = static_cast<size_t>(-1);
+	TVector<size_t> renumbered(positions.size(), none);
+	size_t size = 0;
+	for (size_t start = 0; start != positions.size(); ++start)
+		for (size_t pos = start; pos != none && useful[pos] && renumbered[pos] == none;) {
+			renumbered[pos] = size++;
+			size_t chained = none;
+			for (auto&& next : follow[pos])
+				if (useful[next] && renumbered[next] == none) {
+					chained = next;
+					break;
+				}
+			pos = chained;
+		}
+
+	automaton.letters.swap(letters);
+	automaton.lettersCount = lettersCount;
+	automaton.follow.assign(size, TVector<size_t>());
+	automaton.entries.assign(lettersCount, TVector<size_t>());
+	automaton.finals.assign(size, false);
+	for (size_t pos = 0; pos != positions.size(); ++pos) {
+		if (!useful[pos])
+			continue;
+		const size_t renum = renumbered[pos];
+		automaton.finals[renum] = fsm.IsFinal(positions[pos].first);
+		for (auto&& letter : positions[pos].second)
+			automaton.entries[letter].push_back(renum);
+		for (auto&& next : follow[pos])
+			if (useful[next])
+				automaton.follow[renum].push_back(renumbered[next]);
+	}
+	return true;
+}
+
+}
+
+}
@@ -0,0 +1,449 @@
+/*
+ * bitparallel.h -- definition of the BitParallelScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_SCANNERS_BITPARALLEL_H
+#define PIRE_SCANNERS_BITPARALLEL_H
+
+#include "common.h"
+#include "../approx_matching.h"
+#include "../stub/stl.h"
+#include "../stub/defaults.h"
+#include "../fsm.h"
+#include "../run.h"
+#include "../stub/saveload.h"
+#include "../platform.h"
+#include <memory>
+#include <string.h>
+
+namespace Pire {
+
+namespace Impl {
+
+	/**
+	 * An epsilon-free NFA where all transitions into a state (a position)
+	 * are labelled with the same set of letters, as in Glushkov's construction.
+	 * The set of states after a letter is thus the union of follow sets of
+	 * the current states, restricted to the positions entered by the letter.
+	 *
+	 * Positions which cannot lead to a final one are dropped, so an empty
+	 * set of states is dead.
+	 */
+	struct PositionAutomaton {
+		/// Letter class of each character
+		TVector<size_t> letters;
+		size_t lettersCount;
+		/// Positions which may follow each position
+		TVector< TVector<size_t> > follow;
+		/// Positions entered by each letter class
+		TVector< TVector<size_t> > entries;
+		TVector<bool> finals;
+		/// The initial position is always placed at zero position
+		static const size_t Initial = 0;
+
+		size_t Size() const { return follow.size(); }
+	};
+
+	/// Builds a position automaton for @p fsm, splitting each state by the sets of
+	/// letters it is entered with. Returns false if the automaton would have
+	/// more than @p maxSize positions.
+	bool BuildPositionAutomaton(const Fsm& fsm, size_t maxSize, PositionAutomaton& automaton);
+
+	/**
+	 * A scanner simulating a position automaton of up to 64 * Words positions
+	 * with bit-parallel operations (the shift-and approach generalized
+	 * to arbitrary follow sets).
+	 *
+	 * The state is a bitmask of active positions. On each letter, follow sets
+	 * of all active positions are or-ed together, and the result is and-ed
+	 * with the mask of positions entered by the letter. Positions followed
+	 * by the next one (or by themselves) are advanced with a single shift
+	 * (or kept) for the whole mask at once; other follow sets are looked up in precomputed tables, one per
+	 * ChunkBits-wide chunk of the mask containing such positions.
+	 * Thus the cost of a step does not depend on the number of active positions.
+	 *
+	 * Like SlowScanner, it does not require the FSM to be deterministic,
+	 * and is meant for patterns such as /x.{40}$/ whose DFAs are too large.
+	 */
+	template<size_t Words>
+	class BitParallelScanner {
+	public:
+		typedef ui16 Letter;
+		typedef ui32 Action;
+		typedef ui8  Tag;
+
+		enum {
+			FinalFlag = 1,
+			DeadFlag  = 2
+		};
+
+		/// Maximum number of positions
+		static const size_t MaxSize = 64 * Words;
+
+		struct State {
+			ui64 bits[Words];
+		};
+
+		BitParallelScanner()
+		{
+			m.words = Words;
+			m.size = 0;
+			m.lettersCount = 1;
+			m.chunksCount = 0;
+			Clear(m.initial);
+			Clear(m.final);
+			Clear(m.shift);
+			Clear(m.loops);
+			m_buffer = BufferType(new char[BufSize()]);
+			memset(m_buffer.get(), 0, BufSize());
+			Markup(m_buffer.get());
+		}
+
+		explicit BitParallelScanner(Fsm& fsm, size_t distance = 0)
+		{
+			if (distance)
+				fsm = CreateApproxFsm(fsm, distance);
+			PositionAutomaton automaton;
+			if (!BuildPositionAutomaton(fsm, MaxSize, automaton))
+				throw Error("Regexp is too large for BitParallelScanner");
+			Init(automaton);
+		}
+
+		explicit BitParallelScanner(const PositionAutomaton& automaton)
+		{
+			if (automaton.Size() > MaxSize)
+				throw Error("Regexp is too large for BitParallelScanner");
+			Init(automaton);
+		}
+
+		BitParallelScanner(const BitParallelScanner& s): m(s.m)
+		{
+			if (!s.m_buffer) {
+				// Mmap()-ed scanner, just copy pointers
+				Alias(s);
+			} else {
+				m_buffer = BufferType(new char[BufSize()]);
+				memcpy(m_buffer.get(), s.m_buffer.get(), BufSize());
+				Markup(m_buffer.get());
+			}
+		}
+
+		BitParallelScanner& operator = (const BitParallelScanner& s) { BitParallelScanner(s).Swap(*this); return *this; }
+
+		size_t Size() const { return m.size; }
+		bool Empty() const { return !m.size; }
+
+		size_t Id() const { return (size_t) -1; }
+		size_t RegexpsCount() const { return Empty() ? 0 : 1; }
+
+		size_t LettersCount() const { return m.lettersCount; }
+
+		void Initialize(State& state) const { state = m.initial; }
+
+		Char Translate(Char ch) const { return m_letters[static_cast<size_t>(ch)]; }
+
+		PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+		Action NextTranslated(State& state, Char letter) const
+		{
+			State next;
+			ui64 carry = 0;
+			for (size_t i = 0; i != Words; ++i) {
+				next.bits[i] = (((state.bits[i] << 1) | carry) & m.shift.bits[i]) | (state.bits[i] & m.loops.bits[i]);
+				carry = state.bits[i] >> 63;
+			}
+
+			const State* table = m_follow;
+			for (const Chunk* chunk = m_chunks, *end = m_chunks + m.chunksCount; chunk != end; ++chunk) {
+				// No check for empty chunks: the branch would hardly be predictable
+				const State& follow = table[(state.bits[chunk->word] >> chunk->shift) & ChunkMask];
+				for (size_t i = 0; i != Words; ++i)
+					next.bits[i] |= follow.bits[i];
+				table += ChunkValues;
+			}
+
+			const State& entries = m_entries[letter];
+			for (size_t i = 0; i != Words; ++i)
+				state.bits[i] = next.bits[i] & entries.bits[i];
+			return 0;
+		}
+
+		PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+		Action Next(State& state, Char c) const
+		{
+			return NextTranslated(state, Translate(c));
+		}
+
+		bool TakeAction(State&, Action) const { return false; }
+
+		bool Final(const State& state) const
+		{
+			ui64 final = 0;
+			for (size_t i = 0; i != Words; ++i)
+				final |= state.bits[i] & m.final.bits[i];
+			return final != 0;
+		}
+
+		bool Dead(const State& state) const
+		{
+			ui64 alive = 0;
+			for (size_t i = 0; i != Words; ++i)
+				alive |= state.bits[i];
+			return !alive;
+		}
+
+		ypair<const size_t*, const size_t*> AcceptedRegexps(const State& state) const
+		{
+			static const size_t v[1] = { 0 };
+			return ymake_pair(v, v + (Final(state) ? 1 : 0));
+		}
+
+		bool CanStop(const State& state) const { return Final(state); }
+
+		/// Only used for debug output
+		size_t StateIndex(const State& state) const { return static_cast<size_t>(state.bits[0]); }
+
+		void Swap(BitParallelScanner& s)
+		{
+			DoSwap(m, s.m);
+			DoSwap(m_buffer, s.m_buffer);
+			DoSwap(m_letters, s.m_letters);
+			DoSwap(m_entries, s.m_entries);
+			DoSwap(m_chunks, s.m_chunks);
+			DoSwap(m_follow, s.m_follow);
+		}
+
+		void Save(yostream* s) const
+		{
+			SavePodType(s, Header(ScannerIOTypes::BitParallelScanner, sizeof(m)));
+			Impl::AlignSave(s, sizeof(Header));
+			SavePodType(s, m);
+			Impl::AlignSave(s, sizeof(m));
+			// In-memory and mmap()-ed scanners share the layout, so the tables are saved as is
+			Impl::AlignedSaveArray(s, reinterpret_cast<const char*>(m_letters), BufSize());
+		}
+
+		void Load(yistream* s)
+		{
+			BitParallelScanner sc;
+			Impl::ValidateHeader(s, ScannerIOTypes::BitParallelScanner, sizeof(sc.m));
+			LoadPodType(s, sc.m);
+			Impl::AlignLoad(s, sizeof(sc.m));
+			sc.CheckWords();
+			sc.m_buffer = BufferType(new char[sc.BufSize()]);
+			Impl::AlignedLoadArray(s, sc.m_buffer.get(), sc.BufSize());
+			sc.Markup(sc.m_buffer.get());
+			Swap(sc);
+		}
+
+		/*
+		 * Constructs the scanner from mmap()-ed memory range, returning a pointer
+		 * to unconsumed part of the buffer.
+		 */
+		const void* Mmap(const void* ptr, size_t size)
+		{
+			Impl::CheckAlign(ptr);
+			BitParallelScanner s;
+			const size_t* p = reinterpret_cast<const size_t*>(ptr);
+
+			Impl::ValidateHeader(p, size, ScannerIOTypes::BitParallelScanner, sizeof(s.m));
+			Locals* locals;
+			Impl::MapPtr(locals, 1, p, size);
+			memcpy(&s.m, locals, sizeof(s.m));
+			s.CheckWords();
+
+			if (size < s.BufSize())
+				throw Error("EOF reached while mapping Pire::BitParallelScanner");
+			s.m_buffer.reset();
+			s.Markup(const_cast<size_t*>(p));
+			Impl::AdvancePtr(p, size, s.BufSize());
+			Swap(s);
+			return Impl::AlignPtr(p, size);
+		}
+
+	private:
+		// Wide masks are split into smaller chunks to keep follow tables small
+		static const size_t ChunkBits = (Words <= 2) ? 8 : 4;
+		static const size_t ChunkValues = size_t(1) << ChunkBits;
+		static const ui64 ChunkMask = ChunkValues - 1;
+
+		struct Chunk {
+			size_t word;
+			size_t shift;
+		};
+
+		struct Locals {
+			/// Equals to Words, checked when loading
+			size_t words;
+			size_t size;
+			size_t lettersCount;
+			size_t chunksCount;
+			State initial;
+			State final;
+			/// Positions entered from the previous one
+			State shift;
+			/// Positions entered from themselves
+			State loops;
+		} m;
+
+		using BufferType = std::unique_ptr<char[]>;
+		/// Owns the tables unless the scanner is mmap()-ed
+		BufferType m_buffer;
+
+		Letter* m_letters;
+		/// Positions entered by each letter class
+		State* m_entries;
+		/// Chunks containing positions followed by anything but the next one or itself
+		Chunk* m_chunks;
+		/// For each of m_chunks and each its value, the union of follow sets
+		/// (except the next positions and themselves) of the positions set in the value
+		State* m_follow;
+
+		static void Clear(State& state)
+		{
+			for (size_t i = 0; i != Words; ++i)
+				state.bits[i] = 0;
+		}
+
+		static void Set(State& state, size_t position)
+		{
+			state.bits[position / 64] |= ui64(1) << (position % 64);
+		}
+
+		void CheckWords()
+		{
+			if (m.words != Words)
+				throw Error("Type mismatch while loading Pire::BitParallelScanner");
+		}
+
+		/// Size of the tables in bytes
+		size_t BufSize() const
+		{
+			return
+				Impl::AlignUp(MaxChar * sizeof(*m_letters), sizeof(size_t))
+				+ Impl::AlignUp(m.lettersCount * sizeof(*m_entries), sizeof(size_t))
+				+ Impl::AlignUp(m.chunksCount * sizeof(*m_chunks), sizeof(size_t))
+				+ Impl::AlignUp(m.chunksCount * ChunkValues * sizeof(*m_follow), sizeof(size_t))
+				;
+		}
+
+		void Markup(void* buf)
+		{
+			char* p = static_cast<char*>(buf);
+			m_letters = reinterpret_cast<Letter*>(p);
+			p += Impl::AlignUp(MaxChar * sizeof(*m_letters), sizeof(size_t));
+			m_entries = reinterpret_cast<State*>(p);
+			p += Impl::AlignUp(m.lettersCount * sizeof(*m_entries), sizeof(size_t));
+			m_chunks = reinterpret_cast<Chunk*>(p);
+			p += Impl::AlignUp(m.chunksCount * sizeof(*m_chunks), sizeof(size_t));
+			m_follow = reinterpret_cast<State*>(p);
+		}
+
+		void Alias(const BitParallelScanner& s)
+		{
+			memcpy(&m, &s.m, sizeof(m));
+			m_buffer.reset();
+			m_letters = s.m_letters;
+			m_entries = s.m_entries;
+			m_chunks = s.m_chunks;
+			m_follow = s.m_follow;
+		}
+
+		void Init(const PositionAutomaton& automaton)
+		{
+			m.words = Words;
+			m.size = automaton.Size();
+
+			Clear(m.initial);
+			Set(m.initial, PositionAutomaton::Initial);
+			Clear(m.final);
+			for (size_t pos = 0; pos != m.size; ++pos)
+				if (automaton.finals[pos])
+					Set(m.final, pos);
+
+			TVector<State> entries(automaton.lettersCount);
+			for (size_t letter = 0; letter != automaton.lettersCount; ++letter) {
+				Clear(entries[letter]);
+				for (auto&& pos : automaton.entries[letter])
+					Set(entries[letter], pos);
+			}
+
+			Clear(m.shift);
+			Clear(m.loops);
+			TVector< TVector<size_t> > jumps(m.size);
+			for (size_t pos = 0; pos != m.size; ++pos)
+				for (auto&& next : automaton.follow[pos])
+					if (next == pos + 1)
+						Set(m.shift, next);
+					else if (next == pos)
+						Set(m.loops, next);
+					else
+						jumps[pos].push_back(next);
+
+			TVector<Chunk> chunks;
+			TVector<State> follow;
+			for (size_t first = 0; first < m.size; first += ChunkBits) {
+				bool jumping = false;
+				for (size_t pos = first; pos != first + ChunkBits && pos != m.size; ++pos)
+					jumping = jumping || !jumps[pos].empty();
+				if (!jumping)
+					continue;
+
+				Chunk chunk = { first / 64, first % 64 };
+				chunks.push_back(chunk);
+				// Each value of a chunk adds the follow set of its lowest bit
+				// to the value without that bit, which has already been computed
+				follow.resize(follow.size() + ChunkValues);
+				State* table = &follow[follow.size() - ChunkValues];
+				Clear(table[0]);
+				for (size_t value = 1; value != ChunkValues; ++value) {
+					size_t bit = 0;
+					while (!(value & (size_t(1) << bit)))
+						++bit;
+					table[value] = table[value & (value - 1)];
+					if (first + bit < m.size)
+						for (auto&& next : jumps[first + bit])
+							Set(table[value], next);
+				}
+			}
+
+			m.lettersCount = entries.size();
+			m.chunksCount = chunks.size();
+			m_buffer = BufferType(new char[BufSize()]);
+			memset(m_buffer.get(), 0, BufSize());
+			Markup(m_buffer.get());
+			for (size_t c = 0; c != MaxChar; ++c)
+				m_letters[c] = static_cast<Letter>(automaton.letters[c]);
+			std::copy(entries.begin(), entries.end(), m_entries);
+			std::copy(chunks.begin(), chunks.end(), m_chunks);
+			std::copy(follow.begin(), follow.end(), m_follow);
+		}
+	};
+}
+
+/// Bit-parallel scanners for up to 64, 128 and 512 positions
+typedef Impl::BitParallelScanner<1> BitParallelScanner64;
+typedef Impl::BitParallelScanner<2> BitParallelScanner128;
+typedef Impl::BitParallelScanner<8> BitParallelScanner512;
+
+}
+
+#endif
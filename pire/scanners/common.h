@@ -38,6 +38,9 @@ namespace Pire {
 			SlowScanner = 3,
 			LoadedScanner = 4,
 			NoGlueLimitCountingScanner = 5,
+			TaggedCapturingScanner = 6,
+			MultiCapturingScanner = 7,
+			BitParallelScanner = 9,
 		};
 	}
 
@@ -50,8 +53,10 @@ namespace Pire {
 		ui32 HdrSize;
 
 		static const ui32 MAGIC = 0x45524950;   // "PIRE" on litte-endian
-		static const ui32 RE_VERSION = 7;       // Should be incremented each time when the format of serialized scanner changes
+		static const ui32 RE_VERSION = 8;       // Should be incremented each time when the format of serialized scanner changes
 		static const ui32 RE_VERSION_WITH_MACTIONS = 6;  // LoadedScanner with m_actions, which is ignored
+		static const ui32 RE_VERSION_BEFORE_SLOW_ROWS = 7; // Only the layout of SlowScanner has changed since
+		static const ui32 COMPACT_TRANSITIONS = 0x10000; // Set in Version of a LoadedScanner built with PIRE_COMPACT_TRANSITIONS
 
 		explicit Header(ui32 type, size_t hdrsize)
 			: Magic(MAGIC)
@@ -66,15 +71,20 @@ namespace Pire {
 		{
 			if (Magic != MAGIC || PtrSize != sizeof(void*) || MaxWordSize != sizeof(Impl::MaxSizeWord))
 				throw Error("Serialized regexp incompatible with your system");
-			if (Version != RE_VERSION && Version != RE_VERSION_WITH_MACTIONS)
+			if (FormatVersion() != RE_VERSION && !(Type != ScannerIOTypes::SlowScanner && (FormatVersion() == RE_VERSION_BEFORE_SLOW_ROWS || Version == RE_VERSION_WITH_MACTIONS)))
 				throw Error("You are trying to used an incompatible version of a serialized regexp");
 			if (type != ScannerIOTypes::NoScanner && type != Type &&
-			   !(type == ScannerIOTypes::LoadedScanner && Type == ScannerIOTypes::NoGlueLimitCountingScanner)) {
+			   !(type == ScannerIOTypes::LoadedScanner && (Type == ScannerIOTypes::NoGlueLimitCountingScanner || Type == ScannerIOTypes::TaggedCapturingScanner || Type == ScannerIOTypes::MultiCapturingScanner))) {
 				throw Error("Serialized regexp incompatible with your system");
 			}
 			if (hdrsize != 0 && HdrSize != hdrsize)
 				throw Error("Serialized regexp incompatible with your system");
 		}
+
+		ui32 FormatVersion() const { return Version & ~COMPACT_TRANSITIONS; }
+
+		/// Whether transitions of a LoadedScanner are saved in the compact layout
+		bool CompactTransitions() const { return Version & COMPACT_TRANSITIONS; }
 	};
 
 	namespace Impl {
@@ -2,6 +2,8 @@
 #define PIRE_SCANNERS_HALF_FINAL_H
 
 #include <string.h>
+#include <algorithm>
+#include <iterator>
 #include "common.h"
 #include "multi.h"
 #include "../fsm.h"
@@ -12,6 +14,62 @@ namespace Pire {
 
 namespace Impl {
 
+/**
+ * Match counters of a HalfFinalScanner state, along with a bitset
+ * of the regexps matched at least once (a bit per regexp, 64 per word).
+ * The counters of at most MaxRegexps regexps are kept inline;
+ * zero MaxRegexps means any number of counters, kept on the heap.
+ */
+template<size_t MaxRegexps>
+class HalfFinalCounters {
+public:
+	static void CheckRegexpsCount(size_t count)
+	{
+		if (count > MaxRegexps)
+			throw Error("Too many regexps for a HalfFinalScanner");
+	}
+
+	static bool Fits(size_t count) { return count <= MaxRegexps; }
+
+	void Reset(size_t count)
+	{
+		memset(m_matched, 0, (count + 63) / 64 * sizeof(*m_matched));
+		memset(m_counts, 0, count * sizeof(*m_counts));
+	}
+
+	size_t* Counts() { return m_counts; }
+	const size_t* Counts() const { return m_counts; }
+	ui64* Matched() { return m_matched; }
+	const ui64* Matched() const { return m_matched; }
+
+private:
+	ui64 m_matched[(MaxRegexps + 63) / 64];
+	size_t m_counts[MaxRegexps];
+};
+
+template<>
+class HalfFinalCounters<0> {
+public:
+	static void CheckRegexpsCount(size_t) {}
+
+	static bool Fits(size_t) { return true; }
+
+	void Reset(size_t count)
+	{
+		m_matched.assign((count + 63) / 64, 0);
+		m_counts.assign(count, 0);
+	}
+
+	size_t* Counts() { return m_counts.data(); }
+	const size_t* Counts() const { return m_counts.data(); }
+	ui64* Matched() { return m_matched.data(); }
+	const ui64* Matched() const { return m_matched.data(); }
+
+private:
+	TVector<ui64> m_matched;
+	TVector<size_t> m_counts;
+};
+
 
 /*
  * A half final scanner -- the deterministic scanner having half-terminal states,
@@ -28,8 +86,11 @@ namespace Impl {
  * does not work properly if the matching text does not end with EndMark.
  *
  * For count to work correctly, the fsm should not be determined.
+ *
+ * If MaxRegexps is nonzero, the counters are kept inline in the state
+ * and at most MaxRegexps regexps can be glued into the scanner.
  */
-template<typename Relocation, typename Shortcutting>
+template<typename Relocation, typename Shortcutting, size_t MaxRegexps = 0>
 class HalfFinalScanner : public Scanner<Relocation, Shortcutting> {
 public:
 	typedef typename Impl::Scanner<Relocation, Shortcutting> Scanner;
@@ -44,61 +105,142 @@ public:
 		fsm.MakeScanner();
 		Scanner::Init(fsm.GetFsm().Size(), fsm.GetFsm().Letters(), fsm.GetFsm().Finals().size(), fsm.GetFsm().Initial(), 1);
 		BuildScanner(fsm.GetFsm(), *this);
+		ForgetDecided();
 	}
 
 	explicit HalfFinalScanner(const HalfFinalFsm& fsm) {
 		Scanner::Init(fsm.GetFsm().Size(), fsm.GetFsm().Letters(), fsm.GetTotalCount(), fsm.GetFsm().Initial(), 1);
 		BuildScanner(fsm.GetFsm(), *this);
 		BuildFinals(fsm);
+		ForgetDecided();
 	}
 
 	typedef typename Scanner::ScannerRowHeader ScannerRowHeader;
 	typedef typename Scanner::Action Action;
 
+	/**
+	 * The state keeps match counters of all the regexps, along with
+	 * a bitset of the regexps matched at least once, so that a match
+	 * does not allocate memory and accepted regexps are enumerated
+	 * a word of the bitset at a time.
+	 */
 	class State {
 	public:
-		typedef TVector<size_t>::const_iterator IdsIterator;
+		/// Iterates over ids of the regexps matched at least once, in ascending order.
+		/// Distances and indexing are supported too, by counting bits.
+		class IdsIterator {
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef size_t value_type;
+			typedef ptrdiff_t difference_type;
+			typedef const size_t* pointer;
+			typedef size_t reference;
+
+			IdsIterator(): m_words(0), m_wordsCount(0), m_word(0), m_bits(0) {}
+
+			size_t operator*() const { return m_word * 64 + LowestBit(m_bits); }
+
+			IdsIterator& operator++()
+			{
+				m_bits &= m_bits - 1;
+				Skip();
+				return *this;
+			}
 
-		State() : ScannerState(0) {}
+			IdsIterator operator++(int)
+			{
+				IdsIterator it = *this;
+				++*this;
+				return it;
+			}
+
+			IdsIterator& operator+=(size_t n)
+			{
+				for (; n; --n)
+					++*this;
+				return *this;
+			}
+
+			IdsIterator operator+(size_t n) const { return IdsIterator(*this) += n; }
+
+			size_t operator[](size_t n) const { return *(*this + n); }
+
+			difference_type operator-(const IdsIterator& other) const { return Rank() - other.Rank(); }
+
+			bool operator==(const IdsIterator& other) const { return m_word == other.m_word && m_bits == other.m_bits; }
+			bool operator!=(const IdsIterator& other) const { return !(*this == other); }
 
-		State(const typename Scanner::State& otherState) : ScannerState(otherState) {}
+		private:
+			const ui64* m_words;
+			size_t m_wordsCount;
+			size_t m_word;
+			ui64 m_bits;
 
-		void GetMatchedRegexpsIds() {
-			MatchedRegexpsIds.clear();
-			for (size_t i = 0; i < MatchedRegexps.size(); i++) {
-				if (MatchedRegexps[i]) {
-					MatchedRegexpsIds.push_back(i);
-				}
+			IdsIterator(const ui64* words, size_t wordsCount, size_t word)
+				: m_words(words), m_wordsCount(wordsCount), m_word(word), m_bits(word != wordsCount ? words[word] : 0)
+			{
+				Skip();
 			}
-		}
+
+			/// Number of ids preceding the current one
+			difference_type Rank() const
+			{
+				size_t rank = 0;
+				for (size_t word = 0; word != m_word; ++word)
+					rank += PopCount(m_words[word]);
+				if (m_word != m_wordsCount)
+					rank += PopCount(m_words[m_word] & ~m_bits);
+				return static_cast<difference_type>(rank);
+			}
+
+			void Skip()
+			{
+				while (!m_bits && m_word != m_wordsCount && ++m_word != m_wordsCount)
+					m_bits = m_words[m_word];
+			}
+
+			friend class State;
+		};
+
+		State() : ScannerState(0), RegexpsCount(0) {}
+
+		State(const typename Scanner::State& otherState) : ScannerState(otherState), RegexpsCount(0) {}
+
+		/// Matched ids are always up to date; kept for compatibility
+		void GetMatchedRegexpsIds() {}
 
 		IdsIterator IdsBegin() const {
-			return MatchedRegexpsIds.cbegin();
+			return IdsIterator(Counters.Matched(), Words(), 0);
 		}
 
 		IdsIterator IdsEnd() const {
-			return MatchedRegexpsIds.cend();
+			return IdsIterator(Counters.Matched(), Words(), Words());
 		}
 
 		bool operator==(const State& other) const {
-			return ScannerState == other.ScannerState && MatchedRegexps == other.MatchedRegexps;
+			return ScannerState == other.ScannerState && RegexpsCount == other.RegexpsCount
+				&& std::equal(Counters.Matched(), Counters.Matched() + Words(), other.Counters.Matched())
+				&& std::equal(Counters.Counts(), Counters.Counts() + RegexpsCount, other.Counters.Counts());
 		}
 
 		bool operator!=(const State& other) const {
-			return ScannerState != other.ScannerState || MatchedRegexps != other.MatchedRegexps;
+			return !(*this == other);
 		}
 
 		size_t Result(size_t regexp_id) const {
-			return MatchedRegexps[regexp_id];
+			Y_ASSERT(regexp_id < RegexpsCount);
+			return Counters.Counts()[regexp_id];
 		}
 
+		/// Saves the counters and the (unrelocated) state of the scanner,
+		/// so the state can only be loaded for the same scanner object
 		void Save(yostream* s) const {
 			SavePodType(s, Pire::Header(5, sizeof(size_t)));
 			Impl::AlignSave(s, sizeof(Pire::Header));
-			auto stateSizePair = ymake_pair(ScannerState, MatchedRegexps.size());
+			auto stateSizePair = ymake_pair(ScannerState, RegexpsCount);
 			SavePodType(s, stateSizePair);
 			Impl::AlignSave(s, sizeof(ypair<size_t, size_t>));
-			Y_ASSERT(0);
+			Impl::AlignedSaveArray(s, Counters.Counts(), RegexpsCount);
 		}
 
 		void Load(yistream* s) {
@@ -106,17 +248,26 @@ public:
 			ypair<size_t, size_t> stateSizePair;
 			LoadPodType(s, stateSizePair);
 			Impl::AlignLoad(s, sizeof(ypair<size_t, size_t>));
+			if (!Counters.Fits(stateSizePair.second))
+				throw Error("Serialized state has too many regexps for this HalfFinalScanner");
 			ScannerState = stateSizePair.first;
-			MatchedRegexps.clear();
-			MatchedRegexps.resize(stateSizePair.second);
+			RegexpsCount = stateSizePair.second;
+			Counters.Reset(RegexpsCount);
+			Impl::AlignedLoadArray(s, Counters.Counts(), RegexpsCount);
+			for (size_t i = 0; i != RegexpsCount; ++i)
+				if (Counters.Counts()[i])
+					Counters.Matched()[i / 64] |= ui64(1) << (i % 64);
 		}
 
 	private:
-		TVector<size_t> MatchedRegexpsIds;
 		typename Scanner::State ScannerState;
-		TVector<size_t> MatchedRegexps;
+		size_t RegexpsCount;
+		/// Only the counters of the first RegexpsCount regexps are in use
+		HalfFinalCounters<MaxRegexps> Counters;
 
-		friend class HalfFinalScanner<Relocation, Shortcutting>;
+		size_t Words() const { return (RegexpsCount + 63) / 64; }
+
+		friend class HalfFinalScanner<Relocation, Shortcutting, MaxRegexps>;
 	};
 
 
@@ -129,16 +280,16 @@ public:
 
 	typedef ypair<typename State::IdsIterator, typename State::IdsIterator> AcceptedRegexpsType;
 
-	AcceptedRegexpsType AcceptedRegexps(State& state) const {
-		state.GetMatchedRegexpsIds();
+	AcceptedRegexpsType AcceptedRegexps(const State& state) const {
 		return ymake_pair(state.IdsBegin(), state.IdsEnd());
 	}
 
 	/// Returns an initial state for this scanner
 	void Initialize(State& state) const {
+		Y_ASSERT(state.Counters.Fits(Scanner::m.regexpsCount));
 		state.ScannerState = Scanner::m.initial;
-		state.MatchedRegexps.clear();
-		state.MatchedRegexps.resize(Scanner::m.regexpsCount);
+		state.RegexpsCount = Scanner::m.regexpsCount;
+		state.Counters.Reset(state.RegexpsCount);
 		TakeAction(state, 0);
 	}
 
@@ -155,27 +306,29 @@ public:
 		if (Final(state)) {
 			size_t idx = StateIndex(state);
 			const size_t *it = Scanner::m_final + Scanner::m_finalIndex[idx];
-			while (*it != Scanner::End) {
-				state.MatchedRegexps[*it]++;
-				++it;
+			size_t* counts = state.Counters.Counts();
+			ui64* matched = state.Counters.Matched();
+			for (; *it != Scanner::End; ++it) {
+				++counts[*it];
+				matched[*it / 64] |= ui64(1) << (*it % 64);
 			}
 		}
 	}
 
 	HalfFinalScanner(const HalfFinalScanner& s) : Scanner(s) {}
 
-	HalfFinalScanner(const Scanner& s) : Scanner(s) {}
+	HalfFinalScanner(const Scanner& s) : Scanner(s) { CheckRegexpsCount(); }
 
 	HalfFinalScanner(HalfFinalScanner&& s) : Scanner(s) {}
 
-	HalfFinalScanner(Scanner&& s) : Scanner(s) {}
+	HalfFinalScanner(Scanner&& s) : Scanner(s) { CheckRegexpsCount(); }
 
 	template<class AnotherRelocation>
-	HalfFinalScanner(const HalfFinalScanner<AnotherRelocation, Shortcutting>& s)
+	HalfFinalScanner(const HalfFinalScanner<AnotherRelocation, Shortcutting, MaxRegexps>& s)
 			: Scanner(s) {}
 
 	template<class AnotherRelocation>
-	HalfFinalScanner(const Impl::Scanner<AnotherRelocation, Shortcutting>& s) : Scanner(s) {}
+	HalfFinalScanner(const Impl::Scanner<AnotherRelocation, Shortcutting>& s) : Scanner(s) { CheckRegexpsCount(); }
 
 	void Swap(HalfFinalScanner& s) {
 		Scanner::Swap(s);
@@ -195,18 +348,39 @@ public:
 	 * Checking a string against that scanner effectively checks them against both agglutinated regexps
 	 * (detailed information about matched regexps can be obtained with AcceptedRegexps()).
 	 *
-	 * Returns default-constructed scanner in case of failure
+	 * Returns default-constructed scanner in case of failure, including the case
+	 * when there would be more than (nonzero) MaxRegexps regexps
 	 * (consult Scanner::Empty() to find out whether the operation was successful).
 	 */
 	static HalfFinalScanner Glue(const HalfFinalScanner& a, const HalfFinalScanner& b, size_t maxSize = 0) {
-		return Scanner::Glue(a, b, maxSize);
+		if (!HalfFinalCounters<MaxRegexps>::Fits(a.RegexpsCount() + b.RegexpsCount()))
+			return HalfFinalScanner();
+		HalfFinalScanner glued = Scanner::Glue(a, b, maxSize);
+		glued.ForgetDecided();
+		return glued;
 	}
 
+	/// Every entry into a final state is counted, so no state decides
+	/// the result and RunUntilDecided() is not supported
+	bool Decided(const State&) const = delete;
+
 	ScannerRowHeader& Header(const State& s) { return Scanner::Header(s.ScannerState); }
 
 	const ScannerRowHeader& Header(const State& s) const { return Scanner::Header(s.ScannerState); }
 
 private:
+	void CheckRegexpsCount() const {
+		HalfFinalCounters<MaxRegexps>::CheckRegexpsCount(Scanner::RegexpsCount());
+	}
+
+	/// Drops DecidedFlag, which Scanner sets as if it only reported the regexps accepted
+	void ForgetDecided() {
+		if (Scanner::Empty())
+			return;
+		for (size_t state = 0; state < Scanner::Size(); ++state)
+			Scanner::Header(Scanner::IndexToState(state)).Common.Flags &= ~Scanner::DecidedFlag;
+	}
+
 	void BuildFinals(const HalfFinalFsm& fsm) {
 		Y_ASSERT(Scanner::m_buffer);
 		Y_ASSERT(fsm.GetFsm().Size() == Scanner::Size());
@@ -239,6 +413,15 @@ typedef Impl::HalfFinalScanner<Impl::Relocatable, Impl::NoShortcuts> HalfFinalSc
 typedef Impl::HalfFinalScanner<Impl::Nonrelocatable, Impl::ExitMasks<2> > NonrelocHalfFinalScanner;
 typedef Impl::HalfFinalScanner<Impl::Nonrelocatable, Impl::NoShortcuts> NonrelocHalfFinalScannerNoMask;
 
+/**
+ * Same as HalfFinalScanner, but keeps the counters inline in the state,
+ * so that Initialize() does not allocate memory either.
+ * At most 256 regexps can be glued into it, and its states
+ * are much larger to copy.
+ */
+typedef Impl::HalfFinalScanner<Impl::Relocatable, Impl::ExitMasks<2>, 256> InlineHalfFinalScanner;
+typedef Impl::HalfFinalScanner<Impl::Relocatable, Impl::NoShortcuts, 256> InlineHalfFinalScannerNoMask;
+
 }
 
 
@@ -0,0 +1,225 @@
+/*
+ * lazy.cpp -- on-demand determinization for the LazyScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <algorithm>
+#include <mutex>
+#include "lazy.h"
+
+namespace Pire {
+
+namespace Impl {
+
+	/**
+	 * A set of DFA states discovered between two cache flushes.
+	 * States are never removed from a generation, so pointers to them
+	 * (and transitions between them) stay valid as long as the generation lives.
+	 */
+	class LazyDfaGeneration {
+	public:
+		LazyDfaGeneration(const SlowScanner& nfa)
+			: m_letters(nfa.GetLettersCount())
+			, m_memory(0)
+		{
+			SlowScanner::State initial;
+			nfa.Initialize(initial);
+			m_initial = Intern(nfa, initial);
+		}
+
+		const LazyDfaState* Initial() const { return m_initial; }
+		size_t Size() const { return m_states.size(); }
+		size_t Memory() const { return m_memory; }
+
+		/// Returns an approximate amount of memory a state with @p nfaStates would take.
+		size_t StateMemory(size_t nfaStates) const
+		{
+			return sizeof(LazyDfaState) + sizeof(std::atomic<const LazyDfaState*>) * m_letters
+				+ 2 * sizeof(unsigned) * nfaStates + MapNodeOverhead;
+		}
+
+		/// Finds the state corresponding to a set of NFA states
+		/// (which must be sorted), creating it if necessary.
+		const LazyDfaState* Intern(const SlowScanner& nfa, const SlowScanner::State& nfaState)
+		{
+			const TVector<unsigned>& nfaStates = nfaState.states;
+			auto it = m_index.find(nfaStates);
+			if (it != m_index.end())
+				return it->second;
+
+			m_states.emplace_back();
+			LazyDfaState& state = m_states.back();
+			state.nfaStates = nfaStates;
+			state.index = m_states.size() - 1;
+			state.final = nfa.Final(nfaState);
+			state.dead = nfaStates.empty();
+			state.next.reset(new std::atomic<const LazyDfaState*>[m_letters]());
+			for (size_t letter = 0; letter != m_letters; ++letter)
+				state.next[letter].store(0, std::memory_order_relaxed);
+
+			m_index.insert(ymake_pair(nfaStates, &state));
+			m_memory += StateMemory(nfaStates.size());
+			return &state;
+		}
+
+	private:
+		enum { MapNodeOverhead = 64 };
+
+		size_t m_letters;
+		size_t m_memory;
+		TDeque<LazyDfaState> m_states;
+		TMap<TVector<unsigned>, const LazyDfaState*> m_index;
+		const LazyDfaState* m_initial;
+	};
+
+	/// A state cache shared between copies of a LazyScanner.
+	class LazyDfaCache {
+	public:
+		LazyDfaCache(const SlowScanner& nfa, size_t maxMemory)
+			: m_maxMemory(maxMemory)
+			, m_flushes(0)
+			, m_current(new LazyDfaGeneration(nfa))
+		{
+			nfa.Initialize(m_from);
+			nfa.Initialize(m_to);
+		}
+
+		void Initialize(LazyScanner::State& state) const
+		{
+			state.m_generation = std::atomic_load(&m_current);
+			state.m_state = state.m_generation->Initial();
+		}
+
+		void Discover(const SlowScanner& nfa, LazyScanner::State& state, Char letter)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+
+			// Another thread might have discovered the transition while we were waiting
+			const LazyDfaState* next = state.m_state->next[letter].load(std::memory_order_acquire);
+			if (next) {
+				state.m_state = next;
+				return;
+			}
+
+			m_from.states = state.m_state->nfaStates;
+			nfa.NextTranslated(m_from, m_to, letter);
+			std::sort(m_to.states.begin(), m_to.states.end());
+
+			bool sameGeneration = (state.m_generation == m_current);
+			if (m_current->Size() > 1 && m_current->Memory() + m_current->StateMemory(m_to.states.size()) > m_maxMemory) {
+				std::atomic_store(&m_current, std::shared_ptr<LazyDfaGeneration>(new LazyDfaGeneration(nfa)));
+				++m_flushes;
+				sameGeneration = false;
+			}
+
+			next = m_current->Intern(nfa, m_to);
+			// Transitions never lead across generations, so that an old generation
+			// could be safely destroyed while newer ones are still in use.
+			if (sameGeneration)
+				state.m_state->next[letter].store(next, std::memory_order_release);
+			else
+				state.m_generation = m_current;
+			state.m_state = next;
+		}
+
+		size_t StatesCount() const
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			return m_current->Size();
+		}
+
+		size_t FlushesCount() const
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			return m_flushes;
+		}
+
+	private:
+		size_t m_maxMemory;
+		size_t m_flushes;
+		std::shared_ptr<LazyDfaGeneration> m_current;
+		mutable std::mutex m_lock;
+
+		// Scratch NFA states, reused by Discover() under the lock
+		SlowScanner::State m_from;
+		SlowScanner::State m_to;
+	};
+}
+
+LazyScanner::LazyScanner()
+	: m_cacheSize(DefaultCacheSize)
+{
+	ResetCache();
+}
+
+LazyScanner::LazyScanner(const SlowScanner& nfa, size_t cacheSize)
+	: m_nfa(nfa)
+	, m_cacheSize(cacheSize)
+{
+	ResetCache();
+}
+
+LazyScanner::LazyScanner(Fsm& fsm, size_t distance, size_t cacheSize)
+	: m_nfa(fsm, false, true, distance)
+	, m_cacheSize(cacheSize)
+{
+	ResetCache();
+}
+
+void LazyScanner::ResetCache()
+{
+	m_cache = std::make_shared<Impl::LazyDfaCache>(m_nfa, m_cacheSize);
+}
+
+size_t LazyScanner::CachedStatesCount() const
+{
+	return m_cache->StatesCount();
+}
+
+size_t LazyScanner::CacheFlushesCount() const
+{
+	return m_cache->FlushesCount();
+}
+
+void LazyScanner::Initialize(State& state) const
+{
+	m_cache->Initialize(state);
+}
+
+void LazyScanner::Discover(State& state, Char letter) const
+{
+	m_cache->Discover(m_nfa, state, letter);
+}
+
+void LazyScanner::Load(yistream* s)
+{
+	m_nfa.Load(s);
+	ResetCache();
+}
+
+const void* LazyScanner::Mmap(const void* ptr, size_t size)
+{
+	const void* ret = m_nfa.Mmap(ptr, size);
+	ResetCache();
+	return ret;
+}
+
+}
@@ -0,0 +1,186 @@
+/*
+ * lazy.h -- definition of the LazyScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_SCANNERS_LAZY_H
+#define PIRE_SCANNERS_LAZY_H
+
+#include <atomic>
+#include <memory>
+#include "common.h"
+#include "slow.h"
+#include "../stub/stl.h"
+#include "../fsm.h"
+#include "../run.h"
+#include "../platform.h"
+
+namespace Pire {
+
+namespace Impl {
+
+	/// A single DFA state discovered by LazyScanner: a set of NFA states
+	/// and a row of (possibly not yet known) transitions.
+	struct LazyDfaState {
+		TVector<unsigned> nfaStates;
+		size_t index;
+		bool final;
+		bool dead;
+		std::unique_ptr<std::atomic<const LazyDfaState*>[]> next;
+	};
+
+	class LazyDfaGeneration;
+	class LazyDfaCache;
+}
+
+/**
+ * A scanner which determinizes its FSM lazily, at scan time.
+ *
+ * Like SlowScanner, it does not require the FSM to be deterministic,
+ * but instead of tracking a set of NFA states on each byte it builds
+ * DFA states on demand and caches them along with their transitions.
+ * Once the cache is warm, scanning costs one table lookup per byte,
+ * as with a real DFA.
+ *
+ * The cache is limited by a memory budget; when the budget is exhausted,
+ * all cached states are dropped and discovery starts over (states being
+ * held by running scans stay valid until those scans finish).
+ *
+ * Copies of a scanner share the cache, and all const methods are safe
+ * to call concurrently: cache hits are lock-free, while cache misses
+ * are serialized.
+ */
+class LazyScanner {
+public:
+	typedef SlowScanner::Letter Letter;
+	typedef ui32                Action;
+	typedef ui8                 Tag;
+
+	enum {
+		FinalFlag = 1,
+		DeadFlag  = 2
+	};
+
+	/// Default memory budget of the state cache, in bytes.
+	static const size_t DefaultCacheSize = 1 << 20;
+
+	struct State {
+		const Impl::LazyDfaState* m_state;
+		/// Keeps m_state alive if the cache gets flushed in the middle of a scan.
+		std::shared_ptr<const Impl::LazyDfaGeneration> m_generation;
+
+		State(): m_state(0) {}
+	};
+
+	LazyScanner();
+	explicit LazyScanner(const SlowScanner& nfa, size_t cacheSize = DefaultCacheSize);
+	explicit LazyScanner(Fsm& fsm, size_t distance = 0, size_t cacheSize = DefaultCacheSize);
+
+	size_t Size() const { return m_nfa.Size(); }
+	bool Empty() const { return m_nfa.Empty(); }
+
+	size_t Id() const { return (size_t) -1; }
+	size_t RegexpsCount() const { return Empty() ? 0 : 1; }
+
+	size_t LettersCount() const { return m_nfa.GetLettersCount(); }
+
+	/// Returns the number of DFA states currently held in the cache.
+	size_t CachedStatesCount() const;
+	/// Returns how many times the cache has been flushed so far.
+	size_t CacheFlushesCount() const;
+
+	void Initialize(State& state) const;
+
+	Char Translate(Char ch) const { return m_nfa.Translate(ch); }
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action NextTranslated(State& state, Char letter) const
+	{
+		const Impl::LazyDfaState* next = state.m_state->next[letter].load(std::memory_order_acquire);
+		if (PIRE_LIKELY(next != 0))
+			state.m_state = next;
+		else
+			Discover(state, letter);
+		return 0;
+	}
+
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action Next(State& state, Char c) const
+	{
+		return NextTranslated(state, Translate(c));
+	}
+
+	bool TakeAction(State&, Action) const { return false; }
+
+	bool Final(const State& state) const { return state.m_state->final; }
+	bool Dead(const State& state) const { return state.m_state->dead; }
+
+	ypair<const size_t*, const size_t*> AcceptedRegexps(const State& state) const
+	{
+		return Final(state) ? Accept() : Deny();
+	}
+
+	bool CanStop(const State& state) const { return Final(state); }
+
+	size_t StateIndex(const State& state) const { return state.m_state->index; }
+
+	void Swap(LazyScanner& s)
+	{
+		m_nfa.Swap(s.m_nfa);
+		m_cache.swap(s.m_cache);
+		DoSwap(m_cacheSize, s.m_cacheSize);
+	}
+
+	/// LazyScanner is stored in the same format as SlowScanner.
+	void Save(yostream* s) const { m_nfa.Save(s); }
+	void Load(yistream* s);
+	const void* Mmap(const void* ptr, size_t size);
+
+private:
+	SlowScanner m_nfa;
+	std::shared_ptr<Impl::LazyDfaCache> m_cache;
+	size_t m_cacheSize;
+
+	void ResetCache();
+	void Discover(State& state, Char letter) const;
+
+	static ypair<const size_t*, const size_t*> Accept()
+	{
+		static size_t v[1] = { 0 };
+		return ymake_pair(v, v + 1);
+	}
+
+	static ypair<const size_t*, const size_t*> Deny()
+	{
+		static size_t v[1] = { 0 };
+		return ymake_pair(v, v);
+	}
+};
+
+template<>
+inline LazyScanner Fsm::Compile(size_t distance) {
+	return LazyScanner(*this, distance);
+}
+
+}
+
+
+#endif
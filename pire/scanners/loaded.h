@@ -48,6 +48,13 @@ namespace Pire {
 * It is a good idea to override copy ctor, operator= and swap()
 * in subclasses to avoid mixing different scanner types in these methods.
 * Also please note that subclasses should not have any data members of thier own.
+*
+* Transitions are usually pairs of a shift to the destination state
+* and an action. If PIRE_COMPACT_TRANSITIONS is defined, they are 32-bit
+* shifts instead, and the few transitions which have actions refer
+* to a side table of full transitions, which halves the size of the table
+* when most transitions have no actions (as in counting scanners).
+* Scanners saved with different layouts can be loaded but not mmap()-ed.
 */
 class LoadedScanner {
 public:
@@ -65,6 +72,16 @@ public:
 		};
 	};
 
+#ifdef PIRE_COMPACT_TRANSITIONS
+	/// A shift to the destination state (a multiple of four),
+	/// or the index of a transition in the side table, shifted by one
+	/// and with the HasAction bit set
+	typedef ui32 Jump;
+	enum { HasAction = 1 };
+#else
+	typedef Transition Jump;
+#endif
+
 	// Override in subclass, if neccessary
 	enum {
 		FinalFlag = 0,
@@ -83,6 +100,11 @@ protected:
 			memcpy(m_buffer.get(), s.m_buffer.get(), BufSize());
 			Markup(m_buffer.get());
 			m.initial = (InternalState)m_jumps + (s.m.initial - (InternalState)s.m_jumps);
+#ifdef PIRE_COMPACT_TRANSITIONS
+			m_actionJumpsBuffer.assign(s.m_actionJumps, s.m_actionJumps + s.m_actionJumpsCount);
+			m_actionJumps = m_actionJumpsBuffer.data();
+			m_actionJumpsCount = s.m_actionJumpsCount;
+#endif
 		} else {
 			Alias(s);
 		}
@@ -98,6 +120,11 @@ protected:
 		DoSwap(m_letters, s.m_letters);
 		DoSwap(m_jumps, s.m_jumps);
 		DoSwap(m_tags, s.m_tags);
+#ifdef PIRE_COMPACT_TRANSITIONS
+		m_actionJumpsBuffer.swap(s.m_actionJumpsBuffer);
+		DoSwap(m_actionJumps, s.m_actionJumps);
+		DoSwap(m_actionJumpsCount, s.m_actionJumpsCount);
+#endif
 	}
 
 	LoadedScanner& operator = (const LoadedScanner& s) { LoadedScanner(s).Swap(*this); return *this; }
@@ -131,6 +158,8 @@ public:
 		if (type) {
 			*type = header.Type;
 		}
+		if (header.CompactTransitions() != CompactTransitions())
+			throw Error("Serialized regexp has another layout of transitions and cannot be mmap()-ed");
 
 		Locals* locals;
 		Impl::MapPtr(locals, 1, p, size);
@@ -143,6 +172,12 @@ public:
 			Impl::MapPtr(actions, s.m.statesCount * s.m.lettersCount, p, size);
 		}
 		Impl::MapPtr(s.m_tags, s.m.statesCount, p, size);
+#ifdef PIRE_COMPACT_TRANSITIONS
+		const size_t* count = 0;
+		Impl::MapPtr(count, 1, p, size);
+		s.m_actionJumpsCount = *count;
+		Impl::MapPtr(s.m_actionJumps, s.m_actionJumpsCount, p, size);
+#endif
 
 		s.m.initial += reinterpret_cast<size_t>(s.m_jumps);
 		Swap(s);
@@ -164,6 +199,11 @@ public:
 		m_buffer = BufferType(new char[BufSize()]);
 		memset(m_buffer.get(), 0, BufSize());
 		Markup(m_buffer.get());
+#ifdef PIRE_COMPACT_TRANSITIONS
+		m_actionJumpsBuffer.clear();
+		m_actionJumps = nullptr;
+		m_actionJumpsCount = 0;
+#endif
 
 		m.initial = reinterpret_cast<size_t>(m_jumps + startState * m.lettersCount);
 
@@ -186,15 +226,63 @@ public:
 
 	void SetJump(size_t oldState, Char c, size_t newState, Action action)
 	{
-		Y_ASSERT(m_buffer);
 		Y_ASSERT(oldState < m.statesCount);
+		SetJump(TransitionIndex(oldState, c), newState, action);
+	}
+
+	/// Sets the @p index-th transition (see TransitionIndex())
+	void SetJump(size_t index, size_t newState, Action action)
+	{
+		Y_ASSERT(m_buffer);
+		Y_ASSERT(index < m.statesCount * m.lettersCount);
 		Y_ASSERT(newState < m.statesCount);
 
-		size_t shift = (newState - oldState) * StateSize();
 		Transition tr;
-		tr.shift = shift;
+		tr.shift = (newState - index / m.lettersCount) * StateSize();
 		tr.action = action;
-		m_jumps[TransitionIndex(oldState, c)] = tr;
+#ifdef PIRE_COMPACT_TRANSITIONS
+		Jump& jump = m_jumps[index];
+		if (!action) {
+			jump = tr.shift;
+			return;
+		}
+		if (!(jump & HasAction)) {
+			m_actionJumpsBuffer.push_back(tr);
+			m_actionJumps = m_actionJumpsBuffer.data();
+			m_actionJumpsCount = m_actionJumpsBuffer.size();
+			jump = static_cast<Jump>((m_actionJumpsCount - 1) << 1) | HasAction;
+		}
+		m_actionJumpsBuffer[jump >> 1] = tr;
+#else
+		m_jumps[index] = tr;
+#endif
+	}
+
+	/// Action of the @p index-th transition
+	Action JumpAction(size_t index) const
+	{
+#ifdef PIRE_COMPACT_TRANSITIONS
+		return (m_jumps[index] & HasAction) ? m_actionJumps[m_jumps[index] >> 1].action : 0;
+#else
+		return m_jumps[index].action;
+#endif
+	}
+
+	/// Destination state of the @p index-th transition
+	size_t JumpTarget(size_t index) const
+	{
+		InternalState s = reinterpret_cast<InternalState>(m_jumps + index - index % m.lettersCount);
+		Follow(s, static_cast<Char>(index % m.lettersCount));
+		return StateIdx(s);
+	}
+
+	static bool CompactTransitions()
+	{
+#ifdef PIRE_COMPACT_TRANSITIONS
+		return true;
+#else
+		return false;
+#endif
 	}
 
 	Action RemapAction(Action action) { return action; }
@@ -205,7 +293,7 @@ public:
 
 	size_t StateIdx(InternalState s) const
 	{
-		return (reinterpret_cast<Transition*>(s) - m_jumps) / m.lettersCount;
+		return (reinterpret_cast<Jump*>(s) - m_jumps) / m.lettersCount;
 	}
 
 	i64 SignExtend(i32 i) const { return i; }
@@ -221,6 +309,26 @@ public:
 
 protected:
 
+	/// Moves @p s along the transition by (translated) @p letter, returning its action
+	PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+	Action Follow(InternalState& s, Char letter) const
+	{
+#ifdef PIRE_COMPACT_TRANSITIONS
+		const Jump x = reinterpret_cast<const Jump*>(s)[letter];
+		if (PIRE_LIKELY(!(x & HasAction))) {
+			s += SignExtend(x);
+			return 0;
+		}
+		const Transition& tr = m_actionJumps[x >> 1];
+		s += SignExtend(tr.shift);
+		return tr.action;
+#else
+		Transition x = reinterpret_cast<const Transition*>(s)[letter];
+		s += SignExtend(x.shift);
+		return x.action;
+#endif
+	}
+
 	static const Action IncrementMask     = (1 << MAX_RE_COUNT) - 1;
 	static const Action ResetMask         = IncrementMask << MAX_RE_COUNT;
 
@@ -237,9 +345,16 @@ protected:
 	BufferType m_buffer;
 
 	Letter* m_letters;
-	Transition* m_jumps;
+	Jump* m_jumps;
 	Tag* m_tags;
 
+#ifdef PIRE_COMPACT_TRANSITIONS
+	/// Transitions having actions
+	TVector<Transition> m_actionJumpsBuffer;
+	const Transition* m_actionJumps = nullptr;
+	size_t m_actionJumpsCount = 0;
+#endif
+
 	virtual ~LoadedScanner();
 
 private:
@@ -267,7 +382,7 @@ private:
 	void Markup(void* buf)
 	{
 		m_letters = reinterpret_cast<Letter*>(buf);
-		m_jumps   = reinterpret_cast<Transition*>(m_letters + MaxChar);
+		m_jumps   = reinterpret_cast<Jump*>(m_letters + MaxChar);
 		m_tags    = reinterpret_cast<Tag*>(m_jumps + m.statesCount * m.lettersCount);
 	}
 
@@ -278,6 +393,11 @@ private:
 		m_letters = s.m_letters;
 		m_jumps = s.m_jumps;
 		m_tags = s.m_tags;
+#ifdef PIRE_COMPACT_TRANSITIONS
+		m_actionJumpsBuffer.clear();
+		m_actionJumps = s.m_actionJumps;
+		m_actionJumpsCount = s.m_actionJumpsCount;
+#endif
 	}
 
 	template<class Eq>
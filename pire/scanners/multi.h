@@ -88,9 +88,10 @@ template<class Relocation, class Shortcutting>
 class Scanner {
 protected:
 	enum {
-		 FinalFlag = 1,
-		 DeadFlag  = 2,
-		 Flags = FinalFlag | DeadFlag
+		 FinalFlag   = 1,
+		 DeadFlag    = 2,
+		 DecidedFlag = 4,
+		 Flags = FinalFlag | DeadFlag | DecidedFlag
 	};
 
 	static const size_t End = static_cast<size_t>(-1);
@@ -104,7 +105,7 @@ public:
 
 	/// Some properties of the particular state.
 	struct CommonRowHeader {
-		size_t Flags; ///< Holds FinalFlag, DeadFlag, etc...
+		size_t Flags; ///< Holds FinalFlag, DeadFlag, DecidedFlag, etc...
 
 		CommonRowHeader(): Flags(0) {}
 
@@ -146,6 +147,11 @@ public:
 	/// reach any final state from current one)
 	bool Dead(const State& state) const { return (Header(state).Common.Flags & DeadFlag) != 0; }
 
+	/// Checks whether specified state is 'decided' (i.e. neither the rest
+	/// of the input nor EndMark can change AcceptedRegexps(), so there
+	/// is no point in reading them; see RunUntilDecided())
+	bool Decided(const State& state) const { return (Header(state).Common.Flags & DecidedFlag) != 0; }
+
 	ypair<const size_t*, const size_t*> AcceptedRegexps(const State& state) const
 	{
 		size_t idx = (state - reinterpret_cast<size_t>(m_transitions)) /
@@ -293,6 +299,14 @@ public:
 	 */
 	static Scanner Glue(const Scanner& a, const Scanner& b, size_t maxSize = 0);
 
+	/// The same as above, but within limits of the given compile context
+	/// (throws CompileLimitError if they are exceeded).
+	static Scanner Glue(const Scanner& a, const Scanner& b, const CompileContext& ctx, size_t maxSize = 0)
+	{
+		CompileContext::Scope scope(ctx);
+		return Glue(a, b, maxSize);
+	}
+
 	// Returns the size of the memory buffer used (or required) by scanner.
 	size_t BufSize() const
 	{
@@ -525,6 +539,75 @@ protected:
 			*finalWriter++ = static_cast<size_t>(-1);
 		}
 		BuildShortcuts();
+		BuildDecided();
+	}
+
+	// Marks the states from which only states accepting the same regexps
+	// can be reached by characters and EndMark (BeginMark is not expected
+	// in the middle of the input, though it might revive anchored regexps)
+	void BuildDecided()
+	{
+		Y_ASSERT(m_buffer);
+
+		TVector<bool> used(RowSize(), false);
+		for (size_t ch = 0; ch != MaxChar; ++ch)
+			if (ch < 256 || ch == EndMark)
+				used[m_letters[ch]] = true;
+		TVector<size_t> letters;
+		for (size_t let = HEADER_SIZE; let != LettersCount() + HEADER_SIZE; ++let)
+			if (used[let])
+				letters.push_back(let);
+
+		// Reverse transitions grouped by destination, and the states
+		// which can move to a state accepting other regexps
+		TVector<ui32> offsets(Size() + 1, 0);
+		TVector<ui32> queue;
+		TVector<bool> decided(Size(), true);
+		for (size_t i = 0; i != Size(); ++i) {
+			State st = IndexToState(i);
+			for (auto&& let : letters) {
+				size_t dest = StateIndex(Relocation::Go(st, reinterpret_cast<const Transition*>(st)[let]));
+				++offsets[dest + 1];
+				if (decided[i] && !SameAcceptedRegexps(i, dest)) {
+					decided[i] = false;
+					queue.push_back(i);
+				}
+			}
+		}
+		for (size_t i = 0; i != Size(); ++i)
+			offsets[i + 1] += offsets[i];
+		TVector<ui32> sources(offsets.back());
+		for (size_t i = 0; i != Size(); ++i) {
+			State st = IndexToState(i);
+			for (auto&& let : letters)
+				sources[offsets[StateIndex(Relocation::Go(st, reinterpret_cast<const Transition*>(st)[let]))]++] = i;
+		}
+		// Now offsets[i] is where sources of the (i + 1)-th state begin
+
+		// Anything which can reach an undecided state is undecided as well
+		while (!queue.empty()) {
+			size_t dest = queue.back();
+			queue.pop_back();
+			for (size_t j = dest ? offsets[dest - 1] : 0; j != offsets[dest]; ++j)
+				if (decided[sources[j]]) {
+					decided[sources[j]] = false;
+					queue.push_back(sources[j]);
+				}
+		}
+
+		for (size_t i = 0; i != Size(); ++i)
+			if (decided[i])
+				Header(IndexToState(i)).Common.Flags |= DecidedFlag;
+	}
+
+	bool SameAcceptedRegexps(size_t idx1, size_t idx2) const
+	{
+		const size_t* p1 = m_final + m_finalIndex[idx1];
+		const size_t* p2 = m_final + m_finalIndex[idx2];
+		for (; *p1 == *p2; ++p1, ++p2)
+			if (*p1 == End)
+				return true;
+		return false;
 	}
 
 	size_t AcceptedRegexpsCount(size_t idx) const
@@ -1012,11 +1095,21 @@ public:
 	using Base::Sc;
 	using Base::Letters;
 
-	typedef GluedStateLookupTable<256*1024, typename Scanner::State> InvStates;
+	typedef GluedStateLookupTable<typename Scanner::State> InvStates;
 	
 	ScannerGlueTask(const Scanner& lhs, const Scanner& rhs)
 		: ScannerGlueCommon<Scanner>(lhs, rhs, LettersEquality<Scanner>(lhs.m_letters, rhs.m_letters))
+		, m_representatives(Letters().Size())
+	{
+		for (auto&& letter : Letters())
+			m_representatives[letter.second.first] = letter.first;
+	}
+
+	// Rows are kept as 32-bit state indices until the scanner can be allocated;
+	// they arrive in the order of states, so @p from is implied
+	void AcceptRow(size_t /*from*/, const TVector<size_t>& row)
 	{
+		m_rows.insert(m_rows.end(), row.begin(), row.end());
 	}
 	
 	void AcceptStates(const TVector<State>& states)
@@ -1039,17 +1132,25 @@ public:
 			Sc().SetTag(state, ((Lhs().Final(states[state].first) || Rhs().Final(states[state].second)) ? Scanner::FinalFlag : 0)
 				| ((Lhs().Dead(states[state].first) && Rhs().Dead(states[state].second)) ? Scanner::DeadFlag : 0));
 		}
+
+		auto to = m_rows.begin();
+		for (size_t from = 0; from != states.size(); ++from)
+			for (auto&& letter : m_representatives)
+				Sc().SetJump(from, letter, *to++);
+		TVector<ui32>().swap(m_rows);
 	}
-	
-	void Connect(size_t from, size_t to, Char letter) { Sc().SetJump(from, letter, to); }
 
 	const Scanner& Success()
 	{
 		Sc().BuildShortcuts();
+		Sc().BuildDecided();
 		return Sc();
 	}
 	
 private:
+	TVector<Char> m_representatives;
+	TVector<ui32> m_rows;
+
 	template<class Iter>
 	size_t RangeLen(ypair<Iter, Iter> range) const
 	{
@@ -1082,6 +1183,8 @@ struct StDumper< Impl::Scanner<Relocation, Shortcutting> > {
 			stream << " [final]";
 		if (m_sc->Dead(m_st))
 			stream << " [dead]";
+		if (m_sc->Decided(m_st))
+			stream << " [decided]";
 	}
 private:
 	const ScannerType* m_sc;
@@ -1099,7 +1202,7 @@ Impl::Scanner<Relocation, Shortcutting> Impl::Scanner<Relocation, Shortcutting>:
 	
 	static const size_t DefMaxSize = 80000;
 	Impl::ScannerGlueTask< Impl::Scanner<Relocation, Shortcutting> > task(lhs, rhs);
-	return Impl::Determine(task, maxSize ? maxSize : DefMaxSize);
+	return Impl::DetermineRows(task, maxSize ? maxSize : DefMaxSize, "glue");
 }
 
 
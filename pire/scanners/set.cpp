@@ -0,0 +1,101 @@
+/*
+ * set.cpp -- a set of regexps automatically split between glued scanners
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <algorithm>
+#include "set.h"
+
+namespace Pire {
+
+TVector<size_t> ScannerSet::Matches(const char* begin, const char* end) const
+{
+	TVector<size_t> matched;
+	for (auto&& group : m_groups) {
+		Scanner::State state = Runner(group.scanner).Begin().Run(begin, end).End().State();
+		ypair<const size_t*, const size_t*> accepted = group.scanner.AcceptedRegexps(state);
+		for (; accepted.first != accepted.second; ++accepted.first)
+			matched.push_back(group.ids[*accepted.first]);
+	}
+	for (auto&& fallback : m_fallbacks)
+		if (fallback.first.Final(Runner(fallback.first).Begin().Run(begin, end).End().State()))
+			matched.push_back(fallback.second);
+	std::sort(matched.begin(), matched.end());
+	return matched;
+}
+
+size_t ScannerSet::Builder::MaxStates(size_t letters) const
+{
+	// Each state takes a row of transitions by all letters, plus a header and a final index entry
+	return ymax<size_t>(m_memoryLimit / ((letters + 2) * sizeof(size_t)), 1);
+}
+
+ScannerSet ScannerSet::Builder::Build() const
+{
+	ScannerSet set;
+	set.m_regexpsCount = m_fsms.size();
+
+	// Compile regexps one by one
+	TVector<ypair<Scanner, size_t>> scanners;
+	for (size_t id = 0; id != m_fsms.size(); ++id) {
+		Fsm fsm = m_fsms[id];
+		fsm.Sparse();
+		if (fsm.Determine(MaxStates(fsm.Letters().Size()))) {
+			fsm.Minimize();
+			Scanner scanner(fsm);
+			if (scanner.BufSize() <= m_memoryLimit) {
+				scanners.push_back(ymake_pair(scanner, id));
+				continue;
+			}
+		}
+		Fsm nfa = m_fsms[id];
+		set.m_fallbacks.push_back(ymake_pair(LazyScanner(nfa), id));
+	}
+
+	// First fit decreasing: large scanners are the hardest to place,
+	// so they go first, while there is still a choice of groups
+	std::stable_sort(scanners.begin(), scanners.end(), [](const ypair<Scanner, size_t>& a, const ypair<Scanner, size_t>& b) {
+		return a.first.Size() > b.first.Size();
+	});
+
+	for (auto&& scanner : scanners) {
+		bool placed = false;
+		for (auto&& group : set.m_groups) {
+			size_t letters = ymax(group.scanner.LettersCount(), scanner.first.LettersCount());
+			Scanner glued = Scanner::Glue(group.scanner, scanner.first, MaxStates(letters));
+			if (!glued.Empty() && glued.BufSize() <= m_memoryLimit) {
+				group.scanner.Swap(glued);
+				group.ids.push_back(scanner.second);
+				placed = true;
+				break;
+			}
+		}
+		if (!placed) {
+			set.m_groups.push_back(Group());
+			set.m_groups.back().scanner.Swap(scanner.first);
+			set.m_groups.back().ids.push_back(scanner.second);
+		}
+	}
+
+	return set;
+}
+
+}
@@ -0,0 +1,123 @@
+/*
+ * set.h -- a set of regexps automatically split between glued scanners
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_SCANNERS_SET_H
+#define PIRE_SCANNERS_SET_H
+
+#include "multi.h"
+#include "lazy.h"
+#include "../fsm.h"
+#include "../stub/stl.h"
+
+namespace Pire {
+
+/**
+ * A set of regexps, each identified by its index in the order of addition,
+ * compiled into as few glued scanners as a memory budget allows.
+ *
+ *    Pire::ScannerSet::Builder builder(32 << 20);
+ *    for (auto&& pattern : patterns)
+ *        builder.Add(Pire::Lexer(pattern).Parse().Surround());
+ *    Pire::ScannerSet set = builder.Build();
+ *    TVector<size_t> matched = set.Matches(text);
+ *
+ * Regexps which cannot be determined within the budget
+ * are matched with LazyScanners instead.
+ */
+class ScannerSet {
+public:
+	class Builder;
+
+	struct Group {
+		Scanner scanner;
+		/// Regexp ids in the order of scanner's AcceptedRegexps() indices
+		TVector<size_t> ids;
+	};
+
+	ScannerSet(): m_regexpsCount(0) {}
+
+	/// Returns ids of all regexps matching the input (in ascending order).
+	/// Each group scans the input once.
+	TVector<size_t> Matches(const char* begin, const char* end) const;
+	TVector<size_t> Matches(const ystring& str) const { return Matches(str.c_str(), str.c_str() + str.size()); }
+
+	size_t RegexpsCount() const { return m_regexpsCount; }
+
+	/// Glued scanners with the ids of their regexps
+	const TVector<Group>& Groups() const { return m_groups; }
+
+	/// Regexps which could not be determined, with their ids
+	const TVector<ypair<LazyScanner, size_t>>& Fallbacks() const { return m_fallbacks; }
+
+	void Swap(ScannerSet& s)
+	{
+		m_groups.swap(s.m_groups);
+		m_fallbacks.swap(s.m_fallbacks);
+		DoSwap(m_regexpsCount, s.m_regexpsCount);
+	}
+
+private:
+	TVector<Group> m_groups;
+	TVector<ypair<LazyScanner, size_t>> m_fallbacks;
+	size_t m_regexpsCount;
+};
+
+/**
+ * Collects regexps and distributes them between glued scanners.
+ *
+ * Each regexp is compiled separately first; then, starting from the
+ * largest scanners, every scanner is glued into the first group where
+ * the result fits into the memory limit (it is the trial gluing itself
+ * which estimates the blow-up, aborting as soon as the limit is exceeded).
+ * Scanners sharing no unbounded repetitions usually glue almost additively,
+ * so they end up together, while those whose product explodes
+ * are spread among separate groups.
+ */
+class ScannerSet::Builder {
+public:
+	static const size_t DefaultMemoryLimit = 16 << 20;
+
+	/// @p memoryLimit is the maximum size of a single glued scanner in bytes
+	explicit Builder(size_t memoryLimit = DefaultMemoryLimit): m_memoryLimit(memoryLimit) {}
+
+	/// Adds a regexp, returning its id. The FSM is used as is, so it should be
+	/// surrounded if the regexp is to be matched anywhere in the input.
+	size_t Add(const Fsm& fsm)
+	{
+		m_fsms.push_back(fsm);
+		return m_fsms.size() - 1;
+	}
+
+	ScannerSet Build() const;
+
+private:
+	size_t m_memoryLimit;
+	TVector<Fsm> m_fsms;
+
+	/// Maximum number of states a scanner with the given number of letters can have
+	size_t MaxStates(size_t letters) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ * slow.cpp -- building and memoized runs of the SlowScanner
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include "slow.h"
+
+namespace Pire {
+
+namespace {
+	/// Approximate overhead of a set of states kept in a std::map
+	const size_t MapNodeOverhead = 64;
+
+	/// Memoization is abandoned for the rest of a run once misses
+	/// exceed this number plus a quarter of the steps made
+	const size_t MemoMissesAllowed = 128;
+}
+
+void SlowScanner::FinishBuild()
+{
+	// Destinations within a cell keep the order they were added in
+	std::stable_sort(m_pendingJumps.begin(), m_pendingJumps.end(), [](const PendingJump& a, const PendingJump& b) {
+		return a.cell < b.cell;
+	});
+	if (m_pendingJumps.size() >= static_cast<ui32>(-1))
+		throw Error("Too many transitions for Pire::SlowScanner");
+
+	m.cellsCount = 0;
+	for (size_t i = 0; i != m_pendingJumps.size(); ++i)
+		if (!i || m_pendingJumps[i].cell != m_pendingJumps[i - 1].cell)
+			++m.cellsCount;
+	m.jumpsCount = m_pendingJumps.size();
+	m.actionsCount = need_actions ? m.jumpsCount : 0;
+	const size_t cellsTotal = m.statesCount * m.lettersCount;
+	m.offsetsCount = cellsTotal <= MaxDirectCells ? cellsTotal + 1 : 0;
+	m.acceptedCount = 0;
+	if (m.regexpsCount > 1)
+		for (auto&& accepted : m_pendingAccepted)
+			m.acceptedCount += accepted.size();
+
+	m_buffer = BufferType(new char[BufSize()]);
+	memset(m_buffer.get(), 0, BufSize());
+	Markup(m_buffer.get());
+
+	std::copy(m_letterClasses.begin(), m_letterClasses.end(), m_letters);
+	std::copy(m_pendingFinals.begin(), m_pendingFinals.end(), m_finals);
+	if (m.regexpsCount > 1) {
+		size_t accepted = 0;
+		for (size_t state = 0; state != m.statesCount; ++state) {
+			m_acceptedIndex[state] = accepted;
+			for (auto&& id : m_pendingAccepted[state])
+				m_accepted[accepted++] = id;
+		}
+		m_acceptedIndex[m.statesCount] = accepted;
+	}
+
+	size_t cell = 0;
+	size_t state = 0;
+	for (size_t i = 0; i != m_pendingJumps.size(); ++i) {
+		const PendingJump& jump = m_pendingJumps[i];
+		if (!i || jump.cell != m_pendingJumps[i - 1].cell) {
+			const size_t letter = jump.cell % m.lettersCount;
+			for (; state <= jump.cell / m.lettersCount; ++state)
+				m_rows[state * RowSize()] = cell;
+			m_rows[(state - 1) * RowSize() + 1 + letter / 8] |= 1 << (letter % 8);
+			m_cells[cell++] = i;
+		}
+		m_jumps[i] = jump.to;
+		if (m_actions)
+			m_actions[i] = jump.action;
+	}
+	for (; state != m.statesCount; ++state)
+		m_rows[state * RowSize()] = cell;
+	m_cells[cell] = m.jumpsCount;
+
+	if (m_offsets) {
+		size_t jump = 0;
+		for (size_t cell = 0; cell != m.offsetsCount; ++cell) {
+			for (; jump != m_pendingJumps.size() && m_pendingJumps[jump].cell < cell; ++jump)
+				;
+			m_offsets[cell] = jump;
+		}
+	}
+
+	// Each group of letters is prefixed with the number of cells in the preceding ones
+	for (state = 0; state != m.statesCount; ++state) {
+		ui32* group = m_rows + state * RowSize() + 1;
+		ui32 count = 0;
+		for (ui32* end = m_rows + (state + 1) * RowSize(); group != end; ++group) {
+			ui32 mask = *group;
+			*group |= count << 8;
+			for (; mask; mask &= mask - 1)
+				++count;
+		}
+	}
+
+	TVector<Letter>().swap(m_letterClasses);
+	TVector<bool>().swap(m_pendingFinals);
+	TVector<PendingJump>().swap(m_pendingJumps);
+	TVector< TVector<ui32> >().swap(m_pendingAccepted);
+}
+
+SlowScanner SlowScanner::Glue(const SlowScanner& lhs, const SlowScanner& rhs)
+{
+	if (lhs.Empty())
+		return rhs;
+	if (rhs.Empty())
+		return lhs;
+
+	// Actions can only be kept if both operands have them
+	SlowScanner sc(lhs.need_actions && rhs.need_actions);
+
+	// Each letter of the result is a pair of letters of the operands
+	TMap<ypair<Letter, Letter>, Letter> letters;
+	TVector< ypair<Letter, Letter> > pairs;
+	sc.m_letterClasses.assign(MaxChar, 0);
+	for (size_t ch = 0; ch != MaxChar; ++ch) {
+		ypair<Letter, Letter> letter(lhs.m_letters[ch], rhs.m_letters[ch]);
+		auto ins = letters.insert(ymake_pair(letter, static_cast<Letter>(pairs.size())));
+		if (ins.second)
+			pairs.push_back(letter);
+		sc.m_letterClasses[ch] = ins.first->second;
+	}
+
+	// State 0 is the common initial state, followed by states of lhs and rhs
+	const size_t rhsOffset = 1 + lhs.m.statesCount;
+	sc.m.statesCount = rhsOffset + rhs.m.statesCount;
+	if (sc.m.statesCount >= static_cast<ui32>(-1))
+		throw Error("Too many states for Pire::SlowScanner");
+	sc.m.lettersCount = pairs.size();
+	sc.m.start = 0;
+	sc.m.regexpsCount = lhs.m.regexpsCount + rhs.m.regexpsCount;
+	sc.m_pendingFinals.assign(sc.m.statesCount, false);
+	sc.m_pendingAccepted.assign(sc.m.statesCount, TVector<ui32>());
+
+	// Makes @p to (a state of the result) behave like @p from (a state of @p src)
+	auto copy = [&](const SlowScanner& src, bool isLhs, size_t from, size_t to) {
+		const size_t offset = isLhs ? 1 : rhsOffset;
+		const size_t firstId = isLhs ? 0 : lhs.m.regexpsCount;
+
+		if (src.m_finals[from]) {
+			sc.m_pendingFinals[to] = true;
+			if (src.m.regexpsCount > 1)
+				for (size_t i = src.m_acceptedIndex[from], end = src.m_acceptedIndex[from + 1]; i != end; ++i)
+					sc.m_pendingAccepted[to].push_back(firstId + src.m_accepted[i]);
+			else
+				sc.m_pendingAccepted[to].push_back(firstId);
+		}
+
+		for (size_t letter = 0; letter != pairs.size(); ++letter) {
+			ypair<size_t, size_t> range = src.JumpRange(from, isLhs ? pairs[letter].first : pairs[letter].second);
+			for (size_t i = range.first; i != range.second; ++i) {
+				PendingJump jump = {
+					to * sc.m.lettersCount + letter,
+					static_cast<ui32>(offset + src.m_jumps[i]),
+					src.m_actions ? src.m_actions[i] : 0
+				};
+				sc.m_pendingJumps.push_back(jump);
+			}
+		}
+	};
+
+	copy(lhs, true, lhs.m.start, 0);
+	copy(rhs, false, rhs.m.start, 0);
+	for (size_t state = 0; state != lhs.m.statesCount; ++state)
+		copy(lhs, true, state, 1 + state);
+	for (size_t state = 0; state != rhs.m.statesCount; ++state)
+		copy(rhs, false, state, rhsOffset + state);
+
+	sc.FinishBuild();
+	return sc;
+}
+
+size_t SlowScanner::NewSerial()
+{
+	static std::atomic<size_t> serial(0);
+	return ++serial;
+}
+
+const char* SlowScanner::RunMemoized(State& state, const char* begin, const char* end) const
+{
+	static const ui32 Unknown = static_cast<ui32>(-1);
+
+	if (!state.memo || state.memo->scanner != m_serial)
+		state.memo.reset(new Memo(m_serial, m.statesCount));
+	Memo& memo = *state.memo;
+
+	auto intern = [&](const TVector<unsigned>& set) {
+		auto ins = memo.index.insert(ymake_pair(set, static_cast<ui32>(memo.sets.size())));
+		if (ins.second) {
+			memo.sets.push_back(&ins.first->first);
+			memo.next.resize(memo.next.size() + m.lettersCount, Unknown);
+			memo.memory += MapNodeOverhead + sizeof(unsigned) * set.size() + sizeof(ui32) * m.lettersCount;
+		}
+		return ins.first->second;
+	};
+
+	memo.states = state.states;
+	std::sort(memo.states.begin(), memo.states.end());
+	auto known = memo.index.find(memo.states);
+	if (known == memo.index.end() && memo.memory > m_memoSize)
+		return begin;
+	ui32 current = (known != memo.index.end()) ? known->second : intern(memo.states);
+
+	size_t steps = 0;
+	size_t misses = 0;
+	for (; begin != end; ++begin, ++steps) {
+		Char letter = Translate(static_cast<unsigned char>(*begin));
+		size_t slot = current * m.lettersCount + letter;
+		if (memo.next[slot] == Unknown) {
+			if (memo.memory > m_memoSize || ++misses > MemoMissesAllowed + steps / 4)
+				break;
+			memo.states.clear();
+			Collect(*memo.sets[current], memo.states, memo.flags, letter);
+			for (auto&& st : memo.states)
+				memo.flags.Reset(st);
+			std::sort(memo.states.begin(), memo.states.end());
+			ui32 found = intern(memo.states);
+			memo.next[slot] = found;
+		}
+		current = memo.next[slot];
+	}
+
+	for (auto&& st : state.states)
+		state.flags.Reset(st);
+	state.states = *memo.sets[current];
+	for (auto&& st : state.states)
+		state.flags.Set(st);
+	return begin;
+}
+
+}
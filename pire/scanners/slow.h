@@ -32,6 +32,9 @@
 #include "../fsm.h"
 #include "../run.h"
 #include "../stub/saveload.h"
+#include "../platform.h"
+#include <algorithm>
+#include <memory>
 
 #ifdef PIRE_DEBUG
 #include <iostream>
@@ -60,20 +63,58 @@ public:
 		DeadFlag  = 0
 	};
 
+	/// Transitions between sets of states memoized by Run()
+	struct Memo {
+		/// Serial number of the scanner the transitions belong to
+		size_t scanner;
+		/// Sets of states (sorted) met so far, and transitions between them
+		TMap<TVector<unsigned>, ui32> index;
+		TVector<const TVector<unsigned>*> sets;
+		TVector<ui32> next;
+		size_t memory;
+		/// Scratch space for stepping through unknown transitions
+		TVector<unsigned> states;
+		BitSet flags;
+
+		Memo(size_t scanner, size_t size): scanner(scanner), memory(0), flags(size) {}
+	};
+
 	struct State {
 		TVector<unsigned> states;
+		/// Marks exactly the states listed in states
 		BitSet flags;
+		/// Preallocated storage for the next set of states
+		TVector<unsigned> spare;
+		/// Storage for AcceptedRegexps() of a glued scanner
+		mutable TVector<size_t> accepted;
+		/// Transitions memoized by Run(), reused by later runs from this state
+		/// (a copy of the state starts with none)
+		std::unique_ptr<Memo> memo;
 
 		State() {}
 		State(size_t size): flags(size) { states.reserve(size); }
-		void Swap(State& s) { states.swap(s.states); flags.Swap(s.flags); }
+		State(const State& s): states(s.states), flags(s.flags), spare(s.spare), accepted(s.accepted) {}
+		State& operator = (const State& s)
+		{
+			states = s.states;
+			flags = s.flags;
+			spare = s.spare;
+			accepted = s.accepted;
+			return *this;
+		}
+		void Swap(State& s) { states.swap(s.states); flags.Swap(s.flags); spare.swap(s.spare); accepted.swap(s.accepted); memo.swap(s.memo); }
 
 #ifdef PIRE_DEBUG
 		friend yostream& operator << (yostream& stream, const State& state) { return stream << Join(state.states.begin(), state.states.end(), ", "); }
 #endif
 	};
 
-	SlowScanner(bool needActions = false) {
+	/// A reasonable limit to pass to SetMemoSize()
+	static const size_t SuggestedMemoSize = 256 << 10;
+
+	SlowScanner(bool needActions = false)
+		: m_serial(NewSerial())
+	{
 		Alias(Null());
 		need_actions = needActions;
 	}
@@ -85,7 +126,7 @@ public:
 	bool Empty() const { return m_finals == Null().m_finals; }
 	
 	size_t Id() const {return (size_t) -1;}
-	size_t RegexpsCount() const { return Empty() ? 0 : 1; }
+	size_t RegexpsCount() const { return Empty() ? 0 : m.regexpsCount; }
 
 	void Initialize(State& state) const
 	{
@@ -93,8 +134,25 @@ public:
 		state.states.reserve(m.statesCount);
 		state.states.push_back(m.start);
 		BitSet(m.statesCount).Swap(state.flags);
+		state.flags.Set(m.start);
+		state.spare.reserve(m.statesCount);
 	}
 
+	/**
+	 * Sets the memory limit for transitions memoized by Run().
+	 *
+	 * On long inputs, Run() remembers each set of states it comes across
+	 * along with transitions from it, so that repeated sets are stepped
+	 * through with a single lookup (like LazyScanner does, but the memo is
+	 * kept in the State rather than shared). Later runs from the same state
+	 * reuse the memo. Once the limit is hit, or if sets hardly repeat,
+	 * the rest of the input is scanned without memoization.
+	 * The memo is allocated per state, so this is off (zero) by default.
+	 * The limit is not saved with the scanner.
+	 */
+	void SetMemoSize(size_t size) { m_memoSize = size; }
+	size_t MemoSize() const { return m_memoSize; }
+
 	Char Translate(Char ch) const
 	{
 		return m_letters[static_cast<size_t>(ch)];
@@ -102,30 +160,11 @@ public:
 
 	Action NextTranslated(const State& current, State& next, Char l) const
 	{
-		next.flags.Clear();
+		// Resetting just the marked flags is much cheaper than clearing them all
+		for (auto&& state : next.states)
+			next.flags.Reset(state);
 		next.states.clear();
-		for (auto&& state : current.states) {
-			const unsigned* begin = 0;
-			const unsigned* end = 0;
-			if (!m_vecptr) {
-				const size_t* pos = m_jumpPos + state * m.lettersCount + l;
-				begin = m_jumps + pos[0];
-				end = m_jumps + pos[1];
-			} else {
-				const auto& v = (*m_vecptr)[state * m.lettersCount + l];
-				if (!v.empty()) {
-					begin = &v[0];
-					end = &v[0] + v.size();
-				}
-			}
-
-			for (; begin != end; ++begin)
-				if (!next.flags.Test(*begin)) {
-					next.flags.Set(*begin);
-					next.states.push_back(*begin);
-				}
-		}
-
+		Collect(current.states, next.states, next.flags, l);
 		return 0;
 	}
 
@@ -138,10 +177,12 @@ public:
 
 	Action NextTranslated(State& s, Char l) const
 	{
-		State dest(m.statesCount);
-		Action a = NextTranslated(s, dest, l);
-		s.Swap(dest);
-		return a;
+		for (auto&& state : s.states)
+			s.flags.Reset(state);
+		s.spare.clear();
+		Collect(s.states, s.spare, s.flags, l);
+		s.states.swap(s.spare);
+		return 0;
 	}
 
 	Action Next(State& s, Char c) const
@@ -162,8 +203,20 @@ public:
 		return false;
 	}
 
+	/// Returns ids of the regexps accepted in the state, in ascending order.
+	/// For glued scanners, the ids are kept in the state and are only valid
+	/// until the next call.
 	ypair<const size_t*, const size_t*> AcceptedRegexps(const State& s) const {
-		return Final(s) ? Accept() : Deny();
+		if (m.regexpsCount <= 1)
+			return Final(s) ? Accept() : Deny();
+		s.accepted.clear();
+		for (auto&& state : s.states)
+			for (size_t i = m_acceptedIndex[state], end = m_acceptedIndex[state + 1]; i != end; ++i)
+				s.accepted.push_back(m_accepted[i]);
+		std::sort(s.accepted.begin(), s.accepted.end());
+		s.accepted.erase(std::unique(s.accepted.begin(), s.accepted.end()), s.accepted.end());
+		const size_t* begin = s.accepted.empty() ? 0 : &s.accepted[0];
+		return ymake_pair(begin, begin + s.accepted.size());
 	}
 
 	bool CanStop(const State& s) const {
@@ -173,7 +226,7 @@ public:
 	const void* Mmap(const void* ptr, size_t size)
 	{
 		Impl::CheckAlign(ptr);
-		SlowScanner s;
+		SlowScanner s(need_actions);
 		const size_t* p = reinterpret_cast<const size_t*>(ptr);
 
 		Impl::ValidateHeader(p, size, ScannerIOTypes::SlowScanner, sizeof(s.m));
@@ -188,69 +241,66 @@ public:
 		if (empty)
 			s.Alias(Null());
 		else {
-			s.m_vecptr = 0;
-			Impl::MapPtr(s.m_letters, MaxChar, p, size);
-			Impl::MapPtr(s.m_finals, s.m.statesCount, p, size);
-			Impl::MapPtr(s.m_jumpPos, s.m.statesCount * s.m.lettersCount + 1, p, size);
-			Impl::MapPtr(s.m_jumps, s.m_jumpPos[s.m.statesCount * s.m.lettersCount], p, size);
-			if (need_actions)
-				Impl::MapPtr(s.m_actions, s.m_jumpPos[s.m.statesCount * s.m.lettersCount], p, size);
-			Swap(s);
+			s.CheckActions();
+			if (size < s.BufSize())
+				throw Error("EOF reached while mapping Pire::SlowScanner");
+			s.Markup(const_cast<size_t*>(p));
+			Impl::AdvancePtr(p, size, s.BufSize());
 		}
+		Swap(s);
 		return (const void*) p;
 	}
 
 	void Swap(SlowScanner& s)
 	{
-		DoSwap(m_finals, s.m_finals);
-		DoSwap(m_jumps, s.m_jumps);
-		DoSwap(m_actions, s.m_actions);
-		DoSwap(m_jumpPos, s.m_jumpPos);
 		DoSwap(m.statesCount, s.m.statesCount);
 		DoSwap(m.lettersCount, s.m.lettersCount);
 		DoSwap(m.start, s.m.start);
+		DoSwap(m.cellsCount, s.m.cellsCount);
+		DoSwap(m.jumpsCount, s.m.jumpsCount);
+		DoSwap(m.actionsCount, s.m.actionsCount);
+		DoSwap(m.regexpsCount, s.m.regexpsCount);
+		DoSwap(m.acceptedCount, s.m.acceptedCount);
+		DoSwap(m.offsetsCount, s.m.offsetsCount);
+		DoSwap(m_memoSize, s.m_memoSize);
+		DoSwap(m_serial, s.m_serial);
+		DoSwap(m_buffer, s.m_buffer);
 		DoSwap(m_letters, s.m_letters);
-		DoSwap(m_pool, s.m_pool);
-		DoSwap(m_vec, s.m_vec);
-		
-		DoSwap(m_vecptr, s.m_vecptr);
+		DoSwap(m_finals, s.m_finals);
+		DoSwap(m_acceptedIndex, s.m_acceptedIndex);
+		DoSwap(m_accepted, s.m_accepted);
+		DoSwap(m_rows, s.m_rows);
+		DoSwap(m_cells, s.m_cells);
+		DoSwap(m_jumps, s.m_jumps);
+		DoSwap(m_actions, s.m_actions);
+		DoSwap(m_offsets, s.m_offsets);
 		DoSwap(need_actions, s.need_actions);
-		DoSwap(m_actionsvec, s.m_actionsvec);
-		if (m_vecptr == &s.m_vec)
-			m_vecptr = &m_vec;
-		if (s.m_vecptr == &m_vec)
-			s.m_vecptr = &s.m_vec;
+		DoSwap(m_pendingFinals, s.m_pendingFinals);
+		DoSwap(m_pendingJumps, s.m_pendingJumps);
+		DoSwap(m_pendingAccepted, s.m_pendingAccepted);
 	}
 
 	SlowScanner(const SlowScanner& s)
 		: m(s.m)
-		, m_vec(s.m_vec)
+		, m_memoSize(s.m_memoSize)
+		, m_serial(NewSerial())
 		, need_actions(s.need_actions)
-		, m_actionsvec(s.m_actionsvec)
 	{
-		if (s.m_vec.empty()) {
+		if (!s.m_buffer) {
 			// Empty or mmap()-ed scanner, just copy pointers
-			m_finals = s.m_finals;
-			m_jumps = s.m_jumps;
-			m_actions = s.m_actions;
-			m_jumpPos = s.m_jumpPos;
-			m_letters = s.m_letters;
-			m_vecptr = 0;
+			Alias(s);
 		} else {
 			// In-memory scanner, perform deep copy
-			alloc(m_letters, MaxChar);
-			memcpy(m_letters, s.m_letters, sizeof(*m_letters) * MaxChar);
-			m_jumps = 0;
-			m_jumpPos = 0;
-			m_actions = 0;
-			alloc(m_finals, m.statesCount);
-			memcpy(m_finals, s.m_finals, sizeof(*m_finals) * m.statesCount);
-			m_vecptr = &m_vec;
+			m_buffer = BufferType(new char[BufSize()]);
+			memcpy(m_buffer.get(), s.m_buffer.get(), BufSize());
+			Markup(m_buffer.get());
 		}
 	}
 
 	explicit SlowScanner(Fsm& fsm, bool needActions = false, bool removeEpsilons = true, size_t distance = 0)
-		: need_actions(needActions)
+		: m_memoSize(0)
+		, m_serial(NewSerial())
+		, need_actions(needActions)
 	{
 		if (distance) {
 			fsm = CreateApproxFsm(fsm, distance);
@@ -261,69 +311,78 @@ public:
 
 		m.statesCount = fsm.Size();
 		m.lettersCount = fsm.Letters().Size();
+		m.start = fsm.Initial();
+		m.regexpsCount = 1;
 
-		m_vec.resize(m.statesCount * m.lettersCount);
-		if (need_actions)
-			m_actionsvec.resize(m.statesCount * m.lettersCount);
-		m_vecptr = &m_vec;
-		alloc(m_letters, MaxChar);
-		m_jumps = 0;
-		m_actions = 0;
-		m_jumpPos = 0;
-		alloc(m_finals, m.statesCount);
-
-		// Build letter translation table
-		Fill(m_letters, m_letters + MaxChar, 0);
+		// Letter translation table is needed by SetJump() during the build
+		m_letterClasses.assign(MaxChar, 0);
 		for (auto&& letter : fsm.Letters())
 			for (auto&& character : letter.second.second)
-				m_letters[character] = letter.second.first;
+				m_letterClasses[character] = letter.second.first;
 
-		m.start = fsm.Initial();
+		m_pendingFinals.assign(m.statesCount, false);
 		BuildScanner(fsm, *this);
 	}
 
 	SlowScanner& operator = (const SlowScanner& s) { SlowScanner(s).Swap(*this); return *this; }
 
-	~SlowScanner()
-	{
-		for (auto&& i : m_pool)
-			free(i);
-	}
+	/**
+	 * Agglutinates two scanners together into a scanner which
+	 * checks a string against the regexps of both in a single pass.
+	 * The result is an NFA holding states of both operands
+	 * (plus a common initial state), so its size is just the sum
+	 * of their sizes, but a step takes as long as both steps did.
+	 * Regexps of @p rhs are numbered after the ones of @p lhs
+	 * in AcceptedRegexps().
+	 */
+	static SlowScanner Glue(const SlowScanner& lhs, const SlowScanner& rhs);
 
 	void Save(yostream*) const;
 	void Load(yistream*);
 
 	const State& StateIndex(const State& s) const { return s; }
 
-protected:
-	bool IsMmaped() const
-	{
-		return (!m_vecptr);
-	}
+	/// Runs the scanner through the input with memoization (see SetMemoSize()),
+	/// until the end of the input or until memoization stops paying off.
+	/// Returns the position where it stopped.
+	const char* RunMemoized(State& state, const char* begin, const char* end) const;
 
-	size_t GetJump(size_t pos) const
+	/// Size of the transition tables in bytes
+	size_t BufSize() const
 	{
-		return m_jumps[pos];
+		return
+			Impl::AlignUp(MaxChar * sizeof(*m_letters), sizeof(size_t))
+			+ Impl::AlignUp(m.statesCount * sizeof(*m_finals), sizeof(size_t))
+			+ Impl::AlignUp(AcceptedIndexSize() * sizeof(*m_acceptedIndex), sizeof(size_t))
+			+ Impl::AlignUp(m.acceptedCount * sizeof(*m_accepted), sizeof(size_t))
+			+ Impl::AlignUp(m.statesCount * RowSize() * sizeof(*m_rows), sizeof(size_t))
+			+ Impl::AlignUp((m.cellsCount + 1) * sizeof(*m_cells), sizeof(size_t))
+			+ Impl::AlignUp(m.jumpsCount * sizeof(*m_jumps), sizeof(size_t))
+			+ Impl::AlignUp(m.actionsCount * sizeof(*m_actions), sizeof(size_t))
+			+ Impl::AlignUp(m.offsetsCount * sizeof(*m_offsets), sizeof(size_t))
+			;
 	}
 
-	Action& GetAction(size_t pos) const
-	{
-		return m_actions[pos];
-	}
-
-	const TVector<Action>& GetActionsVec(size_t from) const
+protected:
+	/// Returns the range of positions in the jump (and action) table
+	/// holding transitions from @p state by @p letter
+	ypair<size_t, size_t> JumpRange(size_t state, Char letter) const
 	{
-		return m_actionsvec[from];
+		if (m_offsets) {
+			const size_t cell = state * m.lettersCount + letter;
+			return ypair<size_t, size_t>(m_offsets[cell], m_offsets[cell + 1]);
+		}
+		return CellRange(m_rows + state * RowSize(), m_cells, letter);
 	}
 
-	const TVector<unsigned int>& GetJumpsVec(size_t from) const
+	size_t GetJump(size_t pos) const
 	{
-		return m_vec[from];
+		return m_jumps[pos];
 	}
 
-	size_t* GetJumpPos() const
+	Action GetAction(size_t pos) const
 	{
-		return m_jumpPos;
+		return m_actions[pos];
 	}
 
 	size_t GetStart() const
@@ -342,16 +401,59 @@ private:
 		size_t statesCount;
 		size_t lettersCount;
 		size_t start;
+		/// Number of non-empty (state, letter) cells
+		size_t cellsCount;
+		size_t jumpsCount;
+		/// Either jumpsCount or zero, if the scanner was built without actions
+		size_t actionsCount;
+		size_t regexpsCount;
+		/// Number of (final state, regexp) pairs, only kept for glued scanners
+		size_t acceptedCount;
+		/// Number of (state, letter) cells plus one, if they are few enough
+		/// to be indexed directly, or zero
+		size_t offsetsCount;
 	} m;
 
+	size_t m_memoSize;
+	/// Tells memos in states of different scanners apart
+	size_t m_serial;
+
+	/*
+	 * All tables are kept in a single buffer (or an mmap()-ed region)
+	 * in the following layout, each table aligned on sizeof(size_t):
+	 *
+	 *   m_letters  letter class of each character
+	 *   m_finals   whether each state is final
+	 *   m_acceptedIndex  for each state (plus one), index of its first
+	 *              accepted regexp (only if there are several regexps)
+	 *   m_accepted ids of regexps accepted in each state
+	 *   m_rows     for each state, index of its first non-empty cell, followed
+	 *              by a bitmap of letters it has transitions by, split into
+	 *              groups of 8 letters, each prefixed with the number
+	 *              of letters set in the preceding groups
+	 *   m_cells    for each non-empty cell (plus one), index of its first jump
+	 *   m_jumps    destination states
+	 *   m_actions  actions of the jumps (only if built with actions)
+	 *   m_offsets  for each (state, letter) cell (plus one), index of its
+	 *              first jump (only if there are at most MaxDirectCells cells)
+	 *
+	 * So empty cells take 4 bits, and a non-empty one takes
+	 * 4 bytes plus 4 (or 8, with actions) bytes per destination.
+	 * Small scanners also spend 4 bytes per cell on m_offsets,
+	 * which saves a row lookup on each step.
+	 */
+	using BufferType = std::unique_ptr<char[]>;
+	BufferType m_buffer;
+
+	Letter* m_letters;
 	bool* m_finals;
-	unsigned* m_jumps;
+	ui32* m_acceptedIndex;
+	ui32* m_accepted;
+	ui32* m_rows;
+	ui32* m_cells;
+	ui32* m_jumps;
 	Action* m_actions;
-	size_t* m_jumpPos;
-	size_t* m_letters;
-
-	TVector<void*> m_pool;
-	TVector< TVector<unsigned> > m_vec, *m_vecptr;
+	ui32* m_offsets;
 
 	// Only used to force Null() call during static initialization, when Null()::n can be
 	// initialized safely by compilers that don't support thread safe static local vars
@@ -359,49 +461,139 @@ private:
 	static const SlowScanner* m_null;
 
 	bool need_actions;
-	TVector<TVector<Action>> m_actionsvec;
+
+	/// Transitions collected by BuildScanner(), packed into the buffer by FinishBuild()
+	struct PendingJump {
+		size_t cell;
+		ui32 to;
+		Action action;
+	};
+	TVector<Letter> m_letterClasses;
+	TVector<bool> m_pendingFinals;
+	TVector<PendingJump> m_pendingJumps;
+	/// Accepted regexps of each state, only used when gluing
+	TVector< TVector<ui32> > m_pendingAccepted;
+
 	static const SlowScanner& Null();
 
-	template<class T> void alloc(T*& p, size_t size)
+	static size_t NewSerial();
+
+	/// Largest number of cells indexed directly (their offsets fit in L1 cache)
+	static const size_t MaxDirectCells = 4096;
+
+	/// Number of 32-bit words in a row: the first cell index and letter groups
+	size_t RowSize() const { return m.lettersCount / 8 + 2; }
+
+	size_t AcceptedIndexSize() const { return m.regexpsCount > 1 ? m.statesCount + 1 : 0; }
+
+	void Markup(void* buf)
+	{
+		char* p = static_cast<char*>(buf);
+		m_letters = reinterpret_cast<Letter*>(p);
+		p += Impl::AlignUp(MaxChar * sizeof(*m_letters), sizeof(size_t));
+		m_finals = reinterpret_cast<bool*>(p);
+		p += Impl::AlignUp(m.statesCount * sizeof(*m_finals), sizeof(size_t));
+		m_acceptedIndex = reinterpret_cast<ui32*>(p);
+		p += Impl::AlignUp(AcceptedIndexSize() * sizeof(*m_acceptedIndex), sizeof(size_t));
+		m_accepted = reinterpret_cast<ui32*>(p);
+		p += Impl::AlignUp(m.acceptedCount * sizeof(*m_accepted), sizeof(size_t));
+		m_rows = reinterpret_cast<ui32*>(p);
+		p += Impl::AlignUp(m.statesCount * RowSize() * sizeof(*m_rows), sizeof(size_t));
+		m_cells = reinterpret_cast<ui32*>(p);
+		p += Impl::AlignUp((m.cellsCount + 1) * sizeof(*m_cells), sizeof(size_t));
+		m_jumps = reinterpret_cast<ui32*>(p);
+		p += Impl::AlignUp(m.jumpsCount * sizeof(*m_jumps), sizeof(size_t));
+		m_actions = m.actionsCount ? reinterpret_cast<Action*>(p) : 0;
+		p += Impl::AlignUp(m.actionsCount * sizeof(*m_actions), sizeof(size_t));
+		m_offsets = m.offsetsCount ? reinterpret_cast<ui32*>(p) : 0;
+	}
+
+	void CheckActions() const
 	{
-		p = static_cast<T*>(malloc(size * sizeof(T)));
-		memset(p, 0, size * sizeof(T));
-		m_pool.push_back(p);
+		if (need_actions && m.jumpsCount && !m.actionsCount)
+			throw Error("Serialized Pire::SlowScanner has no actions");
 	}
 	
 	void Alias(const SlowScanner& s)
 	{		
 		memcpy(&m, &s.m, sizeof(m));
-		m_vec.clear();
-		need_actions = s.need_actions;
-		m_actionsvec.clear();
+		m_memoSize = s.m_memoSize;
+		m_buffer.reset();
+		m_letters = s.m_letters;
 		m_finals = s.m_finals;
+		m_acceptedIndex = s.m_acceptedIndex;
+		m_accepted = s.m_accepted;
+		m_rows = s.m_rows;
+		m_cells = s.m_cells;
 		m_jumps = s.m_jumps;
 		m_actions = s.m_actions;
-		m_jumpPos = s.m_jumpPos;
-		m_letters = s.m_letters;
-		m_vecptr = s.m_vecptr;
-		m_pool.clear();
+		m_offsets = s.m_offsets;
 	}
 	
 	void SetJump(size_t oldState, Char c, size_t newState, unsigned long action)
 	{
-		Y_ASSERT(!m_vec.empty());
 		Y_ASSERT(oldState < m.statesCount);
 		Y_ASSERT(newState < m.statesCount);
 
-		size_t idx = oldState * m.lettersCount + m_letters[c];
-		m_vec[idx].push_back(newState);
-		if (need_actions)
-			m_actionsvec[idx].push_back(action);
+		PendingJump jump = { oldState * m.lettersCount + m_letterClasses[c], static_cast<ui32>(newState), static_cast<Action>(action) };
+		m_pendingJumps.push_back(jump);
 	}
 
 	unsigned long RemapAction(unsigned long action) { return action; }
 
+	/// Looks up the cell of @p letter in the @p row of a state
+	static PIRE_FORCED_INLINE
+	ypair<size_t, size_t> CellRange(const ui32* row, const ui32* cells, Char letter)
+	{
+		const ui32 group = row[1 + letter / 8];
+		const ui32 bit = 1 << (letter % 8);
+		if (!(group & bit))
+			return ypair<size_t, size_t>(0, 0);
+		// A byte-wide popcount is cheap even without a dedicated instruction
+		ui32 below = group & (bit - 1);
+		below = below - ((below >> 1) & 0x55);
+		below = (below & 0x33) + ((below >> 2) & 0x33);
+		below = (below + (below >> 4)) & 0x0F;
+		const size_t cell = row[0] + (group >> 8) + below;
+		return ypair<size_t, size_t>(cells[cell], cells[cell + 1]);
+	}
+
+	/// Adds all states reachable from @p from by @p l to @p to,
+	/// unless they are already marked in @p flags
+	void Collect(const TVector<unsigned>& from, TVector<unsigned>& to, BitSet& flags, Char l) const
+	{
+		// Flags are bytes which may alias anything, so tables are kept in locals
+		const ui32* jumps = m_jumps;
+		if (const ui32* offsets = m_offsets) {
+			const size_t lettersCount = m.lettersCount;
+			for (auto&& state : from) {
+				const size_t cell = state * lettersCount + l;
+				for (const ui32* jump = jumps + offsets[cell], *end = jumps + offsets[cell + 1]; jump != end; ++jump)
+					if (!flags.Test(*jump)) {
+						flags.Set(*jump);
+						to.push_back(*jump);
+					}
+			}
+			return;
+		}
+
+		const ui32* rows = m_rows;
+		const ui32* cells = m_cells;
+		const size_t rowSize = RowSize();
+		for (auto&& state : from) {
+			ypair<size_t, size_t> range = CellRange(rows + state * rowSize, cells, l);
+			for (const ui32* jump = jumps + range.first, *end = jumps + range.second; jump != end; ++jump)
+				if (!flags.Test(*jump)) {
+					flags.Set(*jump);
+					to.push_back(*jump);
+				}
+		}
+	}
+
 	void SetInitial(size_t state) { m.start = state; }
-	void SetTag(size_t state, ui8 tag) { m_finals[state] = (tag != 0); }
+	void SetTag(size_t state, ui8 tag) { m_pendingFinals[state] = (tag != 0); }
 	
-	void FinishBuild() {}
+	void FinishBuild();
 
 	static ypair<const size_t*, const size_t*> Accept()
 	{
@@ -436,18 +628,13 @@ inline const SlowScanner& SlowScanner::Null()
 template<>
 inline void Run<SlowScanner>(const SlowScanner& scanner, SlowScanner::State& state, const char* begin, const char* end)
 {
-	SlowScanner::State temp;
-	scanner.Initialize(temp);
+	// Short inputs are not worth memoizing
+	static const ptrdiff_t MinMemoizedRun = 256;
+	if (end - begin >= MinMemoizedRun && scanner.MemoSize())
+		begin = scanner.RunMemoized(state, begin, end);
 
-	SlowScanner::State* src = &state;
-	SlowScanner::State* dest = &temp;
-
-	for (; begin != end; ++begin) {
-		scanner.Next(*src, *dest, static_cast<unsigned char>(*begin));
-		DoSwap(src, dest);
-	}
-	if (src != &state)
-		state = *src;
+	for (; begin != end; ++begin)
+		scanner.NextTranslated(state, scanner.Translate(static_cast<unsigned char>(*begin)));
 }
 #endif
 
@@ -0,0 +1,154 @@
+/*
+ * tuple.h -- definition of the tuple of scanners
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_SCANNER_TUPLE_INCLUDED
+#define PIRE_SCANNER_TUPLE_INCLUDED
+
+#include <tuple>
+#include <type_traits>
+#include "../stub/stl.h"
+#include "../stub/lexical_cast.h"
+#include "../platform.h"
+
+namespace Pire {
+
+namespace Impl {
+	template<size_t... I>
+	struct Indices {};
+
+	template<size_t N, size_t... I>
+	struct MakeIndices: MakeIndices<N - 1, N - 1, I...> {};
+
+	template<size_t... I>
+	struct MakeIndices<0, I...> { typedef Indices<I...> Type; };
+
+	/// Evaluates its arguments (packs expanded into them are evaluated
+	/// in order, since they are braced initializers)
+	struct Unroll {
+		template<class... T>
+		Unroll(T&&...) {}
+	};
+}
+
+	/**
+	 * A tuple of scanners of any types, providing the interface of a scanner
+	 * itself, as ScannerPair does for two of them. Each input character is read
+	 * once and fed to all the scanners in turn, with no loops over them.
+	 *
+	 * The tuple is final if any of the scanners is, and dead if all of them are,
+	 * so LongestPrefix() and ShortestPrefix() find the longest (shortest) prefix
+	 * any scanner matches. States of the scanners are std::get<I>() of the state.
+	 */
+	template<class... Scanners>
+	class ScannerTuple {
+	public:
+		typedef std::tuple<typename Scanners::State...> State;
+		typedef std::tuple<typename Scanners::Action...> Action;
+
+		static const size_t Size = sizeof...(Scanners);
+
+		template<size_t I>
+		using Member = typename std::tuple_element<I, std::tuple<Scanners...>>::type;
+
+		ScannerTuple(): m_scanners() {}
+
+		explicit ScannerTuple(const Scanners&... scanners): m_scanners(&scanners...) {}
+
+		void Initialize(State& state) const { Initialize(state, Seq()); }
+
+		PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+		Action Next(State& state, Char ch) const { return Next(state, ch, Seq()); }
+
+		PIRE_FORCED_INLINE PIRE_HOT_FUNCTION
+		void TakeAction(State& state, const Action& action) const { TakeAction(state, action, Seq()); }
+
+		bool Final(const State& state) const { return Final(state, Index<0>()); }
+
+		bool Dead(const State& state) const { return Dead(state, Index<0>()); }
+
+		/// Only used for debug output
+		ystring StateIndex(const State& state) const { return StateIndex(state, Seq()); }
+
+		/// The I-th scanner
+		template<size_t I>
+		const Member<I>& Get() const { return *std::get<I>(m_scanners); }
+
+	private:
+		typedef typename Impl::MakeIndices<Size>::Type Seq;
+
+		std::tuple<const Scanners*...> m_scanners;
+
+		template<size_t... I>
+		void Initialize(State& state, Impl::Indices<I...>) const
+		{
+			Impl::Unroll{(std::get<I>(m_scanners)->Initialize(std::get<I>(state)), 0)...};
+		}
+
+		template<size_t... I>
+		PIRE_FORCED_INLINE
+		Action Next(State& state, Char ch, Impl::Indices<I...>) const
+		{
+			return Action{std::get<I>(m_scanners)->Next(std::get<I>(state), ch)...};
+		}
+
+		template<size_t... I>
+		PIRE_FORCED_INLINE
+		void TakeAction(State& state, const Action& action, Impl::Indices<I...>) const
+		{
+			Impl::Unroll{(std::get<I>(m_scanners)->TakeAction(std::get<I>(state), std::get<I>(action)), 0)...};
+		}
+
+		template<size_t I>
+		using Index = std::integral_constant<size_t, I>;
+
+		template<size_t I>
+		bool Final(const State& state, Index<I>) const
+		{
+			return std::get<I>(m_scanners)->Final(std::get<I>(state)) || Final(state, Index<I + 1>());
+		}
+		bool Final(const State&, Index<Size>) const { return false; }
+
+		template<size_t I>
+		bool Dead(const State& state, Index<I>) const
+		{
+			return std::get<I>(m_scanners)->Dead(std::get<I>(state)) && Dead(state, Index<I + 1>());
+		}
+		bool Dead(const State&, Index<Size>) const { return true; }
+
+		template<size_t... I>
+		ystring StateIndex(const State& state, Impl::Indices<I...>) const
+		{
+			ystring index;
+			Impl::Unroll{(index += (I ? ", " : "[") + ToString(std::get<I>(m_scanners)->StateIndex(std::get<I>(state))), 0)...};
+			return index + "]";
+		}
+	};
+
+	template<class... Scanners>
+	ScannerTuple<Scanners...> MakeScannerTuple(const Scanners&... scanners)
+	{
+		return ScannerTuple<Scanners...>(scanners...);
+	}
+}
+
+#endif
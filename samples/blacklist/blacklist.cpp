@@ -43,6 +43,11 @@
  * In this example, blacklist items are treated as fixed strings (if you read 'blabla.com',
  * you might expect dot to mean precisely one dot, not any symbol), but there's nothing
  * to prevent you from reading arbitrary regexps.
+ *
+ * If you also want to catch misspelled domains (say, 'blabal.com'), approximate regexps
+ * will not help with a large blacklist, as they grow too fast. Instead, the domains
+ * can be put into a FuzzyDictionary (see Fuzzy()), which looks up the domain of each URL
+ * (and its parent domains) within the given edit distance.
  */
 
 #include <iostream>
@@ -52,12 +57,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pire/pire.h>
+#ifdef BLACKLIST_EXTRA_ENABLED
+#include <pire/extra.h>
+#endif
 #include "../../tools/common/filemap.h"
 
 void Usage()
 {
     std::cerr << "Usage: blacklist -g -d <filename>  -- reads series of domains and makes a dictionary\n"
               << "       blacklist -u -d <filename>  -- reads the dictionary and passes matching URLs to stdout\n"
+#ifdef BLACKLIST_EXTRA_ENABLED
+              << "       blacklist -f <distance> -d <filename>  -- reads series of domains from the file and passes URLs\n"
+              << "                                                 with domains within the distance to stdout\n"
+#endif
               << std::endl;
     exit(1);
 }
@@ -92,6 +104,40 @@ void Use(const std::string& filename)
     Filter(sc);
 }
 
+#ifdef BLACKLIST_EXTRA_ENABLED
+size_t distance = 0;
+
+void Fuzzy(const std::string& filename)
+{
+    Pire::TVector<std::string> domains;
+    std::ifstream ifs(filename.c_str());
+    std::string domain;
+    while (ifs >> domain)
+        domains.push_back(domain);
+    Pire::FuzzyDictionary dict(domains, distance);
+
+    std::string url;
+    while (std::cin >> url) {
+        // Strip the scheme and the local path
+        size_t begin = url.find("://");
+        begin = (begin == std::string::npos) ? 0 : begin + 3;
+        size_t end = url.find('/', begin);
+        std::string host = url.substr(begin, (end == std::string::npos) ? std::string::npos : end - begin);
+
+        // Look up the host and all its parent domains
+        for (size_t pos = 0;; ++pos) {
+            if (dict.MinDistance(host.substr(pos)) != Pire::FuzzyDictionary::NoMatch) {
+                std::cout << url << std::endl;
+                break;
+            }
+            pos = host.find('.', pos);
+            if (pos == std::string::npos)
+                break;
+        }
+    }
+}
+#endif
+
 #ifndef _WIN32
 #include <libgen.h>
 #else
@@ -117,6 +163,12 @@ int main(int argc, char** argv)
                 mode = Generate;
             } else if (!strcmp(*argv, "-u")) {
                 mode = Use;
+#ifdef BLACKLIST_EXTRA_ENABLED
+            } else if (!strcmp(*argv, "-f") && argc >= 2) {
+                mode = Fuzzy;
+                distance = strtoul(argv[1], 0, 10);
+                ++argv; --argc;
+#endif
             } else
                 Usage();
         }
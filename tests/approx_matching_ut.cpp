@@ -21,6 +21,7 @@
 
 
 #include <pire.h>
+#include <extra.h>
 #include "common.h"
 
 SIMPLE_UNIT_TEST_SUITE(ApproxMatchingTest) {
@@ -376,4 +377,114 @@ SIMPLE_UNIT_TEST_SUITE(ApproxMatchingTest) {
 			}
 		}
 	}
+
+	size_t LiteralDistance(const Pire::ApproxLiteralScanner& scanner, const ystring& text)
+	{
+		return scanner.Distance(RunRegexp(scanner, text));
+	}
+
+	SIMPLE_UNIT_TEST(ApproxLiteral) {
+		UNIT_ASSERT(Pire::ApproxLiteralScanner::Suitable(BuildFsm("^a[bc].d$"), 2));
+		UNIT_ASSERT(Pire::ApproxLiteralScanner::Suitable(BuildFsm("abc").Surround(), 2));
+		UNIT_ASSERT(!Pire::ApproxLiteralScanner::Suitable(BuildFsm("^(ab|cd)$"), 1));
+		UNIT_ASSERT(!Pire::ApproxLiteralScanner::Suitable(BuildFsm("^.*ab$"), 1));
+		UNIT_ASSERT(!Pire::ApproxLiteralScanner::Suitable(BuildFsm("^abc$"), Pire::ApproxLiteralScanner::MaxDistance + 1));
+
+		auto fsm = BuildFsm("abcdef").Surround();
+		Pire::ApproxLiteralScanner scanner = Pire::Fsm(fsm).Compile<Pire::ApproxLiteralScanner>(2);
+		UNIT_ASSERT_EQUAL(LiteralDistance(scanner, "xxabcdefxx"), size_t(0));
+		UNIT_ASSERT_EQUAL(LiteralDistance(scanner, "xxabdcefxx"), size_t(1));
+		UNIT_ASSERT_EQUAL(LiteralDistance(scanner, "abef"), size_t(2));
+		UNIT_ASSERT_EQUAL(LiteralDistance(scanner, "xbcxef"), size_t(2));
+		UNIT_ASSERT_EQUAL(LiteralDistance(scanner, "abcdxf abcdef"), size_t(0));
+		UNIT_ASSERT_EQUAL(LiteralDistance(scanner, "ab"), Pire::ApproxLiteralScanner::NoMatch);
+	}
+
+	SIMPLE_UNIT_TEST(MinimalDistance) {
+		const char* patterns[] = { "^ab[cd]e$", "^(ab|cde)+$", "x.z" };
+		const char* texts[] = { "", "abce", "abde", "abxe", "bace", "ae", "xabcex", "abcde", "cdeab", "ababab", "xyz", "xz", "axbz", "ax" };
+		const size_t distance = 2;
+
+		for (auto&& pattern : patterns) {
+			auto fsm = BuildFsm(pattern);
+			if (!strcmp(pattern, "x.z"))
+				fsm.Surround();
+			Pire::ApproxScanner scanner = Pire::Fsm(fsm).Compile<Pire::ApproxScanner>(distance);
+			TVector<Pire::Scanner> scanners;
+			for (size_t d = 0; d <= distance; ++d)
+				scanners.push_back(Pire::Fsm(fsm).Compile<Pire::Scanner>(d));
+
+			for (auto&& text : texts) {
+				size_t expected = Pire::ApproxScanner::NoMatch;
+				for (size_t d = distance + 1; d--;)
+					if (Matches(scanners[d], text))
+						expected = d;
+				UNIT_ASSERT_EQUAL(scanner.Distance(RunRegexp(scanner, text)), expected);
+				UNIT_ASSERT_EQUAL(Matches(scanner, text), (expected != Pire::ApproxScanner::NoMatch));
+			}
+		}
+
+		auto fsm = BuildFsm("^abcd$");
+		Pire::ApproxScanner scanner = Pire::Fsm(fsm).Compile<Pire::ApproxScanner>(3);
+		UNIT_ASSERT_EQUAL(scanner.Distance(RunRegexp(scanner, "abcd")), size_t(0));
+		UNIT_ASSERT_EQUAL(scanner.Distance(RunRegexp(scanner, "abd")), size_t(1));
+		UNIT_ASSERT_EQUAL(scanner.Distance(RunRegexp(scanner, "xbcy")), size_t(2));
+		UNIT_ASSERT_EQUAL(scanner.Distance(RunRegexp(scanner, "a")), size_t(3));
+		UNIT_ASSERT_EQUAL(scanner.Distance(RunRegexp(scanner, "xyzw")), Pire::ApproxScanner::NoMatch);
+	}
+
+	SIMPLE_UNIT_TEST(FuzzyDictionary) {
+		TVector<ystring> words = { "yandex.ru", "google.com", "example.org", "examples.org", "example.org", "exampel.orc" };
+		Pire::FuzzyDictionary dict(words, 2);
+		UNIT_ASSERT_EQUAL(dict.WordsCount(), size_t(5));
+
+		auto matches = dict.Find("example.org");
+		UNIT_ASSERT_EQUAL(matches.size(), size_t(3));
+		UNIT_ASSERT_EQUAL(matches[0].word, ystring("exampel.orc"));
+		UNIT_ASSERT_EQUAL(matches[0].id, size_t(0));
+		UNIT_ASSERT_EQUAL(matches[0].distance, size_t(2));
+		UNIT_ASSERT_EQUAL(matches[1].word, ystring("example.org"));
+		UNIT_ASSERT_EQUAL(matches[1].distance, size_t(0));
+		UNIT_ASSERT_EQUAL(matches[2].word, ystring("examples.org"));
+		UNIT_ASSERT_EQUAL(matches[2].id, size_t(2));
+		UNIT_ASSERT_EQUAL(matches[2].distance, size_t(1));
+
+		UNIT_ASSERT_EQUAL(dict.MinDistance("yadnex.ru"), size_t(1));
+		UNIT_ASSERT_EQUAL(dict.MinDistance("gogle.con"), size_t(2));
+		UNIT_ASSERT_EQUAL(dict.MinDistance("bing.com"), Pire::FuzzyDictionary::NoMatch);
+		UNIT_ASSERT(dict.Find("").empty());
+
+		// Distances agree with the approximate FSM of each word
+		const char* queries[] = { "yandex.ru", "yandx.ru", "yandexru", "ynadex.ru", "google.cm", "gooogle.coom", "xample.or" };
+		for (auto&& query : queries) {
+			for (auto&& match : dict.Find(query)) {
+				ystring pattern = "^";
+				for (auto&& c : match.word)
+					pattern += (c == '.') ? ystring("\\.") : ystring(1, c);
+				pattern += "$";
+				Pire::ApproxScanner scanner = BuildFsm(pattern.c_str()).Compile<Pire::ApproxScanner>(2);
+				UNIT_ASSERT_EQUAL(scanner.Distance(RunRegexp(scanner, query)), match.distance);
+			}
+		}
+
+		Pire::Scanner scanner = dict.ToFsm().Compile<Pire::Scanner>();
+		UNIT_ASSERT(Matches(scanner, "examples.org"));
+		UNIT_ASSERT(!Matches(scanner, "example.or"));
+		UNIT_ASSERT(!Matches(scanner, "examples.orgx"));
+		UNIT_ASSERT(!Matches(scanner, "examxples.org"));
+
+		// Words sharing suffixes, and near misses which are not words
+		Pire::FuzzyDictionary small({ "ac", "bc", "ec", "axc" }, 1);
+		Pire::Fsm fsm = small.ToFsm();
+		Pire::Scanner smallScanner = Pire::Fsm(fsm).Compile<Pire::Scanner>();
+		Pire::SimpleScanner simpleScanner = Pire::Fsm(fsm).Compile<Pire::SimpleScanner>();
+		for (auto&& word : { "ac", "bc", "ec", "axc" }) {
+			UNIT_ASSERT(Matches(smallScanner, word));
+			UNIT_ASSERT(Matches(simpleScanner, word));
+		}
+		for (auto&& word : { "bxc", "exc", "axxc", "a", "c", "acc", "xac", "" }) {
+			UNIT_ASSERT(!Matches(smallScanner, word));
+			UNIT_ASSERT(!Matches(simpleScanner, word));
+		}
+	}
 }
@@ -308,4 +308,243 @@ SIMPLE_UNIT_TEST_SUITE(TestPireCapture) {
 		const char* ans = "\xd0\xa3\xd0\xb2\xd0\xb0\xd0\xb6\xd0\xb0\xd0\xb5\xd0\xbc\xd1\x8b\xd0\xb9 (-\xd0\xb0\xd1\x8f)";
 		MakeSlowCapturingTest(regexp, text, 1, true, ystring(ans));
 	}
+
+	SIMPLE_UNIT_TEST(TwoPhaseCapture)
+	{
+		const char* regexps[] = {
+			"id=(\\d+);", "^GET (\\S+)", "([^a]a)$", "x(a+?)", ".*(pref.*suff)", "(A)|A", "(a*)"
+		};
+		const char* texts[] = {
+			"", "nothing here", "id=123; id=45;", "GET /index.html HTTP/1.0", "POST /x GET /y",
+			"bxba", "xaaa", "pref ala bla pref cla suff dla", "A", "bbb"
+		};
+		for (auto&& regexp : regexps) {
+			Pire::Fsm fsm = Pire::Lexer(regexp).AddFeature(Pire::Features::Capture(1)).Parse();
+			Pire::TwoPhaseCapture capture(fsm);
+			SlowCapturingScanner slow = SlowCompile(regexp, 1);
+			for (auto&& text : texts) {
+				SlowCapturingScanner::State st = RunRegexp(slow, text);
+				SlowCapturingScanner::SingleState expected, found;
+				bool captured = slow.GetCapture(st, expected);
+				UNIT_ASSERT_EQUAL(capture.Capture(text, text + strlen(text), found), captured);
+				if (captured) {
+					UNIT_ASSERT_EQUAL(found.GetBegin(), expected.GetBegin());
+					UNIT_ASSERT_EQUAL(found.GetEnd(), expected.GetEnd());
+				}
+			}
+		}
+	}
+
+	using Pire::TaggedCapturingScanner;
+
+	TaggedCapturingScanner TaggedCompile(const char* regexp)
+	{
+		Pire::Lexer lexer;
+		lexer.Assign(regexp, regexp + strlen(regexp));
+		lexer.AddFeature(Pire::Features::CaptureGroups());
+		Pire::Fsm fsm = lexer.Parse();
+		fsm.Surround();
+		return TaggedCapturingScanner(fsm);
+	}
+
+	TVector<ystring> TaggedCaptures(const TaggedCapturingScanner& scanner, const char* str)
+	{
+		TaggedCapturingScanner::State state;
+		scanner.Initialize(state);
+		Step(scanner, state, Pire::BeginMark);
+		Run(scanner, state, str, str + strlen(str));
+		Step(scanner, state, Pire::EndMark);
+
+		TVector<ystring> groups;
+		if (scanner.Final(state))
+			for (size_t group = 0; group != scanner.GroupsCount(); ++group)
+				groups.push_back(scanner.Captured(state, group)
+					? ystring(str + scanner.Begin(state, group) - 1, str + scanner.End(state, group) - 1)
+					: ystring("-"));
+		return groups;
+	}
+
+	ystring Join(const TVector<ystring>& groups)
+	{
+		ystring ret;
+		for (auto&& group : groups)
+			ret += "[" + group + "]";
+		return ret;
+	}
+
+	SIMPLE_UNIT_TEST(TaggedGroups)
+	{
+		const char* log = "127.0.0.1 - frank [10/Oct/2000:13:55:36 -0700] \"GET /apache_pb.gif HTTP/1.0\" 200 2326";
+		TaggedCapturingScanner scanner = TaggedCompile("^(\\S+) \\S+ \\S+ \\[([^\\]]+)\\] \"(\\S+) (\\S+) [^\"]*\" (\\d+) (\\d+|-)$");
+		UNIT_ASSERT_EQUAL(scanner.GroupsCount(), size_t(6));
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(scanner, log)),
+			ystring("[127.0.0.1][10/Oct/2000:13:55:36 -0700][GET][/apache_pb.gif][200][2326]"));
+		UNIT_ASSERT(TaggedCaptures(scanner, "127.0.0.1 - frank").empty());
+
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("(\\d+)\\.(\\d+)"), "v 12.345 z")), ystring("[12][345]"));
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("((a)(b))"), "zabz")), ystring("[ab][a][b]"));
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("(x)|(y)"), "y")), ystring("[-][y]"));
+	}
+
+	SIMPLE_UNIT_TEST(TaggedLeftmostGreedy)
+	{
+		// Earlier groups start as early and end as late as possible
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("^(a*)(a*)$"), "aa")), ystring("[aa][]"));
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("(a+)(b+)"), "xxaabbbyy")), ystring("[aa][bbb]"));
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("(\\d+)"), "ab123c45")), ystring("[123]"));
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("^([ab]*)(b+)$"), "abab")), ystring("[aba][b]"));
+		// Repeated groups report their last iteration
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("^(a)+$"), "aaa")), ystring("[a]"));
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(TaggedCompile("^(a|(b))+$"), "ba")), ystring("[a][b]"));
+	}
+
+	SIMPLE_UNIT_TEST(TaggedSerialization)
+	{
+		const char* str = "key=value; other=thing";
+		TaggedCapturingScanner scanner = TaggedCompile("(\\w+)=(\\w+);");
+
+		BufferOutput wbuf;
+		::Save(&wbuf, scanner);
+
+		MemoryInput rbuf(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+		TaggedCapturingScanner loaded;
+		::Load(&rbuf, loaded);
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(loaded, str)), ystring("[key][value]"));
+
+		TVector<char> buf(wbuf.Buffer().Size() + sizeof(size_t));
+		const void* ptr = Pire::Impl::AlignUp(&buf[0], sizeof(size_t));
+		memcpy((void*) ptr, wbuf.Buffer().Data(), wbuf.Buffer().Size());
+		TaggedCapturingScanner mapped;
+		const void* tail = mapped.Mmap(ptr, wbuf.Buffer().Size());
+		UNIT_ASSERT_EQUAL(tail, (const void*) ((const char*) ptr + wbuf.Buffer().Size()));
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(mapped, str)), ystring("[key][value]"));
+
+		TaggedCapturingScanner copy = mapped;
+		UNIT_ASSERT_EQUAL(Join(TaggedCaptures(copy, "a=b;")), ystring("[a][b]"));
+
+		// Other scanners cannot be loaded as tagged ones
+		BufferOutput wbuf2;
+		::Save(&wbuf2, Compile("(a)", 1));
+		MemoryInput rbuf2(wbuf2.Buffer().Data(), wbuf2.Buffer().Size());
+		try {
+			::Load(&rbuf2, loaded);
+			UNIT_ASSERT(!"TaggedCapturingScanner failed to check the type of a scanner loaded");
+		}
+		catch (Pire::Error&) {}
+	}
+
+	Pire::MultiCapturingScanner MultiCompile(const char* regexp)
+	{
+		Pire::Lexer lexer;
+		lexer.Assign(regexp, regexp + strlen(regexp));
+		lexer.AddFeature(Pire::Features::CaseInsensitive());
+		lexer.AddFeature(Pire::Features::Capture(1));
+		Pire::Fsm fsm = lexer.Parse();
+		fsm.Surround();
+		return Pire::MultiCapturingScanner(fsm);
+	}
+
+	Pire::MultiCapturingScanner::State RunRegexp(const Pire::MultiCapturingScanner& scanner, const char* str)
+	{
+		Pire::MultiCapturingScanner::State state;
+		scanner.Initialize(state);
+		Step(scanner, state, Pire::BeginMark);
+		Run(scanner, state, str, str + strlen(str));
+		Step(scanner, state, Pire::EndMark);
+		return state;
+	}
+
+	/// Captures of all the regexps, as [capture] or [] for each one
+	ystring MultiCaptures(const Pire::MultiCapturingScanner& scanner, const char* str)
+	{
+		Pire::MultiCapturingScanner::State state = RunRegexp(scanner, str);
+		ystring result;
+		for (size_t i = 0; i != scanner.RegexpsCount(); ++i) {
+			result += "[";
+			if (scanner.Captured(state, i))
+				result += ystring(str + scanner.Begin(state, i) - 1, str + scanner.End(state, i) - 1);
+			result += "]";
+		}
+		return result;
+	}
+
+	ystring Matched(const Pire::MultiCapturingScanner& scanner, const char* str)
+	{
+		Pire::MultiCapturingScanner::State state = RunRegexp(scanner, str);
+		ystring result;
+		for (size_t i = 0; i != scanner.RegexpsCount(); ++i)
+			if (scanner.Matched(state, i))
+				result += Pire::ToString(i);
+		return result;
+	}
+
+	SIMPLE_UNIT_TEST(MultiCapture)
+	{
+		const char* regexps[] = {
+			"google_id\\s*=\\s*[\'\"]([a-z0-9]+)[\'\"]\\s*;",
+			"=(\\d+)[^\\d]",
+			"(/to-match-with)"
+		};
+		Pire::MultiCapturingScanner scanner;
+		for (auto&& regexp : regexps)
+			scanner = Pire::MultiCapturingScanner::Glue(scanner, MultiCompile(regexp));
+		UNIT_ASSERT_EQUAL(scanner.RegexpsCount(), size_t(3));
+
+		const char* strs[] = {
+			"var google_id = 'abc de'; google_id = 'xyz';",
+			"x=12345; /some/path/to-match-with",
+			"nothing here"
+		};
+		for (auto&& str : strs) {
+			// Each regexp captures what a CapturingScanner built from it does
+			ystring expected;
+			for (auto&& regexp : regexps) {
+				State state = RunRegexp(Compile(regexp, 1), str);
+				expected += "[" + Captured(state, str) + "]";
+			}
+			UNIT_ASSERT_EQUAL(MultiCaptures(scanner, str), expected);
+		}
+		UNIT_ASSERT_EQUAL(MultiCaptures(scanner, strs[1]), ystring("[][12345][/to-match-with]"));
+		UNIT_ASSERT_EQUAL(Matched(scanner, strs[1]), ystring("12"));
+		UNIT_ASSERT_EQUAL(Matched(scanner, strs[2]), ystring(""));
+
+		// Many rules are glued without any limit on their number
+		Pire::MultiCapturingScanner many;
+		for (size_t i = 0; i != 40; ++i)
+			many = Pire::MultiCapturingScanner::Glue(many, MultiCompile(("key" + Pire::ToString(i) + "=(\\w+);").c_str()));
+		UNIT_ASSERT_EQUAL(many.RegexpsCount(), size_t(40));
+		Pire::MultiCapturingScanner::State state = RunRegexp(many, "key7=seven; key31=thirty-one; key3=three;");
+		UNIT_ASSERT(many.Captured(state, 7) && many.Captured(state, 3) && !many.Captured(state, 31) && !many.Captured(state, 1));
+		UNIT_ASSERT_EQUAL(many.Begin(state, 3) - 1, size_t(35));
+
+		// Glue gives up on automata larger than maxSize
+		UNIT_ASSERT(Pire::MultiCapturingScanner::Glue(scanner, MultiCompile("(a+)b"), 5).Empty());
+	}
+
+	SIMPLE_UNIT_TEST(MultiCaptureSerialization)
+	{
+		const char* str = "a=1; b=2;";
+		Pire::MultiCapturingScanner scanner = Pire::MultiCapturingScanner::Glue(MultiCompile("a=(\\d+)"), MultiCompile("b=(\\d+)"));
+
+		BufferOutput wbuf;
+		::Save(&wbuf, scanner);
+
+		MemoryInput rbuf(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+		Pire::MultiCapturingScanner loaded;
+		::Load(&rbuf, loaded);
+		UNIT_ASSERT_EQUAL(MultiCaptures(loaded, str), ystring("[1][2]"));
+
+		TVector<char> buf(wbuf.Buffer().Size() + sizeof(size_t));
+		const void* ptr = Pire::Impl::AlignUp(&buf[0], sizeof(size_t));
+		memcpy((void*) ptr, wbuf.Buffer().Data(), wbuf.Buffer().Size());
+		Pire::MultiCapturingScanner mapped;
+		const void* tail = mapped.Mmap(ptr, wbuf.Buffer().Size());
+		UNIT_ASSERT_EQUAL(tail, (const void*) ((const char*) ptr + wbuf.Buffer().Size()));
+		UNIT_ASSERT_EQUAL(MultiCaptures(mapped, str), ystring("[1][2]"));
+		UNIT_ASSERT_EQUAL(Matched(mapped, str), ystring("01"));
+
+		Pire::MultiCapturingScanner copy = mapped;
+		UNIT_ASSERT_EQUAL(MultiCaptures(copy, "b="), ystring("[][]"));
+		UNIT_ASSERT_EQUAL(MultiCaptures(copy, "b=3"), ystring("[][3]"));
+	}
 }
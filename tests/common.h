@@ -77,11 +77,32 @@ inline bool HasError(const char* regexp) {
 	}
 }
 
+/// Returns an empty scanner if the regexp is too large for bit-parallel simulation
+inline Pire::BitParallelScanner512 CompileBitParallel(const Pire::Fsm& fsm, size_t distance = 0)
+{
+	try {
+		return Pire::Fsm(fsm).Compile<Pire::BitParallelScanner512>(distance);
+	} catch (Pire::Error&) {
+		return Pire::BitParallelScanner512();
+	}
+}
+
+/// Returns an empty scanner if the regexp is not a literal one
+inline Pire::ApproxLiteralScanner CompileApproxLiteral(const Pire::Fsm& fsm, size_t distance = 0)
+{
+	if (!Pire::ApproxLiteralScanner::Suitable(fsm, distance))
+		return Pire::ApproxLiteralScanner();
+	return Pire::Fsm(fsm).Compile<Pire::ApproxLiteralScanner>(distance);
+}
+
 struct Scanners {
 	Pire::Scanner fast;
 	Pire::NonrelocScanner nonreloc;
 	Pire::SimpleScanner simple;
 	Pire::SlowScanner slow;
+	Pire::LazyScanner lazy;
+	Pire::BitParallelScanner512 bitParallel;
+	Pire::ApproxLiteralScanner approxLiteral;
 	Pire::ScannerNoMask fastNoMask;
 	Pire::NonrelocScannerNoMask nonrelocNoMask;
 	Pire::HalfFinalScanner halfFinal;
@@ -94,6 +115,9 @@ struct Scanners {
  		, nonreloc(Pire::Fsm(fsm).Compile<Pire::NonrelocScanner>(distance))
 		, simple(Pire::Fsm(fsm).Compile<Pire::SimpleScanner>(distance))
 		, slow(Pire::Fsm(fsm).Compile<Pire::SlowScanner>(distance))
+		, lazy(Pire::Fsm(fsm).Compile<Pire::LazyScanner>(distance))
+		, bitParallel(CompileBitParallel(fsm, distance))
+		, approxLiteral(CompileApproxLiteral(fsm, distance))
 		, fastNoMask(Pire::Fsm(fsm).Compile<Pire::ScannerNoMask>(distance))
  		, nonrelocNoMask(Pire::Fsm(fsm).Compile<Pire::NonrelocScannerNoMask>(distance))
 		, halfFinal(Pire::Fsm(fsm).Compile<Pire::HalfFinalScanner>(distance))
@@ -109,6 +133,9 @@ struct Scanners {
 		nonreloc = Pire::Fsm(fsm).Compile<Pire::NonrelocScanner>();
 		simple = Pire::Fsm(fsm).Compile<Pire::SimpleScanner>();
 		slow = Pire::Fsm(fsm).Compile<Pire::SlowScanner>();
+		lazy = Pire::Fsm(fsm).Compile<Pire::LazyScanner>();
+		bitParallel = CompileBitParallel(fsm);
+		approxLiteral = CompileApproxLiteral(fsm);
 		fastNoMask = Pire::Fsm(fsm).Compile<Pire::ScannerNoMask>();
 		nonrelocNoMask = Pire::Fsm(fsm).Compile<Pire::NonrelocScannerNoMask>();
 		halfFinal = Pire::Fsm(fsm).Compile<Pire::HalfFinalScanner>();
@@ -198,6 +225,9 @@ bool Matches(const Scanner& scanner, const char* str)
 		UNIT_ASSERT(Matches(m_scanners.nonreloc, str));\
 		UNIT_ASSERT(Matches(m_scanners.simple, str));\
 		UNIT_ASSERT(Matches(m_scanners.slow, str));\
+		UNIT_ASSERT(Matches(m_scanners.lazy, str));\
+		UNIT_ASSERT(m_scanners.bitParallel.Empty() || Matches(m_scanners.bitParallel, str));\
+		UNIT_ASSERT(m_scanners.approxLiteral.Empty() || Matches(m_scanners.approxLiteral, str));\
 		UNIT_ASSERT(Matches(m_scanners.fastNoMask, str));\
 		UNIT_ASSERT(Matches(m_scanners.nonrelocNoMask, str));\
 		UNIT_ASSERT(Matches(m_scanners.halfFinal, str));\
@@ -212,6 +242,9 @@ bool Matches(const Scanner& scanner, const char* str)
 		UNIT_ASSERT(!Matches(m_scanners.nonreloc, str));\
 		UNIT_ASSERT(!Matches(m_scanners.simple, str));\
 		UNIT_ASSERT(!Matches(m_scanners.slow, str));\
+		UNIT_ASSERT(!Matches(m_scanners.lazy, str));\
+		UNIT_ASSERT(m_scanners.bitParallel.Empty() || !Matches(m_scanners.bitParallel, str));\
+		UNIT_ASSERT(m_scanners.approxLiteral.Empty() || !Matches(m_scanners.approxLiteral, str));\
 		UNIT_ASSERT(!Matches(m_scanners.fastNoMask, str));\
 		UNIT_ASSERT(!Matches(m_scanners.nonrelocNoMask, str));\
 		UNIT_ASSERT(!Matches(m_scanners.halfFinal, str));\
@@ -0,0 +1,186 @@
+/*
+ * compile_cache_ut.cpp -- Unit tests for the persistent compile cache
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <unistd.h>
+#include <pire.h>
+#include "common.h"
+
+SIMPLE_UNIT_TEST_SUITE(TestCompileCache) {
+
+	/// A temporary cache directory, removed with all its entries
+	class TempCache {
+	public:
+		TempCache()
+		{
+			char dir[] = "/tmp/pire_cache_ut.XXXXXX";
+			UNIT_ASSERT(mkdtemp(dir));
+			m_cache.reset(new Pire::CompileCache(dir));
+		}
+
+		~TempCache()
+		{
+			for (auto&& path : m_paths)
+				remove(path.c_str());
+			rmdir(m_cache->Directory().c_str());
+		}
+
+		Pire::CompileCache& operator *() { return *m_cache; }
+		Pire::CompileCache* operator ->() { return m_cache.get(); }
+
+		template<class Scanner>
+		ystring Track(const ystring& key)
+		{
+			m_paths.push_back(m_cache->Path<Scanner>(key));
+			return m_paths.back();
+		}
+
+	private:
+		std::unique_ptr<Pire::CompileCache> m_cache;
+		TVector<ystring> m_paths;
+	};
+
+	template<class Scanner>
+	struct Compiler {
+		ystring pattern;
+		size_t* calls;
+
+		Scanner operator()() const
+		{
+			++*calls;
+			return Pire::Lexer(pattern).Parse().Surround().Compile<Scanner>();
+		}
+	};
+
+	template<class Scanner>
+	std::shared_ptr<const Scanner> Get(Pire::CompileCache& cache, const ystring& pattern, size_t& calls)
+	{
+		Compiler<Scanner> compile = { pattern, &calls };
+		return cache.Get<Scanner>(pattern, compile);
+	}
+
+	bool FileExists(const ystring& path)
+	{
+		return std::ifstream(path.c_str()).good();
+	}
+
+SIMPLE_UNIT_TEST(HitAndMiss)
+{
+	TempCache cache;
+	const ystring path = cache.Track<Pire::Scanner>("ab+c");
+	size_t calls = 0;
+
+	auto compiled = Get<Pire::Scanner>(*cache, "ab+c", calls);
+	UNIT_ASSERT_EQUAL(calls, 1u);
+	UNIT_ASSERT(FileExists(path));
+
+	// Same key in another cache instance (as after a restart) must come from the disk
+	Pire::CompileCache cache2(cache->Directory());
+	auto cached = Get<Pire::Scanner>(cache2, "ab+c", calls);
+	UNIT_ASSERT_EQUAL(calls, 1u);
+	UNIT_ASSERT(compiled.get() != cached.get());
+	UNIT_ASSERT(Matches(*cached, "xabbbcx"));
+	UNIT_ASSERT(!Matches(*cached, "xacx"));
+	UNIT_ASSERT_EQUAL(cached->Size(), compiled->Size());
+
+	// A different pattern is a miss
+	cache.Track<Pire::Scanner>("ab+d");
+	Get<Pire::Scanner>(*cache, "ab+d", calls);
+	UNIT_ASSERT_EQUAL(calls, 2u);
+}
+
+SIMPLE_UNIT_TEST(ScannerTypes)
+{
+	TempCache cache;
+	UNIT_ASSERT(cache.Track<Pire::Scanner>("a.c") != cache.Track<Pire::SimpleScanner>("a.c"));
+	cache.Track<Pire::SlowScanner>("a.c");
+	size_t calls = 0;
+
+	Get<Pire::Scanner>(*cache, "a.c", calls);
+	Get<Pire::SimpleScanner>(*cache, "a.c", calls);
+	Get<Pire::SlowScanner>(*cache, "a.c", calls);
+	UNIT_ASSERT_EQUAL(calls, 3u);
+
+	UNIT_ASSERT(Matches(*Get<Pire::Scanner>(*cache, "a.c", calls), "abc"));
+	UNIT_ASSERT(Matches(*Get<Pire::SimpleScanner>(*cache, "a.c", calls), "abc"));
+	UNIT_ASSERT(Matches(*Get<Pire::SlowScanner>(*cache, "a.c", calls), "abc"));
+	UNIT_ASSERT(!Matches(*Get<Pire::SlowScanner>(*cache, "a.c", calls), "ab"));
+	UNIT_ASSERT_EQUAL(calls, 3u);
+}
+
+SIMPLE_UNIT_TEST(Corruption)
+{
+	TempCache cache;
+	const ystring path = cache.Track<Pire::Scanner>("x[0-9]+y");
+	size_t calls = 0;
+	Get<Pire::Scanner>(*cache, "x[0-9]+y", calls);
+
+	// Truncated entry
+	std::ifstream in(path.c_str(), std::ios::binary);
+	ystring contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	std::ofstream(path.c_str(), std::ios::binary).write(contents.data(), contents.size() / 2);
+	UNIT_ASSERT(Matches(*Get<Pire::Scanner>(*cache, "x[0-9]+y", calls), "x123y"));
+	UNIT_ASSERT_EQUAL(calls, 2u);
+
+	// Broken scanner header (the offset of the scanner is stored after the magic and the key length)
+	ui64 offset;
+	memcpy(&offset, contents.data() + 2 * sizeof(ui64), sizeof(offset));
+	contents[offset] ^= 0xff;
+	std::ofstream(path.c_str(), std::ios::binary).write(contents.data(), contents.size());
+	UNIT_ASSERT(Matches(*Get<Pire::Scanner>(*cache, "x[0-9]+y", calls), "x123y"));
+	UNIT_ASSERT_EQUAL(calls, 3u);
+
+	// A bit flipped in the transition table, which the scanner itself would not notice
+	contents[offset] ^= 0xff;
+	contents[offset + (contents.size() - offset) / 2] ^= 0x01;
+	std::ofstream(path.c_str(), std::ios::binary).write(contents.data(), contents.size());
+	UNIT_ASSERT(Matches(*Get<Pire::Scanner>(*cache, "x[0-9]+y", calls), "x123y"));
+	UNIT_ASSERT(!Matches(*Get<Pire::Scanner>(*cache, "x[0-9]+y", calls), "x12zy"));
+	UNIT_ASSERT_EQUAL(calls, 4u);
+
+	// The entry has been rewritten
+	UNIT_ASSERT(Matches(*Get<Pire::Scanner>(*cache, "x[0-9]+y", calls), "x123y"));
+	UNIT_ASSERT_EQUAL(calls, 4u);
+}
+
+SIMPLE_UNIT_TEST(ReplacedEntry)
+{
+	TempCache cache;
+	const ystring path = cache.Track<Pire::Scanner>("foo|bar");
+	size_t calls = 0;
+	Get<Pire::Scanner>(*cache, "foo|bar", calls);
+	auto mapped = Get<Pire::Scanner>(*cache, "foo|bar", calls);
+	UNIT_ASSERT_EQUAL(calls, 1u);
+
+	// A mapped scanner outlives its file being replaced by another writer
+	remove(path.c_str());
+	Get<Pire::Scanner>(*cache, "foo|bar", calls);
+	UNIT_ASSERT_EQUAL(calls, 2u);
+	UNIT_ASSERT(Matches(*mapped, "xbarx"));
+	UNIT_ASSERT(!Matches(*mapped, "xbazx"));
+}
+
+}
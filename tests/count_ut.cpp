@@ -29,6 +29,10 @@
 #include <pire.h>
 #include <extra.h>
 #include <string.h>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
 
 
 SIMPLE_UNIT_TEST_SUITE(TestCount) {
@@ -247,6 +251,156 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 		CountManyGluesOne<Pire::NoGlueLimitCountingScanner>(50);
 	}
 
+	SIMPLE_UNIT_TEST(ManyCounters)
+	{
+		// Counters of hundreds of glued regexps
+		const auto& enc = Pire::Encodings::Latin1();
+		const char text[] = "ab ab ab cd he he ef ab ee ee ee ee, zz zz";
+		const size_t count = 300;
+		Pire::NoGlueLimitCountingScanner glued;
+		TVector<size_t> expected;
+		for (size_t i = 0; i != count; ++i) {
+			ystring regexp;
+			regexp += static_cast<char>('a' + i % 26);
+			regexp += static_cast<char>('a' + (i / 26) % 26);
+			if (i % 3 == 0)
+				regexp += "+";
+			Pire::NoGlueLimitCountingScanner single(MkFsm(regexp.c_str(), enc), MkFsm("\\s", enc));
+			expected.push_back(Run(single, text).Result(0));
+			glued = Pire::NoGlueLimitCountingScanner::Glue(glued, single);
+		}
+		UNIT_ASSERT_EQUAL(glued.RegexpsCount(), count);
+
+		auto state = Run(glued, text);
+		for (size_t i = 0; i != count; ++i)
+			UNIT_ASSERT_EQUAL(state.Result(i), expected[i]);
+		UNIT_ASSERT_EQUAL(state.Result(0 + 1 * 26), size_t(3)); // "ab"
+		UNIT_ASSERT_EQUAL(state.Result(7 + 4 * 26), size_t(2)); // "he"
+		UNIT_ASSERT_EQUAL(state.Result(4 + 4 * 26), size_t(4)); // "ee+"
+	}
+
+	template<class Scanner>
+	void CountChunksOne(const Scanner& scanner, const char* text)
+	{
+		const size_t len = strlen(text);
+		auto expected = Run(scanner, text);
+
+		// Split the text at every position and into ten-byte chunks
+		TVector<TVector<size_t>> splits;
+		for (size_t pos = 0; pos <= len; ++pos)
+			splits.push_back({0, pos, len});
+		splits.push_back({0});
+		for (size_t pos = 10; pos < len; pos += 10)
+			splits.back().push_back(pos);
+		splits.back().push_back(len);
+
+		for (auto&& split : splits) {
+			TVector<Pire::CountingSummary<Scanner>> chunks;
+			for (size_t i = 0; i + 1 < split.size(); ++i)
+				chunks.push_back(Pire::CountingSummary<Scanner>(scanner, text + split[i], text + split[i + 1]));
+
+			// Applying the chunks in order
+			auto state = InitializedState(scanner);
+			Pire::Step(scanner, state, Pire::BeginMark);
+			for (auto&& chunk : chunks)
+				chunk.Apply(state);
+			Pire::Step(scanner, state, Pire::EndMark);
+			for (size_t i = 0; i < scanner.RegexpsCount(); ++i)
+				UNIT_ASSERT_EQUAL(state.Result(i), expected.Result(i));
+
+			// Merging them pairwise first
+			while (chunks.size() > 1) {
+				TVector<Pire::CountingSummary<Scanner>> merged;
+				for (size_t i = 0; i < chunks.size(); i += 2) {
+					merged.push_back(chunks[i]);
+					if (i + 1 < chunks.size())
+						merged.back().Append(chunks[i + 1]);
+				}
+				chunks.swap(merged);
+			}
+			state = InitializedState(scanner);
+			Pire::Step(scanner, state, Pire::BeginMark);
+			chunks[0].Apply(state);
+			Pire::Step(scanner, state, Pire::EndMark);
+			UNIT_ASSERT_EQUAL(scanner.StateIndex(state), scanner.StateIndex(expected));
+			for (size_t i = 0; i < scanner.RegexpsCount(); ++i)
+				UNIT_ASSERT_EQUAL(state.Result(i), expected.Result(i));
+		}
+	}
+
+	template<class Scanner>
+	void CountChunksOne()
+	{
+		const auto& enc = Pire::Encodings::Latin1();
+		const char* text = "abc defg 123 jklmn 4567 opqrst, ab ab ab c, 12ab 34cd ab12ab ba aaab";
+		CountChunksOne(Scanner(MkFsm("[a-z]+", enc), MkFsm(".*", enc)), text);
+		CountChunksOne(Scanner(MkFsm("ab", enc), MkFsm(" ", enc)), text);
+		CountChunksOne(Scanner(MkFsm("\\w", enc), MkFsm("", enc)), text);
+		Scanner glued;
+		const char* regexps[] = { "[a-z]+", "[0-9]+", "ab", "a+b?", "(ab)+" };
+		const char* separators[] = { ".*", ".*", " ", "", "[^a-z]*" };
+		for (size_t i = 0; i != sizeof(regexps) / sizeof(*regexps); ++i)
+			glued = Scanner::Glue(glued, Scanner(MkFsm(regexps[i], enc), MkFsm(separators[i], enc)));
+		UNIT_ASSERT_EQUAL(glued.RegexpsCount(), sizeof(regexps) / sizeof(*regexps));
+		CountChunksOne(glued, text);
+	}
+
+	SIMPLE_UNIT_TEST(CountChunks)
+	{
+		CountChunksOne<Pire::CountingScanner>();
+		CountChunksOne<Pire::AdvancedCountingScanner>();
+		CountChunksOne<Pire::NoGlueLimitCountingScanner>();
+	}
+
+	template<class Scanner>
+	void RunInChunksOne(const Scanner& scanner, const char* text)
+	{
+		const size_t len = strlen(text);
+		auto expected = Run(scanner, text);
+
+		// Chunk boundaries fall inside matches for most of the counts
+		const size_t counts[] = { 0, 1, 2, 3, 5, 7, 16, len - 1, len, len + 10 };
+		for (auto&& count : counts) {
+			size_t calls = 0;
+			auto state = InitializedState(scanner);
+			Pire::Step(scanner, state, Pire::BeginMark);
+			// Tasks may be run in any order
+			Pire::RunInChunks(scanner, state, text, text + len, count, [&](size_t n, const std::function<void(size_t)>& task) {
+				for (size_t i = n; i--; ++calls)
+					task(i);
+			});
+			Pire::Step(scanner, state, Pire::EndMark);
+			UNIT_ASSERT_EQUAL(calls, ymax<size_t>(ymin(count, len), 1));
+			UNIT_ASSERT_EQUAL(scanner.StateIndex(state), scanner.StateIndex(expected));
+			for (size_t i = 0; i < scanner.RegexpsCount(); ++i)
+				UNIT_ASSERT_EQUAL(state.Result(i), expected.Result(i));
+		}
+	}
+
+	template<class Scanner>
+	void RunInChunksOne()
+	{
+		const auto& enc = Pire::Encodings::Latin1();
+		const char* text = "aaaaaaaaaaaaaaaaaaaa bb aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa b ababababababababab abab, 1234567890123 aa";
+		RunInChunksOne(Scanner(MkFsm("a+", enc), MkFsm("[^a]*", enc)), text);
+		RunInChunksOne(Scanner(MkFsm("ab", enc), MkFsm("", enc)), text);
+		RunInChunksOne(Scanner(MkFsm("[a-z]+", enc), MkFsm(".*", enc)), text);
+		Scanner glued;
+		const char* regexps[] = { "a+", "[0-9]+", "(ab)+", "b" };
+		const char* separators[] = { "[^a]*", ".*", " ", "" };
+		for (size_t i = 0; i != sizeof(regexps) / sizeof(*regexps); ++i)
+			glued = Scanner::Glue(glued, Scanner(MkFsm(regexps[i], enc), MkFsm(separators[i], enc)));
+		UNIT_ASSERT_EQUAL(glued.RegexpsCount(), sizeof(regexps) / sizeof(*regexps));
+		RunInChunksOne(glued, text);
+	}
+
+	SIMPLE_UNIT_TEST(RunInChunks)
+	{
+		RunInChunksOne<Pire::CountingScanner>();
+		RunInChunksOne<Pire::AdvancedCountingScanner>();
+		RunInChunksOne<Pire::NoGlueLimitCountingScanner>();
+	}
+
 	template<class Scanner>
 	void CountBoundariesOne()
 	{
@@ -280,6 +434,95 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 		CountBoundariesOne<Pire::NoGlueLimitCountingScanner>();
 	}
 
+	// Rewrites a serialized LoadedScanner as a build with the other layout
+	// of transitions (see PIRE_COMPACT_TRANSITIONS) would have saved it
+	ystring SwitchTransitionsLayout(const char* data, size_t size)
+	{
+		typedef Pire::LoadedScanner::Transition Transition;
+		using namespace Pire::Impl;
+
+		MemoryInput in(data, size);
+		Pire::Header header(0, 0);
+		LoadPodType(&in, header);
+		AlignLoad(&in, sizeof(header));
+		TVector<char> locals(header.HdrSize);
+		AlignedLoadArray(&in, locals.data(), locals.size());
+		TVector<char> letters(Pire::MaxChar);
+		AlignedLoadArray(&in, letters.data(), letters.size());
+
+		// LoadedScanner::Locals starts with the counts of states and letters
+		// and ends with the offset of the initial state
+		ui32 statesCount, lettersCount;
+		size_t initial;
+		memcpy(&statesCount, locals.data(), sizeof(statesCount));
+		memcpy(&lettersCount, locals.data() + sizeof(statesCount), sizeof(lettersCount));
+		memcpy(&initial, locals.data() + locals.size() - sizeof(initial), sizeof(initial));
+
+		const size_t jumpsCount = statesCount * lettersCount;
+		TVector<Transition> jumps(jumpsCount);
+		TVector<Pire::LoadedScanner::Tag> tags(statesCount);
+		size_t oldStateSize, newStateSize;
+		if (header.CompactTransitions()) {
+			TVector<ui32> compact(jumpsCount);
+			AlignedLoadArray(&in, compact.data(), jumpsCount);
+			AlignedLoadArray(&in, tags.data(), statesCount);
+			size_t count;
+			LoadPodType(&in, count);
+			TVector<Transition> actionJumps(count);
+			AlignedLoadArray(&in, actionJumps.data(), count);
+			for (size_t i = 0; i != jumpsCount; ++i) {
+				if (compact[i] & 1) {
+					jumps[i] = actionJumps[compact[i] >> 1];
+				} else {
+					jumps[i].shift = compact[i];
+					jumps[i].action = 0;
+				}
+			}
+			oldStateSize = lettersCount * sizeof(ui32);
+			newStateSize = lettersCount * sizeof(Transition);
+		} else {
+			AlignedLoadArray(&in, jumps.data(), jumpsCount);
+			AlignedLoadArray(&in, tags.data(), statesCount);
+			oldStateSize = lettersCount * sizeof(Transition);
+			newStateSize = lettersCount * sizeof(ui32);
+		}
+		for (auto&& jump : jumps)
+			jump.shift = static_cast<ui32>(static_cast<i32>(jump.shift) / static_cast<i64>(oldStateSize) * static_cast<i64>(newStateSize));
+		initial = initial / oldStateSize * newStateSize;
+		memcpy(locals.data() + locals.size() - sizeof(initial), &initial, sizeof(initial));
+		header.Version ^= Pire::Header::COMPACT_TRANSITIONS;
+
+		BufferOutput out;
+		SavePodType(&out, header);
+		AlignSave(&out, sizeof(header));
+		AlignedSaveArray(&out, locals.data(), locals.size());
+		AlignedSaveArray(&out, letters.data(), letters.size());
+		if (header.CompactTransitions()) {
+			TVector<ui32> compact(jumpsCount);
+			TVector<Transition> actionJumps;
+			for (size_t i = 0; i != jumpsCount; ++i) {
+				if (jumps[i].action) {
+					compact[i] = static_cast<ui32>(actionJumps.size() << 1) | 1;
+					actionJumps.push_back(jumps[i]);
+				} else {
+					compact[i] = jumps[i].shift;
+				}
+			}
+			AlignedSaveArray(&out, compact.data(), jumpsCount);
+			AlignedSaveArray(&out, tags.data(), statesCount);
+			SavePodType(&out, actionJumps.size());
+			AlignedSaveArray(&out, actionJumps.data(), actionJumps.size());
+		} else {
+			AlignedSaveArray(&out, jumps.data(), jumpsCount);
+			AlignedSaveArray(&out, tags.data(), statesCount);
+		}
+
+		// Whatever a derived scanner saves after its LoadedScanner part
+		ystring result(out.Buffer().Data(), out.Buffer().Size());
+		result.append(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		return result;
+	}
+
 	template<class Scanner>
 	void SerializationOne()
 	{
@@ -322,6 +565,30 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 			}
 			catch (Pire::Error&) {}
 		}
+
+		// Scanners saved with another layout of transitions cannot be mmap()-ed
+		char* data = Pire::Impl::AlignUp(&buf2[0], sizeof(size_t));
+		memcpy(data, wbuf.Buffer().Data(), wbuf.Buffer().Size());
+		reinterpret_cast<Pire::Header*>(data)->Version ^= Pire::Header::COMPACT_TRANSITIONS;
+		try {
+			Scanner sc5;
+			sc5.Mmap(data, wbuf.Buffer().Size());
+			UNIT_ASSERT(!"Scanner failed to check the layout of transitions");
+		}
+		catch (Pire::Error&) {}
+
+		// ...but are converted by Load()
+		const ystring switched = SwitchTransitionsLayout(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+		UNIT_ASSERT(switched.size() != wbuf.Buffer().Size());
+		MemoryInput rbuf2(switched.data(), switched.size());
+		Scanner sc6;
+		::Load(&rbuf2, sc6);
+		for (auto&& text : {"abc defg 123 jklmn 4567 opqrst", "1a2b33ccc444dddd", "", "x 0 y"}) {
+			auto expected = Run(sc, text);
+			auto actual = Run(sc6, text);
+			for (size_t i = 0; i != sc.RegexpsCount(); ++i)
+				UNIT_ASSERT_EQUAL(actual.Result(i), expected.Result(i));
+		}
 	}
 
 	SIMPLE_UNIT_TEST(Serialization)
@@ -331,6 +598,7 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 		SerializationOne<Pire::NoGlueLimitCountingScanner>();
 	}
 
+	// Version 6 scanners only had the standard layout of transitions
 	template<class Scanner>
 	void Serialization_v6_compatibilityOne()
 	{
@@ -341,6 +609,11 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 
 		BufferOutput wbuf;
 		::Save(&wbuf, sc);
+#ifdef PIRE_COMPACT_TRANSITIONS
+		const ystring saved = SwitchTransitionsLayout(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+#else
+		const ystring saved(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+#endif
 
 		// Patched scanner is a scanner of RE_VERSION 6.
 		// The patched scanner is concatenated with original scanner to
@@ -353,8 +626,8 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 			sizeof(typename Scanner::Action);
 		UNIT_ASSERT_EQUAL(actions_size % ALIGNMENT, 0);
 		size_t tags_size = sc.Size() * sizeof(typename Scanner::Tag);
-		const char* src = wbuf.Buffer().Data();
-		size_t src_size = wbuf.Buffer().Size();
+		const char* src = saved.data();
+		size_t src_size = saved.size();
 		size_t patched_size = src_size + actions_size;
 		size_t bytes_before_actions = src_size - tags_size;
 		const int fill_char = 0x42;
@@ -400,6 +673,14 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 		// test loading using Mmap
 		{
 			Scanner sc_patched, sc_normal;
+#ifdef PIRE_COMPACT_TRANSITIONS
+			// Only Load() converts the standard layout of transitions
+			try {
+				sc_patched.Mmap(patched, patched_size);
+				UNIT_ASSERT(!"Scanner failed to check the layout of transitions");
+			}
+			catch (Pire::Error&) {}
+#else
 			const void* tail = sc_patched.Mmap(patched, patched_size);
 			UNIT_ASSERT_EQUAL(tail, normal);
 			const void* tail2 = sc_normal.Mmap(tail, src_size);
@@ -412,6 +693,7 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 					"abc defg 123 jklmn 4567 opqrst");
 			UNIT_ASSERT_EQUAL(st_normal.Result(0), size_t(4));
 			UNIT_ASSERT_EQUAL(st_normal.Result(1), size_t(2));
+#endif
 		}
 	}
 
@@ -558,6 +840,38 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 		TestHalfFinalCount<Pire::NonrelocHalfFinalScannerNoMask>();
 	}
 
+	template<class Scanner, class = void>
+	struct HasDecided: std::false_type {};
+
+	template<class Scanner>
+	struct HasDecided<Scanner, decltype(void(std::declval<const Scanner&>().Decided(std::declval<const typename Scanner::State&>())))>: std::true_type {};
+
+	template<typename Scanner>
+	void TestHalfFinalUndecided() {
+		static_assert(!HasDecided<Scanner>::value, "a half final scanner cannot tell decided states");
+		static_assert(HasDecided<typename Scanner::Scanner>::value, "a plain scanner tells decided states");
+
+		// Nor does its table mark any, since every match is counted
+		const char* text = "abeeeebeeeeeeeeeceeaeebeeeaeecceebeeaeebeeb";
+		for (auto&& scanner : MakeHalfFinalCount<Scanner>("a[a-z]+c|b")) {
+			const typename Scanner::Scanner& plain = scanner;
+			typename Scanner::Scanner::State state;
+			plain.Initialize(state);
+			UNIT_ASSERT(!plain.Decided(state));
+			for (const char* p = text; *p; ++p) {
+				Pire::Step(plain, state, *p);
+				UNIT_ASSERT(!plain.Decided(state));
+			}
+		}
+	}
+
+	SIMPLE_UNIT_TEST(HalfFinalUndecided)
+	{
+		TestHalfFinalUndecided<Pire::HalfFinalScanner>();
+		TestHalfFinalUndecided<Pire::NonrelocHalfFinalScanner>();
+		TestHalfFinalUndecided<Pire::HalfFinalScannerNoMask>();
+	}
+
 	template<typename Scanner>
 	void TestHalfFinalSerialization() {
 		auto oldScanners = MakeHalfFinalCount<Scanner>("(\\w\\w)+");
@@ -580,4 +894,93 @@ SIMPLE_UNIT_TEST_SUITE(TestCount) {
 		TestHalfFinalSerialization<Pire::HalfFinalScanner>();
 		TestHalfFinalSerialization<Pire::HalfFinalScannerNoMask>();
 	}
+
+	SIMPLE_UNIT_TEST(HalfFinalManyRegexps)
+	{
+		// Two-letter regexps "aa", "ab", ..., "kz"
+		const char* text = "ab ab fz cd abc dd kk";
+		TVector<Pire::HalfFinalScanner> scanners;
+		Pire::HalfFinalScanner glued;
+		for (size_t i = 0; i != 26 * 11; ++i) {
+			const char regexp[] = { static_cast<char>('a' + i / 26), static_cast<char>('a' + i % 26), 0 };
+			HalfFinalFsm fsm(MkFsm(regexp, Pire::Encodings::Latin1()));
+			fsm.MakeNonGreedyCounter(false);
+			scanners.push_back(Pire::HalfFinalScanner(fsm));
+			glued = Pire::HalfFinalScanner::Glue(glued, scanners.back());
+		}
+		UNIT_ASSERT_EQUAL(glued.RegexpsCount(), size_t(26 * 11));
+
+		auto state = Run(glued, text);
+		TVector<size_t> matched;
+		for (size_t i = 0; i != scanners.size(); ++i) {
+			const size_t count = Run(scanners[i], text).Result(0);
+			UNIT_ASSERT_EQUAL(state.Result(i), count);
+			if (count)
+				matched.push_back(i);
+		}
+		UNIT_ASSERT_EQUAL(state.Result(1), size_t(3));
+		UNIT_ASSERT_EQUAL(state.Result(26 * 5 + 25), size_t(1));
+		UNIT_ASSERT_EQUAL(state.Result(26 * 10 + 10), size_t(1));
+		auto accepted = glued.AcceptedRegexps(state);
+		UNIT_ASSERT(TVector<size_t>(accepted.first, accepted.second) == matched);
+
+		// States are saved along with the counters
+		BufferOutput wbuf;
+		state.Save(&wbuf);
+		MemoryInput rbuf(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+		Pire::HalfFinalScanner::State loaded;
+		loaded.Load(&rbuf);
+		UNIT_ASSERT(loaded == state);
+		accepted = glued.AcceptedRegexps(loaded);
+		UNIT_ASSERT(TVector<size_t>(accepted.first, accepted.second) == matched);
+
+		// Scanners with inline counters cannot hold more regexps than their states can count
+		try {
+			Pire::InlineHalfFinalScanner inlined(glued);
+			UNIT_ASSERT(!"InlineHalfFinalScanner failed to check the number of regexps");
+		}
+		catch (Pire::Error&) {}
+		typedef Pire::Impl::HalfFinalScanner<Pire::Impl::Relocatable, Pire::Impl::ExitMasks<2>, 64> SmallScanner;
+		SmallScanner small;
+		for (size_t i = 0; i != 64; ++i)
+			small = SmallScanner::Glue(small, SmallScanner(scanners[i]));
+		UNIT_ASSERT_EQUAL(small.RegexpsCount(), size_t(64));
+		UNIT_ASSERT(SmallScanner::Glue(small, SmallScanner(scanners[64])).Empty());
+		auto smallState = Run(small, text);
+		for (size_t i = 0; i != 64; ++i)
+			UNIT_ASSERT_EQUAL(smallState.Result(i), state.Result(i));
+	}
+
+	SIMPLE_UNIT_TEST(ScannerTuple)
+	{
+		// Scanners of different types run in one pass give the same results as run one by one
+		const auto& enc = Pire::Encodings::Latin1();
+		const char text[] = "abc 123 abcd ab 12ab, abc";
+		Pire::CountingScanner words(MkFsm("[a-z]+", enc), MkFsm("\\s", enc));
+		Pire::NoGlueLimitCountingScanner digits(MkFsm("[0-9]+", enc), MkFsm(".*", enc));
+		Pire::Scanner scanner = MkFsm("abc", enc).Surround().Compile<Pire::Scanner>();
+		Pire::SimpleScanner simple = MkFsm("a[b-z]*", enc).Compile<Pire::SimpleScanner>();
+
+		auto tuple = Pire::MakeScannerTuple(words, digits, scanner, simple);
+		UNIT_ASSERT_EQUAL(decltype(tuple)::Size, size_t(4));
+		UNIT_ASSERT_EQUAL(&tuple.Get<2>(), &scanner);
+
+		auto state = Run(tuple, text);
+		UNIT_ASSERT_EQUAL(std::get<0>(state).Result(0), Run(words, text).Result(0));
+		UNIT_ASSERT_EQUAL(std::get<1>(state).Result(0), Run(digits, text).Result(0));
+		UNIT_ASSERT_EQUAL(std::get<1>(state).Result(0), size_t(2));
+		UNIT_ASSERT_EQUAL(std::get<2>(state), Run(scanner, text));
+		UNIT_ASSERT(scanner.Final(std::get<2>(state)));
+		UNIT_ASSERT(tuple.Final(state));
+		UNIT_ASSERT(Pire::Runner(tuple).Begin().Run(text, sizeof(text) - 1).End());
+
+		// The tuple matches the longest prefix any of the scanners does
+		auto pair = Pire::MakeScannerTuple(scanner, simple);
+		const char* strings[] = { "abcde", "xabc", "abd", "ab", "" };
+		for (auto&& str : strings) {
+			const char* end = str + strlen(str);
+			UNIT_ASSERT_EQUAL(Pire::LongestPrefix(pair, str, end), ymax(Pire::LongestPrefix(scanner, str, end), Pire::LongestPrefix(simple, str, end)));
+			UNIT_ASSERT(!Pire::ShortestPrefix(pair, str, end) == (!Pire::ShortestPrefix(scanner, str, end) && !Pire::ShortestPrefix(simple, str, end)));
+		}
+	}
 }
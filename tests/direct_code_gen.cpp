@@ -0,0 +1,45 @@
+/*
+ * direct_code_gen.cpp -- prints direct-coded matchers for direct_code_ut.cpp
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <iostream>
+#include <direct_code.h>
+#include <stub/lexical_cast.h>
+#include "direct_code_ut.h"
+
+int main()
+{
+	std::cout << "// Generated by direct_code_gen; do not edit.\n\n"
+		<< "#include \"direct_code_ut.h\"\n\n";
+
+	for (size_t i = 0; i != DirectCodeRegexpsCount; ++i) {
+		Pire::Fsm fsm = DirectCodeFsm(DirectCodeRegexps[i]);
+		Pire::PrintDirectCode(std::cout, fsm.Compile<Pire::Scanner>(), "DirectCodeScanner" + Pire::ToString(i));
+		Pire::PrintDirectCode(std::cout, fsm.Compile<Pire::SimpleScanner>(), "DirectCodeSimpleScanner" + Pire::ToString(i));
+	}
+
+	std::cout << "const DirectCodeMatcher DirectCodeMatchers[][2] = {\n";
+	for (size_t i = 0; i != DirectCodeRegexpsCount; ++i)
+		std::cout << "\t{ &DirectCodeScanner" << i << ", &DirectCodeSimpleScanner" << i << " },\n";
+	std::cout << "};\n";
+	return 0;
+}
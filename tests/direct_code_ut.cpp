@@ -0,0 +1,108 @@
+/*
+ * direct_code_ut.cpp -- Unit tests for direct-coded matchers
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include "common.h"
+#include "direct_code_ut.h"
+
+SIMPLE_UNIT_TEST_SUITE(TestDirectCode) {
+
+	/// Random strings, mostly made of characters of the regexp itself
+	class RandomInputs {
+	public:
+		explicit RandomInputs(const char* regexp): m_alphabet(regexp), m_seed(1)
+		{
+			m_alphabet += "a0@. \n";
+		}
+
+		ystring Next()
+		{
+			ystring str;
+			for (size_t len = Random() % 80; len; --len) {
+				unsigned r = Random();
+				str += (r % 8 ? m_alphabet[(r >> 3) % m_alphabet.size()] : char(r >> 3));
+			}
+			return str;
+		}
+
+	private:
+		ystring m_alphabet;
+		unsigned m_seed;
+
+		unsigned Random()
+		{
+			m_seed = m_seed * 1103515245 + 12345;
+			return m_seed >> 8;
+		}
+	};
+
+	template<class Scanner>
+	bool RunnerMatches(const Scanner& scanner, const ystring& str)
+	{
+		return scanner.Final(Pire::Runner(scanner).Begin().Run(str.c_str(), str.c_str() + str.size()).End().State());
+	}
+
+	template<class Scanner>
+	void Check(const char* regexp, DirectCodeMatcher matcher)
+	{
+		Scanner scanner = DirectCodeFsm(regexp).Compile<Scanner>();
+		RandomInputs inputs(regexp);
+		for (size_t i = 0; i != 5000; ++i) {
+			ystring str = inputs.Next();
+			bool expected = RunnerMatches(scanner, str);
+			if (matcher(str.c_str(), str.c_str() + str.size()) != expected) {
+				std::cerr << "Regexp: " << regexp << ", input: " << str << std::endl;
+				UNIT_ASSERT(!"direct code differs from the scanner");
+			}
+		}
+	}
+
+SIMPLE_UNIT_TEST(RandomInputs)
+{
+	for (size_t i = 0; i != DirectCodeRegexpsCount; ++i) {
+		Check<Pire::Scanner>(DirectCodeRegexps[i], DirectCodeMatchers[i][0]);
+		Check<Pire::SimpleScanner>(DirectCodeRegexps[i], DirectCodeMatchers[i][1]);
+	}
+}
+
+SIMPLE_UNIT_TEST(Samples)
+{
+	// The first regexp is an e-mail validator
+	const ystring valid[] = { "john.doe@example.com", "a+b@c.de" };
+	const ystring invalid[] = { "john.doe@example", "@example.com", "john doe@example.com", "" };
+	for (auto&& str : valid)
+		UNIT_ASSERT(DirectCodeMatchers[0][0](str.c_str(), str.c_str() + str.size()));
+	for (auto&& str : invalid)
+		UNIT_ASSERT(!DirectCodeMatchers[0][0](str.c_str(), str.c_str() + str.size()));
+
+	// Long inputs go through SIMD skip loops
+	ystring text(1000, 'a');
+	UNIT_ASSERT(DirectCodeMatchers[6][1](text.c_str(), text.c_str() + text.size()) == false);
+	text += 'b';
+	UNIT_ASSERT(DirectCodeMatchers[6][1](text.c_str(), text.c_str() + text.size()));
+	text[500] = '\n';
+	UNIT_ASSERT(DirectCodeMatchers[6][1](text.c_str(), text.c_str() + text.size()));
+	text.resize(text.size() - 1);
+	UNIT_ASSERT(!DirectCodeMatchers[6][1](text.c_str(), text.c_str() + text.size()));
+}
+
+}
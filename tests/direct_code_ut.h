@@ -0,0 +1,58 @@
+/*
+ * direct_code_ut.h -- regexps for the direct-coded matchers test
+ *
+ * Copyright (c) 2007-2010, Dmitry Prokoptsev <dprokoptsev@gmail.com>,
+ *                          Alexander Gololobov <agololobov@gmail.com>
+ *
+ * This file is part of Pire, the Perl Incompatible
+ * Regular Expressions library.
+ *
+ * Pire is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Pire is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser Public License for more details.
+ * You should have received a copy of the GNU Lesser Public License
+ * along with Pire.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PIRE_TEST_DIRECT_CODE_UT_H_INCLUDED
+#define PIRE_TEST_DIRECT_CODE_UT_H_INCLUDED
+
+#include <pire.h>
+
+// direct_code_gen prints a matcher for each of these regexps (compiled
+// both into Pire::Scanner and Pire::SimpleScanner) into direct_code_ut_2.cpp,
+// which direct_code_ut.cpp then checks against the scanners themselves.
+static const char* const DirectCodeRegexps[] = {
+	"^[a-z0-9._%+\\-]+@[a-z0-9.\\-]+\\.[a-z][a-z]+$",
+	"foo|bar|baz",
+	"^ab*c$",
+	"x.{3}y",
+	"^[0-9]+$",
+	"^(GET|POST) /[^ ]* HTTP/1\\.[01]$",
+	"a[^\\n]*b",
+	"",
+	"^$",
+	"\\x00\\xFF",
+};
+
+static const size_t DirectCodeRegexpsCount = sizeof(DirectCodeRegexps) / sizeof(*DirectCodeRegexps);
+
+inline Pire::Fsm DirectCodeFsm(const char* regexp)
+{
+	return Pire::Lexer(regexp).Parse().Surround();
+}
+
+typedef bool (*DirectCodeMatcher)(const char* begin, const char* end);
+
+// Defined in the generated direct_code_ut_2.cpp:
+// matchers for Pire::Scanner and Pire::SimpleScanner for each regexp
+extern const DirectCodeMatcher DirectCodeMatchers[][2];
+
+#endif
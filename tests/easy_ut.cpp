@@ -53,5 +53,54 @@ SIMPLE_UNIT_TEST(TwoFeatures)
 	UNIT_ASSERT("ABC" ==~ re);
 	UNIT_ASSERT(!("adc" ==~ re));
 }
+
+SIMPLE_UNIT_TEST(Nondeterministic)
+{
+	// Too large to be determined, so the regexp is scanned lazily
+	Pire::Regexp re("x.{40}$");
+	//                          1234567890123456789012345678901234567890
+	UNIT_ASSERT(     "....x........................................" ==~ re);
+	UNIT_ASSERT(!(   "....x........................................." ==~ re));
+	UNIT_ASSERT(!(   "....x......................................." ==~ re));
+
+	Pire::Regexp copy = re;
+	re = Pire::Regexp("^y$");
+	UNIT_ASSERT(     "....x........................................" ==~ copy);
+	UNIT_ASSERT(!(   "....x........................................" ==~ re));
+}
+
+SIMPLE_UNIT_TEST(Approximate)
+{
+	// A literal is matched by ApproxLiteralScanner
+	Pire::Regexp literal("template", Pire::Options(), 2);
+	UNIT_ASSERT("a tmeplate here" ==~ literal);
+	UNIT_ASSERT("tmplte" ==~ literal);
+	UNIT_ASSERT("templates" ==~ literal);
+	UNIT_ASSERT(!("tmpl" ==~ literal));
+	UNIT_ASSERT(!("nothing like it" ==~ literal));
+
+	Pire::Regexp alternative("^(ab|cd)e$", Pire::Options(), 1);
+	UNIT_ASSERT("abe" ==~ alternative);
+	UNIT_ASSERT("xbe" ==~ alternative);
+	UNIT_ASSERT("cde" ==~ alternative);
+	UNIT_ASSERT(!("xxe" ==~ alternative));
+}
+
+SIMPLE_UNIT_TEST(MovedFrom)
+{
+	Pire::Regexp re("foo");
+	Pire::Regexp moved(std::move(re));
+	UNIT_ASSERT("a foo" ==~ moved);
+
+	// A moved-from regexp matches nothing, but can be copied and assigned to
+	UNIT_ASSERT(!("a foo" ==~ re));
+	UNIT_ASSERT(!("" ==~ re));
+	Pire::Regexp copy = re;
+	UNIT_ASSERT(!("a foo" ==~ copy));
+	moved = re;
+	UNIT_ASSERT(!("a foo" ==~ moved));
+	re = Pire::Regexp("bar");
+	UNIT_ASSERT("a bar" ==~ re);
+}
 	
 }
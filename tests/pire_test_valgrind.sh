@@ -1,2 +1,2 @@
 #!/bin/sh
-libtool --mode=execute valgrind ./pire_test_valgrind
+libtool --mode=execute valgrind --leak-check=full --error-exitcode=1 ./pire_test_valgrind
@@ -625,6 +625,54 @@ SIMPLE_UNIT_TEST(Serialization)
 	}
 }
 
+SIMPLE_UNIT_TEST(SerializedBeforeSlowRows)
+{
+	// Only SlowScanner has changed its layout since version 7
+	Scanners s("^regexp$");
+	BufferOutput wbuf;
+	Save(&wbuf, s.fast);
+	Save(&wbuf, s.simple);
+	Save(&wbuf, s.fastNoMask);
+	Save(&wbuf, s.halfFinal);
+	Save(&wbuf, s.slow);
+	ystring image(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	for (size_t pos = image.find("PIRE"); pos != ystring::npos; pos = image.find("PIRE", pos + 1)) {
+		Pire::Header* header = reinterpret_cast<Pire::Header*>(&image[pos]);
+		UNIT_ASSERT_EQUAL(header->FormatVersion(), Pire::Header::RE_VERSION);
+		header->Version ^= Pire::Header::RE_VERSION ^ Pire::Header::RE_VERSION_BEFORE_SLOW_ROWS;
+	}
+
+	MemoryInput rbuf(image.data(), image.size());
+	LoadAndMatchScanner(rbuf, s.fast);
+	LoadAndMatchScanner(rbuf, s.simple);
+	LoadAndMatchScanner(rbuf, s.fastNoMask);
+	LoadAndMatchScanner(rbuf, s.halfFinal);
+	try {
+		Load(&rbuf, s.slow);
+		UNIT_ASSERT(!"old SlowScanner accepted");
+	} catch (Pire::Error& e) {
+		UNIT_ASSERT(ystring(e.what()).find("incompatible version") != ystring::npos);
+	}
+
+	TVector<char> buf(image.size() + sizeof(size_t));
+	const char* ptr = Pire::Impl::AlignUp(&buf[0], sizeof(size_t));
+	const char* end = ptr + image.size();
+	memcpy((void*) ptr, image.data(), image.size());
+	Pire::Scanner fast;
+	Pire::SimpleScanner simple;
+	Pire::ScannerNoMask fastNoMask;
+	Pire::HalfFinalScanner halfFinal;
+	ptr = MmapAndMatchScanner(fast, ptr, end - ptr);
+	ptr = MmapAndMatchScanner(simple, ptr, end - ptr);
+	ptr = MmapAndMatchScanner(fastNoMask, ptr, end - ptr);
+	ptr = MmapAndMatchScanner(halfFinal, ptr, end - ptr);
+	Pire::SlowScanner slow;
+	try {
+		slow.Mmap(ptr, end - ptr);
+		UNIT_ASSERT(!"old SlowScanner accepted");
+	} catch (Pire::Error&) {}
+}
+
 SIMPLE_UNIT_TEST(TestShortcuts)
 {
 	REGEXP("aaa") {
@@ -704,6 +752,287 @@ SIMPLE_UNIT_TEST(Glue)
 	TestGlue<Pire::NonrelocHalfFinalScannerNoMask>();
 }
 
+SIMPLE_UNIT_TEST(GlueLarge)
+{
+	// The product has more states than the former fixed-size lookup table could hold
+	const char* regexps[] = { "a.{5}b", "c.{5}d", "e.{4}f", "g[a-z]{3}h", "x.{3}y", "k.{3}l", "m.{3}n" };
+	const size_t count = sizeof(regexps) / sizeof(*regexps);
+	Pire::Scanner glued;
+	for (size_t i = 0; i != count; ++i) {
+		glued = Pire::Scanner::Glue(glued, ParseRegexp(regexps[i]).Compile<Pire::Scanner>(), 1 << 20);
+		UNIT_ASSERT(!glued.Empty());
+	}
+	UNIT_ASSERT(glued.Size() > 256 * 1024);
+	UNIT_ASSERT(Pire::Scanner::Glue(glued, ParseRegexp("z").Compile<Pire::Scanner>(), 256 * 1024).Empty());
+
+	auto state = RunRegexp(glued, "--a12345b--x123y--m...n");
+	auto res = glued.AcceptedRegexps(state);
+	UNIT_ASSERT_EQUAL(res.second - res.first, ssize_t(3));
+	UNIT_ASSERT_EQUAL(res.first[0], size_t(0));
+	UNIT_ASSERT_EQUAL(res.first[1], size_t(4));
+	UNIT_ASSERT_EQUAL(res.first[2], size_t(6));
+
+	state = RunRegexp(glued, "ghijkh cdddd");
+	res = glued.AcceptedRegexps(state);
+	UNIT_ASSERT_EQUAL(res.second - res.first, ssize_t(0));
+}
+
+template<class Scanner>
+TVector<size_t> AcceptedUntilDecided(const Scanner& scanner, const ystring& str, size_t& stopped)
+{
+	typename Scanner::State state;
+	scanner.Initialize(state);
+	Pire::Step(scanner, state, Pire::BeginMark);
+	stopped = Pire::RunUntilDecided(scanner, state, str.c_str(), str.c_str() + str.size()) - str.c_str();
+	Pire::Step(scanner, state, Pire::EndMark);
+	auto accepted = scanner.AcceptedRegexps(state);
+	return TVector<size_t>(accepted.first, accepted.second);
+}
+
+template<class Scanner>
+void TestDecided()
+{
+	Scanner glued;
+	const char* regexps[] = { "foo", "^bar", "ba[rz]" };
+	for (auto&& regexp : regexps)
+		glued = Scanner::Glue(glued, ParseRegexp(regexp).Compile<Scanner>());
+
+	// Stops once all regexps have matched, or the remaining ones never can
+	size_t stopped;
+	ystring str = "xxbaz--foo" + ystring(1000, 'y');
+	TVector<size_t> expected = { 0, 2 };
+	UNIT_ASSERT(AcceptedUntilDecided(glued, str, stopped) == expected);
+	UNIT_ASSERT_EQUAL(stopped, size_t(10));
+	UNIT_ASSERT(AcceptedUntilDecided(Scanner::Glue(glued, ParseRegexp("z$").Compile<Scanner>()), str, stopped) == expected);
+	UNIT_ASSERT_EQUAL(stopped, str.size());
+	Scanner anchored = ParseRegexp("^ab", "n").Compile<Scanner>();
+	UNIT_ASSERT(AcceptedUntilDecided(anchored, str, stopped).empty());
+	UNIT_ASSERT_EQUAL(stopped, size_t(1));
+
+	// Stopping early never changes the result
+	const char alphabet[] = "abforz$";
+	unsigned seed = 1;
+	for (size_t i = 0; i != 300; ++i) {
+		str.clear();
+		for (size_t len = (seed >> 4) % 30; len; --len) {
+			seed = seed * 1103515245 + 12345;
+			str += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+		}
+		auto state = RunRegexp(glued, str);
+		auto accepted = glued.AcceptedRegexps(state);
+		UNIT_ASSERT(AcceptedUntilDecided(glued, str, stopped) == TVector<size_t>(accepted.first, accepted.second));
+		UNIT_ASSERT(stopped == str.size() || glued.Decided(state));
+	}
+
+	// Decided states survive serialization
+	BufferOutput wbuf;
+	glued.Save(&wbuf);
+	MemoryInput rbuf(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	Scanner loaded;
+	loaded.Load(&rbuf);
+	UNIT_ASSERT(AcceptedUntilDecided(loaded, "bar.foo.bar", stopped) == TVector<size_t>({ 0, 1, 2 }));
+	UNIT_ASSERT_EQUAL(stopped, size_t(7));
+}
+
+SIMPLE_UNIT_TEST(Decided)
+{
+	TestDecided<Pire::Scanner>();
+	TestDecided<Pire::NonrelocScanner>();
+	TestDecided<Pire::ScannerNoMask>();
+}
+
+SIMPLE_UNIT_TEST(LetterClasses)
+{
+	// Partitioning letters by their signatures must produce exactly the same classes
+	Pire::Fsm::TransitionTable tbl(50);
+	unsigned seed = 1;
+	for (size_t state = 0; state != tbl.size(); ++state)
+		for (Char letter = 0; letter != MaxChar; ++letter) {
+			seed = seed * 1103515245 + 12345;
+			if ((seed >> 16) % 5 == 0)
+				tbl[state][letter].insert((letter / 16 + state) % tbl.size());
+			else if ((seed >> 16) % 5 == 1)
+				tbl[state][letter];
+		}
+
+	Pire::Fsm::LettersEquality eq(tbl);
+	TVector<size_t> signatures = eq.Signatures();
+	Pire::Fsm::LettersTbl plain(eq), signed_(eq);
+	for (Char letter = 0; letter != MaxChar; ++letter) {
+		plain.Append(letter);
+		signed_.Append(letter, signatures[letter]);
+	}
+	UNIT_ASSERT(plain.Size() > 1);
+	UNIT_ASSERT(plain == signed_);
+	for (Char letter = 0; letter != MaxChar; ++letter) {
+		UNIT_ASSERT_EQUAL(plain.Index(letter), signed_.Index(letter));
+		UNIT_ASSERT_EQUAL(plain.Representative(letter), signed_.Representative(letter));
+	}
+}
+
+struct ModuloEquality: public Pire::ybinary_function<int, int, bool> {
+	int modulo;
+	explicit ModuloEquality(int m): modulo(m) {}
+	bool operator()(int a, int b) const { return a % modulo == b % modulo; }
+};
+
+SIMPLE_UNIT_TEST(SignedAppendAfterSplit)
+{
+	// Signatures of the classes must survive splitting them
+	typedef Pire::Partition<int, ModuloEquality> Partition;
+	Partition plain(ModuloEquality(3)), signed_(ModuloEquality(3));
+	for (int i = 0; i != 30; ++i) {
+		plain.Append(i);
+		signed_.Append(i, i % 3);
+	}
+	plain.Split(ModuloEquality(6));
+	signed_.Split(ModuloEquality(6));
+	for (int i = 30; i != 60; ++i) {
+		plain.Append(i);
+		signed_.Append(i, i % 3);
+	}
+	UNIT_ASSERT_EQUAL(signed_.Size(), size_t(6));
+	UNIT_ASSERT(plain == signed_);
+	for (int i = 0; i != 60; ++i)
+		UNIT_ASSERT_EQUAL(plain.Index(i), signed_.Index(i));
+}
+
+size_t MinimalSize(const Pire::Fsm& fsm)
+{
+	// Moore's algorithm: refine state classes until their number stops growing
+	TVector<size_t> classes(fsm.Size());
+	for (size_t state = 0; state != fsm.Size(); ++state)
+		classes[state] = fsm.IsFinal(state);
+	for (size_t count = 0;;) {
+		TMap<TVector<size_t>, size_t> signatures;
+		TVector<size_t> refined(fsm.Size());
+		for (size_t state = 0; state != fsm.Size(); ++state) {
+			TVector<size_t> signature(1, classes[state]);
+			for (auto&& letter : fsm.Letters()) {
+				const Pire::Fsm::StatesSet& tos = fsm.Destinations(state, letter.first);
+				signature.push_back(tos.empty() ? fsm.Size() : classes[*tos.begin()]);
+			}
+			refined[state] = signatures.insert(ymake_pair(signature, signatures.size())).first->second;
+		}
+		classes.swap(refined);
+		if (signatures.size() == count)
+			return count;
+		count = signatures.size();
+	}
+}
+
+SIMPLE_UNIT_TEST(Minimize)
+{
+	const char* regexps[] = { "(a|b)*abb", "x.{6}$", "(ab|cd|ef){2,5}", "[a-z]+[0-9]*&.*z.*", "((a|b)(c|d))*(ac)?" };
+	for (size_t i = 0; i != sizeof(regexps) / sizeof(*regexps); ++i) {
+		Pire::Fsm fsm = Pire::Lexer(regexps[i]).AddFeature(Pire::Features::AndNotSupport()).Parse();
+		fsm.Surround();
+		UNIT_ASSERT(fsm.Determine());
+		Pire::Fsm minimized = fsm;
+		minimized.Minimize();
+		UNIT_ASSERT(minimized.Size() <= fsm.Size());
+		UNIT_ASSERT_EQUAL(minimized.Size(), MinimalSize(fsm));
+
+		Pire::SlowScanner sc1 = Pire::SlowScanner(fsm);
+		Pire::SimpleScanner sc2 = Pire::SimpleScanner(minimized);
+		const char* inputs[] = { "", "abb", "aababb", "xabcdefg", "xabcdef", "abcdef", "cdab", "abcz", "az9", "acbdac", "acad" };
+		for (size_t j = 0; j != sizeof(inputs) / sizeof(*inputs); ++j)
+			UNIT_ASSERT_EQUAL(Matches(sc1, inputs[j]), Matches(sc2, inputs[j]));
+	}
+}
+
+bool FsmAccepts(const Pire::Fsm& fsm, const char* str)
+{
+	size_t state = fsm.Initial();
+	for (; *str; ++str) {
+		const Pire::Fsm::StatesSet& next = fsm.Destinations(state, static_cast<unsigned char>(*str));
+		if (next.empty())
+			return false;
+		state = *next.begin();
+	}
+	return fsm.IsFinal(state);
+}
+
+SIMPLE_UNIT_TEST(MinimizeIncomplete)
+{
+	// A determined FSM with missing transitions: states 2 and 4 are equivalent, 1 is not
+	Pire::Fsm fsm;
+	fsm.Resize(5);
+	fsm.Connect(0, 1, 'a');
+	fsm.Connect(0, 2, 'b');
+	fsm.Connect(0, 4, 'e');
+	fsm.Connect(1, 3, 'c');
+	fsm.Connect(2, 3, 'c');
+	fsm.Connect(4, 3, 'c');
+	fsm.Connect(1, 4, 'x');
+	fsm.SetInitial(0);
+	fsm.ClearFinal();
+	fsm.SetFinal(3, true);
+	fsm.Sparse();
+	fsm.SetIsDetermined(true);
+
+	Pire::Fsm minimized = fsm;
+	minimized.Minimize();
+	UNIT_ASSERT_EQUAL(minimized.Size(), size_t(4));
+	const char* inputs[] = { "ac", "bc", "ec", "axc", "bxc", "exc", "axxc", "c", "" };
+	for (auto&& input : inputs)
+		UNIT_ASSERT_EQUAL(FsmAccepts(minimized, input), FsmAccepts(fsm, input));
+	UNIT_ASSERT(!FsmAccepts(minimized, "bxc"));
+}
+
+SIMPLE_UNIT_TEST(CompileLimits)
+{
+	Pire::CompileContext unlimited;
+	Pire::Fsm parsed = Pire::Lexer("ab{3}c").Parse(unlimited);
+	parsed.Surround();
+	UNIT_ASSERT(Matches(parsed.Compile<Pire::Scanner>(unlimited), "abbbc"));
+
+	Pire::CompileContext small;
+	small.SetMemoryLimit(1 << 20);
+	try {
+		Pire::Lexer("((ab|cd){1000}){1000}").Parse(small);
+		UNIT_ASSERT(!"memory limit ignored when parsing");
+	} catch (Pire::CompileLimitError& e) {
+		UNIT_ASSERT_EQUAL(e.Stage(), ystring("parse"));
+		UNIT_ASSERT_EQUAL(e.Limit(), Pire::CompileLimitError::MemoryLimit);
+		UNIT_ASSERT(e.Memory() > small.MemoryLimit());
+	}
+
+	Pire::CompileContext medium;
+	medium.SetMemoryLimit(16 << 20);
+	Pire::Fsm fsm = ParseRegexp("x.{20}$");
+	try {
+		fsm.Canonize(1 << 30, medium);
+		UNIT_ASSERT(!"memory limit ignored when determining");
+	} catch (Pire::CompileLimitError& e) {
+		UNIT_ASSERT_EQUAL(e.Stage(), ystring("determine"));
+		UNIT_ASSERT_EQUAL(e.Limit(), Pire::CompileLimitError::MemoryLimit);
+	}
+
+	Pire::CompileContext expired;
+	expired.SetDeadline(Pire::CompileContext::Clock::now() - std::chrono::seconds(1));
+	try {
+		ParseRegexp("abc").Compile<Pire::Scanner>(expired);
+		UNIT_ASSERT(!"deadline ignored");
+	} catch (Pire::CompileLimitError& e) {
+		UNIT_ASSERT_EQUAL(e.Limit(), Pire::CompileLimitError::Deadline);
+	}
+
+	Pire::Scanner sc1 = ParseRegexp("aaa").Compile<Pire::Scanner>();
+	Pire::Scanner sc2 = ParseRegexp("bbb").Compile<Pire::Scanner>();
+	Pire::CompileContext cancelled;
+	cancelled.Cancel();
+	try {
+		Pire::Scanner::Glue(sc1, sc2, cancelled);
+		UNIT_ASSERT(!"cancellation ignored");
+	} catch (Pire::CompileLimitError& e) {
+		UNIT_ASSERT_EQUAL(e.Stage(), ystring("glue"));
+		UNIT_ASSERT_EQUAL(e.Limit(), Pire::CompileLimitError::Cancelled);
+	}
+	UNIT_ASSERT(Pire::CompileContext::Current() == 0);
+	UNIT_ASSERT_EQUAL(Pire::Scanner::Glue(sc1, sc2).RegexpsCount(), size_t(2));
+}
+
 SIMPLE_UNIT_TEST(Slow)
 {
 	Pire::SlowScanner sc = ParseRegexp("a.{30}$", "").Compile<Pire::SlowScanner>();
@@ -713,6 +1042,377 @@ SIMPLE_UNIT_TEST(Slow)
 	UNIT_ASSERT(!Matches(sc, "....a............................."));
 }
 
+SIMPLE_UNIT_TEST(SlowMemoized)
+{
+	const char* regexps[] = { "a.{30}$", "((foo|bar) )+baz", "(foo|ba[rz]).{3}q" };
+	ystring text;
+	for (size_t i = 0; text.size() < 2000; ++i)
+		text += (i % 5 == 3) ? "baz " : (i % 3) ? "foo " : "bar ";
+	text[1500] = 'q';
+
+	for (auto&& regexp : regexps) {
+		Pire::SlowScanner plain = ParseRegexp(regexp, "").Compile<Pire::SlowScanner>();
+		UNIT_ASSERT_EQUAL(plain.MemoSize(), 0u);
+		Pire::SlowScanner memoized = plain;
+		memoized.SetMemoSize(Pire::SlowScanner::SuggestedMemoSize);
+		Pire::SlowScanner tiny = plain;
+		tiny.SetMemoSize(1);
+
+		for (size_t len = 250; len <= text.size(); len += 97) {
+			ystring str = text.substr(0, len);
+			// Reference: one character at a time
+			Pire::SlowScanner::State state;
+			plain.Initialize(state);
+			plain.Next(state, Pire::BeginMark);
+			for (auto&& ch : str)
+				plain.Next(state, static_cast<unsigned char>(ch));
+			plain.Next(state, Pire::EndMark);
+			bool expected = plain.Final(state);
+
+			UNIT_ASSERT_EQUAL(Matches(memoized, str), expected);
+			UNIT_ASSERT_EQUAL(Matches(plain, str), expected);
+			UNIT_ASSERT_EQUAL(Matches(tiny, str), expected);
+		}
+	}
+
+	// The memo is kept in the state and reused by later runs
+	Pire::SlowScanner plain = ParseRegexp("(foo|ba[rz]).{3}q", "").Compile<Pire::SlowScanner>();
+	Pire::SlowScanner secondPlain = ParseRegexp("((foo|bar) )+baz", "").Compile<Pire::SlowScanner>();
+	Pire::SlowScanner first = plain;
+	first.SetMemoSize(Pire::SlowScanner::SuggestedMemoSize);
+	Pire::SlowScanner second = secondPlain;
+	second.SetMemoSize(Pire::SlowScanner::SuggestedMemoSize);
+	Pire::SlowScanner::State state;
+	Pire::SlowScanner::State reference;
+	first.Initialize(state);
+	plain.Initialize(reference);
+	Pire::Run(first, state, text.data(), text.data() + 1000);
+	UNIT_ASSERT(state.memo.get());
+	const Pire::SlowScanner::Memo* memo = state.memo.get();
+	const size_t firstSerial = memo->scanner;
+	Pire::Run(first, state, text.data() + 1000, text.data() + text.size());
+	UNIT_ASSERT_EQUAL(state.memo.get(), memo);
+	Pire::Run(plain, reference, text.data(), text.data() + text.size());
+	// Memoization is off by default
+	UNIT_ASSERT(!reference.memo);
+	// Memoized sets of states are sorted
+	std::sort(reference.states.begin(), reference.states.end());
+	UNIT_ASSERT_EQUAL(state.states, reference.states);
+	UNIT_ASSERT(!Pire::SlowScanner::State(state).memo);
+
+	// A memo of another scanner is not used
+	second.Initialize(state);
+	Pire::Run(second, state, text.data(), text.data() + text.size());
+	UNIT_ASSERT(state.memo->scanner != firstSerial);
+	Pire::SlowScanner::State fresh;
+	second.Initialize(fresh);
+	Pire::Run(secondPlain, fresh, text.data(), text.data() + text.size());
+	std::sort(fresh.states.begin(), fresh.states.end());
+	UNIT_ASSERT_EQUAL(state.states, fresh.states);
+}
+
+SIMPLE_UNIT_TEST(SlowLayout)
+{
+	// More than 64 letters, so letter bitmaps take several words
+	const ystring alphabet = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!%,/:;=@_";
+	ystring regexp = "(";
+	for (size_t i = 0; i != alphabet.size(); ++i)
+		regexp += ystring(i ? "|" : "") + alphabet[i] + alphabet[alphabet.size() - 1 - i];
+	regexp += ").{3}$";
+	Pire::Fsm fsm = ParseRegexp(regexp.c_str(), "");
+	Pire::SlowScanner slow = Pire::Fsm(fsm).Compile<Pire::SlowScanner>();
+	Pire::SimpleScanner simple = Pire::Fsm(fsm).Compile<Pire::SimpleScanner>();
+	UNIT_ASSERT(slow.GetLettersCount() > 64);
+	// Most of (state, letter) cells are empty
+	UNIT_ASSERT(slow.BufSize() < slow.Size() * slow.GetLettersCount() * sizeof(ui32));
+
+	BufferOutput wbuf;
+	Save(&wbuf, slow);
+	TVector<char> buf(wbuf.Buffer().Size() + sizeof(size_t));
+	char* ptr = Pire::Impl::AlignUp(&buf[0], sizeof(size_t));
+	memcpy(ptr, wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	Pire::SlowScanner mmaped;
+	UNIT_ASSERT_EQUAL(mmaped.Mmap(ptr, wbuf.Buffer().Size()), (const void*) (ptr + wbuf.Buffer().Size()));
+
+	// An mmap()-ed scanner shares the layout, so it can be saved again
+	BufferOutput wbuf2;
+	Save(&wbuf2, mmaped);
+	UNIT_ASSERT_EQUAL(ystring(wbuf2.Buffer().Data(), wbuf2.Buffer().Size()), ystring(wbuf.Buffer().Data(), wbuf.Buffer().Size()));
+	MemoryInput rbuf(wbuf2.Buffer().Data(), wbuf2.Buffer().Size());
+	Pire::SlowScanner loaded;
+	Load(&rbuf, loaded);
+
+	unsigned seed = 3;
+	for (size_t i = 0; i != 300; ++i) {
+		ystring str;
+		for (size_t len = (seed >> 4) % 12; len; --len) {
+			seed = seed * 1103515245 + 12345;
+			str += alphabet[(seed >> 16) % alphabet.size()];
+		}
+		bool expected = Matches(simple, str);
+		UNIT_ASSERT_EQUAL(Matches(slow, str), expected);
+		UNIT_ASSERT_EQUAL(Matches(mmaped, str), expected);
+		UNIT_ASSERT_EQUAL(Matches(loaded, str), expected);
+		UNIT_ASSERT_EQUAL(Matches(Pire::SlowScanner(mmaped), str), expected);
+	}
+	UNIT_ASSERT( Matches(mmaped, "x0_123"));
+
+	// A scanner saved without actions cannot be loaded as one needing them
+	Pire::SlowScanner capturing(true);
+	MemoryInput rbuf2(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	try {
+		Load(&rbuf2, capturing);
+		UNIT_ASSERT(!"actions are not checked");
+	} catch (Pire::Error&) {}
+
+	// Images of older versions are rejected by the version check
+	const ui32 oldVersions[] = { Pire::Header::RE_VERSION_BEFORE_SLOW_ROWS, Pire::Header::RE_VERSION_WITH_MACTIONS };
+	for (auto&& version : oldVersions) {
+		ystring image(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+		reinterpret_cast<Pire::Header*>(&image[0])->Version = version;
+		MemoryInput rbuf3(image.data(), image.size());
+		Pire::SlowScanner old;
+		try {
+			Load(&rbuf3, old);
+			UNIT_ASSERT(!"old version accepted");
+		} catch (Pire::Error& e) {
+			UNIT_ASSERT(ystring(e.what()).find("incompatible version") != ystring::npos);
+		}
+	}
+}
+
+SIMPLE_UNIT_TEST(SlowGlue)
+{
+	const char* regexps[] = { "a.{5}b", "c[0-9]{3}$", "ab", "^x" };
+	const size_t count = sizeof(regexps) / sizeof(*regexps);
+	TVector<Pire::SlowScanner> scanners;
+	for (size_t i = 0; i != count; ++i)
+		scanners.push_back(ParseRegexp(regexps[i], "").Compile<Pire::SlowScanner>());
+	Pire::SlowScanner glued = Pire::SlowScanner::Glue(Pire::SlowScanner::Glue(scanners[0], scanners[1]),
+		Pire::SlowScanner::Glue(scanners[2], scanners[3]));
+	UNIT_ASSERT_EQUAL(glued.RegexpsCount(), count);
+	UNIT_ASSERT_EQUAL(Pire::SlowScanner::Glue(Pire::SlowScanner(), glued).RegexpsCount(), count);
+
+	BufferOutput wbuf;
+	Save(&wbuf, glued);
+	TVector<char> buf(wbuf.Buffer().Size() + sizeof(size_t));
+	char* ptr = Pire::Impl::AlignUp(&buf[0], sizeof(size_t));
+	memcpy(ptr, wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	Pire::SlowScanner mmaped;
+	UNIT_ASSERT_EQUAL(mmaped.Mmap(ptr, wbuf.Buffer().Size()), (const void*) (ptr + wbuf.Buffer().Size()));
+	MemoryInput rbuf(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	Pire::SlowScanner loaded;
+	Load(&rbuf, loaded);
+	UNIT_ASSERT_EQUAL(loaded.RegexpsCount(), count);
+
+	const ystring alphabet = "abcx019";
+	unsigned seed = 7;
+	for (size_t i = 0; i != 500; ++i) {
+		ystring str;
+		for (size_t len = (seed >> 4) % 10; len; --len) {
+			seed = seed * 1103515245 + 12345;
+			str += alphabet[(seed >> 16) % alphabet.size()];
+		}
+		TVector<size_t> expected;
+		for (size_t j = 0; j != count; ++j)
+			if (Matches(scanners[j], str))
+				expected.push_back(j);
+		for (auto&& sc : { &glued, &mmaped, &loaded }) {
+			Pire::SlowScanner::State state = RunRegexp(*sc, str);
+			auto accepted = sc->AcceptedRegexps(state);
+			UNIT_ASSERT_EQUAL(TVector<size_t>(accepted.first, accepted.second), expected);
+		}
+	}
+}
+
+SIMPLE_UNIT_TEST(Lazy)
+{
+	Pire::LazyScanner sc = ParseRegexp("a.{30}$", "").Compile<Pire::LazyScanner>();
+	//                             123456789012345678901234567890
+	UNIT_ASSERT( Matches(sc, "....a.............................."));
+	UNIT_ASSERT(!Matches(sc, "....a..............................."));
+	UNIT_ASSERT(!Matches(sc, "....a............................."));
+	UNIT_ASSERT(sc.CachedStatesCount() > 1);
+	UNIT_ASSERT_EQUAL(sc.CacheFlushesCount(), size_t(0));
+
+	// A copy shares the cache with the original
+	Pire::LazyScanner copy = sc;
+	size_t cached = sc.CachedStatesCount();
+	UNIT_ASSERT( Matches(copy, "....a.............................."));
+	UNIT_ASSERT_EQUAL(sc.CachedStatesCount(), cached);
+
+	// A tiny budget forces the cache to be flushed in the middle of a scan
+	Pire::Fsm fsm = ParseRegexp("a.{30}$", "");
+	Pire::LazyScanner small(fsm, 0, 1);
+	ystring text;
+	for (size_t i = 0; i != 200; ++i)
+		text += (i % 7 ? 'b' : 'a');
+	Pire::SlowScanner slow = ParseRegexp("a.{30}$", "").Compile<Pire::SlowScanner>();
+	for (size_t len = 0; len <= text.size(); ++len)
+		UNIT_ASSERT_EQUAL(Matches(small, text.substr(0, len)), Matches(slow, text.substr(0, len)));
+	UNIT_ASSERT(small.CacheFlushesCount() > 0);
+}
+
+template<class Scanner>
+bool HasBitParallelError(const char* regexp)
+{
+	try {
+		ParseRegexp(regexp, "").Compile<Scanner>();
+		return false;
+	} catch (Pire::Error&) {
+		return true;
+	}
+}
+
+template<class Scanner>
+void TestBitParallel(const char* regexp)
+{
+	Pire::Fsm fsm = ParseRegexp(regexp, "");
+	Scanner sc = Pire::Fsm(fsm).Compile<Scanner>();
+	Pire::SlowScanner slow = Pire::Fsm(fsm).Compile<Pire::SlowScanner>();
+
+	const char alphabet[] = "abcxyz.";
+	unsigned seed = 7;
+	for (size_t i = 0; i != 300; ++i) {
+		ystring str;
+		for (size_t len = (seed >> 4) % 250; len; --len) {
+			seed = seed * 1103515245 + 12345;
+			str += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+		}
+		UNIT_ASSERT_EQUAL(Matches(sc, str), Matches(slow, str));
+	}
+}
+
+template<class Scanner>
+void TestBitParallelSerialization(const char* regexp)
+{
+	Pire::Fsm fsm = ParseRegexp(regexp, "");
+	Scanner sc = Pire::Fsm(fsm).Compile<Scanner>();
+	Pire::SlowScanner slow = Pire::Fsm(fsm).Compile<Pire::SlowScanner>();
+
+	BufferOutput wbuf;
+	Save(&wbuf, sc);
+
+	MemoryInput rbuf(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	Scanner loaded;
+	Load(&rbuf, loaded);
+
+	TVector<char> buf(wbuf.Buffer().Size() + sizeof(size_t));
+	const char* ptr = Pire::Impl::AlignUp(&buf[0], sizeof(size_t));
+	memcpy((void*) ptr, wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	Scanner mapped;
+	UNIT_ASSERT_EQUAL(mapped.Mmap(ptr, wbuf.Buffer().Size()), (const void*) (ptr + wbuf.Buffer().Size()));
+	// A copy of an mmap()-ed scanner refers to the same memory
+	Scanner copy = mapped;
+
+	const char alphabet[] = "abxy.";
+	unsigned seed = 11;
+	for (size_t i = 0; i != 100; ++i) {
+		ystring str;
+		for (size_t len = (seed >> 4) % 150; len; --len) {
+			seed = seed * 1103515245 + 12345;
+			str += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+		}
+		UNIT_ASSERT_EQUAL(Matches(loaded, str), Matches(slow, str));
+		UNIT_ASSERT_EQUAL(Matches(mapped, str), Matches(slow, str));
+		UNIT_ASSERT_EQUAL(Matches(copy, str), Matches(slow, str));
+	}
+}
+
+SIMPLE_UNIT_TEST(BitParallel)
+{
+	Pire::BitParallelScanner64 sc = ParseRegexp("a.{30}$", "").Compile<Pire::BitParallelScanner64>();
+	//                             123456789012345678901234567890
+	UNIT_ASSERT( Matches(sc, "....a.............................."));
+	UNIT_ASSERT(!Matches(sc, "....a..............................."));
+	UNIT_ASSERT(!Matches(sc, "....a............................."));
+
+	const char* regexps[] = { "a.{20}b", "^(ab|c)*x.{10}$", "(a|bc+)y[a-c]{3}z", "x(ab)*.{5}y|z.{8}$", "a" };
+	for (auto&& regexp : regexps) {
+		TestBitParallel<Pire::BitParallelScanner64>(regexp);
+		TestBitParallel<Pire::BitParallelScanner128>(regexp);
+		TestBitParallel<Pire::BitParallelScanner512>(regexp);
+	}
+	TestBitParallel<Pire::BitParallelScanner128>("a.{100}b");
+	TestBitParallel<Pire::BitParallelScanner512>("a.{100}b|x.{200}$");
+
+	// Dead states are detected
+	Pire::BitParallelScanner64 anchored = ParseRegexp("ab", "n").Compile<Pire::BitParallelScanner64>();
+	Pire::BitParallelScanner64::State state;
+	anchored.Initialize(state);
+	Pire::Step(anchored, state, Pire::BeginMark);
+	Pire::Step(anchored, state, 'x');
+	UNIT_ASSERT(anchored.Dead(state));
+
+	UNIT_CHECKPOINT(); UNIT_ASSERT(HasBitParallelError<Pire::BitParallelScanner64>("a.{100}b"));
+	UNIT_CHECKPOINT(); UNIT_ASSERT(!HasBitParallelError<Pire::BitParallelScanner128>("a.{100}b"));
+
+	TestBitParallelSerialization<Pire::BitParallelScanner64>("a.{20}b|^(ab)*x");
+	TestBitParallelSerialization<Pire::BitParallelScanner512>("a.{100}b|x.{200}$");
+
+	// Scanners of another width cannot be loaded
+	BufferOutput wbuf;
+	Save(&wbuf, sc);
+	MemoryInput rbuf(wbuf.Buffer().Data(), wbuf.Buffer().Size());
+	try {
+		Pire::BitParallelScanner128 wide;
+		Load(&rbuf, wide);
+		UNIT_ASSERT(!"BitParallelScanner failed to check the width");
+	}
+	catch (Pire::Error&) {}
+}
+
+SIMPLE_UNIT_TEST(ScannerSet)
+{
+	const char* regexps[] = {
+		"foo", "bar", "baz", "^quux$", "[0-9]+x",
+		"a.{6}b", "c.{6}d", "e.{6}f", "g.{6}h",
+		"q.{20}$"  // too large to be determined within the limit
+	};
+	const size_t count = sizeof(regexps) / sizeof(*regexps);
+
+	Pire::ScannerSet::Builder builder(1 << 20);
+	TVector<Pire::SlowScanner> expected;
+	for (size_t i = 0; i != count; ++i) {
+		UNIT_ASSERT_EQUAL(builder.Add(ParseRegexp(regexps[i])), i);
+		expected.push_back(ParseRegexp(regexps[i]).Compile<Pire::SlowScanner>());
+	}
+	Pire::ScannerSet set = builder.Build();
+	UNIT_ASSERT_EQUAL(set.RegexpsCount(), count);
+	UNIT_ASSERT_EQUAL(set.Fallbacks().size(), size_t(1));
+	UNIT_ASSERT_EQUAL(set.Fallbacks()[0].second, count - 1);
+	UNIT_ASSERT(set.Groups().size() > 1);
+	UNIT_ASSERT(set.Groups().size() < count - 2);
+	size_t glued = 0;
+	for (auto&& group : set.Groups()) {
+		UNIT_ASSERT(group.scanner.BufSize() <= (1 << 20));
+		UNIT_ASSERT_EQUAL(group.scanner.RegexpsCount(), group.ids.size());
+		glued += group.ids.size();
+	}
+	UNIT_ASSERT_EQUAL(glued, count - 1);
+
+	TVector<size_t> ids;
+	ids.push_back(0);
+	ids.push_back(5);
+	UNIT_ASSERT(set.Matches("xxfooxxa123456b") == ids);
+	UNIT_ASSERT(set.Matches("quux") == TVector<size_t>(1, 3));
+
+	const char alphabet[] = "abcdefghqxfooz01";
+	unsigned seed = 1;
+	for (size_t i = 0; i != 500; ++i) {
+		ystring str;
+		for (size_t len = (seed >> 4) % 40; len; --len) {
+			seed = seed * 1103515245 + 12345;
+			str += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+		}
+		TVector<size_t> matched;
+		for (size_t id = 0; id != count; ++id)
+			if (Matches(expected[id], str))
+				matched.push_back(id);
+		UNIT_ASSERT(set.Matches(str) == matched);
+	}
+}
+
 class AlignedString {
 public:
 	explicit AlignedString(const char* str): m_str((char*) strdup(str)) {}
@@ -46,4 +46,22 @@ SIMPLE_UNIT_TEST(Valgrind)
 	}
 }
 
+SIMPLE_UNIT_TEST(CompileLimitsDoNotLeak)
+{
+	// Limits are hit inside parser actions, with many values on the parser stack
+	const char* patterns[] = { "x((ab|cd){1000}){1000}y", "[^a]((b|c){100}){100}", "(ab|cd)&~(x((ab|cd){100}){100})" };
+	for (auto&& pattern : patterns) {
+		Pire::CompileContext ctx;
+		ctx.SetMemoryLimit(64 << 10);
+		Pire::Lexer lexer(pattern);
+		lexer.AddFeature(Pire::Features::AndNotSupport());
+		try {
+			lexer.Parse(ctx);
+			UNIT_ASSERT(!"memory limit ignored when parsing");
+		} catch (Pire::CompileLimitError& e) {
+			UNIT_ASSERT_EQUAL(e.Limit(), Pire::CompileLimitError::MemoryLimit);
+		}
+	}
+}
+
 }
@@ -28,6 +28,8 @@
 #include "../common/filemap.h"
 
 #ifdef BENCH_EXTRA_ENABLED
+#include <functional>
+#include <thread>
 #include <pire/extra.h>
 #endif
 
@@ -86,28 +88,28 @@ public:
 	};
 
 	virtual ~ITester() {}
-	virtual void Prepare(Algorithm alg, const std::vector<Patterns>& patterns) = 0;
+	virtual void Prepare(Algorithm alg, const std::vector<Patterns>& patterns, size_t distance) = 0;
 	virtual void Run(const char* begin, const char* end) = 0;
 };
 
 // Sinlge regexp scanner
 template<class Scanner>
 struct CompileRe {
-	static Scanner Do(const Patterns& patterns, bool surround)
+	static Scanner Do(const Patterns& patterns, bool surround, size_t distance)
 	{
 		if (patterns.size() != 1)
 			throw std::runtime_error("Only one regexp is allowed for this scanner");
 		Pire::Fsm fsm = Pire::Lexer(patterns[0]).Parse();
 		if (surround)
 			fsm.Surround();
-		return fsm.Compile<Scanner>();
+		return fsm.Compile<Scanner>(distance);
 	}
 };
 
 // Multi regexp scanner
 template<class Relocation, class Shortcutting>
 struct CompileRe< Pire::Impl::Scanner<Relocation, Shortcutting> > {
-	static Pire::Impl::Scanner<Relocation, Shortcutting> Do(const Patterns& patterns, bool surround)
+	static Pire::Impl::Scanner<Relocation, Shortcutting> Do(const Patterns& patterns, bool surround, size_t distance)
 	{
 		typedef Pire::Impl::Scanner<Relocation, Shortcutting> Sc;
 		Sc sc;
@@ -115,7 +117,7 @@ struct CompileRe< Pire::Impl::Scanner<Relocation, Shortcutting> > {
 			Pire::Fsm fsm = Pire::Lexer(*i).Parse();
 			if (surround)
 				fsm.Surround();
-			Sc tsc = fsm.Compile<Sc>();
+			Sc tsc = fsm.Compile<Sc>(distance);
 			if (i == patterns.begin())
 				tsc.Swap(sc);
 			else {
@@ -170,10 +172,28 @@ struct PrintResult< Pire::ScannerPair<Scanner1, Scanner2> > {
 	}
 };
 
+// Tuple result
+template<class... Scanners>
+struct PrintResult< Pire::ScannerTuple<Scanners...> > {
+	typedef Pire::ScannerTuple<Scanners...> Scanner;
+
+	static void Do(const Scanner& sc, typename Scanner::State st)
+	{
+		Do(sc, st, typename Pire::Impl::MakeIndices<Scanner::Size>::Type());
+	}
+
+	template<size_t... I>
+	static void Do(const Scanner& sc, const typename Scanner::State& st, Pire::Impl::Indices<I...>)
+	{
+		Pire::Impl::Unroll{(std::cout << "[#" << I << "] ",
+			PrintResult<typename Scanner::template Member<I>>::Do(sc.template Get<I>(), std::get<I>(st)), 0)...};
+	}
+};
+
 #ifdef BENCH_EXTRA_ENABLED
 template <>
 struct CompileRe<Pire::CapturingScanner> {
-	static Pire::CapturingScanner Do(const Patterns& patterns, bool surround)
+	static Pire::CapturingScanner Do(const Patterns& patterns, bool surround, size_t /*distance*/)
 	{
 		if (patterns.size() != 1)
 			throw std::runtime_error("Only one regexp is allowed for this scanner");
@@ -184,18 +204,18 @@ struct CompileRe<Pire::CapturingScanner> {
 	}
 };
 
-template <>
-struct CompileRe<Pire::CountingScanner> {
-	static Pire::CountingScanner Do(const Patterns& patterns, bool /*surround*/)
+template <class Scanner>
+struct CompileCountingRe {
+	static Scanner Do(const Patterns& patterns, bool /*surround*/, size_t /*distance*/)
 	{
-		Pire::CountingScanner sc;
+		Scanner sc;
 		for (Patterns::const_iterator i = patterns.begin(), ie = patterns.end(); i != ie; ++i) {
-			Pire::CountingScanner tsc = Pire::CountingScanner(
+			Scanner tsc = Scanner(
 				Pire::Lexer(*i).Parse(), Pire::Lexer(".*").Parse());
 			if (i == patterns.begin())
 				tsc.Swap(sc);
 			else {
-				sc = Pire::CountingScanner::Glue(sc, tsc);
+				sc = Scanner::Glue(sc, tsc);
 				if (sc.Empty()) {
 					std::ostringstream msg;
 					msg << "Scanner gluing failed at regexp " << *i << " - pattern too complicated";
@@ -207,15 +227,27 @@ struct CompileRe<Pire::CountingScanner> {
 	}
 };
 
-template<>
-struct PrintResult<Pire::CountingScanner> {
-	static void Do(const Pire::CountingScanner& sc, Pire::CountingScanner::State st)
+template <>
+struct CompileRe<Pire::CountingScanner>: public CompileCountingRe<Pire::CountingScanner> {};
+
+template <>
+struct CompileRe<Pire::NoGlueLimitCountingScanner>: public CompileCountingRe<Pire::NoGlueLimitCountingScanner> {};
+
+template <class Scanner>
+struct PrintCounts {
+	static void Do(const Scanner& sc, typename Scanner::State st)
 	{
 		for (size_t i = 0; i < sc.RegexpsCount(); ++i)
 			std::cout << "regexp #" << i << ": " << st.Result(i) << std::endl;
 	}
 };
 
+template<>
+struct PrintResult<Pire::CountingScanner>: public PrintCounts<Pire::CountingScanner> {};
+
+template<>
+struct PrintResult<Pire::NoGlueLimitCountingScanner>: public PrintCounts<Pire::NoGlueLimitCountingScanner> {};
+
 template<>
 struct PrintResult<Pire::CapturingScanner> {
 	static void Do(const Pire::CapturingScanner&, Pire::CapturingScanner::State st)
@@ -228,33 +260,39 @@ struct PrintResult<Pire::CapturingScanner> {
 };
 #endif // BENCH_EXTRA_ENABLED
 
+template<class Scanner>
+void RunScanner(ITester::Algorithm alg, const Scanner& sc, const char* begin, const char* end)
+{
+	if (alg == ITester::DefaultRun)
+		PrintResult<Scanner>::Do(sc, Pire::Runner(sc).Begin().Run(begin, end).End().State());
+	else {
+		const char* pos = (alg == ITester::ShortestPrefix ? 
+			Pire::ShortestPrefix(sc, begin, end) :
+			Pire::LongestPrefix(sc, begin, end));
+		if (pos)
+			std::cout << "Prefix end: " << pos - begin << std::endl;
+		else
+			std::cout << "No prefix" << std::endl;
+	}
+}
+
 // Common implementation for all scanners
 template<class Scanner>
 class TesterBase: public ITester {
 public:
-	void Prepare(Algorithm a, const std::vector<Patterns>& patterns)
+	void Prepare(Algorithm a, const std::vector<Patterns>& patterns, size_t distance)
 	{
 		alg = a;
-		Compile(patterns, alg == DefaultRun);
+		Compile(patterns, alg == DefaultRun, distance);
 	}
 
 	void Run(const char* begin, const char* end)
 	{
-		if (alg == DefaultRun)
-			PrintResult<Scanner>::Do(sc, Pire::Runner(sc).Begin().Run(begin, end).End().State());
-		else {
-			const char* pos = (alg == ShortestPrefix ? 
-				Pire::ShortestPrefix(sc, begin, end) :
-				Pire::LongestPrefix(sc, begin, end));
-			if (pos)
-				std::cout << "Prefix end: " << pos - begin << std::endl;
-			else
-				std::cout << "No prefix" << std::endl;
-		}
+		RunScanner(alg, sc, begin, end);
 	}
 
 protected:
-	virtual void Compile(const std::vector<Patterns>& patterns, bool surround) = 0;
+	virtual void Compile(const std::vector<Patterns>& patterns, bool surround, size_t distance) = 0;
 
 	Scanner sc;
 	ITester::Algorithm alg;
@@ -264,11 +302,11 @@ template<class Scanner>
 class Tester: public TesterBase<Scanner> {
 	typedef TesterBase<Scanner> Base;
 
-	void Compile(const std::vector<Patterns>& patterns, bool surround)
+	void Compile(const std::vector<Patterns>& patterns, bool surround, size_t distance)
 	{
 		if (patterns.size() != 1)
 			throw std::runtime_error("Only one set of regexps is allowed for this scanner");
-		Base::sc = ::CompileRe<Scanner>::Do(patterns[0], surround);
+		Base::sc = ::CompileRe<Scanner>::Do(patterns[0], surround, distance);
 	}
 };
 
@@ -276,12 +314,12 @@ template<class Scanner1, class Scanner2>
 class PairTester: public TesterBase< Pire::ScannerPair<Scanner1, Scanner2> > {
 	typedef TesterBase< Pire::ScannerPair<Scanner1, Scanner2> > Base;
 
-	void Compile(const std::vector<Patterns>& patterns, bool surround)
+	void Compile(const std::vector<Patterns>& patterns, bool surround, size_t distance)
 	{
 		if (patterns.size() != 2)
 			throw std::runtime_error("Only two sets of regexps are allowed for this scanner");
-		sc1 = ::CompileRe<Scanner1>::Do(patterns[0], surround);
-		sc2 = ::CompileRe<Scanner2>::Do(patterns[1], surround);
+		sc1 = ::CompileRe<Scanner1>::Do(patterns[0], surround, distance);
+		sc2 = ::CompileRe<Scanner2>::Do(patterns[1], surround, distance);
 		typedef Pire::ScannerPair<Scanner1, Scanner2> Pair;
 		Base::sc = Pair(sc1, sc2);
 	}
@@ -290,10 +328,52 @@ private:
 	Scanner2 sc2;
 };
 
+// Several scanners run in one pass, or one after another for comparison
+// (then prefixes are reported for each scanner rather than for all of them)
+template<class... Scanners>
+class TupleTester: public TesterBase< Pire::ScannerTuple<Scanners...> > {
+	typedef Pire::ScannerTuple<Scanners...> Tuple;
+	typedef TesterBase<Tuple> Base;
+	typedef typename Pire::Impl::MakeIndices<Tuple::Size>::Type Seq;
+public:
+	explicit TupleTester(bool sequential): sequential(sequential) {}
+
+	void Run(const char* begin, const char* end)
+	{
+		if (sequential)
+			RunSequential(begin, end, Seq());
+		else
+			Base::Run(begin, end);
+	}
+
+private:
+	std::tuple<Scanners...> scanners;
+	bool sequential;
+
+	void Compile(const std::vector<Patterns>& patterns, bool surround, size_t distance)
+	{
+		if (patterns.size() != Tuple::Size)
+			throw std::runtime_error("The number of sets of regexps must match the number of scanners");
+		Compile(patterns, surround, distance, Seq());
+	}
+
+	template<size_t... I>
+	void Compile(const std::vector<Patterns>& patterns, bool surround, size_t distance, Pire::Impl::Indices<I...>)
+	{
+		Pire::Impl::Unroll{(std::get<I>(scanners) = ::CompileRe<typename Tuple::template Member<I>>::Do(patterns[I], surround, distance), 0)...};
+		Base::sc = Tuple(std::get<I>(scanners)...);
+	}
+
+	template<size_t... I>
+	void RunSequential(const char* begin, const char* end, Pire::Impl::Indices<I...>)
+	{
+		Pire::Impl::Unroll{(std::cout << "[#" << I << "] ", RunScanner(Base::alg, std::get<I>(scanners), begin, end), 0)...};
+	}
+};
 
 class MemTester: public ITester {
 public:
-	void Prepare(Algorithm, const std::vector<Patterns>&) {}
+	void Prepare(Algorithm, const std::vector<Patterns>&, size_t) {}
 	// Just estimates memory throughput
 	void Run(const char* begin, const char* end)
 	{
@@ -305,16 +385,88 @@ public:
 	}
 };
 
+#ifdef BENCH_EXTRA_ENABLED
+// SlowCapturingScanner looking for a capture anywhere in the text,
+// either alone or behind the DFA prefilter of TwoPhaseCapture
+class SlowCaptureTester: public ITester {
+public:
+	explicit SlowCaptureTester(bool prefilter): prefilter(prefilter) {}
+
+	void Prepare(Algorithm, const std::vector<Patterns>& patterns, size_t)
+	{
+		if (patterns.size() != 1 || patterns[0].size() != 1)
+			throw std::runtime_error("Only one regexp is allowed for this scanner");
+		capture = Pire::TwoPhaseCapture(Pire::Lexer(patterns[0][0]).AddFeature(Pire::Features::Capture(1)).Parse());
+	}
+
+	void Run(const char* begin, const char* end)
+	{
+		Pire::SlowCapturingScanner::SingleState final;
+		bool captured;
+		if (prefilter)
+			captured = capture.Capture(begin, end, final);
+		else {
+			const Pire::SlowCapturingScanner& sc = capture.Capturing();
+			Pire::SlowCapturingScanner::State st;
+			sc.Initialize(st);
+			Pire::Run(sc, st, begin, end);
+			captured = sc.GetCapture(st, final);
+		}
+		if (captured)
+			std::cout << "Match: [" << final.GetBegin() << ", " << final.GetEnd() << "]" << std::endl;
+		else
+			std::cout << "No match" << std::endl;
+	}
+
+private:
+	bool prefilter;
+	Pire::TwoPhaseCapture capture;
+};
+
+// Counts in chunks of the input summarized by separate threads
+template<class Scanner>
+class ChunkedCountTester: public Tester<Scanner> {
+	typedef Tester<Scanner> Base;
+public:
+	ChunkedCountTester(size_t threads): threads(threads) {}
+
+	void Run(const char* begin, const char* end)
+	{
+		if (Base::alg != ITester::DefaultRun) {
+			Base::Run(begin, end);
+			return;
+		}
+		typename Scanner::State st;
+		Base::sc.Initialize(st);
+		Pire::Step(Base::sc, st, Pire::BeginMark);
+		Pire::RunInChunks(Base::sc, st, begin, end, threads, [](size_t n, const std::function<void(size_t)>& task) {
+			std::vector<std::thread> workers;
+			for (size_t i = 0; i != n; ++i)
+				workers.push_back(std::thread(task, i));
+			for (auto&& worker : workers)
+				worker.join();
+		});
+		Pire::Step(Base::sc, st, Pire::EndMark);
+		PrintResult<Scanner>::Do(Base::sc, st);
+	}
+
+private:
+	size_t threads;
+};
+#endif // BENCH_EXTRA_ENABLED
+
 std::runtime_error usage(
 	"Usage: bench -f file [-c repetition_count] "
-	"[-a run|shortestprefix|longestprefix] "
-	"-t {multi|nonreloc|multinomask|nonrelocnomask|simple|slow|null"
+	"[-a run|shortestprefix|longestprefix] [-d edit_distance] [-s] [-j threads] "
+	"-t {multi|nonreloc|multinomask|nonrelocnomask|simple|slow|lazy|approx|null"
 #ifdef BENCH_EXTRA_ENABLED
-	"count|capture"
+	"count|nogluecount|capture|slowcapture|twophasecapture"
 #endif
-	"} regexp [regexp2 [-e regexp3...]] [-t <type> regexp4 [regexp5...]]");
+	"} regexp [regexp2 [-e regexp3...]] [-t <type> regexp4 [regexp5...]] [-t <type> ...]\n"
+	"Three types are run in one pass, or one after another with -s;\n"
+	"count and nogluecount split the input between several threads with -j");
 
-ITester* CreateTester(const std::vector<std::string>& types)
+ITester* CreateTester(const std::vector<std::string>& types, bool sequential, size_t threads)
 {
 	// TODO: is there a way to get out of this copypasting?
 	if (types.size() == 1 && types[0] == "multi")
@@ -329,6 +481,10 @@ ITester* CreateTester(const std::vector<std::string>& types)
 		return new Tester<Pire::SimpleScanner>;
 	else if (types.size() == 1 && types[0] == "slow")
 		return new Tester<Pire::SlowScanner>;
+	else if (types.size() == 1 && types[0] == "lazy")
+		return new Tester<Pire::LazyScanner>;
+	else if (types.size() == 1 && types[0] == "approx")
+		return new Tester<Pire::ApproxLiteralScanner>;
 	else if (types.size() == 1 && types[0] == "null")
 		return new MemTester;
 	else if (types.size() == 2 && types[0] == "multi" && types[1] == "multi")
@@ -353,15 +509,33 @@ ITester* CreateTester(const std::vector<std::string>& types)
 		return new PairTester<Pire::NonrelocScanner, Pire::NonrelocScanner>;
 	else if (types.size() == 2 && types[0] == "nonrelocnomask" && types[1] == "nonrelocnomask")
 		return new PairTester<Pire::NonrelocScannerNoMask, Pire::NonrelocScannerNoMask>;
+	else if (types.size() == 3 && types[0] == "multi" && types[1] == "multi" && types[2] == "multi")
+		return new TupleTester<Pire::Scanner, Pire::Scanner, Pire::Scanner>(sequential);
+	else if (types.size() == 3 && types[0] == "multi" && types[1] == "nonreloc" && types[2] == "simple")
+		return new TupleTester<Pire::Scanner, Pire::NonrelocScanner, Pire::SimpleScanner>(sequential);
 #ifdef BENCH_EXTRA_ENABLED
+	else if (threads > 1 && types.size() == 1 && types[0] == "count")
+		return new ChunkedCountTester<Pire::CountingScanner>(threads);
+	else if (threads > 1 && types.size() == 1 && types[0] == "nogluecount")
+		return new ChunkedCountTester<Pire::NoGlueLimitCountingScanner>(threads);
 	else if (types.size() == 1 && types[0] == "count")
 		return new Tester<Pire::CountingScanner>;
+	else if (types.size() == 1 && types[0] == "nogluecount")
+		return new Tester<Pire::NoGlueLimitCountingScanner>;
 	else if (types.size() == 1 && types[0] == "capture")
 		return new Tester<Pire::CapturingScanner>;
+	else if (types.size() == 1 && types[0] == "slowcapture")
+		return new SlowCaptureTester(false);
+	else if (types.size() == 1 && types[0] == "twophasecapture")
+		return new SlowCaptureTester(true);
 	else if (types.size() == 2 && types[0] == "count" && types[1] == "count")
 		return new PairTester<Pire::CountingScanner, Pire::CountingScanner>;
 	else if (types.size() == 2 && types[0] == "capture" && types[1] == "capture")
 		return new PairTester<Pire::CapturingScanner, Pire::CapturingScanner>;
+	else if (types.size() == 3 && types[0] == "multi" && types[1] == "count" && types[2] == "capture")
+		return new TupleTester<Pire::Scanner, Pire::CountingScanner, Pire::CapturingScanner>(sequential);
+	else if (types.size() == 3 && types[0] == "nogluecount" && types[1] == "count" && types[2] == "capture")
+		return new TupleTester<Pire::NoGlueLimitCountingScanner, Pire::CountingScanner, Pire::CapturingScanner>(sequential);
 #endif
 
 	else
@@ -376,6 +550,9 @@ void Main(int argc, char** argv)
 	std::string file;
 	std::string algName = "run";
 	int repCount = 10;
+	size_t distance = 0;
+	bool sequential = false;
+	size_t threads = 1;
 	ITester::Algorithm alg;
 	for (--argc, ++argv; argc; --argc, ++argv) {
 		if (!strcmp(*argv, "-t") && argc >= 2) {
@@ -391,6 +568,14 @@ void Main(int argc, char** argv)
 		} else if (!strcmp(*argv, "-c") && argc >= 2) {
 			repCount = Pire::FromString<int>(argv[1]);
 			--argc, ++argv;
+		} else if (!strcmp(*argv, "-d") && argc >= 2) {
+			distance = Pire::FromString<size_t>(argv[1]);
+			--argc, ++argv;
+		} else if (!strcmp(*argv, "-j") && argc >= 2) {
+			threads = Pire::FromString<size_t>(argv[1]);
+			--argc, ++argv;
+		} else if (!strcmp(*argv, "-s")) {
+			sequential = true;
 		} else if (!strcmp(*argv, "-e") && argc >= 2) {
 			if (patterns.empty())
 				throw usage;
@@ -414,9 +599,9 @@ void Main(int argc, char** argv)
 	else 
 		throw usage;
 
-	std::unique_ptr<ITester> tester(CreateTester(types));
+	std::unique_ptr<ITester> tester(CreateTester(types, sequential, threads));
 
-	tester->Prepare(alg, patterns);
+	tester->Prepare(alg, patterns, distance);
 	FileMmap fmap(file.c_str());
 
 	// Run the benchmark multiple times